@@ -0,0 +1,633 @@
+#include "Aggregator.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "ThreadPlacement.h"
+
+using std::cout;
+using std::endl;
+
+#define AGGREGATOR_POLL_MS 250 // How often the serve loop checks for stop()
+#define AGGREGATOR_RECV_LEN 65536 // Bytes read from a node at a time
+
+// Returns true if all characters of str are digits
+static bool isDigits(const string& str) {
+    if (str.empty())
+        return false;
+
+    for (uint32_t i = 0; i < str.length(); i++) {
+        if (!isdigit(str[i]))
+            return false;
+    }
+
+    return true;
+}
+
+/* Parses "<path>" (containing a '/') or "[<IPv4 address>:]<port>" (default
+ * address 127.0.0.1), returns false if invalid
+ */
+bool ParseSummaryAddress(const string& str, SummaryAddress& addr) {
+    addr.path.clear();
+    addr.host = "127.0.0.1";
+    addr.port = 0;
+
+    if (str.find('/') != string::npos) {
+        if (str.length() >= sizeof(((struct sockaddr_un*)nullptr)->sun_path))
+            return false;
+
+        addr.path = str;
+        return true;
+    }
+
+    size_t colon = str.rfind(':');
+    string port = str;
+    if (colon != string::npos) {
+        struct in_addr in;
+        addr.host = str.substr(0, colon);
+        port = str.substr(colon + 1);
+        if (inet_pton(AF_INET, addr.host.c_str(), &in) != 1)
+            return false;
+    }
+
+    if (!isDigits(port) || port.length() > 5 || stoul(port) == 0 || stoul(port) > 65535)
+        return false;
+
+    addr.port = (uint16_t)stoul(port);
+    return true;
+}
+
+string SummaryAddressToString(const SummaryAddress& addr) {
+    if (!addr.path.empty())
+        return addr.path;
+
+    return addr.host + ":" + std::to_string(addr.port);
+}
+
+/* Creates a socket for 'addr' and fills in its socket address
+ * Returns -1 if the socket could not be created.
+ */
+static int summarySocket(const SummaryAddress& addr, struct sockaddr_storage& sa, socklen_t& saLen) {
+    memset(&sa, 0, sizeof(sa));
+
+    if (!addr.path.empty()) {
+        struct sockaddr_un* un = (struct sockaddr_un*)&sa;
+        un->sun_family = AF_UNIX;
+        strncpy(un->sun_path, addr.path.c_str(), sizeof(un->sun_path) - 1);
+        saLen = sizeof(struct sockaddr_un);
+        return socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    }
+
+    struct sockaddr_in* in = (struct sockaddr_in*)&sa;
+    in->sin_family = AF_INET;
+    in->sin_port = htons(addr.port);
+    inet_pton(AF_INET, addr.host.c_str(), &in->sin_addr);
+    saLen = sizeof(struct sockaddr_in);
+    return socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+}
+
+// Sends all of 'len' Bytes, retrying short sends
+static bool sendAll(const int fd, const void* data, size_t len) {
+    const uint8_t* pos = (const uint8_t*)data;
+    while (len) {
+        ssize_t n = send(fd, pos, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        pos += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+/* ========== SummarySender ========== */
+SummarySender::SummarySender() : _sent(0), _failed(0), _lastBytes(0), _connected(false) {};
+
+SummarySender::~SummarySender() {
+    stop();
+}
+
+// Starts the sender thread, summaries go to 'addr'
+bool SummarySender::start(const SummaryAddress& addr) {
+    if (_running)
+        return false;
+
+    _addr = addr;
+    _stopping = false;
+    _running = true;
+    _sender = std::thread(&SummarySender::senderLoop, this);
+    return true;
+}
+
+/* Sends any pending summary, then stops the sender thread
+ * Function is idempotent
+ */
+void SummarySender::stop() {
+    if (!_running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _cond.notify_one();
+
+    if (_sender.joinable())
+        _sender.join();
+    _running = false;
+
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    _connected = false;
+}
+
+/* Hands a payload to the sender thread, taken at packet time createdUs
+ * 'payload' is swapped with the sender's previous buffer.
+ */
+void SummarySender::submit(vector<uint8_t>& payload, const uint64_t createdUs) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _payload.swap(payload);
+        _createdUs = createdUs;
+        _pending = true;
+    }
+    _cond.notify_one();
+}
+
+void SummarySender::senderLoop() {
+    ThreadPlacements::place(THREAD_WORKER, "summary-sender");
+
+    vector<uint8_t> payload;
+    uint64_t createdUs;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _cond.wait(lock, [this] { return _pending || _stopping; });
+        if (!_pending)
+            return; // Stopping, nothing left to send
+
+        payload.swap(_payload);
+        createdUs = _createdUs;
+        _pending = false;
+
+        // The sniff loop may submit the next one while this one is sent
+        lock.unlock();
+        if (sendSummary(payload, createdUs)) {
+            _sent.fetch_add(1, std::memory_order_relaxed);
+            _lastBytes.store(sizeof(SummaryHeader) + payload.size(), std::memory_order_relaxed);
+        } else {
+            _failed.fetch_add(1, std::memory_order_relaxed);
+        }
+        lock.lock();
+    }
+}
+
+// Connects if not connected yet, returns false if that failed
+bool SummarySender::connectAggregator() {
+    if (_fd >= 0)
+        return true;
+
+    struct sockaddr_storage sa;
+    socklen_t saLen;
+    _fd = summarySocket(_addr, sa, saLen);
+    if (_fd < 0)
+        return false;
+
+    if (connect(_fd, (struct sockaddr*)&sa, saLen) != 0) {
+        // Only reported once per outage, summaries are retried on every interval
+        if (!_warned)
+            cout << "ERROR: Could not connect to aggregator " << SummaryAddressToString(_addr) <<
+                " (" << strerror(errno) << "), retrying" << endl;
+        _warned = true;
+        close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    // Summaries are sent whole, don't let a stalled aggregator hold up the next one for long
+    struct timeval timeout = {1, 0};
+    setsockopt(_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    cout << "Sending summaries to aggregator " << SummaryAddressToString(_addr) << endl;
+    _warned = false;
+    _connected = true;
+    return true;
+}
+
+// Sends a header and payload, returns false (and disconnects) on errors
+bool SummarySender::sendSummary(const vector<uint8_t>& payload, const uint64_t createdUs) {
+    if (!connectAggregator())
+        return false;
+
+    SummaryHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SUMMARY_MAGIC;
+    header.version = SUMMARY_VERSION;
+    header.payloadLen = payload.size();
+    header.checksum = CheckpointWriter::checksum(payload.data(), payload.size());
+    header.createdUs = createdUs;
+
+    if (sendAll(_fd, &header, sizeof(header)) && sendAll(_fd, payload.data(), payload.size()))
+        return true;
+
+    // A partly sent summary can't be continued, the aggregator drops it with the connection
+    cout << "ERROR: Lost connection to aggregator " << SummaryAddressToString(_addr) <<
+        " (" << strerror(errno) << "), reconnecting" << endl;
+    close(_fd);
+    _fd = -1;
+    _connected = false;
+    return false;
+}
+
+// Human-readable address and counters
+void SummarySender::dump(std::ostream& os) const {
+    os << "Summaries: " << _sent.load(std::memory_order_relaxed) << " sent to " <<
+        SummaryAddressToString(_addr) << (_connected ? "" : " (not connected)") << " (last " <<
+        _lastBytes.load(std::memory_order_relaxed) << " Bytes), " <<
+        _failed.load(std::memory_order_relaxed) << " failed" << endl;
+}
+
+/* ========== SummaryAggregator ========== */
+SummaryAggregator::SummaryAggregator() : _running(false), _rejected(0) {};
+
+SummaryAggregator::~SummaryAggregator() {
+    stop();
+}
+
+/* Listens on 'addr' and starts aggregating in a new thread
+ * Returns false if the socket could not be set up
+ */
+bool SummaryAggregator::start(const SummaryAddress& addr) {
+    if (_running)
+        return true;
+
+    _addr = addr;
+    struct sockaddr_storage sa;
+    socklen_t saLen;
+    _listenFd = summarySocket(addr, sa, saLen);
+    if (_listenFd < 0) {
+        cout << "ERROR: Unable to create aggregator socket: " << strerror(errno) << endl;
+        return false;
+    }
+
+    if (!addr.path.empty()) {
+        // A socket left behind by an earlier run is replaced, anything else is kept
+        struct stat st;
+        if (lstat(addr.path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            unlink(addr.path.c_str());
+    } else {
+        int enable = 1;
+        setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    }
+
+    if (bind(_listenFd, (struct sockaddr*)&sa, saLen) != 0 ||
+            listen(_listenFd, SUMMARY_MAX_NODES) != 0) {
+        cout << "ERROR: Unable to listen on " << SummaryAddressToString(addr) <<
+            " for summaries: " << strerror(errno) << endl;
+        close(_listenFd);
+        _listenFd = -1;
+        return false;
+    }
+
+    _running = true;
+    _thread = std::thread(&SummaryAggregator::serveLoop, this);
+
+    return true;
+}
+
+void SummaryAggregator::stop() {
+    if (!_running)
+        return;
+
+    _running = false;
+    _thread.join();
+
+    close(_listenFd);
+    _listenFd = -1;
+    if (!_addr.path.empty())
+        unlink(_addr.path.c_str());
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (NodeState& node : _nodes)
+        close(node.fd);
+    _nodes.clear();
+}
+
+/* The global view, for a single reader (e.g. a MetricsExporter)
+ * See SnapshotExchange for the reader-side interface.
+ */
+SnapshotExchange<StatsSnapshot>& SummaryAggregator::snapshots() {
+    return _snapshots;
+}
+
+void SummaryAggregator::serveLoop() {
+    ThreadPlacements::place(THREAD_WORKER, "aggregator");
+
+    vector<struct pollfd> pfds;
+
+    while (_running) {
+        pfds.resize(1 + _nodes.size());
+        pfds[0].fd = _listenFd;
+        pfds[0].events = POLLIN;
+        for (uint32_t i = 0; i < _nodes.size(); i++) {
+            pfds[1 + i].fd = _nodes[i].fd;
+            pfds[1 + i].events = POLLIN;
+        }
+
+        if (poll(pfds.data(), pfds.size(), AGGREGATOR_POLL_MS) <= 0)
+            continue;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        bool changed = false;
+
+        // Nodes are only added after the poll results of the others were handled
+        for (uint32_t i = _nodes.size(); i-- > 0; ) {
+            if (!pfds[1 + i].revents)
+                continue;
+
+            NodeState& node = _nodes[i];
+            bool updated = false;
+            if (readNode(node, updated)) {
+                changed |= updated;
+                continue;
+            }
+
+            if (node.hasSummary)
+                cout << "Node " << node.name << " left the aggregation" << endl;
+            close(node.fd);
+            _nodes.erase(_nodes.begin() + i);
+            changed = true;
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            int connFd = accept4(_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (connFd >= 0 && _nodes.size() >= SUMMARY_MAX_NODES) {
+                cout << "ERROR: Aggregator is full (" << SUMMARY_MAX_NODES << " nodes), refusing a node" << endl;
+                close(connFd);
+            } else if (connFd >= 0) {
+                _nodes.emplace_back();
+                NodeState& node = _nodes.back();
+                node.fd = connFd;
+                node.id = _nextNodeId++;
+                node.hasSummary = false;
+                node.createdUs = 0;
+                node.summaries = 0;
+                memset(&node.counters, 0, sizeof(node.counters));
+            }
+        }
+
+        if (changed)
+            rebuildView();
+    }
+}
+
+// Reads what is available from a node, returns false if it must be dropped
+bool SummaryAggregator::readNode(NodeState& node, bool& updated) {
+    uint8_t buf[AGGREGATOR_RECV_LEN];
+    ssize_t n = recv(node.fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n == 0)
+        return false;
+    if (n < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    node.inBuf.insert(node.inBuf.end(), buf, buf + n);
+
+    // Decodes all complete summaries; only the last one matters, but each is checked
+    size_t off = 0;
+    vector<uint8_t> payload;
+    while (node.inBuf.size() - off >= sizeof(SummaryHeader)) {
+        SummaryHeader header;
+        memcpy(&header, &node.inBuf[off], sizeof(header));
+        if (header.magic != SUMMARY_MAGIC || header.version != SUMMARY_VERSION ||
+                header.payloadLen > SUMMARY_MAX_PAYLOAD) {
+            cout << "ERROR: Summary of another version or size from a node, dropping it" << endl;
+            bump(_rejected);
+            return false;
+        }
+        if (node.inBuf.size() - off - sizeof(header) < header.payloadLen)
+            break;
+
+        const uint8_t* data = &node.inBuf[off + sizeof(header)];
+        payload.assign(data, data + header.payloadLen);
+        if (CheckpointWriter::checksum(payload.data(), payload.size()) != header.checksum ||
+                !decodeSummary(node, payload)) {
+            cout << "ERROR: Malformed summary from a node, dropping it" << endl;
+            bump(_rejected);
+            return false;
+        }
+
+        if (!node.hasSummary)
+            cout << "Node " << node.name << " joined the aggregation" << endl;
+        node.hasSummary = true;
+        node.createdUs = header.createdUs;
+        node.summaries++;
+        updated = true;
+        off += sizeof(header) + header.payloadLen;
+    }
+    node.inBuf.erase(node.inBuf.begin(), node.inBuf.begin() + off);
+
+    return true;
+}
+
+// Decodes a complete payload into the node's state, false if malformed
+bool SummaryAggregator::decodeSummary(NodeState& node, const vector<uint8_t>& payload) {
+    CheckpointReader in(payload);
+
+    uint8_t nameLen;
+    char name[SUMMARY_MAX_NAME_LEN];
+    uint32_t numEndpoints;
+    if (!in.get(nameLen) || !in.getBytes(name, nameLen) || !in.get(node.counters) ||
+            !in.get(numEndpoints) || numEndpoints > in.remaining() / sizeof(EndpointSnapshot))
+        return false;
+    node.name.assign(name, nameLen);
+
+    node.endpoints.resize(numEndpoints);
+    node.links.clear();
+    for (EndpointSnapshot& epSnap : node.endpoints) {
+        if (!in.get(epSnap))
+            return false;
+
+        // IPv6 endpoints refer to their address by an ID of the node's, replaced with one of ours
+        if (IsIPv6Endpoint(epSnap.endpoint)) {
+            uint8_t addr[IPV6_ADDR_LEN];
+            if (!in.getBytes(addr, IPV6_ADDR_LEN))
+                return false;
+
+            uint32_t id = IPv6AddressTable::global().intern(addr);
+            if (id == IPV6_NO_ID)
+                return false;
+            epSnap.endpoint = ENDPOINT_IPV6_FLAG | ((uint64_t)id << 16) | (epSnap.endpoint & 0xFFFF);
+        }
+
+        if (epSnap.numLinks > in.remaining() / sizeof(LinkSnapshot))
+            return false;
+        epSnap.firstLink = node.links.size();
+        node.links.resize(node.links.size() + epSnap.numLinks);
+        if (!in.getBytes(&node.links[epSnap.firstLink], epSnap.numLinks * sizeof(LinkSnapshot)))
+            return false;
+    }
+
+    return in.remaining() == 0;
+}
+
+// Samples behind a switch's report, the report with the most of them stands for the switch
+static uint64_t reportSamples(const EndpointSnapshot& epSnap) {
+    return epSnap.echoRTT.hist.count + epSnap.pktInRTT.hist.count;
+}
+
+// Folds a report's node and version into a version of the view (only compared for equality)
+static uint64_t mixVersion(const uint64_t version, const uint32_t nodeId, const uint64_t epVersion) {
+    return (version ^ (((uint64_t)nodeId << 40) + epVersion)) * 1099511628211ULL;
+}
+
+/* Merges the latest summaries of all nodes into _view and publishes it
+ * Called with _mutex held. Reports of the same datapath ID are merged in
+ * node order; reports without one are all kept.
+ */
+void SummaryAggregator::rebuildView() {
+    StatsSnapshot& view = _view;
+    view.ts = Timestamp::current_time();
+    view.seqNum = ++_viewSeqNum;
+    view.packets = view.ofMessages = view.parseErrors = 0;
+    view.captureRecv = view.captureDrops = view.captureIfDrops = 0;
+    memset(view.diagCounts, 0, sizeof(view.diagCounts)); // Nodes keep their own diagnostics
+    memset(&view.overload, 0, sizeof(view.overload));
+    memset(&view.memory, 0, sizeof(view.memory));
+    view.endpoints.clear();
+    view.links.clear();
+    _viewSources.clear();
+
+    // Switch (view endpoint) of each datapath ID, and all reports of it
+    std::unordered_map<uint64_t, uint32_t> byDatapathID;
+    vector<vector<std::pair<uint32_t, uint32_t>>> reports;
+
+    for (uint32_t n = 0; n < _nodes.size(); n++) {
+        const NodeState& node = _nodes[n];
+        if (!node.hasSummary)
+            continue;
+
+        view.packets += node.counters.packets;
+        view.ofMessages += node.counters.ofMessages;
+        view.parseErrors += node.counters.parseErrors;
+        view.captureRecv += node.counters.captureRecv;
+        view.captureDrops += node.counters.captureDrops;
+        view.captureIfDrops += node.counters.captureIfDrops;
+
+        for (uint32_t i = 0; i < node.endpoints.size(); i++) {
+            const EndpointSnapshot& epSnap = node.endpoints[i];
+            auto it = byDatapathID.end();
+            if (epSnap.datapathID)
+                it = byDatapathID.find(epSnap.datapathID);
+
+            if (it == byDatapathID.end()) {
+                if (epSnap.datapathID)
+                    byDatapathID.emplace(epSnap.datapathID, view.endpoints.size());
+                view.endpoints.push_back(epSnap);
+                view.endpoints.back().version = mixVersion(0, node.id, epSnap.version);
+                _viewSources.push_back({n, i, 1});
+                reports.push_back({{n, i}});
+                continue;
+            }
+
+            // Another report of a known switch: the one with more samples stands for it
+            uint32_t idx = it->second;
+            ViewSource& source = _viewSources[idx];
+            const NodeState& current = _nodes[source.node];
+            const EndpointSnapshot& best = current.endpoints[source.index];
+            uint64_t version = mixVersion(view.endpoints[idx].version, node.id, epSnap.version);
+            if (reportSamples(epSnap) > reportSamples(best) ||
+                    (reportSamples(epSnap) == reportSamples(best) && node.createdUs > current.createdUs)) {
+                view.endpoints[idx] = epSnap;
+                source.node = n;
+                source.index = i;
+            }
+            view.endpoints[idx].version = version;
+            source.reports++;
+            reports[idx].push_back({n, i});
+        }
+    }
+
+    // Links of each switch from all of its reports, by port
+    for (uint32_t idx = 0; idx < view.endpoints.size(); idx++) {
+        EndpointSnapshot& epSnap = view.endpoints[idx];
+        epSnap.firstLink = view.links.size();
+
+        for (const auto& report : reports[idx]) {
+            const NodeState& node = _nodes[report.first];
+            const EndpointSnapshot& reported = node.endpoints[report.second];
+
+            for (uint32_t l = reported.firstLink; l < reported.firstLink + reported.numLinks; l++) {
+                const LinkSnapshot& link = node.links[l];
+                uint32_t j = epSnap.firstLink;
+                while (j < view.links.size() && view.links[j].port_no != link.port_no)
+                    j++;
+
+                if (j == view.links.size())
+                    view.links.push_back(link);
+                else if (link.lat.hist.count > view.links[j].lat.hist.count)
+                    view.links[j] = link;
+            }
+        }
+        epSnap.numLinks = view.links.size() - epSnap.firstLink;
+    }
+
+    // Copied rather than swapped, _view stays whole for dump()
+    StatsSnapshot& snap = _snapshots.back();
+    snap = view;
+    _snapshots.publish();
+}
+
+// Human-readable nodes and global view, with the node of each switch
+void SummaryAggregator::dump(std::ostream& os) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    uint32_t merged = 0;
+    for (const ViewSource& source : _viewSources)
+        merged += source.reports - 1;
+
+    os << "Aggregator on " << SummaryAddressToString(_addr) << ": " << _nodes.size() << " nodes, " <<
+        _view.endpoints.size() << " switches (" << merged << " duplicate reports merged by datapath ID), " <<
+        _rejected.load(std::memory_order_relaxed) << " malformed summaries" << endl;
+
+    for (const NodeState& node : _nodes) {
+        if (!node.hasSummary) {
+            os << "  Node (no summary yet)" << endl;
+            continue;
+        }
+
+        os << "  Node " << node.name << ": " << node.endpoints.size() << " switches, " <<
+            node.links.size() << " links, " << node.summaries << " summaries, " <<
+            node.counters.packets << " packets" << endl;
+    }
+
+    for (uint32_t idx = 0; idx < _view.endpoints.size(); idx++) {
+        const EndpointSnapshot& epSnap = _view.endpoints[idx];
+        const ViewSource& source = _viewSources[idx];
+
+        os << "  Switch " << (epSnap.datapathID ? DatapathIDToString(epSnap.datapathID) : "(unknown dpid)") <<
+            " at " << EndpointToString(epSnap.endpoint) << " via " << _nodes[source.node].name;
+        if (source.reports > 1)
+            os << " (" << source.reports << " reports)";
+        os << ": echo RTT " << epSnap.echoRTT.med << " ms (median), PacketIn RTT " <<
+            epSnap.pktInRTT.med << " ms (median)" << endl;
+
+        for (uint32_t l = epSnap.firstLink; l < epSnap.firstLink + epSnap.numLinks; l++) {
+            const LinkSnapshot& link = _view.links[l];
+            os << "    Port " << link.port_no << ": link latency " << link.srtt <<
+                " ms (smoothed), " << link.lat.med << " ms (median)" << endl;
+        }
+    }
+}
@@ -0,0 +1,543 @@
+#include "CaptureSources.h"
+#include "OFTypeFilter.h"
+
+#include <algorithm>
+#include <iterator>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+using std::cout;
+using std::endl;
+
+using Tins::EthernetII;
+using Tins::SLL;
+using Tins::IP;
+using Tins::IPv6;
+using Tins::SnifferConfiguration;
+
+/* Takes ownership of the sniffer
+ * bufferSize, ofTypeFilter and passPureAcks are what it was opened
+ * with (see CaptureSources::add()), to reopen it with; filter is the
+ * BPF program it was left with (see CaptureSources::open()).
+ */
+CaptureSource::CaptureSource(const string& iface, const vector<uint16_t>& ports, Sniffer* sniffer,
+                                const uint32_t bufferSize, const bool ofTypeFilter,
+                                const bool passPureAcks, const vector<struct bpf_insn>& filter) :
+        _iface(iface), _ports(ports), _sniffer(sniffer), _bufferSize(bufferSize),
+        _ofTypeFilter(ofTypeFilter), _passPureAcks(passPureAcks), _filter(filter),
+        packets(0), ofMessages(0), fallbacks(0), malformed(0), recv(0), drop(0), ifDrop(0),
+        duplicates(0) {
+    _linkType = pcap_datalink(_sniffer->get_pcap_handle());
+};
+
+CaptureSource::~CaptureSource() {
+    delete _sniffer;
+};
+
+/* Decodes a captured frame according to the link type
+ * Returns nullptr if it is malformed or the link type isn't supported.
+ */
+PDU* CaptureSource::decode(const uint8_t* data, const uint32_t len) const {
+    try {
+        switch (_linkType) {
+            case DLT_EN10MB:
+                return new EthernetII(data, len);
+            case DLT_LINUX_SLL: // e.g. capturing on "any"
+                return new SLL(data, len);
+            case DLT_RAW:
+                if (len && (data[0] >> 4) == 6)
+                    return new IPv6(data, len);
+                return new IP(data, len);
+            default:
+                return nullptr;
+        }
+    } catch (const Tins::malformed_packet&) {
+        return nullptr;
+    }
+}
+
+/* Reads pcap_stats and updates the capture counters
+ * Returns the cumulative counters (sniff loop only).
+ */
+const PcapTotals& CaptureSource::collect() {
+    if (_pcap.read(handle())) {
+        recv.store(_pcap.totals.recv, std::memory_order_relaxed);
+        drop.store(_pcap.totals.drop, std::memory_order_relaxed);
+        ifDrop.store(_pcap.totals.ifDrop, std::memory_order_relaxed);
+    }
+
+    return _pcap.totals;
+}
+
+/* Continues the counters of the source this one replaces, and skips
+ * the frames it already took (sniff loop only)
+ */
+void CaptureSource::takeOver(CaptureSource& old) {
+    /* Continue from the old totals; what the new handle counted while both
+     * captured (read here, so only later increments are added) was counted
+     * by the old one
+     */
+    PcapTotals oldTotals = old.collect();
+    _pcap.read(handle());
+    _pcap.totals = oldTotals;
+    recv.store(_pcap.totals.recv, std::memory_order_relaxed);
+    drop.store(_pcap.totals.drop, std::memory_order_relaxed);
+    ifDrop.store(_pcap.totals.ifDrop, std::memory_order_relaxed);
+
+    packets.store(old.packets.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    ofMessages.store(old.ofMessages.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    fallbacks.store(old.fallbacks.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    malformed.store(old.malformed.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    duplicates.store(old.duplicates.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    _skipUntilUs = old._lastUs;
+    _skipFilter = old._filter;
+}
+
+CaptureSources::CaptureSources() : _stopped(false), _delivery(CAPTURE_DELIVERY_IMMEDIATE),
+                                    _changesPending(false), _nextDelivery(CAPTURE_DELIVERY_IMMEDIATE),
+                                    _removedTotals() {
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFd < 0)
+        cout << "ERROR: Unable to create capture epoll instance (errno " << errno << ")" << endl;
+
+    _stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_stopFd < 0) {
+        cout << "ERROR: Unable to create capture stop eventfd (errno " << errno << ")" << endl;
+    } else if (_epollFd >= 0) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = UINT32_MAX;
+        epoll_ctl(_epollFd, EPOLL_CTL_ADD, _stopFd, &ev);
+    }
+};
+
+CaptureSources::~CaptureSources() {
+    _sources.clear();
+
+    if (_stopFd >= 0)
+        close(_stopFd);
+    if (_epollFd >= 0)
+        close(_epollFd);
+};
+
+/* Sets how packets of sources added afterwards are delivered
+ * Returns false if sources were already added or it is invalid.
+ */
+bool CaptureSources::setDelivery(const CaptureDelivery& delivery) {
+    if (!_sources.empty()) {
+        cout << "ERROR: Capture delivery must be set before adding sources" << endl;
+        return false;
+    }
+
+    if (delivery.batchSize == 0 || delivery.batchSize > CAPTURE_MAX_BATCH ||
+            (!delivery.immediate && delivery.timeoutMs == 0)) {
+        cout << "ERROR: Invalid capture delivery (timeout " << delivery.timeoutMs <<
+                " ms, batch size " << delivery.batchSize << ")" << endl;
+        return false;
+    }
+
+    _delivery = delivery;
+    _nextDelivery = delivery;
+    return true;
+}
+
+// "tcp port A or tcp port B ..."
+string CaptureSources::portFilter(const vector<uint16_t>& ports) {
+    string filter;
+    for (uint16_t port : ports) {
+        if (!filter.empty())
+            filter += " or ";
+        filter += "tcp port " + std::to_string(port);
+    }
+
+    return filter;
+}
+
+/* Opens a live capture of 'iface' filtered to the given OpenFlow ports,
+ * ready to be polled; returns nullptr on errors
+ * The BPF program it is left with is returned through 'program'
+ * (empty if it could not be reproduced).
+ */
+Sniffer* CaptureSources::open(const string& iface, const vector<uint16_t>& ports,
+                                const uint32_t bufferSize, const bool ofTypeFilter,
+                                const bool passPureAcks, const CaptureDelivery& delivery,
+                                vector<struct bpf_insn>& program) {
+    if (ports.empty() || ports.size() > CAPTURE_MAX_PORTS) {
+        cout << "ERROR: Between 1 and " << CAPTURE_MAX_PORTS << " OpenFlow ports per interface" << endl;
+        return nullptr;
+    }
+
+    string filter = portFilter(ports);
+
+    SnifferConfiguration config;
+    config.set_filter(filter);
+    config.set_promisc_mode(false);
+    config.set_snap_len(CAPTURE_MAX_LEN);
+    if (delivery.immediate) {
+        config.set_immediate_mode(true);
+    } else {
+        config.set_immediate_mode(false);
+        config.set_timeout(delivery.timeoutMs);
+    }
+    if (bufferSize)
+        config.set_buffer_size(bufferSize);
+
+    Sniffer* sniffer;
+    try {
+        sniffer = new Sniffer(iface, config);
+    } catch (const std::exception &ex) {
+        cout << "ERROR: Unable to create new Sniffer object for " << iface << endl;
+        cout << ex.what() << endl;
+        return nullptr;
+    }
+
+    // The loop reads whatever is there whenever epoll says so
+    char errBuf[PCAP_ERRBUF_SIZE];
+    pcap_t* handle = sniffer->get_pcap_handle();
+    int fd = pcap_get_selectable_fd(handle);
+    if (fd < 0 || pcap_setnonblock(handle, 1, errBuf) != 0) {
+        cout << "ERROR: Capture on " << iface << " can't be polled" << endl;
+        delete sniffer;
+        return nullptr;
+    }
+
+    // Falls back to the plain port filter set above if not supported
+    program.clear();
+    if (ofTypeFilter) {
+        if (InstallOFTypeFilter(handle, ports, OF_TYPES_LATENCY, passPureAcks)) {
+            cout << "Filtering OpenFlow messages by type in the kernel on " << iface << endl;
+            BuildOFTypeFilter(ports, OF_TYPES_LATENCY, passPureAcks, program);
+        } else {
+            cout << "WARNING: Falling back to filter \"" << filter << "\" on " << iface << endl;
+        }
+    }
+
+    // Kept to tell which packets this capture takes, see CaptureSource::isDuplicate()
+    struct bpf_program portProg;
+    if (program.empty() && pcap_compile(handle, &portProg, filter.c_str(), 1, PCAP_NETMASK_UNKNOWN) == 0) {
+        program.assign(portProg.bf_insns, portProg.bf_insns + portProg.bf_len);
+        pcap_freecode(&portProg);
+    }
+
+    return sniffer;
+}
+
+// Index of the source capturing 'iface', -1 if none
+int CaptureSources::find(const string& iface) const {
+    for (uint32_t i = 0; i < _sources.size(); i++) {
+        if (_sources[i]->iface() == iface)
+            return i;
+    }
+
+    return -1;
+}
+
+// Adds (op EPOLL_CTL_ADD), re-indexes (EPOLL_CTL_MOD) or removes (EPOLL_CTL_DEL) the source at 'index' in the epoll set
+bool CaptureSources::poll(const int op, const uint32_t index) {
+    CaptureSource& source = *_sources[index];
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = index;
+    if (epoll_ctl(_epollFd, op, pcap_get_selectable_fd(source.handle()), &ev) != 0) {
+        cout << "ERROR: Unable to poll capture on " << source.iface() << " (errno " << errno << ")" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+/* Opens a live capture of 'iface' filtered to the given OpenFlow ports,
+ * optionally with the in-kernel OpenFlow type filter (see OFTypeFilter.h)
+ * bufferSize 0 keeps libpcap's default. Returns false on errors.
+ */
+bool CaptureSources::add(const string& iface, const vector<uint16_t>& ports, const uint32_t bufferSize,
+                            const bool ofTypeFilter, const bool passPureAcks) {
+    if (_epollFd < 0)
+        return false;
+
+    if (_sources.size() >= CAPTURE_MAX_SOURCES) {
+        cout << "ERROR: At most " << CAPTURE_MAX_SOURCES << " capture sources" << endl;
+        return false;
+    }
+
+    vector<struct bpf_insn> program;
+    Sniffer* sniffer = open(iface, ports, bufferSize, ofTypeFilter, passPureAcks, _delivery, program);
+    if (!sniffer)
+        return false;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _sources.emplace_back(new CaptureSource(iface, ports, sniffer, bufferSize, ofTypeFilter,
+                                            passPureAcks, program));
+    if (!poll(EPOLL_CTL_ADD, _sources.size() - 1)) {
+        _sources.pop_back();
+        return false;
+    }
+
+    return true;
+}
+
+// Queues a change, applied once the current capture had time to deliver
+void CaptureSources::queueChange(CaptureChange& change) {
+    // Packets wait in the kernel for up to the delivery timeout before they can be read
+    uint32_t timeoutMs = _delivery.immediate ? 0 : _delivery.timeoutMs;
+    change.readyUs = TimestampToUs(Timestamp::current_time()) +
+                        (uint64_t)(timeoutMs + CAPTURE_HANDOVER_MS) * 1000;
+
+    _changes.push_back(std::move(change));
+    _changesPending.store(true);
+}
+
+/* Adds a source, or replaces the one capturing 'iface' (e.g. to change
+ * its ports or filter), while the sniff loop runs; see above
+ * Returns false if the capture could not be opened, leaving the
+ * sources as they are.
+ */
+bool CaptureSources::update(const string& iface, const vector<uint16_t>& ports, const uint32_t bufferSize,
+                            const bool ofTypeFilter, const bool passPureAcks) {
+    if (_epollFd < 0)
+        return false;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (find(iface) < 0 && _sources.size() + _changes.size() >= CAPTURE_MAX_SOURCES) {
+        cout << "ERROR: At most " << CAPTURE_MAX_SOURCES << " capture sources" << endl;
+        return false;
+    }
+
+    // Opened right away, so it captures alongside the source it replaces
+    vector<struct bpf_insn> program;
+    Sniffer* sniffer = open(iface, ports, bufferSize, ofTypeFilter, passPureAcks, _nextDelivery,
+                            program);
+    if (!sniffer)
+        return false;
+
+    CaptureChange change;
+    change.iface = iface;
+    change.source.reset(new CaptureSource(iface, ports, sniffer, bufferSize, ofTypeFilter,
+                                            passPureAcks, program));
+    change.setsDelivery = false;
+    queueChange(change);
+    return true;
+}
+
+/* Stops capturing 'iface' while the sniff loop runs, once it has
+ * delivered everything captured until now
+ * Returns false if 'iface' isn't captured.
+ */
+bool CaptureSources::remove(const string& iface) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (find(iface) < 0) {
+        cout << "ERROR: Not capturing on " << iface << endl;
+        return false;
+    }
+
+    CaptureChange change;
+    change.iface = iface;
+    change.setsDelivery = false;
+    queueChange(change);
+    return true;
+}
+
+/* Changes how packets are delivered while the sniff loop runs, by
+ * replacing every source with one of the new delivery mode
+ * Returns false if it is invalid or a capture could not be opened.
+ */
+bool CaptureSources::updateDelivery(const CaptureDelivery& delivery) {
+    if (delivery.batchSize == 0 || delivery.batchSize > CAPTURE_MAX_BATCH ||
+            (!delivery.immediate && delivery.timeoutMs == 0)) {
+        cout << "ERROR: Invalid capture delivery (timeout " << delivery.timeoutMs <<
+                " ms, batch size " << delivery.batchSize << ")" << endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // All or nothing: the replacements are only queued once all of them are open
+    vector<CaptureChange> changes(_sources.size());
+    for (uint32_t i = 0; i < _sources.size(); i++) {
+        const CaptureSource& source = *_sources[i];
+        vector<struct bpf_insn> program;
+        Sniffer* sniffer = open(source.iface(), source.ports(), source.bufferSize(),
+                                source.ofTypeFilter(), source.passPureAcks(), delivery, program);
+        if (!sniffer)
+            return false;
+
+        changes[i].iface = source.iface();
+        changes[i].source.reset(new CaptureSource(source.iface(), source.ports(), sniffer,
+                                                    source.bufferSize(), source.ofTypeFilter(),
+                                                    source.passPureAcks(), program));
+        changes[i].setsDelivery = false;
+    }
+
+    // The batch size changes as the last source is replaced (or right away without sources)
+    changes.emplace_back();
+    changes.back().setsDelivery = true;
+    changes.back().delivery = delivery;
+
+    for (CaptureChange& change : changes)
+        queueChange(change);
+    _nextDelivery = delivery;
+    return true;
+}
+
+/* Applies the changes whose captures had time to deliver (sniff loop
+ * only): drain(source) is called for every source about to be
+ * replaced or removed, and must process all frames it still holds
+ */
+void CaptureSources::applyChanges(const std::function<void(CaptureSource&)>& drain) {
+    uint64_t nowUs = TimestampToUs(Timestamp::current_time());
+
+    vector<CaptureChange> changes;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        uint32_t numReady = 0;
+        while (numReady < _changes.size() && _changes[numReady].readyUs <= nowUs)
+            numReady++;
+
+        std::move(_changes.begin(), _changes.begin() + numReady, std::back_inserter(changes));
+        _changes.erase(_changes.begin(), _changes.begin() + numReady);
+        _changesPending.store(!_changes.empty());
+    }
+
+    for (CaptureChange& change : changes) {
+        if (change.setsDelivery) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _delivery = change.delivery;
+            continue;
+        }
+
+        // Everything the old capture holds is processed before it is closed
+        int index = find(change.iface);
+        if (index >= 0) {
+            CaptureSource& old = *_sources[index];
+            drain(old);
+            if (change.source) {
+                change.source->takeOver(old);
+            } else {
+                const PcapTotals& totals = old.collect();
+                _removedTotals.recv += totals.recv;
+                _removedTotals.drop += totals.drop;
+                _removedTotals.ifDrop += totals.ifDrop;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (index >= 0)
+            poll(EPOLL_CTL_DEL, index);
+
+        if (!change.source) {
+            if (index < 0)
+                continue;
+
+            // Later sources move up, and are polled under their new index
+            _sources.erase(_sources.begin() + index);
+            for (uint32_t i = index; i < _sources.size(); i++)
+                poll(EPOLL_CTL_MOD, i);
+            cout << "Stopped capturing on " << change.iface << endl;
+        } else if (index >= 0) {
+            _sources[index] = std::move(change.source);
+            poll(EPOLL_CTL_ADD, index);
+            cout << "Capturing on " << change.iface << ": " << portFilter(_sources[index]->ports()) << endl;
+        } else if (_sources.size() < CAPTURE_MAX_SOURCES) {
+            _sources.push_back(std::move(change.source));
+            poll(EPOLL_CTL_ADD, _sources.size() - 1);
+            cout << "Capturing on " << change.iface << ": " << portFilter(_sources.back()->ports()) << endl;
+        }
+    }
+}
+
+// Interfaces and ports of all sources
+vector<std::pair<string, vector<uint16_t>>> CaptureSources::list() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    vector<std::pair<string, vector<uint16_t>>> sources;
+    for (auto& source : _sources)
+        sources.emplace_back(source->iface(), source->ports());
+
+    return sources;
+}
+
+/* Waits up to timeoutMs for sources with packets to read, and writes
+ * their indices into 'ready'
+ * Returns the number of ready sources, or -1 once stopped.
+ */
+int CaptureSources::wait(uint32_t* ready, const uint32_t maxReady, const int timeoutMs) {
+    struct epoll_event events[CAPTURE_MAX_SOURCES + 1]; // Sources and the stop eventfd
+    uint32_t maxEvents = std::min<uint32_t>(maxReady, CAPTURE_MAX_SOURCES) + 1;
+
+    int numEvents = epoll_wait(_epollFd, events, maxEvents, timeoutMs);
+    if (stopped())
+        return -1;
+
+    if (numEvents < 0) {
+        if (errno != EINTR)
+            cout << "ERROR: Waiting for captured packets failed (errno " << errno << ")" << endl;
+        return 0;
+    }
+
+    int numReady = 0;
+    for (int i = 0; i < numEvents; i++) {
+        if (events[i].data.u32 < _sources.size())
+            ready[numReady++] = events[i].data.u32;
+    }
+
+    return numReady;
+}
+
+// Makes the sniff loop return; async-signal-safe
+void CaptureSources::stop() {
+    _stopped.store(true);
+
+    // If this fails, the loop still notices within CAPTURE_WAIT_MS
+    uint64_t one = 1;
+    if (_stopFd >= 0 && write(_stopFd, &one, sizeof(one)) < 0)
+        return;
+}
+
+/* Reads pcap_stats of all sources
+ * Returns the counters summed over all sources (sniff loop only).
+ */
+PcapTotals CaptureSources::collect() {
+    PcapTotals sum = _removedTotals;
+    for (auto& source : _sources) {
+        const PcapTotals& totals = source->collect();
+        sum.recv += totals.recv;
+        sum.drop += totals.drop;
+        sum.ifDrop += totals.ifDrop;
+    }
+
+    return sum;
+}
+
+// Human-readable delivery mode and per-source counters
+void CaptureSources::dump(std::ostream& os) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    os << "Capture sources (";
+    if (_delivery.immediate)
+        os << "immediate delivery";
+    else
+        os << "batched delivery, up to " << _delivery.timeoutMs << " ms";
+    os << ", up to " << _delivery.batchSize << " packets per turn):" << endl;
+    for (auto& source : _sources) {
+        os << "  " << source->iface() << " (ports";
+        for (uint16_t port : source->ports())
+            os << " " << port;
+        os << "): packets " << source->packets.load(std::memory_order_relaxed) <<
+            ", OpenFlow " << source->ofMessages.load(std::memory_order_relaxed) <<
+            ", decoded by libtins " << source->fallbacks.load(std::memory_order_relaxed) <<
+            ", malformed " << source->malformed.load(std::memory_order_relaxed) <<
+            ", received " << source->recv.load(std::memory_order_relaxed) <<
+            ", dropped " << source->drop.load(std::memory_order_relaxed) <<
+            " (buffer full), " << source->ifDrop.load(std::memory_order_relaxed) <<
+            " (interface)";
+        if (source->duplicates.load(std::memory_order_relaxed))
+            os << ", skipped after a handover " << source->duplicates.load(std::memory_order_relaxed);
+        os << endl;
+    }
+    if (!_changes.empty())
+        os << "  " << _changes.size() << " changes pending" << endl;
+}
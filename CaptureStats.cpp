@@ -0,0 +1,224 @@
+#include "CaptureStats.h"
+
+#include <cstring>
+#include <sstream>
+#include <time.h>
+
+using std::endl;
+
+PcapCounters::PcapCounters() {
+    memset(&_lastStat, 0, sizeof(_lastStat));
+    totals = PcapTotals();
+};
+
+/* Reads pcap_stats from the handle and adds the increments to 'totals'
+ * The first reading includes everything counted before it.
+ * Returns false if the counters could not be read.
+ */
+bool PcapCounters::read(pcap_t* handle) {
+    struct pcap_stat ps;
+    if (handle == nullptr || pcap_stats(handle, &ps) != 0)
+        return false;
+
+    // pcap_stat counters are 32-bit and wrap around; unsigned deltas handle that
+    totals.recv += (uint32_t)(ps.ps_recv - _lastStat.ps_recv);
+    totals.drop += (uint32_t)(ps.ps_drop - _lastStat.ps_drop);
+    totals.ifDrop += (uint32_t)(ps.ps_ifdrop - _lastStat.ps_ifdrop);
+    _lastStat = ps;
+
+    return true;
+}
+
+// Time of the given clock in ms
+static double clockMs(const clockid_t clock) {
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0)
+        return 0;
+
+    return ts.tv_sec * (double)THOUSAND + ts.tv_nsec / (double)MILLION;
+}
+
+// Upper bound of the histogram bucket holding quantile q (0 - 1), +Inf as -1
+static double histQuantile(const LatencyHistogram& hist, const double q) {
+    uint64_t rank = (uint64_t)(q * hist.count);
+    uint64_t seen = 0;
+    for (uint16_t i = 0; i < LAT_HIST_NUM_BOUNDS; i++) {
+        seen += hist.buckets[i];
+        if (seen > rank)
+            return LAT_HIST_BOUNDS[i];
+    }
+
+    return -1;
+}
+
+static string boundToString(const double bound) {
+    if (bound < 0)
+        return "+Inf";
+
+    std::ostringstream oss;
+    oss << bound << " ms";
+    return oss.str();
+}
+
+CaptureStats::CaptureStats() {
+    _lastTotals = PcapTotals();
+    _totals = CaptureInterval();
+    memset(&_delivery, 0, sizeof(_delivery));
+};
+
+/* Reads pcap_stats from the handle, closes the current interval and
+ * updates the capture counters in 'counters'
+ * Returns the interval that was just closed.
+ */
+CaptureInterval CaptureStats::collect(pcap_t* handle, const Timestamp& ts, SniffCounters& counters) {
+    if (!_pcap.read(handle))
+        return CaptureInterval();
+
+    return collect(_pcap.totals, ts, counters);
+}
+
+/* As above, for cumulative counters read by the caller (e.g. summed
+ * over several handles, see CaptureSources)
+ */
+CaptureInterval CaptureStats::collect(const PcapTotals& totals, const Timestamp& ts,
+                                        SniffCounters& counters) {
+    CaptureInterval interval = CaptureInterval();
+
+    uint64_t probesMatched = counters.probesMatched.load(std::memory_order_relaxed);
+    uint64_t probesExpired = counters.probesExpired.load(std::memory_order_relaxed);
+
+    // Called from the sniff loop thread, so this is the sniff loop's CPU time
+    double cpuMs = clockMs(CLOCK_THREAD_CPUTIME_ID);
+    double wallMs = clockMs(CLOCK_MONOTONIC);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (_started) {
+        interval.ts = ts;
+        interval.durationMs = CalcTimestampDiff(_lastTs, ts);
+        interval.recv = totals.recv - _lastTotals.recv;
+        interval.drop = totals.drop - _lastTotals.drop;
+        interval.ifDrop = totals.ifDrop - _lastTotals.ifDrop;
+        interval.probesMatched = probesMatched - _lastProbesMatched;
+        interval.probesExpired = probesExpired - _lastProbesExpired;
+
+        _totals.ts = ts;
+        _totals.durationMs += interval.durationMs;
+        _totals.recv += interval.recv;
+        _totals.drop += interval.drop;
+        _totals.ifDrop += interval.ifDrop;
+        _totals.probesMatched += interval.probesMatched;
+        _totals.probesExpired += interval.probesExpired;
+
+        _delivery.cpuMs += cpuMs - _lastCpuMs;
+        _delivery.wallMs += wallMs - _lastWallMs;
+
+        if (_history.size() < CAPTURE_STATS_HISTORY) {
+            _history.push_back(interval);
+        } else {
+            _history[_historyHead] = interval;
+            _historyHead = (_historyHead + 1) % CAPTURE_STATS_HISTORY;
+        }
+    } else {
+        // First reading only sets the baseline, counters before it are included in totals
+        _totals.recv = totals.recv;
+        _totals.drop = totals.drop;
+        _totals.ifDrop = totals.ifDrop;
+        _started = true;
+    }
+
+    _lastTotals = totals;
+    _lastProbesMatched = probesMatched;
+    _lastProbesExpired = probesExpired;
+    _lastTs = ts;
+    _lastCpuMs = cpuMs;
+    _lastWallMs = wallMs;
+
+    counters.captureRecv.store(_totals.recv, std::memory_order_relaxed);
+    counters.captureDrops.store(_totals.drop, std::memory_order_relaxed);
+    counters.captureIfDrops.store(_totals.ifDrop, std::memory_order_relaxed);
+
+    return interval;
+}
+
+// Adds the delivery delays of a batch (sniff loop only)
+void CaptureStats::addDelivery(const DeliveryStats& batch) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _delivery.wakeups += batch.wakeups;
+    _delivery.packets += batch.packets;
+    for (uint16_t i = 0; i <= LAT_HIST_NUM_BOUNDS; i++)
+        _delivery.delayMs.buckets[i] += batch.delayMs.buckets[i];
+    _delivery.delayMs.count += batch.delayMs.count;
+    _delivery.delayMs.sum += batch.delayMs.sum;
+    if (batch.maxDelayMs > _delivery.maxDelayMs)
+        _delivery.maxDelayMs = batch.maxDelayMs;
+}
+
+CaptureInterval CaptureStats::getTotals() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _totals;
+}
+
+DeliveryStats CaptureStats::getDelivery() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _delivery;
+}
+
+// Past intervals, oldest first
+vector<CaptureInterval> CaptureStats::getHistory() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    vector<CaptureInterval> history;
+    history.reserve(_history.size());
+    for (uint32_t i = 0; i < _history.size(); i++)
+        history.push_back(_history[(_historyHead + i) % _history.size()]);
+
+    return history;
+}
+
+/* Human-readable summary of the totals, the worst recent interval and
+ * the delivery delay and CPU cost
+ */
+void CaptureStats::dump(std::ostream& os) const {
+    CaptureInterval totals = getTotals();
+    vector<CaptureInterval> history = getHistory();
+    DeliveryStats delivery = getDelivery();
+
+    const CaptureInterval* worst = nullptr;
+    for (const CaptureInterval& interval : history) {
+        if (worst == nullptr || interval.drop + interval.ifDrop > worst->drop + worst->ifDrop)
+            worst = &interval;
+    }
+
+    uint64_t probesDone = totals.probesMatched + totals.probesExpired;
+    os << "Capture: received " << totals.recv << ", dropped " << totals.drop <<
+        " (buffer full), " << totals.ifDrop << " (interface)" << endl;
+    os << "Probes: matched " << totals.probesMatched << ", expired " << totals.probesExpired;
+    if (probesDone)
+        os << " (" << 100.0 * totals.probesExpired / probesDone << "% lost)";
+    os << endl;
+
+    if (worst && worst->drop + worst->ifDrop) {
+        os << "Worst of last " << history.size() << " intervals: " <<
+            worst->drop + worst->ifDrop << " drops of " << worst->recv <<
+            " packets in " << worst->durationMs << " ms, " <<
+            worst->probesExpired << " probes expired" << endl;
+    }
+
+    if (delivery.packets) {
+        os << "Delivery: " << delivery.packets << " packets in " << delivery.wakeups <<
+            " batches (" << (double)delivery.packets / delivery.wakeups << " per batch)" << endl;
+        os << "Delivery delay: mean " << delivery.delayMs.sum / delivery.delayMs.count <<
+            " ms, p50 <= " << boundToString(histQuantile(delivery.delayMs, 0.5)) <<
+            ", p99 <= " << boundToString(histQuantile(delivery.delayMs, 0.99)) <<
+            ", max " << delivery.maxDelayMs << " ms" << endl;
+    }
+
+    if (delivery.wallMs > 0) {
+        os << "Sniff loop CPU: " << 100.0 * delivery.cpuMs / delivery.wallMs << "% of a core";
+        if (delivery.packets)
+            os << ", " << THOUSAND * delivery.cpuMs / delivery.packets << " us per packet";
+        os << endl;
+    }
+}
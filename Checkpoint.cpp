@@ -0,0 +1,214 @@
+#include "Checkpoint.h"
+
+#include <cerrno>
+#include <cstdio> // For rename()
+#include <iostream>
+#include <fcntl.h>
+#include <libgen.h> // For dirname()
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ThreadPlacement.h"
+
+using std::cout;
+using std::endl;
+
+CheckpointWriter::CheckpointWriter() : _written(0), _failed(0), _lastBytes(0) {};
+
+CheckpointWriter::~CheckpointWriter() {
+    stop();
+}
+
+// Starts the writer thread, checkpoints go to 'path'
+bool CheckpointWriter::start(const string& path) {
+    if (_running || path.empty())
+        return false;
+
+    _path = path;
+    _stopping = false;
+    _running = true;
+    _writer = std::thread(&CheckpointWriter::writerLoop, this);
+    return true;
+}
+
+/* Writes any pending checkpoint, then stops the writer thread
+ * Function is idempotent
+ */
+void CheckpointWriter::stop() {
+    if (!_running)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _cond.notify_one();
+
+    if (_writer.joinable())
+        _writer.join();
+    _running = false;
+}
+
+/* Hands a payload to the writer thread, taken at packet time createdUs
+ * 'payload' is swapped with the writer's previous buffer, so neither
+ * side allocates once both have grown.
+ */
+void CheckpointWriter::submit(vector<uint8_t>& payload, const uint64_t createdUs) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _payload.swap(payload);
+        _createdUs = createdUs;
+        _pending = true;
+    }
+    _cond.notify_one();
+}
+
+void CheckpointWriter::writerLoop() {
+    ThreadPlacements::place(THREAD_WORKER, "checkpoint-writer");
+
+    vector<uint8_t> payload;
+    uint64_t createdUs;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _cond.wait(lock, [this] { return _pending || _stopping; });
+        if (!_pending)
+            return; // Stopping, nothing left to write
+
+        payload.swap(_payload);
+        createdUs = _createdUs;
+        _pending = false;
+
+        // The sniff loop may submit the next one while this one is written
+        lock.unlock();
+        if (writeFile(_path, payload, createdUs)) {
+            _written.fetch_add(1, std::memory_order_relaxed);
+            _lastBytes.store(sizeof(CheckpointHeader) + payload.size(), std::memory_order_relaxed);
+        } else {
+            _failed.fetch_add(1, std::memory_order_relaxed);
+        }
+        lock.lock();
+    }
+}
+
+// Human-readable path and counters
+void CheckpointWriter::dump(std::ostream& os) const {
+    os << "Checkpoints: " << _written.load(std::memory_order_relaxed) << " written to " <<
+        _path << " (last " << _lastBytes.load(std::memory_order_relaxed) << " Bytes), " <<
+        _failed.load(std::memory_order_relaxed) << " failed" << endl;
+}
+
+// FNV-1a over 'len' Bytes
+uint64_t CheckpointWriter::checksum(const uint8_t* data, const size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// Writes all of 'len' Bytes, retrying short writes
+static bool writeAll(const int fd, const void* data, size_t len) {
+    const uint8_t* pos = (const uint8_t*)data;
+    while (len) {
+        ssize_t n = write(fd, pos, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        pos += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+/* Writes a checkpoint file atomically: to <path>.tmp first, synced, then
+ * renamed over <path>, and the rename synced through the directory
+ * Returns false, and leaves any previous file in place, on errors.
+ */
+bool CheckpointWriter::writeFile(const string& path, const vector<uint8_t>& payload,
+                                    const uint64_t createdUs) {
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CHECKPOINT_MAGIC;
+    header.version = CHECKPOINT_VERSION;
+    header.payloadLen = payload.size();
+    header.checksum = checksum(payload.data(), payload.size());
+    header.createdUs = createdUs;
+
+    string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        cout << "ERROR: Could not open checkpoint file " << tmpPath << " (" << strerror(errno) << ")" << endl;
+        return false;
+    }
+
+    bool ok = writeAll(fd, &header, sizeof(header)) &&
+                writeAll(fd, payload.data(), payload.size()) &&
+                fsync(fd) == 0;
+    close(fd);
+
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        cout << "ERROR: Could not write checkpoint file " << path << " (" << strerror(errno) << ")" << endl;
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    // dirname() may modify its argument
+    vector<char> dir(path.begin(), path.end());
+    dir.push_back('\0');
+    int dirFd = open(dirname(dir.data()), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+
+    return true;
+}
+
+/* Reads and verifies a checkpoint file, its payload goes into 'payload'
+ * Returns false if the file is missing, of another version or corrupt.
+ */
+bool CheckpointWriter::readFile(const string& path, vector<uint8_t>& payload, uint64_t& createdUs) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    // The payload length is checked against the file size before it's trusted
+    CheckpointHeader header;
+    struct stat st;
+    bool ok = (fstat(fd, &st) == 0 &&
+                read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+                header.magic == CHECKPOINT_MAGIC && header.version == CHECKPOINT_VERSION &&
+                header.payloadLen == (uint64_t)st.st_size - sizeof(header));
+    if (ok) {
+        payload.resize(header.payloadLen);
+
+        size_t done = 0;
+        while (done < payload.size()) {
+            ssize_t n = read(fd, &payload[done], payload.size() - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            done += n;
+        }
+
+        ok = (done == payload.size() &&
+                checksum(payload.data(), payload.size()) == header.checksum);
+    }
+    close(fd);
+
+    if (!ok) {
+        cout << "ERROR: Checkpoint file " << path << " is corrupt or of another version" << endl;
+        payload.clear();
+        return false;
+    }
+
+    createdUs = header.createdUs;
+    return true;
+}
@@ -0,0 +1,292 @@
+#include "Diagnostics.h"
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <strings.h> // For strcasecmp()
+
+#include "ThreadPlacement.h"
+
+using std::endl;
+
+Diagnostics::Diagnostics() : _minSeverity(DIAG_INFO), _rate(DIAG_DEFAULT_RATE),
+                                _burst(DIAG_DEFAULT_BURST), _head(0), _tail(0),
+                                _writerRunning(false) {
+    for (uint16_t i = 0; i < NUM_DIAG_REASONS; i++) {
+        ReasonState& state = _reasons[i];
+        state.severity = severityOf((DiagReason)i);
+        state.count = 0;
+        state.suppressed = 0;
+        state.tokens = DIAG_DEFAULT_BURST;
+        state.lastRefillNs = 0;
+        state.suppressedSinceMsg = 0;
+    }
+};
+
+Diagnostics::~Diagnostics() {
+    stopWriter();
+};
+
+void Diagnostics::reportSlow(const DiagReason reason, const IPv4EndpointType endpoint,
+                                const uint64_t value, const uint64_t value2, const char* text) {
+    ReasonState& state = _reasons[reason];
+
+    // Refill the token bucket
+    double rate = _rate.load(std::memory_order_relaxed);
+    double burst = _burst.load(std::memory_order_relaxed);
+    uint64_t now = nowNs();
+    if (state.lastRefillNs)
+        state.tokens += (now - state.lastRefillNs) / 1e9 * rate;
+    if (state.tokens > burst)
+        state.tokens = burst;
+    state.lastRefillNs = now;
+
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    bool queueFull = head - _tail.load(std::memory_order_acquire) >= DIAG_QUEUE_SIZE;
+    if (state.tokens < 1 || queueFull) {
+        state.suppressedSinceMsg++;
+        bump(state.suppressed);
+        return;
+    }
+    state.tokens -= 1;
+
+    DiagEvent& event = _queue[head & (DIAG_QUEUE_SIZE - 1)];
+    event.reason = reason;
+    event.endpoint = endpoint;
+    event.value = value;
+    event.value2 = value2;
+    event.suppressed = state.suppressedSinceMsg;
+    event.text[0] = '\0';
+    if (text) {
+        strncpy(event.text, text, DIAG_TEXT_LEN - 1);
+        event.text[DIAG_TEXT_LEN - 1] = '\0';
+    }
+    state.suppressedSinceMsg = 0;
+
+    _head.store(head + 1, std::memory_order_release);
+}
+
+// Formats a single event as "<SEVERITY>: <message>"
+static void formatEvent(std::ostream& os, const DiagEvent& event) {
+    os << Diagnostics::severityName(Diagnostics::severityOf(event.reason)) << ": ";
+
+    switch (event.reason) {
+        case DIAG_UNKNOWN_ETH_TYPE:
+            os << "Unknown eth type: " << event.value;
+            break;
+        case DIAG_UNKNOWN_DST_MAC:
+            os << "Unknown dest MAC";
+            break;
+        case DIAG_NO_LLDP_PDU:
+            os << "Could not find LLDP PDU in Ethernet frame";
+            break;
+        case DIAG_FOREIGN_LLDP:
+            os << "Received LLDP w/ system name: " << event.text;
+            break;
+        case DIAG_MALFORMED_SYS_NAME:
+            os << "Malformed System Name field: " << event.text;
+            break;
+        case DIAG_PACKET_OUT_UNPACK:
+            os << "Unable to parse PacketOut message";
+            break;
+        case DIAG_UNIMPLEMENTED_OF_TYPE:
+            os << "Unimplemented OF message type: " << event.value;
+            break;
+        case DIAG_UNKNOWN_OF_TYPE:
+            os << "Unknown OF message type: " << event.value;
+            break;
+        case DIAG_IP_FRAGMENT:
+            os << "Currently do not support packets w/ IPv4's More Fragments flag set";
+            break;
+        case DIAG_UNRELATED_PACKET:
+            os << "Packet doesn't seem to be related to the OpenFlow connection";
+            break;
+        case DIAG_CAPTURE_DROPS:
+            os << "Capture dropped " << event.value << " of " << event.value2 <<
+                " packets in the last interval, consider a larger capture buffer";
+            break;
+        case DIAG_UNDECODABLE_FRAME:
+            os << "Unable to decode captured frame (link type " << event.value << ")";
+            break;
+        case DIAG_IPV6_TABLE_FULL:
+            os << "IPv6 address table full (" << event.value << " addresses), connection not tracked";
+            break;
+        case DIAG_OVERLOAD_LEVEL:
+            if (event.value == 0)
+                os << "Overload level 0, processing all messages and probes";
+            else
+                os << "Overload level " << event.value << ", shedding messages not needed for " <<
+                    "latency measurements, processing 1 in " << event.value2 << " probes";
+            break;
+        case DIAG_MEMORY_BUDGET:
+            os << "Memory budget exceeded, gave up on " << event.value <<
+                " outstanding probes (" << event.value2 << " Bytes now in use)";
+            break;
+        default:
+            os << Diagnostics::reasonName(event.reason);
+            break;
+    }
+
+    if (event.endpoint)
+        os << " (" << EndpointToString(event.endpoint) << ")";
+
+    if (event.suppressed)
+        os << " [" << event.suppressed << " similar messages suppressed]";
+
+    os << '\n';
+}
+
+// Writes queued messages to os, returns the number written
+uint32_t Diagnostics::flush(std::ostream& os) {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    uint32_t head = _head.load(std::memory_order_acquire);
+
+    uint32_t written = 0;
+    for (; tail != head; tail++, written++)
+        formatEvent(os, _queue[tail & (DIAG_QUEUE_SIZE - 1)]);
+
+    _tail.store(tail, std::memory_order_release);
+    if (written)
+        os.flush();
+
+    return written;
+}
+
+void Diagnostics::writerLoop(std::ostream* os) {
+    ThreadPlacements::place(THREAD_WORKER, "diag-writer");
+
+    while (_writerRunning.load(std::memory_order_relaxed)) {
+        flush(*os);
+        std::this_thread::sleep_for(std::chrono::milliseconds(DIAG_WRITER_PERIOD_MS));
+    }
+
+    flush(*os);
+}
+
+/* Starts a thread writing queued messages to os every DIAG_WRITER_PERIOD_MS
+ * flush() must not be called while it runs.
+ */
+void Diagnostics::startWriter(std::ostream& os) {
+    if (_writerRunning.exchange(true))
+        return;
+
+    _writer = std::thread(&Diagnostics::writerLoop, this, &os);
+}
+
+// Stops the writer thread after it wrote all queued messages
+void Diagnostics::stopWriter() {
+    if (!_writerRunning.exchange(false))
+        return;
+
+    if (_writer.joinable())
+        _writer.join();
+}
+
+// Messages below minSeverity are only counted
+void Diagnostics::setMinSeverity(const DiagSeverity minSeverity) {
+    _minSeverity.store(minSeverity, std::memory_order_relaxed);
+}
+
+DiagSeverity Diagnostics::getMinSeverity() const {
+    return (DiagSeverity)_minSeverity.load(std::memory_order_relaxed);
+}
+
+// Per-reason token bucket: 'rate' messages per second, up to 'burst' at once
+void Diagnostics::setRateLimit(const double rate, const double burst) {
+    _rate.store(rate < 0 ? 0 : rate, std::memory_order_relaxed);
+    _burst.store(burst < 1 ? 1 : burst, std::memory_order_relaxed);
+}
+
+uint64_t Diagnostics::getCount(const DiagReason reason) const {
+    return _reasons[reason].count.load(std::memory_order_relaxed);
+}
+
+// Messages of 'reason' at or above the minimum severity that were rate-limited
+uint64_t Diagnostics::getSuppressed(const DiagReason reason) const {
+    return _reasons[reason].suppressed.load(std::memory_order_relaxed);
+}
+
+// Per-reason counts, for the reasons that occurred
+void Diagnostics::dump(std::ostream& os) const {
+    os << "Diagnostics (minimum severity " << severityName(getMinSeverity()) << "):" << endl;
+
+    bool any = false;
+    for (uint16_t i = 0; i < NUM_DIAG_REASONS; i++) {
+        DiagReason reason = (DiagReason)i;
+        uint64_t count = getCount(reason);
+        if (count == 0)
+            continue;
+
+        any = true;
+        os << "  " << std::left << std::setw(24) << reasonName(reason) <<
+            std::setw(8) << severityName(severityOf(reason)) << std::right <<
+            std::setw(12) << count << " (" << getSuppressed(reason) << " suppressed)" << endl;
+    }
+
+    if (!any)
+        os << "  (none)" << endl;
+}
+
+DiagSeverity Diagnostics::severityOf(const DiagReason reason) {
+    switch (reason) {
+        case DIAG_UNKNOWN_ETH_TYPE: return DIAG_DEBUG; // Any non-LLDP PacketIn, e.g. ARP
+        case DIAG_UNKNOWN_DST_MAC: return DIAG_DEBUG;
+        case DIAG_NO_LLDP_PDU: return DIAG_ERROR;
+        case DIAG_FOREIGN_LLDP: return DIAG_INFO;
+        case DIAG_MALFORMED_SYS_NAME: return DIAG_ERROR;
+        case DIAG_PACKET_OUT_UNPACK: return DIAG_ERROR;
+        case DIAG_UNIMPLEMENTED_OF_TYPE: return DIAG_DEBUG; // e.g. every FlowMod
+        case DIAG_UNKNOWN_OF_TYPE: return DIAG_ERROR;
+        case DIAG_IP_FRAGMENT: return DIAG_WARNING;
+        case DIAG_UNRELATED_PACKET: return DIAG_WARNING;
+        case DIAG_CAPTURE_DROPS: return DIAG_WARNING;
+        case DIAG_UNDECODABLE_FRAME: return DIAG_WARNING;
+        case DIAG_IPV6_TABLE_FULL: return DIAG_ERROR;
+        case DIAG_OVERLOAD_LEVEL: return DIAG_WARNING;
+        case DIAG_MEMORY_BUDGET: return DIAG_WARNING;
+        default: return DIAG_ERROR;
+    }
+}
+
+const char* Diagnostics::reasonName(const DiagReason reason) {
+    switch (reason) {
+        case DIAG_UNKNOWN_ETH_TYPE: return "unknown_eth_type";
+        case DIAG_UNKNOWN_DST_MAC: return "unknown_dst_mac";
+        case DIAG_NO_LLDP_PDU: return "no_lldp_pdu";
+        case DIAG_FOREIGN_LLDP: return "foreign_lldp";
+        case DIAG_MALFORMED_SYS_NAME: return "malformed_sys_name";
+        case DIAG_PACKET_OUT_UNPACK: return "packet_out_unpack";
+        case DIAG_UNIMPLEMENTED_OF_TYPE: return "unimplemented_of_type";
+        case DIAG_UNKNOWN_OF_TYPE: return "unknown_of_type";
+        case DIAG_IP_FRAGMENT: return "ip_fragment";
+        case DIAG_UNRELATED_PACKET: return "unrelated_packet";
+        case DIAG_CAPTURE_DROPS: return "capture_drops";
+        case DIAG_UNDECODABLE_FRAME: return "undecodable_frame";
+        case DIAG_IPV6_TABLE_FULL: return "ipv6_table_full";
+        case DIAG_OVERLOAD_LEVEL: return "overload_level";
+        case DIAG_MEMORY_BUDGET: return "memory_budget";
+        default: return "unknown";
+    }
+}
+
+const char* Diagnostics::severityName(const DiagSeverity severity) {
+    switch (severity) {
+        case DIAG_DEBUG: return "DEBUG";
+        case DIAG_INFO: return "INFO";
+        case DIAG_WARNING: return "WARNING";
+        case DIAG_ERROR: return "ERROR";
+        default: return "UNKNOWN";
+    }
+}
+
+// Returns false if name isn't one of severityName()'s values
+bool Diagnostics::parseSeverity(const string& name, DiagSeverity& severity) {
+    for (uint16_t i = 0; i < NUM_DIAG_SEVERITIES; i++) {
+        if (strcasecmp(name.c_str(), severityName((DiagSeverity)i)) == 0) {
+            severity = (DiagSeverity)i;
+            return true;
+        }
+    }
+
+    return false;
+}
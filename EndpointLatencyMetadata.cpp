@@ -1,16 +1,174 @@
 #include "EndpointLatencyMetadata.h"
+#include "StageTimers.h"
 
-EndpointLatencyMetadata::EndpointLatencyMetadata() {};
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
 
-EndpointLatencyMetadata::~EndpointLatencyMetadata() {
+using std::cout;
+
+/* Sizes and limits that Policy does not fix are taken from 'config'
+ * See also configure().
+ */
+template <class Policy>
+BasicEndpointLatencyMetadata<Policy>::BasicEndpointLatencyMetadata(const LatencyConfig& config) :
+        _config(checkedConfig(config)),
+        _reconfigPending(false),
+        _appliedConfig(_config),
+        _echoRTT(_config.echoRTTWindow),
+        _pktInRTT(_config.pktInRTTWindow),
+        _linkLat(_config.linkLatWindow) {};
+
+template <class Policy>
+BasicEndpointLatencyMetadata<Policy>::~BasicEndpointLatencyMetadata() {
     if ( _statsLog.is_open() )
         _statsLog.close();
 };
 
+// Resolves 'config' against Policy, falling back to the defaults if it is invalid
+template <class Policy>
+LatencyConfig BasicEndpointLatencyMetadata<Policy>::checkedConfig(const LatencyConfig& config) {
+    LatencyConfig resolved = ResolveLatencyConfig<Policy>(config);
+    if (ValidLatencyConfig(resolved))
+        return resolved;
+
+    cout << "ERROR: Invalid latency configuration, using the defaults" << endl;
+    return ResolveLatencyConfig<Policy>(DEFAULT_LATENCY_CONFIG);
+}
+
+/* Changes the sizes and limits that Policy does not fix
+ * Only possible before any switch has been seen (i.e. before the sniff
+ * loop starts); returns false otherwise, or if 'config' is invalid.
+ */
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::configure(const LatencyConfig& config) {
+    LatencyConfig resolved = ResolveLatencyConfig<Policy>(config);
+    if (!_endpoints.empty() || !ValidLatencyConfig(resolved))
+        return false;
+
+    _echoRTT.setWindow(resolved.echoRTTWindow);
+    _pktInRTT.setWindow(resolved.pktInRTTWindow);
+    _linkLat.setWindow(resolved.linkLatWindow);
+    _config = resolved;
+
+    std::lock_guard<std::mutex> lock(_reconfigMutex);
+    _appliedConfig = resolved;
+    return true;
+}
+
+template <class Policy>
+const LatencyConfig& BasicEndpointLatencyMetadata<Policy>::config() const {
+    return _config;
+}
+
+/* Changes the window sizes and the probe limit once switches were seen
+ * May be called from any thread while the sniff loop runs: the sniff
+ * loop applies the change before the next packet, see
+ * applyReconfiguration(). Estimators can't be changed this way.
+ * Returns false if 'config' is invalid or changes an estimator.
+ */
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::reconfigure(const LatencyConfig& config) {
+    LatencyConfig resolved = ResolveLatencyConfig<Policy>(config);
+    if (!ValidLatencyConfig(resolved))
+        return false;
+
+    // Estimators keep their state across a reconfiguration, so not their kind
+    std::lock_guard<std::mutex> lock(_reconfigMutex);
+    if (resolved.echoRTTEstimator != _appliedConfig.echoRTTEstimator ||
+            resolved.pktInRTTEstimator != _appliedConfig.pktInRTTEstimator ||
+            resolved.linkLatEstimator != _appliedConfig.linkLatEstimator) {
+        cout << "ERROR: Estimators can't be changed once switches were seen" << endl;
+        return false;
+    }
+
+    _pendingConfig = resolved;
+    _reconfigPending.store(true);
+    return true;
+}
+
+/* Applies the last reconfigure() in place: every endpoint and link
+ * keeps the newest samples of its windows (as many as fit), and the
+ * memory charged for them is adjusted. Sniff loop only, or while it
+ * is stopped.
+ */
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::applyReconfiguration() {
+    LatencyConfig config;
+    {
+        std::lock_guard<std::mutex> lock(_reconfigMutex);
+        if (!_reconfigPending.load())
+            return;
+        config = _pendingConfig;
+        _reconfigPending.store(false);
+    }
+
+    size_t oldEndpointBytes = endpointFixedBytes();
+    size_t oldLinkBytes = linkFixedBytes();
+
+    // A table whose window Policy fixes keeps it
+    if (!_echoRTT.resizeWindow(config.echoRTTWindow))
+        config.echoRTTWindow = _config.echoRTTWindow;
+    if (!_pktInRTT.resizeWindow(config.pktInRTTWindow))
+        config.pktInRTTWindow = _config.pktInRTTWindow;
+    if (!_linkLat.resizeWindow(config.linkLatWindow))
+        config.linkLatWindow = _config.linkLatWindow;
+
+    // A lowered probe limit is enforced as each port sends its next probe
+    _config = config;
+    {
+        std::lock_guard<std::mutex> lock(_reconfigMutex);
+        _appliedConfig = config;
+    }
+
+    size_t endpointBytes = endpointFixedBytes();
+    size_t linkBytes = linkFixedBytes();
+    for (LatencyMetadata& latMeta : _endpoints) {
+        latMeta.memory.release(oldEndpointBytes);
+        latMeta.memory.charge(endpointBytes);
+    }
+    for (uint32_t epIdx : _linkEndpoint) {
+        _endpoints[epIdx].memory.release(oldLinkBytes);
+        _endpoints[epIdx].memory.charge(linkBytes);
+    }
+}
+
+/* Reserves the tables and indices for 'endpoints' switches and
+ * 'links' links, so the sniff loop doesn't reallocate them (or fault
+ * in their pages) until there are more; see ThreadPlacement.h
+ */
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::reserve(const uint32_t endpoints, const uint32_t links) {
+    _endpointIndex.reserve(endpoints);
+    _endpointKeys.reserve(endpoints);
+    _compactOrder.reserve(endpoints);
+    _echoRTT.reserve(endpoints);
+    _pktInRTT.reserve(endpoints);
+    _echoEstimator.reserve(endpoints);
+    _pktInEstimator.reserve(endpoints);
+    _echoChange.reserve(endpoints);
+    _pktInChange.reserve(endpoints);
+
+    _linkIndex.reserve(links);
+    _linkLat.reserve(links);
+    _linkEstimator.reserve(links);
+    _linkEndpoint.reserve(links);
+    _linkPort.reserve(links);
+    _linkChange.reserve(links);
+
+    if (_rollupsEnabled) {
+        std::lock_guard<std::mutex> lock(_rollupMutex);
+        _echoRollups.reserve(endpoints);
+        _pktInRollups.reserve(endpoints);
+        _linkRollups.reserve(links);
+    }
+}
+
 /* Open statistics log file for writing
  * Function is idempotent
  */
-bool EndpointLatencyMetadata::openStatsLog() {
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::openStatsLog() {
     if ( !_statsLog.is_open() ) {
         time_t     now = time(0);
         struct tm  tstruct;
@@ -26,140 +184,1465 @@ bool EndpointLatencyMetadata::openStatsLog() {
     return _statsLog.good();
 }
 
+// Returns the endpoint's index, adding it if it hasn't been seen yet
+template <class Policy>
+uint32_t BasicEndpointLatencyMetadata<Policy>::internEndpoint(const IPv4EndpointType dpEndpoint) {
+    if (dpEndpoint == _lastEndpoint && _lastEndpointIdx != NO_INDEX)
+        return _lastEndpointIdx;
+
+    auto it = _endpointIndex.find(dpEndpoint);
+    uint32_t epIdx;
+    if (it != _endpointIndex.end()) {
+        epIdx = it->second;
+    } else {
+        epIdx = _endpoints.size();
+        _endpointIndex[dpEndpoint] = epIdx;
+        _endpointKeys.push_back(dpEndpoint);
+        _endpoints.emplace_back(&_memory);
+        _echoRTT.addRow();
+        _pktInRTT.addRow();
+        _echoEstimator.emplace_back((EstimatorKind)_config.echoRTTEstimator);
+        _pktInEstimator.emplace_back((EstimatorKind)_config.pktInRTTEstimator);
+        _echoChange.emplace_back();
+        _pktInChange.emplace_back();
+        if (_rollupsEnabled) {
+            std::lock_guard<std::mutex> lock(_rollupMutex);
+            _echoRollups.addRow();
+            _pktInRollups.addRow();
+        }
+        _endpoints.back().memory.charge(endpointFixedBytes());
+    }
+
+    _lastEndpoint = dpEndpoint;
+    _lastEndpointIdx = epIdx;
+    return epIdx;
+}
+
+// Returns the endpoint's index, or NO_INDEX if it hasn't been seen yet
+template <class Policy>
+uint32_t BasicEndpointLatencyMetadata<Policy>::findEndpoint(const IPv4EndpointType dpEndpoint) const {
+    auto it = _endpointIndex.find(dpEndpoint);
+    return it == _endpointIndex.end() ? NO_INDEX : it->second;
+}
+
+// Returns the link's index, adding it if it hasn't been seen yet
+template <class Policy>
+uint32_t BasicEndpointLatencyMetadata<Policy>::internLink(const uint32_t epIdx, const uint16_t port_no) {
+    uint64_t key = ((uint64_t)epIdx << 16) | port_no;
+    auto it = _linkIndex.find(key);
+    if (it != _linkIndex.end())
+        return it->second;
+
+    uint32_t linkIdx = _linkLat.addRow();
+    _linkIndex[key] = linkIdx;
+    _linkEstimator.push_back(MakeEstimator<LinkLatEstimator>((EstimatorKind)_config.linkLatEstimator));
+    _linkEndpoint.push_back(epIdx);
+    _linkPort.push_back(port_no);
+    _linkChange.emplace_back();
+    if (_rollupsEnabled) {
+        std::lock_guard<std::mutex> lock(_rollupMutex);
+        _linkRollups.addRow();
+    }
+    _endpoints[epIdx].links.push_back(linkIdx);
+    _endpoints[epIdx].memory.charge(linkFixedBytes());
+
+    return linkIdx;
+}
+
+// Returns the link's index, or NO_INDEX if it hasn't been seen yet
+template <class Policy>
+uint32_t BasicEndpointLatencyMetadata<Policy>::findLink(const IPv4EndpointType dpEndpoint,
+                                                         const uint16_t port_no) const {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    if (epIdx == NO_INDEX)
+        return NO_INDEX;
+
+    auto it = _linkIndex.find(((uint64_t)epIdx << 16) | port_no);
+    return it == _linkIndex.end() ? NO_INDEX : it->second;
+}
+
+// Fixed-size table Bytes of a switch and of a link, charged when they are added
+template <class Policy>
+size_t BasicEndpointLatencyMetadata<Policy>::endpointFixedBytes() const {
+    return sizeof(LatencyMetadata) + sizeof(IPv4EndpointType) +
+            _echoRTT.rowBytes() + _pktInRTT.rowBytes() + 2 * sizeof(LatencyEstimator) +
+            2 * sizeof(ChangeDetector) + (_rollupsEnabled ? 2 * RollupTable::rowBytes() : 0);
+}
+
+template <class Policy>
+size_t BasicEndpointLatencyMetadata<Policy>::linkFixedBytes() const {
+    return _linkLat.rowBytes() + sizeof(LinkLatEstimator) + sizeof(uint32_t) + sizeof(uint16_t) +
+            sizeof(ChangeDetector) + (_rollupsEnabled ? RollupTable::rowBytes() : 0);
+}
+
+template <class Policy>
+SniffCounters& BasicEndpointLatencyMetadata<Policy>::counters() {
+    return _counters;
+}
+
+template <class Policy>
+CaptureStats& BasicEndpointLatencyMetadata<Policy>::captureStats() {
+    return _captureStats;
+}
+
+template <class Policy>
+Diagnostics& BasicEndpointLatencyMetadata<Policy>::diagnostics() {
+    return _diagnostics;
+}
+
+template <class Policy>
+OverloadGovernor& BasicEndpointLatencyMetadata<Policy>::governor() {
+    return _governor;
+}
+
+template <class Policy>
+MemoryBudget& BasicEndpointLatencyMetadata<Policy>::memoryBudget() {
+    return _memory;
+}
+
+template <class Policy>
+Observers& BasicEndpointLatencyMetadata<Policy>::observers() {
+    return _observers;
+}
+
+/* Enables periodic snapshots of all statistics, taken by the sniff
+ * loop at most once every intervalMs (in packet time).
+ * Must be called before the sniff loop starts.
+ */
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::enableSnapshots(const uint32_t intervalMs) {
+    _snapshotIntervalMs = intervalMs ? intervalMs : 1;
+}
+
+// Returns true if snapshots are enabled and the interval has elapsed
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::snapshotDue(const Timestamp& ts) {
+    return _snapshotIntervalMs &&
+            CalcTimestampDiff(_lastSnapshotTs, ts) >= _snapshotIntervalMs;
+}
+
+/* Copies current statistics into a snapshot and publishes it
+ * The back buffer is refilled in place, so once its vectors have grown to
+ * the number of endpoints/links, taking a snapshot no longer allocates.
+ * Endpoints are copied in index order, reading the metric tables sequentially.
+ */
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::publishSnapshot(const Timestamp& ts) {
+    StatsSnapshot& snap = _snapshots.back();
+
+    snap.ts = ts;
+    snap.seqNum = ++_snapshotSeqNum;
+    snap.packets = _counters.packets.load(std::memory_order_relaxed);
+    snap.ofMessages = _counters.ofMessages.load(std::memory_order_relaxed);
+    snap.parseErrors = _counters.parseErrors.load(std::memory_order_relaxed);
+    snap.captureRecv = _counters.captureRecv.load(std::memory_order_relaxed);
+    snap.captureDrops = _counters.captureDrops.load(std::memory_order_relaxed);
+    snap.captureIfDrops = _counters.captureIfDrops.load(std::memory_order_relaxed);
+    for (uint16_t i = 0; i < NUM_DIAG_REASONS; i++)
+        snap.diagCounts[i] = _diagnostics.getCount((DiagReason)i);
+    snap.overload = _governor.state();
+    snap.memory = _memory.state();
+
+    snap.endpoints.resize(_endpoints.size());
+    snap.links.resize(_linkLat.rows());
+
+    uint32_t numLinks = 0;
+    for (uint32_t epIdx = 0; epIdx < _endpoints.size(); epIdx++) {
+        EndpointSnapshot& epSnap = snap.endpoints[epIdx];
+        fillEndpointSnapshot(epSnap, epIdx);
+
+        // Links are grouped by endpoint in the snapshot
+        epSnap.firstLink = numLinks;
+        for (uint32_t linkIdx : _endpoints[epIdx].links)
+            fillLinkSnapshot(snap.links[numLinks++], linkIdx);
+    }
+
+    _snapshots.publish();
+    _lastSnapshotTs = ts;
+}
+
+// Copies an endpoint's statistics, except its links, into a snapshot
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::fillEndpointSnapshot(EndpointSnapshot& epSnap,
+                                                                 const uint32_t epIdx) {
+    const LatencyMetadata& latMeta = _endpoints[epIdx];
+
+    epSnap.endpoint = _endpointKeys[epIdx];
+    epSnap.datapathID = latMeta.datapathID;
+    epSnap.version = latMeta.version;
+    epSnap.probesSent = latMeta.probesSent;
+    epSnap.probesMatched = latMeta.probesMatched;
+    epSnap.probesExpired = latMeta.probesExpired;
+    epSnap.probesSkipped = latMeta.probesSkipped;
+    epSnap.probeSampleRate = OverloadGovernor::sampleRateOf(latMeta.probeLevel);
+    epSnap.memoryBytes = latMeta.memory.bytes();
+    epSnap.changePoints = latMeta.changePoints;
+    fillMetricSnapshot(epSnap.echoRTT, _echoRTT, epIdx);
+    epSnap.echoRTT.smoothed = _echoEstimator[epIdx].value();
+    fillMetricSnapshot(epSnap.pktInRTT, _pktInRTT, epIdx);
+    epSnap.pktInRTT.smoothed = _pktInEstimator[epIdx].value();
+    epSnap.tcp = latMeta.tcpFlow.stats;
+    epSnap.firstLink = 0;
+    epSnap.numLinks = latMeta.links.size();
+}
+
+template <class Policy>
+SnapshotExchange<StatsSnapshot>& BasicEndpointLatencyMetadata<Policy>::snapshots() {
+    return _snapshots;
+}
+
+/* Publishes every statistics update into the shared-memory table
+ * /dev/shm/<name>, see ShmStatsTable.h for readers.
+ * Must be called before the sniff loop starts.
+ */
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::openShmTable(const string& name, const uint32_t capacity) {
+    return _shmTable.open(name, capacity);
+}
+
+/* Enables periodic checkpoints of the latency state (see Checkpoint.h)
+ * into 'path', taken by the sniff loop at most once every intervalMs
+ * (in packet time) and written by a thread of their own.
+ * Must be called before the sniff loop starts.
+ */
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::enableCheckpoints(const string& path, const uint32_t intervalMs) {
+    if (!_checkpoints.start(path))
+        return false;
+
+    _checkpointIntervalMs = intervalMs ? intervalMs : 1;
+    return true;
+}
+
+// Returns true if checkpoints are enabled and the interval has elapsed
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::checkpointDue(const Timestamp& ts) {
+    return _checkpointIntervalMs &&
+            CalcTimestampDiff(_lastCheckpointTs, ts) >= _checkpointIntervalMs;
+}
+
+// Copies the latency state and hands it to the checkpoint writer
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::writeCheckpoint(const Timestamp& ts) {
+    if (!_checkpoints.running())
+        return;
+
+    fillCheckpoint(_checkpointBuf);
+    _checkpoints.submit(_checkpointBuf.data(), TimestampToUs(ts));
+    _lastCheckpointTs = ts;
+}
+
+/* Writes a last checkpoint and stops the writer thread
+ * Must be called after the sniff loop stopped; function is idempotent.
+ */
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::closeCheckpoints() {
+    if (!_checkpoints.running())
+        return;
+
+    writeCheckpoint(Timestamp::current_time());
+    _checkpoints.stop();
+}
+
+template <class Policy>
+const CheckpointWriter& BasicEndpointLatencyMetadata<Policy>::checkpoints() const {
+    return _checkpoints;
+}
+
+/* Enables periodic summaries of all statistics for an aggregator
+ * (see Aggregator.h) at 'addr', taken by the sniff loop at most once
+ * every intervalMs (in packet time) and sent by a thread of their own.
+ * Must be called before the sniff loop starts.
+ */
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::enableSummaries(const SummaryAddress& addr, const string& nodeName,
+                                                            const uint32_t intervalMs) {
+    if (nodeName.length() > SUMMARY_MAX_NAME_LEN || !_summaries.start(addr))
+        return false;
+
+    _nodeName = nodeName;
+    _summaryIntervalMs = intervalMs ? intervalMs : 1;
+    return true;
+}
+
+// Returns true if summaries are enabled and the interval has elapsed
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::summaryDue(const Timestamp& ts) {
+    return _summaryIntervalMs &&
+            CalcTimestampDiff(_lastSummaryTs, ts) >= _summaryIntervalMs;
+}
+
+// Copies current statistics and hands them to the summary sender
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::sendSummary(const Timestamp& ts) {
+    if (!_summaries.running())
+        return;
+
+    fillSummary(_summaryBuf);
+    _summaries.submit(_summaryBuf.data(), TimestampToUs(ts));
+    _lastSummaryTs = ts;
+}
+
+/* Sends a last summary and stops the sender thread
+ * Must be called after the sniff loop stopped; function is idempotent.
+ */
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::closeSummaries() {
+    if (!_summaries.running())
+        return;
+
+    sendSummary(Timestamp::current_time());
+    _summaries.stop();
+}
+
+template <class Policy>
+const SummarySender& BasicEndpointLatencyMetadata<Policy>::summaries() const {
+    return _summaries;
+}
+
+/* Keeps 1s, 1min and 1h rollups of the echo RTT, PacketIn RTT and
+ * link latency samples of every switch and link (see Rollups.h).
+ * If logPath is not empty, a line is appended to it for every closed
+ * interval of logLevel of every stream, instead of one per sample:
+ * "<start s> <resolution s> <endpoint> <metric> <count> <min> <max> <mean> <p50> <p90> <p99>"
+ * Must be called before the sniff loop starts; returns false if the
+ * log could not be opened.
+ */
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::enableRollups(const string& logPath, const RollupLevel logLevel) {
+    std::lock_guard<std::mutex> lock(_rollupMutex);
+    if (!logPath.empty() && !_rollupLog.is_open()) {
+        _rollupLog.open(logPath, std::ios::out | std::ios::app);
+        if (!_rollupLog.is_open()) {
+            cout << "ERROR: Could not open rollup log " << logPath << endl;
+            return false;
+        }
+        _rollupLogLevel = logLevel;
+    }
+
+    if (_rollupsEnabled)
+        return true;
+
+    // Switches and links seen (or restored) so far get their rows now
+    for (uint32_t epIdx = 0; epIdx < _endpoints.size(); epIdx++) {
+        _echoRollups.addRow();
+        _pktInRollups.addRow();
+        _endpoints[epIdx].memory.charge(2 * RollupTable::rowBytes());
+    }
+    for (uint32_t linkIdx = 0; linkIdx < _linkLat.rows(); linkIdx++) {
+        _linkRollups.addRow();
+        _endpoints[_linkEndpoint[linkIdx]].memory.charge(RollupTable::rowBytes());
+    }
+
+    _rollupsEnabled = true;
+    return true;
+}
+
+// Returns true if rollups are enabled and ts is in a later second than their intervals
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::rollupsDue(const Timestamp& ts) const {
+    return _rollupsEnabled && TimestampToUs(ts) / 1000000 > _rollupNowS;
+}
+
+// Closes the rollup intervals that ended before ts, logging them if enabled
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::advanceRollups(const Timestamp& ts) {
+    std::lock_guard<std::mutex> lock(_rollupMutex);
+    _rollupNowS = TimestampToUs(ts) / 1000000;
+
+    _echoRollups.advance(_rollupNowS, [this](const RollupLevel level, const uint32_t row,
+                                                const RollupSlot& slot) {
+        logRollup(level, slot, _endpointKeys[row], "EchoRTT", -1);
+    });
+    _pktInRollups.advance(_rollupNowS, [this](const RollupLevel level, const uint32_t row,
+                                                const RollupSlot& slot) {
+        logRollup(level, slot, _endpointKeys[row], "PktInRTT", -1);
+    });
+    _linkRollups.advance(_rollupNowS, [this](const RollupLevel level, const uint32_t row,
+                                                const RollupSlot& slot) {
+        logRollup(level, slot, _endpointKeys[_linkEndpoint[row]], "LinkLatRTT-Port", _linkPort[row]);
+    });
+
+    if (_rollupLog.is_open())
+        _rollupLog.flush();
+}
+
+// Appends a closed rollup interval of a stream to the rollup log (port_no -1: no link)
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::logRollup(const RollupLevel level, const RollupSlot& slot,
+                                                        const IPv4EndpointType dpEndpoint,
+                                                        const char* metric, const int port_no) {
+    if (level != _rollupLogLevel || !_rollupLog.is_open())
+        return;
+
+    STAGE_TIMER(STAGE_STATS_LOG);
+    uint32_t res = ROLLUP_RESOLUTION_S[level];
+    _rollupLog << (uint64_t)slot.interval * res << " " << res << " " << dpEndpoint << " " << metric;
+    if (port_no >= 0)
+        _rollupLog << port_no;
+    _rollupLog << " " << slot.count << " " << slot.min << " " << slot.max << " " << slot.mean <<
+        " " << slot.p50 << " " << slot.p90 << " " << slot.p99 << "\n";
+}
+
+/* Rollups at 'level' of the intervals starting in [fromS, toS) (packet
+ * time, seconds since the epoch) of a metric: OBS_METRIC_ECHO_RTT,
+ * OBS_METRIC_PKT_IN_RTT, or OBS_METRIC_LINK_LAT of the link at port_no.
+ * Returns false if rollups are disabled, or the stream wasn't seen yet.
+ */
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::getRollups(const IPv4EndpointType dpEndpoint,
+                                                        const ObserverMetric metric,
+                                                        const uint16_t port_no, const RollupLevel level,
+                                                        const uint64_t fromS, const uint64_t toS,
+                                                        RollupSeries& out) const {
+    std::lock_guard<std::mutex> lock(_rollupMutex);
+    if (!_rollupsEnabled || level >= NUM_ROLLUP_LEVELS)
+        return false;
+
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    uint32_t linkIdx = findLink(dpEndpoint, port_no);
+    if (metric == OBS_METRIC_ECHO_RTT && epIdx != NO_INDEX && epIdx < _echoRollups.rows())
+        _echoRollups.query(epIdx, level, fromS, toS, out);
+    else if (metric == OBS_METRIC_PKT_IN_RTT && epIdx != NO_INDEX && epIdx < _pktInRollups.rows())
+        _pktInRollups.query(epIdx, level, fromS, toS, out);
+    else if (metric == OBS_METRIC_LINK_LAT && linkIdx != NO_INDEX && linkIdx < _linkRollups.rows())
+        _linkRollups.query(linkIdx, level, fromS, toS, out);
+    else
+        return false;
+
+    return true;
+}
+
+/* Copies counters, endpoints and links into a summary payload
+ * Layout as described in Aggregator.h; endpoint snapshots are filled as for
+ * publishSnapshot(), with the links following their endpoint.
+ */
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::fillSummary(CheckpointBuffer& buf) {
+    buf.clear();
+    buf.put((uint8_t)_nodeName.length());
+    buf.putBytes(_nodeName.data(), _nodeName.length());
+
+    SummaryCounters counters;
+    counters.packets = _counters.packets.load(std::memory_order_relaxed);
+    counters.ofMessages = _counters.ofMessages.load(std::memory_order_relaxed);
+    counters.parseErrors = _counters.parseErrors.load(std::memory_order_relaxed);
+    counters.captureRecv = _counters.captureRecv.load(std::memory_order_relaxed);
+    counters.captureDrops = _counters.captureDrops.load(std::memory_order_relaxed);
+    counters.captureIfDrops = _counters.captureIfDrops.load(std::memory_order_relaxed);
+    buf.put(counters);
+
+    buf.put((uint32_t)_endpoints.size());
+    for (uint32_t epIdx = 0; epIdx < _endpoints.size(); epIdx++) {
+        EndpointSnapshot epSnap;
+        fillEndpointSnapshot(epSnap, epIdx);
+        buf.put(epSnap);
+
+        // The aggregator has IDs of its own for IPv6 addresses
+        if (IsIPv6Endpoint(epSnap.endpoint)) {
+            uint8_t addr[IPV6_ADDR_LEN] = {0};
+            IPv6AddressTable::global().address((uint32_t)(epSnap.endpoint >> 16), addr);
+            buf.putBytes(addr, IPV6_ADDR_LEN);
+        }
+
+        for (uint32_t linkIdx : _endpoints[epIdx].links) {
+            LinkSnapshot linkSnap;
+            fillLinkSnapshot(linkSnap, linkIdx);
+            buf.put(linkSnap);
+        }
+    }
+}
+
+// Appends a row's window samples and histogram to a checkpoint
+template <class Policy>
+template <class Table>
+void BasicEndpointLatencyMetadata<Policy>::putCheckpointRow(CheckpointBuffer& buf, const Table& table,
+                                                             const uint32_t row, vector<double>& scratch) {
+    scratch.resize(table.window());
+    uint16_t len = table.samples(row, scratch.data());
+
+    buf.put(len);
+    buf.putBytes(scratch.data(), len * sizeof(double));
+    buf.put(table.hist[row]);
+}
+
+/* Replays a row's window samples from a checkpoint into the table
+ * Only the newest samples are kept if the table's window is smaller.
+ */
+template <class Policy>
+template <class Table>
+bool BasicEndpointLatencyMetadata<Policy>::getCheckpointRow(CheckpointReader& in, Table& table,
+                                                             const uint32_t row, vector<double>& scratch) {
+    uint16_t len;
+    if (!in.get(len))
+        return false;
+
+    scratch.resize(len);
+    if (!in.getBytes(scratch.data(), len * sizeof(double)) || !in.get(table.hist[row]))
+        return false;
+
+    for (uint16_t i = len > table.window() ? len - table.window() : 0; i < len; i++)
+        table.update(row, scratch[i]);
+
+    return true;
+}
+
+/* Copies endpoints, links, windows and estimators into a checkpoint payload
+ * Layout (host byte order):
+ *  - estimator size, then the IPv6 addresses (endpoint keys refer to their IDs)
+ *  - per endpoint: key, datapath ID, probe counters, echo and PacketIn RTT
+ *    estimators and rows
+ *  - per link: endpoint index, port, estimator, link latency row
+ * where a row is its sample count, its samples (oldest first) and histogram.
+ * Outstanding probes are not saved, their pongs won't be seen after a restart.
+ */
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::fillCheckpoint(CheckpointBuffer& buf) {
+    static_assert(std::is_trivially_copyable<LinkLatEstimator>::value,
+                    "Link latency estimators are checkpointed as is");
+
+    vector<double> scratch;
+    buf.clear();
+    buf.put((uint32_t)sizeof(LinkLatEstimator));
+
+    IPv6AddressTable& ipv6Addrs = IPv6AddressTable::global();
+    uint32_t numAddrs = ipv6Addrs.size();
+    buf.put(numAddrs);
+    for (uint32_t id = 0; id < numAddrs; id++) {
+        uint8_t addr[IPV6_ADDR_LEN] = {0};
+        ipv6Addrs.address(id, addr);
+        buf.putBytes(addr, IPV6_ADDR_LEN);
+    }
+
+    buf.put((uint32_t)_endpoints.size());
+    for (uint32_t epIdx = 0; epIdx < _endpoints.size(); epIdx++) {
+        const LatencyMetadata& latMeta = _endpoints[epIdx];
+
+        buf.put(_endpointKeys[epIdx]);
+        buf.put(latMeta.datapathID);
+        buf.put(latMeta.probesSent);
+        buf.put(latMeta.probesMatched);
+        buf.put(latMeta.probesExpired);
+        buf.put(latMeta.probesSkipped);
+        buf.put(_echoEstimator[epIdx]);
+        buf.put(_pktInEstimator[epIdx]);
+        putCheckpointRow(buf, _echoRTT, epIdx, scratch);
+        putCheckpointRow(buf, _pktInRTT, epIdx, scratch);
+    }
+
+    buf.put((uint32_t)_linkLat.rows());
+    for (uint32_t linkIdx = 0; linkIdx < _linkLat.rows(); linkIdx++) {
+        buf.put(_linkEndpoint[linkIdx]);
+        buf.put(_linkPort[linkIdx]);
+        buf.put(_linkEstimator[linkIdx]);
+        putCheckpointRow(buf, _linkLat, linkIdx, scratch);
+    }
+}
+
+// Skips a row written by putCheckpointRow()
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::skipCheckpointRow(CheckpointReader& in, vector<double>& scratch) {
+    uint16_t len;
+    LatencyHistogram hist;
+    if (!in.get(len))
+        return false;
+
+    scratch.resize(len);
+    return in.getBytes(scratch.data(), len * sizeof(double)) && in.get(hist);
+}
+
+/* Checks that a checkpoint payload is complete and consistent, so
+ * restoreCheckpoint() won't stop halfway through it: every field is
+ * present, endpoints are distinct, links refer to them and the IPv6
+ * addresses fit into the address table. Changes nothing.
+ */
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::checkCheckpoint(CheckpointReader& in) {
+    vector<double> scratch;
+
+    uint32_t estimatorSize;
+    if (!in.get(estimatorSize))
+        return false;
+
+    // Repeated addresses get the ID of their first occurrence
+    IPv6AddressTable& ipv6Addrs = IPv6AddressTable::global();
+    uint32_t numAddrs;
+    if (!in.get(numAddrs))
+        return false;
+    unordered_map<IPv6AddrBytes, uint32_t, IPv6AddrHash> firstId;
+    vector<uint32_t> addrIds(numAddrs);
+    uint32_t newAddrs = 0;
+    for (uint32_t id = 0; id < numAddrs; id++) {
+        IPv6AddrBytes addr;
+        if (!in.getBytes(addr.data(), IPV6_ADDR_LEN))
+            return false;
+
+        auto it = firstId.emplace(addr, id).first;
+        addrIds[id] = it->second;
+        if (it->second == id && ipv6Addrs.find(addr.data()) == IPV6_NO_ID)
+            newAddrs++;
+    }
+    if (newAddrs > IPV6_MAX_ADDRS - ipv6Addrs.size())
+        return false;
+
+    uint32_t numEndpoints;
+    if (!in.get(numEndpoints))
+        return false;
+    unordered_map<IPv4EndpointType, uint32_t> endpoints;
+    for (uint32_t i = 0; i < numEndpoints; i++) {
+        IPv4EndpointType dpEndpoint;
+        uint64_t datapathID;
+        uint64_t probes[4];
+        LatencyEstimator echoEstimator, pktInEstimator;
+        if (!in.get(dpEndpoint) || !in.get(datapathID) || !in.getBytes(probes, sizeof(probes)) ||
+                !in.get(echoEstimator) || !in.get(pktInEstimator) ||
+                !skipCheckpointRow(in, scratch) || !skipCheckpointRow(in, scratch))
+            return false;
+
+        if (IsIPv6Endpoint(dpEndpoint)) {
+            uint32_t id = (uint32_t)((dpEndpoint & ~ENDPOINT_IPV6_FLAG) >> 16);
+            if (id >= numAddrs)
+                return false;
+            dpEndpoint = ENDPOINT_IPV6_FLAG | ((uint64_t)addrIds[id] << 16) | (dpEndpoint & 0xFFFF);
+        }
+
+        if (!endpoints.emplace(dpEndpoint, i).second)
+            return false;
+    }
+
+    uint32_t numLinks;
+    if (!in.get(numLinks))
+        return false;
+    vector<uint8_t> estimator(estimatorSize);
+    for (uint32_t i = 0; i < numLinks; i++) {
+        uint32_t epIdx;
+        uint16_t port_no;
+        if (!in.get(epIdx) || !in.get(port_no) || epIdx >= numEndpoints ||
+                !in.getBytes(estimator.data(), estimatorSize) || !skipCheckpointRow(in, scratch))
+            return false;
+    }
+
+    return in.remaining() == 0;
+}
+
+// Adds the endpoints and links of a checkpoint payload, see fillCheckpoint()
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::restoreCheckpoint(CheckpointReader& in) {
+    vector<double> scratch;
+
+    // Estimators of another kind start over, their windows are still restored
+    uint32_t estimatorSize;
+    if (!in.get(estimatorSize))
+        return false;
+    bool sameEstimator = (estimatorSize == sizeof(LinkLatEstimator));
+
+    // IPv6 addresses may get other IDs in this process
+    uint32_t numAddrs;
+    if (!in.get(numAddrs))
+        return false;
+    vector<uint32_t> addrIds(numAddrs);
+    for (uint32_t id = 0; id < numAddrs; id++) {
+        uint8_t addr[IPV6_ADDR_LEN];
+        if (!in.getBytes(addr, IPV6_ADDR_LEN))
+            return false;
+        addrIds[id] = IPv6AddressTable::global().intern(addr);
+    }
+
+    uint32_t numEndpoints;
+    if (!in.get(numEndpoints))
+        return false;
+    for (uint32_t i = 0; i < numEndpoints; i++) {
+        IPv4EndpointType dpEndpoint;
+        uint64_t datapathID;
+        uint64_t probes[4];
+        if (!in.get(dpEndpoint) || !in.get(datapathID) || !in.getBytes(probes, sizeof(probes)))
+            return false;
+
+        if (IsIPv6Endpoint(dpEndpoint)) {
+            uint32_t id = (uint32_t)((dpEndpoint & ~ENDPOINT_IPV6_FLAG) >> 16);
+            if (id >= numAddrs || addrIds[id] == IPV6_NO_ID)
+                return false;
+            dpEndpoint = ENDPOINT_IPV6_FLAG | ((uint64_t)addrIds[id] << 16) | (dpEndpoint & 0xFFFF);
+        }
+
+        // Endpoint indices are dense, so they match the checkpoint's
+        uint32_t epIdx = internEndpoint(dpEndpoint);
+        if (epIdx != i)
+            return false;
+
+        LatencyMetadata& latMeta = _endpoints[epIdx];
+        latMeta.datapathID = datapathID;
+        latMeta.probesSent = probes[0];
+        latMeta.probesMatched = probes[1];
+        latMeta.probesExpired = probes[2];
+        latMeta.probesSkipped = probes[3];
+
+        // Estimators of another kind than configured start over
+        LatencyEstimator echoEstimator, pktInEstimator;
+        if (!in.get(echoEstimator) || !in.get(pktInEstimator))
+            return false;
+        if (echoEstimator.kind() == _config.echoRTTEstimator)
+            _echoEstimator[epIdx] = echoEstimator;
+        if (pktInEstimator.kind() == _config.pktInRTTEstimator)
+            _pktInEstimator[epIdx] = pktInEstimator;
+
+        if (!getCheckpointRow(in, _echoRTT, epIdx, scratch) ||
+                !getCheckpointRow(in, _pktInRTT, epIdx, scratch))
+            return false;
+    }
+
+    uint32_t numLinks;
+    if (!in.get(numLinks))
+        return false;
+    vector<uint8_t> estimator(estimatorSize);
+    for (uint32_t i = 0; i < numLinks; i++) {
+        uint32_t epIdx;
+        uint16_t port_no;
+        if (!in.get(epIdx) || !in.get(port_no) || epIdx >= numEndpoints ||
+                !in.getBytes(estimator.data(), estimatorSize))
+            return false;
+
+        uint32_t linkIdx = internLink(epIdx, port_no);
+        if (sameEstimator) {
+            memcpy(&_linkEstimator[linkIdx], estimator.data(), estimatorSize);
+            if (!IsEstimatorKind(_linkEstimator[linkIdx], (EstimatorKind)_config.linkLatEstimator))
+                _linkEstimator[linkIdx] = MakeEstimator<LinkLatEstimator>((EstimatorKind)_config.linkLatEstimator);
+        }
+        if (!getCheckpointRow(in, _linkLat, linkIdx, scratch))
+            return false;
+    }
+
+    return in.remaining() == 0;
+}
+
+/* Warm restart: restores the windows, link estimators and endpoints of
+ * a checkpoint file written by an earlier run
+ * Windows of another size keep their newest samples. Only possible
+ * before any switch has been seen (i.e. before the sniff loop starts);
+ * returns false otherwise, or if the file is missing or corrupt (in
+ * which case nothing is restored).
+ */
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::loadCheckpoint(const string& path) {
+    if (!_endpoints.empty())
+        return false;
+
+    vector<uint8_t> payload;
+    uint64_t createdUs;
+    if (!CheckpointWriter::readFile(path, payload, createdUs))
+        return false;
+
+    // Checked first, so a bad file leaves the tables as they were
+    CheckpointReader check(payload);
+    if (!checkCheckpoint(check)) {
+        cout << "ERROR: Checkpoint file " << path << " is inconsistent" << endl;
+        return false;
+    }
+
+    CheckpointReader in(payload);
+    return restoreCheckpoint(in);
+}
+
+/* Counts every OpenFlow message whose header starts in the given TCP
+ * segment (direction given by toSwitch), continuing messages that
+ * started in earlier segments of the same direction, and times
+ * request/reply transactions by xid
+ * Returns true if the payload starts with a complete message header.
+ *
+ * Messages are framed by TCP sequence number, so retransmitted Bytes aren't
+ * counted twice and a gap (lost or filtered segments) resynchronizes on
+ * the next segment. seg.payloadLen Bytes are readable at payload, the rest
+ * up to seg.wireLen was cut off by the snapshot length.
+ */
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::processOFHeaders(const Timestamp& ts, const IPv4EndpointType dpEndpoint,
+                                                             const TCPSegment& seg, const uint8_t* payload,
+                                                             const bool toSwitch) {
+    LatencyMetadata& latMeta = _endpoints[internEndpoint(dpEndpoint)];
+    OFTrafficMetadata& traffic = latMeta.ofTraffic;
+    uint64_t tsUs = TimestampToUs(ts);
+    uint16_t dir = toSwitch ? OF_TO_SWITCH : OF_FROM_SWITCH;
+    uint32_t len = std::min(seg.payloadLen, seg.wireLen);
+    uint32_t offset = 0;
+
+    if (traffic.inSync[dir]) {
+        // Offset of the next Byte needed: a header, or the rest of a partial one
+        int32_t ahead = (int32_t)(traffic.nextHeaderSeq[dir] + traffic.partialLen[dir] - seg.seq);
+        if (ahead < 0)
+            traffic.inSync[dir] = false;
+        else if ((uint32_t)ahead >= seg.wireLen)
+            return false; // Retransmission, or the middle of a message counted earlier
+        else
+            offset = ahead;
+    }
+
+    // Out of sync: try the start of this segment
+    if (!traffic.inSync[dir]) {
+        traffic.inSync[dir] = true;
+        traffic.nextHeaderSeq[dir] = seg.seq;
+        traffic.partialLen[dir] = 0;
+    }
+
+    bool startsMessage = false;
+    uint8_t joined[OF_HEADER_LEN];
+    while (offset < seg.wireLen) {
+        uint8_t partialLen = traffic.partialLen[dir];
+        uint32_t avail = std::min<uint32_t>(OF_HEADER_LEN - partialLen, seg.wireLen - offset);
+        if (offset + avail > len)
+            break; // Header not captured
+
+        const uint8_t* header = payload + offset;
+        if (partialLen) {
+            memcpy(joined, traffic.partialHeader[dir], partialLen);
+            memcpy(joined + partialLen, header, avail);
+            header = joined;
+        }
+
+        // The header continues in the next segment
+        if (partialLen + avail < OF_HEADER_LEN) {
+            memcpy(traffic.partialHeader[dir], header, partialLen + avail);
+            traffic.partialLen[dir] = partialLen + avail;
+            return startsMessage;
+        }
+        traffic.partialLen[dir] = 0;
+
+        // Not on a message boundary (e.g. after lost segments)
+        uint16_t msgLen = (header[2] << 8) | header[3];
+        if (header[0] == 0 || header[0] > OF_MAX_VERSION || msgLen < OF_HEADER_LEN)
+            break;
+
+        if (offset == 0 && partialLen == 0)
+            startsMessage = true;
+
+        uint8_t type = std::min<uint8_t>(header[1], OF_TRAFFIC_TYPES - 1);
+        OFTypeCounter& counter = traffic.total.type[dir][type];
+        counter.msgs++;
+        counter.bytes += msgLen;
+
+        // Types not needed for latency measurements are only counted under overload
+        if (!_governor.shed(header[1])) {
+            // A joined header has no body Bytes following it
+            uint32_t msgAvail = partialLen ? OF_HEADER_LEN : std::min<uint32_t>(msgLen, len - offset);
+            OFTransactionKind kind;
+            double latency;
+            if (latMeta.ofTransactions.process(header, msgAvail, toSwitch, tsUs, kind, latency)) {
+                latMeta.version++;
+
+                // Controller-initiated echoes feed the echo RTT (as LLDP echoes do)
+                if (kind == OF_TXN_ECHO)
+                    updateEchoRTT(dpEndpoint, latency);
+            }
+        }
+
+        // May be beyond this segment; following segments skip up to there
+        traffic.nextHeaderSeq[dir] += msgLen;
+        offset = traffic.nextHeaderSeq[dir] - seg.seq;
+    }
+
+    // Leftover that can't be attributed; resynchronize on the next segment
+    if (offset < seg.wireLen) {
+        traffic.inSync[dir] = false;
+        traffic.unparsedBytes[dir] += seg.wireLen - offset;
+    }
+
+    return startsMessage;
+}
+
+/* Tracks TCP timestamps and sequence numbers of every segment of the
+ * endpoint's control connection (direction given by toSwitch)
+ */
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::processTCPSegment(const Timestamp& ts, const IPv4EndpointType dpEndpoint,
+                                                             const TCPSegment& seg, const bool toSwitch) {
+    LatencyMetadata& latMeta = _endpoints[internEndpoint(dpEndpoint)];
+    TCPFlowStats& stats = latMeta.tcpFlow.stats;
+
+    // A new connection starts a new byte stream; the old one ends with a reset
+    if (seg.flags & TCP_FLAG_RST) {
+        latMeta.ofTraffic.inSync[OF_TO_SWITCH] = false;
+        latMeta.ofTraffic.inSync[OF_FROM_SWITCH] = false;
+    } else if (seg.flags & TCP_FLAG_SYN) {
+        latMeta.ofTraffic.inSync[toSwitch ? OF_TO_SWITCH : OF_FROM_SWITCH] = false;
+    }
+
+    if (seg.flags & (TCP_FLAG_FIN | TCP_FLAG_RST)) {
+        if (latMeta.connState == EP_CONN_UP) {
+            latMeta.connState = EP_CONN_DOWN;
+            _observers.endpointDown(dpEndpoint);
+        }
+    } else if (latMeta.connState == EP_CONN_UNSEEN ||
+                (latMeta.connState == EP_CONN_DOWN && (seg.flags & TCP_FLAG_SYN))) {
+        latMeta.connState = EP_CONN_UP;
+        _observers.endpointUp(dpEndpoint);
+    }
+
+    uint32_t inFlightToSwitch = stats.inFlight[OF_TO_SWITCH];
+    uint32_t inFlightFromSwitch = stats.inFlight[OF_FROM_SWITCH];
+    OFDirection rttDir;
+    double rtt;
+
+    bool rttSample = latMeta.tcpFlow.process(seg, toSwitch, TimestampToUs(ts), rttDir, rtt);
+    if (rttSample || stats.inFlight[OF_TO_SWITCH] != inFlightToSwitch ||
+            stats.inFlight[OF_FROM_SWITCH] != inFlightFromSwitch)
+        latMeta.version++;
+
+    if (rttSample) {
+        _observers.sample(dpEndpoint, rttDir == OF_TO_SWITCH ? OBS_METRIC_TCP_RTT_TO_SWITCH :
+                                                                OBS_METRIC_TCP_RTT_FROM_SWITCH, 0, rtt);
+    }
+}
+
+// Returns true if the current traffic interval has elapsed
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::trafficIntervalDue(const Timestamp& ts) {
+    return CalcTimestampDiff(_lastTrafficTs, ts) >= OF_TRAFFIC_INTERVAL_MS;
+}
+
+/* Closes the current traffic interval of all endpoints and publishes
+ * their counters and sliding-window rates for getOFTraffic()
+ * Also expires transactions whose reply was never seen, and closes
+ * the bytes-in-flight peak interval.
+ */
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::closeTrafficInterval(const Timestamp& ts) {
+    _lastTrafficTs = ts;
+    _trafficStatsBack.resize(_endpoints.size());
+    uint64_t tsUs = TimestampToUs(ts);
+
+    for (uint32_t epIdx = 0; epIdx < _endpoints.size(); epIdx++) {
+        LatencyMetadata& latMeta = _endpoints[epIdx];
+        latMeta.ofTransactions.expire(tsUs);
+        latMeta.tcpFlow.closeInterval();
+
+        OFTrafficMetadata& traffic = latMeta.ofTraffic;
+
+        // Append the cumulative counters to the window, overwriting the oldest
+        uint16_t newest, oldest;
+        if (traffic.windowLen < OF_TRAFFIC_WINDOW) {
+            newest = traffic.windowLen++;
+            oldest = 0;
+        } else {
+            newest = traffic.windowHead;
+            traffic.windowHead = (traffic.windowHead + 1) % OF_TRAFFIC_WINDOW;
+            oldest = traffic.windowHead;
+        }
+        traffic.window[newest] = traffic.total;
+        traffic.windowTs[newest] = ts;
+
+        OFTrafficStats& stats = _trafficStatsBack[epIdx];
+        stats.endpoint = _endpointKeys[epIdx];
+        stats.total = traffic.total;
+        stats.unparsedBytes[OF_FROM_SWITCH] = traffic.unparsedBytes[OF_FROM_SWITCH];
+        stats.unparsedBytes[OF_TO_SWITCH] = traffic.unparsedBytes[OF_TO_SWITCH];
+        stats.windowSec = CalcTimestampDiff(traffic.windowTs[oldest], ts) / THOUSAND;
+
+        for (uint16_t dir = 0; dir < NUM_OF_DIRECTIONS; dir++) {
+            for (uint16_t type = 0; type < OF_TRAFFIC_TYPES; type++) {
+                OFTypeRate& rate = stats.rate[dir][type];
+                if (stats.windowSec > 0) {
+                    const OFTypeCounter& from = traffic.window[oldest].type[dir][type];
+                    const OFTypeCounter& to = traffic.window[newest].type[dir][type];
+                    rate.msgsPerSec = (to.msgs - from.msgs) / stats.windowSec;
+                    rate.bytesPerSec = (to.bytes - from.bytes) / stats.windowSec;
+                } else {
+                    rate.msgsPerSec = 0;
+                    rate.bytesPerSec = 0;
+                }
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_trafficMutex);
+    _trafficStats.swap(_trafficStatsBack);
+}
+
+// Counters and rates of all endpoints, as of the last closed interval
+template <class Policy>
+vector<OFTrafficStats> BasicEndpointLatencyMetadata<Policy>::getOFTraffic() const {
+    std::lock_guard<std::mutex> lock(_trafficMutex);
+    return _trafficStats;
+}
+
+// Returns false if the endpoint has no closed interval yet
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::getOFTraffic(const IPv4EndpointType dpEndpoint,
+                                                         OFTrafficStats& stats) const {
+    std::lock_guard<std::mutex> lock(_trafficMutex);
+    for (const OFTrafficStats& s : _trafficStats) {
+        if (s.endpoint == dpEndpoint) {
+            stats = s;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Human-readable counters and rates of all endpoints, by message type
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::dumpOFTraffic(std::ostream& os) const {
+    vector<OFTrafficStats> allStats = getOFTraffic();
+    os << "OpenFlow traffic (rates over up to the last " <<
+        OF_TRAFFIC_WINDOW * OF_TRAFFIC_INTERVAL_MS / THOUSAND << " s):" << endl;
+
+    for (const OFTrafficStats& stats : allStats) {
+        for (uint16_t dir = 0; dir < NUM_OF_DIRECTIONS; dir++) {
+            for (uint16_t type = 0; type < OF_TRAFFIC_TYPES; type++) {
+                const OFTypeCounter& total = stats.total.type[dir][type];
+                if (total.msgs == 0)
+                    continue;
+
+                const OFTypeRate& rate = stats.rate[dir][type];
+                os << "  " << std::left << std::setw(22) << EndpointToString(stats.endpoint) <<
+                    std::setw(13) << (dir == OF_TO_SWITCH ? "to_switch" : "from_switch") <<
+                    std::setw(25) << OFTypeName(type) << std::right <<
+                    std::setw(12) << total.msgs << " msgs" <<
+                    std::setw(14) << total.bytes << " B" << std::fixed << std::setprecision(1) <<
+                    std::setw(10) << rate.msgsPerSec << " msg/s" <<
+                    std::setw(12) << rate.bytesPerSec << " B/s" << endl;
+                os.unsetf(std::ios::floatfield);
+            }
+        }
+    }
+}
+
+/* Copies request/reply latency statistics of all transaction kinds
+ * into 'stats' (NUM_OF_TXN_KINDS entries)
+ * Returns false if the endpoint is unknown.
+ */
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::getTransactionStats(const IPv4EndpointType dpEndpoint,
+                                                                 OFTransactionStats* stats) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    if (epIdx == NO_INDEX)
+        return false;
+
+    memcpy(stats, _endpoints[epIdx].ofTransactions.stats, sizeof(OFTransactionStats) * NUM_OF_TXN_KINDS);
+    return true;
+}
+
+/* Copies transport RTT and bytes-in-flight statistics into 'stats'
+ * Returns false if the endpoint is unknown.
+ */
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::getTCPStats(const IPv4EndpointType dpEndpoint, TCPFlowStats& stats) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    if (epIdx == NO_INDEX)
+        return false;
+
+    stats = _endpoints[epIdx].tcpFlow.stats;
+    return true;
+}
+
+/* Returns true if the endpoint's LLDP probe message should be
+ * processed, false if the overload governor skips it
+ */
+template <class Policy>
+bool BasicEndpointLatencyMetadata<Policy>::sampleProbe(const IPv4EndpointType dpEndpoint,
+                                                        const string& packetID) {
+    LatencyMetadata& latMeta = _endpoints[internEndpoint(dpEndpoint)];
+    uint8_t level = _governor.level();
+    if (latMeta.probeLevel != level) {
+        latMeta.probeLevel = level;
+        latMeta.version++;
+    }
+
+    if (_governor.keepProbe(packetID))
+        return true;
+
+    latMeta.probesSkipped++;
+    latMeta.version++;
+    return false;
+}
+
 // Returns by ref
 // TODO: Re-evaluate need for this, remove this function when new accessors added
-PacketSeenType& EndpointLatencyMetadata::getPacketSeenMap(IPv4EndpointType dpEndpoint) {
-    return _endpoint2LatMeta[dpEndpoint].packetSeen;
+template <class Policy>
+PacketSeenType& BasicEndpointLatencyMetadata<Policy>::getPacketSeenMap(IPv4EndpointType dpEndpoint) {
+    return _endpoints[internEndpoint(dpEndpoint)].packetSeen;
 }
 
-void EndpointLatencyMetadata::addOutstandingPkt(const IPv4EndpointType dpEndpoint,
-                        const uint16_t port_no, const string& packetID) {
-    vector<string>& vPacketIDs = _endpoint2LatMeta[dpEndpoint].outstandingPkts[port_no];
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::addOutstandingPkt(const IPv4EndpointType dpEndpoint,
+                                     const uint16_t port_no, const string& packetID) {
+    uint32_t epIdx = internEndpoint(dpEndpoint);
+    LatencyMetadata& latMeta = _endpoints[epIdx];
+    latMeta.lastActive = ++_activityTick;
+
+    auto it = latMeta.outstandingPkts.find(port_no);
+    if (it == latMeta.outstandingPkts.end()) {
+        OutstandingIDs empty(latMeta.outstandingPkts.get_allocator());
+        it = latMeta.outstandingPkts.emplace(port_no, std::move(empty)).first;
+    }
+
+    OutstandingIDs& vPacketIDs = it->second;
     vPacketIDs.push_back(packetID);
+    latMeta.memory.charge(StringHeapBytes(vPacketIDs.back()));
+    latMeta.probesSent++;
+    latMeta.version++;
+    bump(_counters.probesSent);
 
     /* Check if outstanding packets over limit. If so, clean up from packetSeen.
+     * More than one over after the limit was lowered, see reconfigure().
      * TODO: Think about if this should be done within this function, or some
      *       other clean-up thread...
      */
-    if (vPacketIDs.size() > MAX_OUTSTANDING_PKTS) {
-        _endpoint2LatMeta[dpEndpoint].packetSeen.erase(vPacketIDs.front());
+    while (vPacketIDs.size() > maxOutstandingPkts()) {
+        latMeta.packetSeen.erase(vPacketIDs.front());
+        latMeta.memory.release(StringHeapBytes(vPacketIDs.front()));
         vPacketIDs.erase(vPacketIDs.begin());
+        latMeta.probesExpired++;
+        bump(_counters.probesExpired);
     }
 
+    // Probe tables are the only metadata that grows without new switches or links
+    if (_memory.over())
+        enforceMemoryBudget(epIdx);
 }
 
-void EndpointLatencyMetadata::remOutstandingPkt(const IPv4EndpointType dpEndpoint,
-                        const uint16_t port_no, const string& packetID) {
-    vector<string>& vPacketIDs = _endpoint2LatMeta[dpEndpoint].outstandingPkts[port_no];
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::remOutstandingPkt(const IPv4EndpointType dpEndpoint,
+                                     const uint16_t port_no, const string& packetID) {
+    LatencyMetadata& latMeta = _endpoints[internEndpoint(dpEndpoint)];
+    latMeta.lastActive = ++_activityTick;
+
+    auto portIt = latMeta.outstandingPkts.find(port_no);
+    if (portIt == latMeta.outstandingPkts.end())
+        return;
+
+    OutstandingIDs& vPacketIDs = portIt->second;
     for (auto it = vPacketIDs.begin(); it != vPacketIDs.end(); it++)
         if (*it == packetID) {
+            latMeta.memory.release(StringHeapBytes(*it));
             vPacketIDs.erase(it);
+            latMeta.probesMatched++;
+            bump(_counters.probesMatched);
             break;
         }
 }
 
-void EndpointLatencyMetadata::updateEchoRTT(const IPv4EndpointType dpEndpoint, const double rtt) {
-    LatencyMetadata& latMeta = _endpoint2LatMeta[dpEndpoint];
-    updateStats(latMeta.echoRTTSamples, ECHO_RTT_WINDOW, rtt,
-                latMeta.echoRTTAvg, latMeta.echoRTTVar, latMeta.echoRTTMed);
+/* Gives up on all outstanding probes of the endpoint and frees its
+ * probe tables, returns the number of probes given up on
+ */
+template <class Policy>
+uint64_t BasicEndpointLatencyMetadata<Policy>::compactEndpoint(const uint32_t epIdx) {
+    LatencyMetadata& latMeta = _endpoints[epIdx];
+    uint64_t shed = 0;
+
+    for (auto& port : latMeta.outstandingPkts) {
+        for (const string& packetID : port.second)
+            latMeta.memory.release(StringHeapBytes(packetID));
+        shed += port.second.size();
+    }
+
+    OutstandingPktsType empty(0, latMeta.outstandingPkts.hash_function(),
+                                latMeta.outstandingPkts.key_eq(),
+                                latMeta.outstandingPkts.get_allocator());
+    latMeta.outstandingPkts.swap(empty);
+    latMeta.packetSeen.clear();
+
+    latMeta.probesExpired += shed;
+    latMeta.version++;
+    bump(_counters.probesExpired, shed);
+    _memory.countCompaction(shed);
+    return shed;
+}
+
+/* Compacts the endpoints whose probes were least recently active until
+ * memory usage is within the budget; the active endpoint goes last
+ */
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::enforceMemoryBudget(const uint32_t activeIdx) {
+    _compactOrder.clear();
+    for (uint32_t epIdx = 0; epIdx < _endpoints.size(); epIdx++) {
+        if (epIdx != activeIdx && !_endpoints[epIdx].outstandingPkts.empty())
+            _compactOrder.push_back(epIdx);
+    }
+
+    std::sort(_compactOrder.begin(), _compactOrder.end(), [this](uint32_t a, uint32_t b) {
+        return _endpoints[a].lastActive < _endpoints[b].lastActive;
+    });
+    _compactOrder.push_back(activeIdx);
+
+    for (uint32_t epIdx : _compactOrder) {
+        if (!_memory.over())
+            break;
+
+        uint64_t shed = compactEndpoint(epIdx);
+        _diagnostics.report(DIAG_MEMORY_BUDGET, _endpointKeys[epIdx], shed, _memory.used());
+    }
+}
+
+/* Feeds a sample to a change detector, publishing detected changes to
+ * the observers and counting them against the endpoint
+ */
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::detectChange(ChangeDetector& detector,
+                            const IPv4EndpointType dpEndpoint, const ObserverMetric metric,
+                            const uint16_t port_no, const double sample, LatencyMetadata& latMeta) {
+    ChangeSensitivity sens = _observers.changeSensitivity(metric);
+    if (sens.cusum <= 0 && sens.ewma <= 0)
+        return;
+
+    ChangeDirection dir = detector.update(sample, sens);
+    if (dir == CHANGE_NONE)
+        return;
+
+    latMeta.changePoints++;
+    _observers.changePoint(dpEndpoint, metric, port_no, detector.level(), detector.baseline(),
+                            dir == CHANGE_UP);
+}
+
+// Datapath ID from the switch's FeaturesReply, identifies it across sniffers
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::setDatapathID(const IPv4EndpointType dpEndpoint,
+                                                          const uint64_t datapathID) {
+    LatencyMetadata& latMeta = _endpoints[internEndpoint(dpEndpoint)];
+    if (latMeta.datapathID != datapathID) {
+        latMeta.datapathID = datapathID;
+        latMeta.version++;
+    }
+}
+
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::updateEchoRTT(const IPv4EndpointType dpEndpoint, const double rtt) {
+    STAGE_TIMER(STAGE_UPDATE_STATS);
+    uint32_t epIdx = internEndpoint(dpEndpoint);
+    _echoRTT.update(epIdx, rtt);
+    _echoRTT.hist[epIdx].add(rtt);
+    _echoEstimator[epIdx].update(rtt);
+    _endpoints[epIdx].version++;
+    if (_rollupsEnabled) {
+        std::lock_guard<std::mutex> lock(_rollupMutex);
+        _echoRollups.add(epIdx, rtt);
+    }
+
+    if (_shmTable.isOpen()) {
+        _shmTable.publish(dpEndpoint, SHM_METRIC_ECHO_RTT, 0, _echoRTT.hist[epIdx].count,
+                            _echoRTT.avg[epIdx], _echoRTT.var[epIdx], _echoRTT.med[epIdx], rtt);
+    }
+
+    _observers.sample(dpEndpoint, OBS_METRIC_ECHO_RTT, 0, rtt);
+    detectChange(_echoChange[epIdx], dpEndpoint, OBS_METRIC_ECHO_RTT, 0, rtt, _endpoints[epIdx]);
 
     if (_statsLog.is_open()) {
+        STAGE_TIMER(STAGE_STATS_LOG);
         _statsLog << dpEndpoint << " EchoRTT " << rtt << " " <<
-            latMeta.echoRTTAvg << " " << latMeta.echoRTTVar << endl;
+            _echoRTT.avg[epIdx] << " " << _echoRTT.var[epIdx] << endl;
     }
 }
 
-void EndpointLatencyMetadata::updatePktInRTT(const IPv4EndpointType dpEndpoint, const double rtt) {
-    LatencyMetadata& latMeta = _endpoint2LatMeta[dpEndpoint];
-    updateStats(latMeta.pktInRTTSamples, PKT_IN_RTT_WINDOW, rtt,
-                latMeta.pktInRTTAvg, latMeta.pktInRTTVar, latMeta.pktInRTTMed);
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::updatePktInRTT(const IPv4EndpointType dpEndpoint, const double rtt) {
+    STAGE_TIMER(STAGE_UPDATE_STATS);
+    uint32_t epIdx = internEndpoint(dpEndpoint);
+    _pktInRTT.update(epIdx, rtt);
+    _pktInRTT.hist[epIdx].add(rtt);
+    _pktInEstimator[epIdx].update(rtt);
+    _endpoints[epIdx].version++;
+    if (_rollupsEnabled) {
+        std::lock_guard<std::mutex> lock(_rollupMutex);
+        _pktInRollups.add(epIdx, rtt);
+    }
+
+    if (_shmTable.isOpen()) {
+        _shmTable.publish(dpEndpoint, SHM_METRIC_PKT_IN_RTT, 0, _pktInRTT.hist[epIdx].count,
+                            _pktInRTT.avg[epIdx], _pktInRTT.var[epIdx], _pktInRTT.med[epIdx], rtt,
+                            probeSampleShift(_endpoints[epIdx]));
+    }
+
+    _observers.sample(dpEndpoint, OBS_METRIC_PKT_IN_RTT, 0, rtt);
+    detectChange(_pktInChange[epIdx], dpEndpoint, OBS_METRIC_PKT_IN_RTT, 0, rtt, _endpoints[epIdx]);
 
     if (_statsLog.is_open()) {
+        STAGE_TIMER(STAGE_STATS_LOG);
         _statsLog << dpEndpoint << " PktInRTT " << rtt << " " <<
-            latMeta.pktInRTTAvg << " " << latMeta.pktInRTTVar << endl;
+            _pktInRTT.avg[epIdx] << " " << _pktInRTT.var[epIdx] << endl;
     }
 }
 
-void EndpointLatencyMetadata::updateLinkLat(const IPv4EndpointType dpEndpoint,
-                    const uint16_t port_no, const double latEstimate) {
-    /* Since the latency estimate is the result of a subtraction operation
-     * involving other estimated values, it can potentially be 0. Using medians
-     * may potentially result in 0 as well.
-     *
-     * Thus we use SRTT (aka exponential moving average or low-pass filter) to
-     * smooth out the reuslts while avoiding the likelihood of 0.
-     *
-     * TODO: Consider using DEMA over EMA for faster response time?
-     * TODO: Consider some way to adjust coefficient (the 0.125) dynamically?
+template <class Policy>
+void BasicEndpointLatencyMetadata<Policy>::updateLinkLat(const IPv4EndpointType dpEndpoint,
+                                 const uint16_t port_no, const double latEstimate) {
+    STAGE_TIMER(STAGE_UPDATE_STATS);
+
+    /* The raw estimate is smoothed by the policy's estimator (of the kind
+     * set in the LatencyConfig, EMA by default; see LatencyEstimators.h)
      */
-    LatencyMetadata& epLatMeta = _endpoint2LatMeta[dpEndpoint];
-    LinkLatMetadata& linkLatMeta = epLatMeta.linkLatMeta[port_no];
-    if (linkLatMeta.linkLatSRTT == 0)
-        linkLatMeta.linkLatSRTT = latEstimate; // Avoid slow convergence at start
+    uint32_t epIdx = internEndpoint(dpEndpoint);
+    uint32_t linkIdx = internLink(epIdx, port_no);
+    double srtt = _linkEstimator[linkIdx].update(latEstimate);
+
+    /* Calculate stats based on smoothed samples */
+    _linkLat.update(linkIdx, srtt);
+    _linkLat.hist[linkIdx].add(latEstimate);
+    _endpoints[epIdx].version++;
+    if (_rollupsEnabled) {
+        std::lock_guard<std::mutex> lock(_rollupMutex);
+        _linkRollups.add(linkIdx, latEstimate); // Raw estimates, as the histogram
+    }
+
+    if (_shmTable.isOpen()) {
+        _shmTable.publish(dpEndpoint, SHM_METRIC_LINK_LAT, port_no, _linkLat.hist[linkIdx].count,
+                            _linkLat.avg[linkIdx], _linkLat.var[linkIdx],
+                            _linkLat.med[linkIdx], srtt, probeSampleShift(_endpoints[epIdx]));
+    }
 
-    linkLatMeta.linkLatSRTT = linkLatMeta.linkLatSRTT + \
-                             0.125 * (latEstimate - linkLatMeta.linkLatSRTT);
+    // Observers get the smoothed estimate, as kept in the window
+    _observers.sample(dpEndpoint, OBS_METRIC_LINK_LAT, port_no, srtt);
 
-    /* Calculate stats based on SRTT samples */
-    updateStats(linkLatMeta.linkLatSamples, LINK_LAT_WINDOW, linkLatMeta.linkLatSRTT,
-                linkLatMeta.linkLatAvg, linkLatMeta.linkLatVar, linkLatMeta.linkLatMed);
+    // Changes are detected on the raw estimates, the smoothing would only delay them
+    detectChange(_linkChange[linkIdx], dpEndpoint, OBS_METRIC_LINK_LAT, port_no, latEstimate,
+                    _endpoints[epIdx]);
 
     if (_statsLog.is_open()) {
+        STAGE_TIMER(STAGE_STATS_LOG);
         _statsLog << dpEndpoint << " LinkLatRTT-Port" << port_no <<
-            " " << latEstimate << " " << linkLatMeta.linkLatAvg <<
-            " " << linkLatMeta.linkLatVar << endl;
+            " " << latEstimate << " " << _linkLat.avg[linkIdx] <<
+            " " << _linkLat.var[linkIdx] << endl;
     }
 }
 
-double EndpointLatencyMetadata::getEchoRTTAvg(const IPv4EndpointType dpEndpoint) {
-    return _endpoint2LatMeta[dpEndpoint].echoRTTAvg;
+/* The getters below return 0 for endpoints and links that haven't been
+ * seen yet, without adding them
+ */
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getEchoRTTAvg(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _echoRTT.avg[epIdx];
+}
+
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getPktInRTTAvg(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _pktInRTT.avg[epIdx];
+}
+
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getEchoRTTVar(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _echoRTT.var[epIdx];
 }
 
-double EndpointLatencyMetadata::getPktInRTTAvg(const IPv4EndpointType dpEndpoint) {
-    return _endpoint2LatMeta[dpEndpoint].pktInRTTAvg;
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getPktInRTTVar(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _pktInRTT.var[epIdx];
 }
 
-double EndpointLatencyMetadata::getEchoRTTVar(const IPv4EndpointType dpEndpoint) {
-    return _endpoint2LatMeta[dpEndpoint].echoRTTVar;
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getEchoRTTMed(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _echoRTT.med[epIdx];
 }
 
-double EndpointLatencyMetadata::getPktInRTTVar(const IPv4EndpointType dpEndpoint) {
-    return _endpoint2LatMeta[dpEndpoint].pktInRTTVar;
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getPktInRTTMed(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _pktInRTT.med[epIdx];
 }
 
-double EndpointLatencyMetadata::getEchoRTTMed(const IPv4EndpointType dpEndpoint) {
-    return _endpoint2LatMeta[dpEndpoint].echoRTTMed;
+// Current values of the metrics' estimators (see LatencyConfig)
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getEchoRTTSmoothed(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _echoEstimator[epIdx].value();
 }
 
-double EndpointLatencyMetadata::getPktInRTTMed(const IPv4EndpointType dpEndpoint) {
-    return _endpoint2LatMeta[dpEndpoint].pktInRTTMed;
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getPktInRTTSmoothed(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _pktInEstimator[epIdx].value();
+}
+
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getLinkLatSmoothed(const IPv4EndpointType dpEndpoint,
+                                                                 const uint16_t port_no) {
+    uint32_t linkIdx = findLink(dpEndpoint, port_no);
+    return linkIdx == NO_INDEX ? 0 : _linkEstimator[linkIdx].value();
 }
 
 // TODO: Input should really be a pair of endpoints
-double EndpointLatencyMetadata::getLinkLatAvg(const IPv4EndpointType dpEndpoint, const uint16_t port_no) {
-    return _endpoint2LatMeta[dpEndpoint].linkLatMeta[port_no].linkLatAvg;
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getLinkLatAvg(const IPv4EndpointType dpEndpoint, const uint16_t port_no) {
+    uint32_t linkIdx = findLink(dpEndpoint, port_no);
+    return linkIdx == NO_INDEX ? 0 : _linkLat.avg[linkIdx];
 }
 
 // TODO: Input should really be a pair of endpoints
-double EndpointLatencyMetadata::getLinkLatVar(const IPv4EndpointType dpEndpoint, const uint16_t port_no) {
-    return _endpoint2LatMeta[dpEndpoint].linkLatMeta[port_no].linkLatVar;
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getLinkLatVar(const IPv4EndpointType dpEndpoint, const uint16_t port_no) {
+    uint32_t linkIdx = findLink(dpEndpoint, port_no);
+    return linkIdx == NO_INDEX ? 0 : _linkLat.var[linkIdx];
 }
 
 // TODO: Input should really be a pair of endpoints
-double EndpointLatencyMetadata::getLinkLatMed(const IPv4EndpointType dpEndpoint, const uint16_t port_no) {
-    return _endpoint2LatMeta[dpEndpoint].linkLatMeta[port_no].linkLatMed;
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getLinkLatMed(const IPv4EndpointType dpEndpoint, const uint16_t port_no) {
+    uint32_t linkIdx = findLink(dpEndpoint, port_no);
+    return linkIdx == NO_INDEX ? 0 : _linkLat.med[linkIdx];
+}
+
+template <class Policy>
+uint64_t BasicEndpointLatencyMetadata<Policy>::getProbesSent(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _endpoints[epIdx].probesSent;
+}
+
+template <class Policy>
+uint64_t BasicEndpointLatencyMetadata<Policy>::getProbesMatched(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _endpoints[epIdx].probesMatched;
+}
+
+template <class Policy>
+uint64_t BasicEndpointLatencyMetadata<Policy>::getProbesExpired(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _endpoints[epIdx].probesExpired;
 }
 
-vector<IPv4EndpointType> EndpointLatencyMetadata::getEndpoints() {
-    vector<IPv4EndpointType> keys;
-    for (auto it : _endpoint2LatMeta)
-        keys.push_back(it.first);
+template <class Policy>
+uint64_t BasicEndpointLatencyMetadata<Policy>::getProbesSkipped(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _endpoints[epIdx].probesSkipped;
+}
+
+// Share of probes processed when the endpoint's last probe message was seen
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getProbeSampleRate(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return OverloadGovernor::sampleRateOf(epIdx == NO_INDEX ? 0 : _endpoints[epIdx].probeLevel);
+}
 
-    return keys;
+// Bytes charged to the endpoint (see MemoryAccounting.h)
+template <class Policy>
+uint64_t BasicEndpointLatencyMetadata<Policy>::getMemoryBytes(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _endpoints[epIdx].memory.bytes();
 }
 
-double EndpointLatencyMetadata::getDp2CtrlRTT(IPv4EndpointType dpEndpoint) {
+// 0 until the switch's FeaturesReply was seen
+template <class Policy>
+uint64_t BasicEndpointLatencyMetadata<Policy>::getDatapathID(const IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    return epIdx == NO_INDEX ? 0 : _endpoints[epIdx].datapathID;
+}
+
+// In the order the endpoints were first seen
+template <class Policy>
+vector<IPv4EndpointType> BasicEndpointLatencyMetadata<Policy>::getEndpoints() {
+    return _endpointKeys;
+}
+
+template <class Policy>
+double BasicEndpointLatencyMetadata<Policy>::getDp2CtrlRTT(IPv4EndpointType dpEndpoint) {
+    uint32_t epIdx = findEndpoint(dpEndpoint);
+    if (epIdx == NO_INDEX)
+        return 0;
+
     // Total datapath to controller latencies
-    return _endpoint2LatMeta[dpEndpoint].echoRTTMed + _endpoint2LatMeta[dpEndpoint].pktInRTTMed;
+    return _echoRTT.med[epIdx] + _pktInRTT.med[epIdx];
 }
 
+template class BasicEndpointLatencyMetadata<DefaultLatencyPolicy>;
+template class BasicEndpointLatencyMetadata<RuntimeLatencyPolicy>;
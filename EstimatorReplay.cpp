@@ -0,0 +1,253 @@
+/* Compares the latency estimators (see LatencyEstimators.h) on a statistics
+ * log, as written when STATS_FILELOG is set in OFSniff.cpp: one
+ * "<ep> <metric> <data> <avg> <var>" line per sample. Every estimator is
+ * replayed on every stream (endpoint and metric) of raw samples, and scored on:
+ *  - pred_rmse: RMS error of the estimate as a prediction of the next sample
+ *  - track_rmse: RMS error against a centered running median of the samples,
+ *    i.e. how closely the estimate follows the level without its noise
+ *  - jitter: RMS change of the estimate between samples (its own variance)
+ *  - lag: mean samples until the estimate covers half of a level change
+ *    (changes as found by ChangeDetector.h with default sensitivity, from
+ *    where the reference median crossed halfway)
+ *
+ * Build and run with: make replay STATS_LOG=<file>
+ */
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "LatencyEstimators.h"
+#include "ChangeDetector.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+#define REPLAY_MEDIAN_HALF_WINDOW 4 // Samples on each side of the reference median
+#define REPLAY_MIN_SAMPLES 20 // Shorter streams are skipped
+#define REPLAY_LEVEL_SAMPLES 20 // Samples after a detected change its new level is taken from
+
+typedef struct Stream {
+    string name; // "<ep> <metric>"
+    vector<double> samples;
+} Stream;
+
+typedef struct LevelChange {
+    uint32_t onset;  // First sample of the new level
+    double midpoint; // Halfway between the old and the new level
+    bool up;
+} LevelChange;
+
+typedef struct Score {
+    uint64_t samples = 0;
+    double predSqErr = 0;
+    double trackSqErr = 0;
+    double jitterSq = 0;
+    uint64_t changes = 0;
+    uint64_t lagSum = 0;
+    uint64_t missed = 0; // Changes the estimate never covered half of
+
+    void add(const Score& other) {
+        samples += other.samples;
+        predSqErr += other.predSqErr;
+        trackSqErr += other.trackSqErr;
+        jitterSq += other.jitterSq;
+        changes += other.changes;
+        lagSum += other.lagSum;
+        missed += other.missed;
+    }
+} Score;
+
+// Centered running median of 'samples', shrinking at both ends
+static vector<double> centeredMedian(const vector<double>& samples) {
+    vector<double> ref(samples.size());
+    vector<double> window;
+    for (size_t i = 0; i < samples.size(); i++) {
+        size_t first = i < REPLAY_MEDIAN_HALF_WINDOW ? 0 : i - REPLAY_MEDIAN_HALF_WINDOW;
+        size_t last = std::min(samples.size() - 1, i + REPLAY_MEDIAN_HALF_WINDOW);
+        window.assign(samples.begin() + first, samples.begin() + last + 1);
+        std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+        ref[i] = window[window.size() / 2];
+    }
+
+    return ref;
+}
+
+/* Level changes of a stream: detected by a ChangeDetector, from its baseline
+ * to the median of the following samples, with their onset where the
+ * reference median crossed the midpoint before the detection
+ */
+static vector<LevelChange> findChanges(const vector<double>& samples, const vector<double>& ref) {
+    vector<LevelChange> changes;
+    ChangeDetector detector;
+    ChangeSensitivity sens = {CHANGE_DEFAULT_CUSUM, CHANGE_DEFAULT_EWMA};
+    uint32_t prev = 0;
+
+    for (uint32_t i = 0; i < samples.size(); i++) {
+        ChangeDirection dir = detector.update(samples[i], sens);
+        if (dir == CHANGE_NONE)
+            continue;
+
+        vector<double> after(samples.begin() + i,
+                                samples.begin() + std::min<size_t>(samples.size(), i + REPLAY_LEVEL_SAMPLES));
+        std::nth_element(after.begin(), after.begin() + after.size() / 2, after.end());
+
+        LevelChange change;
+        change.midpoint = (detector.baseline() + after[after.size() / 2]) / 2;
+        change.up = (dir == CHANGE_UP);
+        change.onset = i;
+        while (change.onset > prev &&
+                (change.up ? ref[change.onset - 1] > change.midpoint :
+                                ref[change.onset - 1] < change.midpoint))
+            change.onset--;
+
+        changes.push_back(change);
+        prev = i;
+    }
+
+    return changes;
+}
+
+static Score replay(const EstimatorKind kind, const vector<double>& samples,
+                    const vector<double>& ref, const vector<LevelChange>& changes) {
+    Score score;
+    LatencyEstimator estimator(kind);
+    vector<double> estimates(samples.size());
+
+    for (size_t i = 0; i < samples.size(); i++) {
+        if (i > 0) {
+            double err = samples[i] - estimator.value();
+            score.predSqErr += err * err;
+        }
+
+        estimates[i] = estimator.update(samples[i]);
+        double trackErr = estimates[i] - ref[i];
+        score.trackSqErr += trackErr * trackErr;
+        if (i > 0) {
+            double step = estimates[i] - estimates[i - 1];
+            score.jitterSq += step * step;
+        }
+    }
+    score.samples = samples.size();
+
+    for (size_t c = 0; c < changes.size(); c++) {
+        const LevelChange& change = changes[c];
+        size_t end = c + 1 < changes.size() ? changes[c + 1].onset : samples.size();
+        size_t i = change.onset;
+        while (i < end && (change.up ? estimates[i] < change.midpoint : estimates[i] > change.midpoint))
+            i++;
+
+        score.changes++;
+        if (i == end)
+            score.missed++;
+        else
+            score.lagSum += i - change.onset;
+    }
+
+    return score;
+}
+
+static void printScore(const EstimatorKind kind, const Score& score) {
+    double n = std::max<uint64_t>(score.samples, 2);
+    uint64_t covered = score.changes - score.missed;
+
+    cout << "  " << std::left << std::setw(14) << EstimatorName(kind) << std::right << std::fixed <<
+        std::setprecision(4) << std::setw(11) << std::sqrt(score.predSqErr / (n - 1)) <<
+        std::setw(11) << std::sqrt(score.trackSqErr / n) <<
+        std::setw(11) << std::sqrt(score.jitterSq / (n - 1));
+    if (covered)
+        cout << std::setprecision(1) << std::setw(9) << (double)score.lagSum / covered;
+    else
+        cout << std::setw(9) << "-";
+    if (score.missed)
+        cout << " (" << score.missed << " of " << score.changes << " changes missed)";
+    cout << endl;
+}
+
+static void printHeader() {
+    cout << "  " << std::left << std::setw(14) << "estimator" << std::right << std::setw(11) <<
+        "pred_rmse" << std::setw(11) << "track_rmse" << std::setw(11) << "jitter" <<
+        std::setw(9) << "lag" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        cout << "Usage: " << argv[0] << " <statistics log> [<metric prefix>]" << endl;
+        cout << "Replays every latency estimator on the raw samples of each endpoint and metric" << endl;
+        cout << "(e.g. metric prefix LinkLat for link latencies only), and compares their" << endl;
+        cout << "prediction and tracking errors (ms), jitter (ms) and lag on level changes (samples)" << endl;
+        return argc == 1 ? 0 : 1;
+    }
+
+    std::ifstream log(argv[1]);
+    if (!log.is_open()) {
+        cout << "ERROR: Could not open statistics log " << argv[1] << endl;
+        return 1;
+    }
+    string prefix = argc == 3 ? argv[2] : "";
+
+    // Streams in the order they first appear
+    vector<Stream> streams;
+    std::unordered_map<string, size_t> streamIndex;
+    string line;
+    uint64_t badLines = 0;
+    while (std::getline(log, line)) {
+        std::istringstream fields(line);
+        string endpoint, metric;
+        double data, avg, var;
+        if (!(fields >> endpoint >> metric >> data >> avg >> var)) {
+            badLines++;
+            continue;
+        }
+        if (metric.compare(0, prefix.length(), prefix) != 0)
+            continue;
+
+        string name = endpoint + " " + metric;
+        auto it = streamIndex.find(name);
+        if (it == streamIndex.end()) {
+            it = streamIndex.emplace(name, streams.size()).first;
+            streams.push_back({name, {}});
+        }
+        streams[it->second].samples.push_back(data);
+    }
+    if (badLines)
+        cout << "Skipped " << badLines << " malformed lines" << endl;
+
+    vector<Score> totals(NUM_ESTIMATOR_KINDS);
+    uint32_t replayed = 0;
+    for (const Stream& stream : streams) {
+        if (stream.samples.size() < REPLAY_MIN_SAMPLES)
+            continue;
+
+        vector<double> ref = centeredMedian(stream.samples);
+        vector<LevelChange> changes = findChanges(stream.samples, ref);
+        cout << stream.name << ": " << stream.samples.size() << " samples, " <<
+            changes.size() << " level changes" << endl;
+        printHeader();
+        for (uint8_t kind = 0; kind < NUM_ESTIMATOR_KINDS; kind++) {
+            Score score = replay((EstimatorKind)kind, stream.samples, ref, changes);
+            printScore((EstimatorKind)kind, score);
+            totals[kind].add(score);
+        }
+        replayed++;
+    }
+
+    if (replayed == 0) {
+        cout << "No stream with at least " << REPLAY_MIN_SAMPLES << " samples" << endl;
+        return 1;
+    }
+
+    cout << "All " << replayed << " streams:" << endl;
+    printHeader();
+    for (uint8_t kind = 0; kind < NUM_ESTIMATOR_KINDS; kind++)
+        printScore((EstimatorKind)kind, totals[kind]);
+
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include "IPv6Addresses.h"
+
+IPv6AddressTable::IPv6AddressTable() : _size(0) {};
+
+// The table used by GenIPv6Endpoint() and EndpointToString()
+IPv6AddressTable& IPv6AddressTable::global() {
+    static IPv6AddressTable table;
+    return table;
+}
+
+// Returns the ID of the address (16 Bytes), adding it if new; IPV6_NO_ID if full
+uint32_t IPv6AddressTable::intern(const uint8_t* addr) {
+    IPv6AddrBytes key;
+    memcpy(key.data(), addr, IPV6_ADDR_LEN);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _ids.find(key);
+    if (it != _ids.end())
+        return it->second;
+
+    uint32_t id = _size.load(std::memory_order_relaxed);
+    if (id >= IPV6_MAX_ADDRS)
+        return IPV6_NO_ID;
+
+    if (!_addrs)
+        _addrs.reset(new IPv6AddrBytes[IPV6_MAX_ADDRS]);
+
+    _addrs[id] = key;
+    _ids.emplace(key, id);
+    _size.store(id + 1, std::memory_order_release); // Publishes _addrs[id] to address()
+
+    return id;
+}
+
+// Returns the ID of the address, or IPV6_NO_ID if it was never interned
+uint32_t IPv6AddressTable::find(const uint8_t* addr) {
+    IPv6AddrBytes key;
+    memcpy(key.data(), addr, IPV6_ADDR_LEN);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _ids.find(key);
+    return (it != _ids.end()) ? it->second : IPV6_NO_ID;
+}
+
+// Copies the address with the given ID into 'addr' (16 Bytes), false if unknown
+bool IPv6AddressTable::address(const uint32_t id, uint8_t* addr) const {
+    if (id >= size())
+        return false;
+
+    memcpy(addr, _addrs[id].data(), IPV6_ADDR_LEN);
+    return true;
+}
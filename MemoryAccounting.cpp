@@ -0,0 +1,28 @@
+#include "MemoryAccounting.h"
+
+using std::endl;
+
+MemoryBudget::MemoryBudget() : _used(0), _peak(0), _budget(0), _compactions(0), _shedProbes(0) {};
+
+MemoryState MemoryBudget::state() const {
+    MemoryState state;
+    state.used = used();
+    state.peak = _peak.load(std::memory_order_relaxed);
+    state.budget = _budget.load(std::memory_order_relaxed);
+    state.compactions = _compactions.load(std::memory_order_relaxed);
+    state.shedProbes = _shedProbes.load(std::memory_order_relaxed);
+    return state;
+}
+
+// Human-readable usage and counters
+void MemoryBudget::dump(std::ostream& os) const {
+    MemoryState s = state();
+
+    os << "Memory: " << s.used << " Bytes of switch metadata (peak " << s.peak << "), budget ";
+    if (s.budget)
+        os << s.budget << " Bytes";
+    else
+        os << "unlimited";
+    os << "; " << s.compactions << " compactions, " << s.shedProbes <<
+        " outstanding probes given up on" << endl;
+}
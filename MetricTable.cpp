@@ -0,0 +1,137 @@
+#include "MetricTable.h"
+
+#include <cstring>
+
+// Adds a row to the statistics arrays, returns its index
+uint32_t MetricColumns::addColumns() {
+    _head.push_back(0);
+    _len.push_back(0);
+    avg.push_back(0);
+    var.push_back(0);
+    med.push_back(0);
+    hist.emplace_back();
+    memset(&hist.back(), 0, sizeof(LatencyHistogram));
+
+    return avg.size() - 1;
+}
+
+// Reserves the statistics arrays for 'rows' rows
+void MetricColumns::reserveColumns(const uint32_t rows) {
+    _head.reserve(rows);
+    _len.reserve(rows);
+    avg.reserve(rows);
+    var.reserve(rows);
+    med.reserve(rows);
+    hist.reserve(rows);
+}
+
+double MetricColumns::mean(const double* samples, const uint16_t n) {
+    double sum = 0;
+    for (uint16_t i = 0; i < n; i++)
+        sum += samples[i];
+
+    return sum / n;
+}
+
+// Sample (not population) variance
+double MetricColumns::variance(const double* samples, const uint16_t n, const double avg) {
+    double sum = 0, diff = 0;
+    for (uint16_t i = 0; i < n; i++) {
+        diff = samples[i] - avg;
+        sum += (diff * diff);
+    }
+
+    if (n > 1)
+        return sum / (n - 1);
+    else
+        return 0; // Can't divide by 0, so this is undefined
+}
+
+// Copies the row's samples into 'out', oldest first, returns how many
+uint16_t MetricColumns::copyRow(const uint32_t row, const double* ring, const uint16_t window,
+                                double* out) const {
+    uint16_t head = _head[row];
+    uint16_t len = _len[row];
+    for (uint16_t i = 0; i < len; i++)
+        out[i] = ring[(head + i) % window];
+
+    return len;
+}
+
+/* Refills the row's ring of 'window' samples with 'n' samples, oldest
+ * first, and recomputes its avg, var and med from scratch
+ * 'sorted' is scratch space for n samples.
+ */
+void MetricColumns::refillRow(const uint32_t row, double* ring, double* sorted, const uint16_t window,
+                                const double* in, const uint16_t n) {
+    _head[row] = 0;
+    _len[row] = n;
+    memcpy(ring, in, n * sizeof(double));
+    if (n < window)
+        memset(ring + n, 0, (window - n) * sizeof(double));
+
+    if (n == 0) {
+        avg[row] = var[row] = med[row] = 0;
+        return;
+    }
+
+    avg[row] = mean(in, n);
+    var[row] = variance(in, n, avg[row]);
+
+    memcpy(sorted, in, n * sizeof(double));
+    std::sort(sorted, sorted + n);
+    if (n % 2 == 0)
+        med[row] = (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    else
+        med[row] = sorted[n / 2];
+}
+
+MetricTable<0>::MetricTable(const uint16_t window) : _window(window), _sorted(window) {};
+
+// Only possible while the table has no rows, returns false otherwise
+bool MetricTable<0>::setWindow(const uint16_t window) {
+    if (rows())
+        return false;
+
+    _window = window;
+    _sorted.resize(window);
+    return true;
+}
+
+/* Changes the window of all rows in place: each keeps its newest
+ * samples (as many as fit), and its avg, var and med are recomputed
+ * from them; histograms are kept. Returns false if window < 2.
+ */
+bool MetricTable<0>::resizeWindow(const uint16_t window) {
+    if (window < 2)
+        return false;
+    if (window == _window)
+        return true;
+
+    vector<double> samples((size_t)rows() * window);
+    vector<double> kept(_window);
+    _sorted.resize(std::max(_window, window));
+    for (uint32_t row = 0; row < rows(); row++) {
+        uint16_t n = copyRow(row, &_samples[(size_t)row * _window], _window, kept.data());
+        uint16_t first = n > window ? n - window : 0;
+        refillRow(row, &samples[(size_t)row * window], _sorted.data(), window,
+                    kept.data() + first, n - first);
+    }
+
+    _samples.swap(samples);
+    _window = window;
+    _sorted.resize(window);
+    return true;
+}
+
+// Returns the index of a new, empty row
+uint32_t MetricTable<0>::addRow() {
+    _samples.resize(_samples.size() + _window, 0);
+    return addColumns();
+}
+
+// Reserves room for 'rows' rows, so adding them won't reallocate
+void MetricTable<0>::reserve(const uint32_t rows) {
+    _samples.reserve((size_t)rows * _window);
+    reserveColumns(rows);
+}
@@ -0,0 +1,489 @@
+#include "MetricsExporter.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "ThreadPlacement.h"
+
+using std::cout;
+using std::endl;
+
+#define ACCEPT_POLL_MS 250 // How often the serve loop checks for stop()
+#define MAX_REQUEST_LEN 4096
+
+/* ========== Render helpers ==========
+ * All helpers append to the output string, avoiding temporaries.
+ */
+static void appendLabels(string& out, const IPv4EndpointType endpoint,
+                            const int32_t port_no = -1, const char* le = nullptr) {
+    out += "{endpoint=\"";
+    out += EndpointToString(endpoint);
+    out += '"';
+    if (port_no >= 0) {
+        out += ",port=\"";
+        out += std::to_string(port_no);
+        out += '"';
+    }
+    if (le) {
+        out += ",le=\"";
+        out += le;
+        out += '"';
+    }
+    out += '}';
+}
+
+static void appendValue(string& out, const double val) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), " %.6g\n", val);
+    out += buf;
+}
+
+static void appendValue(string& out, const uint64_t val) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), " %llu\n", (unsigned long long)val);
+    out += buf;
+}
+
+static void appendHistogram(string& out, const char* name, const LatencyHistogram& hist,
+                            const IPv4EndpointType endpoint, const int32_t port_no = -1) {
+    char le[16];
+    uint64_t cumulative = 0;
+
+    for (uint16_t i = 0; i <= LAT_HIST_NUM_BOUNDS; i++) {
+        cumulative += hist.buckets[i];
+        if (i < LAT_HIST_NUM_BOUNDS)
+            snprintf(le, sizeof(le), "%g", LAT_HIST_BOUNDS[i]);
+        else
+            snprintf(le, sizeof(le), "+Inf");
+
+        out += name;
+        out += "_bucket";
+        appendLabels(out, endpoint, port_no, le);
+        appendValue(out, cumulative);
+    }
+
+    out += name;
+    out += "_sum";
+    appendLabels(out, endpoint, port_no);
+    appendValue(out, hist.sum);
+
+    out += name;
+    out += "_count";
+    appendLabels(out, endpoint, port_no);
+    appendValue(out, hist.count);
+}
+
+static void appendGauge(string& out, const char* name, const double val,
+                        const IPv4EndpointType endpoint, const int32_t port_no = -1) {
+    out += name;
+    appendLabels(out, endpoint, port_no);
+    appendValue(out, val);
+}
+
+/* ========== Per-endpoint metric families ========== */
+static void renderEchoAvg(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendGauge(out, "ofsniff_echo_rtt_avg_ms", ep.echoRTT.avg, ep.endpoint);
+}
+
+static void renderEchoSmoothed(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendGauge(out, "ofsniff_echo_rtt_smoothed_ms", ep.echoRTT.smoothed, ep.endpoint);
+}
+
+static void renderEchoVar(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendGauge(out, "ofsniff_echo_rtt_var", ep.echoRTT.var, ep.endpoint);
+}
+
+static void renderEchoMed(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendGauge(out, "ofsniff_echo_rtt_median_ms", ep.echoRTT.med, ep.endpoint);
+}
+
+static void renderEchoHist(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendHistogram(out, "ofsniff_echo_rtt_ms", ep.echoRTT.hist, ep.endpoint);
+}
+
+static void renderPktInAvg(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendGauge(out, "ofsniff_pktin_rtt_avg_ms", ep.pktInRTT.avg, ep.endpoint);
+}
+
+static void renderPktInSmoothed(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendGauge(out, "ofsniff_pktin_rtt_smoothed_ms", ep.pktInRTT.smoothed, ep.endpoint);
+}
+
+static void renderPktInVar(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendGauge(out, "ofsniff_pktin_rtt_var", ep.pktInRTT.var, ep.endpoint);
+}
+
+static void renderPktInMed(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendGauge(out, "ofsniff_pktin_rtt_median_ms", ep.pktInRTT.med, ep.endpoint);
+}
+
+static void renderPktInHist(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendHistogram(out, "ofsniff_pktin_rtt_ms", ep.pktInRTT.hist, ep.endpoint);
+}
+
+static void renderTCPSRTTToSwitch(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendGauge(out, "ofsniff_tcp_srtt_to_switch_ms", ep.tcp.rtt[OF_TO_SWITCH].srtt, ep.endpoint);
+}
+
+static void renderTCPRTTToSwitchHist(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendHistogram(out, "ofsniff_tcp_rtt_to_switch_ms", ep.tcp.rtt[OF_TO_SWITCH].hist, ep.endpoint);
+}
+
+static void renderTCPSRTTFromSwitch(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendGauge(out, "ofsniff_tcp_srtt_from_switch_ms", ep.tcp.rtt[OF_FROM_SWITCH].srtt, ep.endpoint);
+}
+
+static void renderTCPRTTFromSwitchHist(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendHistogram(out, "ofsniff_tcp_rtt_from_switch_ms", ep.tcp.rtt[OF_FROM_SWITCH].hist, ep.endpoint);
+}
+
+static void renderTCPInFlightToSwitch(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendGauge(out, "ofsniff_tcp_in_flight_to_switch_bytes", ep.tcp.inFlight[OF_TO_SWITCH], ep.endpoint);
+}
+
+static void renderTCPInFlightFromSwitch(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendGauge(out, "ofsniff_tcp_in_flight_from_switch_bytes", ep.tcp.inFlight[OF_FROM_SWITCH], ep.endpoint);
+}
+
+static void renderLinkSRTT(const StatsSnapshot& snap, const EndpointSnapshot& ep, string& out) {
+    for (uint32_t i = ep.firstLink; i < ep.firstLink + ep.numLinks; i++)
+        appendGauge(out, "ofsniff_link_latency_srtt_ms", snap.links[i].srtt,
+                    ep.endpoint, snap.links[i].port_no);
+}
+
+static void renderLinkAvg(const StatsSnapshot& snap, const EndpointSnapshot& ep, string& out) {
+    for (uint32_t i = ep.firstLink; i < ep.firstLink + ep.numLinks; i++)
+        appendGauge(out, "ofsniff_link_latency_avg_ms", snap.links[i].lat.avg,
+                    ep.endpoint, snap.links[i].port_no);
+}
+
+static void renderLinkVar(const StatsSnapshot& snap, const EndpointSnapshot& ep, string& out) {
+    for (uint32_t i = ep.firstLink; i < ep.firstLink + ep.numLinks; i++)
+        appendGauge(out, "ofsniff_link_latency_var", snap.links[i].lat.var,
+                    ep.endpoint, snap.links[i].port_no);
+}
+
+static void renderLinkMed(const StatsSnapshot& snap, const EndpointSnapshot& ep, string& out) {
+    for (uint32_t i = ep.firstLink; i < ep.firstLink + ep.numLinks; i++)
+        appendGauge(out, "ofsniff_link_latency_median_ms", snap.links[i].lat.med,
+                    ep.endpoint, snap.links[i].port_no);
+}
+
+static void renderLinkHist(const StatsSnapshot& snap, const EndpointSnapshot& ep, string& out) {
+    for (uint32_t i = ep.firstLink; i < ep.firstLink + ep.numLinks; i++)
+        appendHistogram(out, "ofsniff_link_latency_ms", snap.links[i].lat.hist,
+                        ep.endpoint, snap.links[i].port_no);
+}
+
+static void renderProbesSent(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    out += "ofsniff_probes_sent_total";
+    appendLabels(out, ep.endpoint);
+    appendValue(out, ep.probesSent);
+}
+
+static void renderProbesMatched(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    out += "ofsniff_probes_matched_total";
+    appendLabels(out, ep.endpoint);
+    appendValue(out, ep.probesMatched);
+}
+
+static void renderProbesExpired(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    out += "ofsniff_probes_expired_total";
+    appendLabels(out, ep.endpoint);
+    appendValue(out, ep.probesExpired);
+}
+
+static void renderProbesSkipped(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    out += "ofsniff_probes_skipped_total";
+    appendLabels(out, ep.endpoint);
+    appendValue(out, ep.probesSkipped);
+}
+
+static void renderProbeSampleRate(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    appendGauge(out, "ofsniff_probe_sample_rate", ep.probeSampleRate, ep.endpoint);
+}
+
+static void renderMemoryBytes(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    out += "ofsniff_memory_bytes";
+    appendLabels(out, ep.endpoint);
+    appendValue(out, ep.memoryBytes);
+}
+
+static void renderChangePoints(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    out += "ofsniff_latency_changes_total";
+    appendLabels(out, ep.endpoint);
+    appendValue(out, ep.changePoints);
+}
+
+static void renderSwitchInfo(const StatsSnapshot&, const EndpointSnapshot& ep, string& out) {
+    if (!ep.datapathID)
+        return;
+
+    out += "ofsniff_switch_info{endpoint=\"";
+    out += EndpointToString(ep.endpoint);
+    out += "\",dpid=\"";
+    out += DatapathIDToString(ep.datapathID);
+    out += "\"}";
+    appendValue(out, (uint64_t)1);
+}
+
+const MetricsExporter::MetricFamily MetricsExporter::FAMILIES[] = {
+    {"ofsniff_echo_rtt_avg_ms", "gauge", "Windowed average of controller <=> switch echo RTT", renderEchoAvg},
+    {"ofsniff_echo_rtt_smoothed_ms", "gauge", "Echo RTT estimate (of the configured estimator)", renderEchoSmoothed},
+    {"ofsniff_echo_rtt_var", "gauge", "Windowed sample variance of echo RTT (ms^2)", renderEchoVar},
+    {"ofsniff_echo_rtt_median_ms", "gauge", "Windowed median of echo RTT", renderEchoMed},
+    {"ofsniff_echo_rtt_ms", "histogram", "Distribution of all echo RTT samples", renderEchoHist},
+    {"ofsniff_pktin_rtt_avg_ms", "gauge", "Windowed average of PacketIn => PacketOut RTT", renderPktInAvg},
+    {"ofsniff_pktin_rtt_smoothed_ms", "gauge", "PacketIn RTT estimate (of the configured estimator)", renderPktInSmoothed},
+    {"ofsniff_pktin_rtt_var", "gauge", "Windowed sample variance of PacketIn RTT (ms^2)", renderPktInVar},
+    {"ofsniff_pktin_rtt_median_ms", "gauge", "Windowed median of PacketIn RTT", renderPktInMed},
+    {"ofsniff_pktin_rtt_ms", "histogram", "Distribution of all PacketIn RTT samples", renderPktInHist},
+    {"ofsniff_tcp_srtt_to_switch_ms", "gauge", "Smoothed TCP RTT of segments to the switch (capture point => switch => capture point)", renderTCPSRTTToSwitch},
+    {"ofsniff_tcp_rtt_to_switch_ms", "histogram", "Distribution of TCP RTT samples of segments to the switch", renderTCPRTTToSwitchHist},
+    {"ofsniff_tcp_srtt_from_switch_ms", "gauge", "Smoothed TCP RTT of segments from the switch (capture point => controller => capture point)", renderTCPSRTTFromSwitch},
+    {"ofsniff_tcp_rtt_from_switch_ms", "histogram", "Distribution of TCP RTT samples of segments from the switch", renderTCPRTTFromSwitchHist},
+    {"ofsniff_tcp_in_flight_to_switch_bytes", "gauge", "Unacknowledged Bytes sent to the switch", renderTCPInFlightToSwitch},
+    {"ofsniff_tcp_in_flight_from_switch_bytes", "gauge", "Unacknowledged Bytes sent by the switch", renderTCPInFlightFromSwitch},
+    {"ofsniff_link_latency_srtt_ms", "gauge", "Smoothed link latency estimate (of the configured estimator)", renderLinkSRTT},
+    {"ofsniff_link_latency_avg_ms", "gauge", "Windowed average of smoothed link latency", renderLinkAvg},
+    {"ofsniff_link_latency_var", "gauge", "Windowed sample variance of smoothed link latency (ms^2)", renderLinkVar},
+    {"ofsniff_link_latency_median_ms", "gauge", "Windowed median of smoothed link latency", renderLinkMed},
+    {"ofsniff_link_latency_ms", "histogram", "Distribution of all raw link latency estimates", renderLinkHist},
+    {"ofsniff_probes_sent_total", "counter", "LLDP probes whose reply was awaited", renderProbesSent},
+    {"ofsniff_probes_matched_total", "counter", "LLDP probes whose reply was seen", renderProbesMatched},
+    {"ofsniff_probes_expired_total", "counter", "LLDP probes given up on (reply never seen)", renderProbesExpired},
+    {"ofsniff_probes_skipped_total", "counter", "LLDP probe messages skipped by the overload governor", renderProbesSkipped},
+    {"ofsniff_probe_sample_rate", "gauge", "Share of LLDP probes processed when the last one was seen", renderProbeSampleRate},
+    {"ofsniff_memory_bytes", "gauge", "Bytes of metadata kept for the switch", renderMemoryBytes},
+    {"ofsniff_latency_changes_total", "counter", "Changes of echo RTT, PacketIn RTT or link latency level detected", renderChangePoints},
+    {"ofsniff_switch_info", "gauge", "Datapath ID of the switch at the endpoint (from its FeaturesReply)", renderSwitchInfo},
+};
+
+const uint16_t MetricsExporter::NUM_FAMILIES = sizeof(FAMILIES) / sizeof(FAMILIES[0]);
+
+MetricsExporter::MetricsExporter(SnapshotExchange<StatsSnapshot>& snapshots) :
+        _snapshots(snapshots), _running(false), _cache(NUM_FAMILIES) {};
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+};
+
+/* Binds to bindAddr:port and starts serving in a new thread
+ * Returns false if the socket could not be set up
+ */
+bool MetricsExporter::start(const uint16_t port, const string& bindAddr) {
+    if (_running)
+        return true;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, bindAddr.c_str(), &addr.sin_addr) != 1) {
+        cout << "ERROR: Invalid metrics bind address " << bindAddr << endl;
+        return false;
+    }
+
+    _listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_listenFd < 0) {
+        cout << "ERROR: Unable to create metrics socket: " << strerror(errno) << endl;
+        return false;
+    }
+
+    int enable = 1;
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    if (bind(_listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+            listen(_listenFd, 16) != 0) {
+        cout << "ERROR: Unable to listen on " << bindAddr << ":" << port <<
+            " for metrics: " << strerror(errno) << endl;
+        close(_listenFd);
+        _listenFd = -1;
+        return false;
+    }
+
+    _running = true;
+    _thread = std::thread(&MetricsExporter::serveLoop, this);
+
+    return true;
+}
+
+void MetricsExporter::stop() {
+    if (!_running)
+        return;
+
+    _running = false;
+    _thread.join();
+
+    close(_listenFd);
+    _listenFd = -1;
+}
+
+void MetricsExporter::serveLoop() {
+    ThreadPlacements::place(THREAD_WORKER, "metrics-exporter");
+
+    struct pollfd pfd;
+    pfd.fd = _listenFd;
+    pfd.events = POLLIN;
+
+    while (_running) {
+        if (poll(&pfd, 1, ACCEPT_POLL_MS) <= 0)
+            continue;
+
+        int connFd = accept4(_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connFd < 0)
+            continue;
+
+        handleConnection(connFd);
+        close(connFd);
+    }
+}
+
+void MetricsExporter::handleConnection(const int connFd) {
+    // Don't let a stalled client hold up the next scrape for long
+    struct timeval timeout = {1, 0};
+    setsockopt(connFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(connFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    char request[MAX_REQUEST_LEN + 1];
+    size_t reqLen = 0;
+    while (reqLen < MAX_REQUEST_LEN) {
+        ssize_t n = recv(connFd, request + reqLen, MAX_REQUEST_LEN - reqLen, 0);
+        if (n <= 0)
+            return;
+
+        reqLen += n;
+        request[reqLen] = '\0';
+        if (strstr(request, "\r\n\r\n"))
+            break;
+    }
+
+    string header;
+    const char* content = nullptr;
+    size_t contentLen = 0;
+    if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0) {
+        render();
+        content = _body.data();
+        contentLen = _body.size();
+        header = "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+    } else {
+        header = "HTTP/1.1 404 Not Found\r\n";
+    }
+    header += "Content-Length: " + std::to_string(contentLen) + "\r\n"
+              "Connection: close\r\n\r\n";
+
+    if (send(connFd, header.data(), header.size(), MSG_NOSIGNAL) != (ssize_t)header.size())
+        return;
+
+    while (contentLen) {
+        ssize_t n = send(connFd, content, contentLen, MSG_NOSIGNAL);
+        if (n <= 0)
+            return;
+
+        content += n;
+        contentLen -= n;
+    }
+}
+
+// Re-renders _body if a newer snapshot was published
+void MetricsExporter::render() {
+    _snapshots.update();
+    const StatsSnapshot& snap = _snapshots.front();
+    if (snap.seqNum == _renderedSeqNum && !_body.empty())
+        return;
+
+    // Nothing to export before the sniff loop published its first snapshot
+    _body.clear();
+    if (snap.seqNum == 0)
+        return;
+
+    for (uint16_t f = 0; f < NUM_FAMILIES; f++) {
+        const MetricFamily& family = FAMILIES[f];
+        auto& cache = _cache[f];
+
+        _body += "# HELP ";
+        _body += family.name;
+        _body += ' ';
+        _body += family.help;
+        _body += "\n# TYPE ";
+        _body += family.name;
+        _body += ' ';
+        _body += family.type;
+        _body += '\n';
+
+        for (const EndpointSnapshot& epSnap : snap.endpoints) {
+            RenderCacheEntry& entry = cache[epSnap.endpoint];
+            if (entry.text.empty() || entry.version != epSnap.version) {
+                entry.text.clear();
+                family.render(snap, epSnap, entry.text);
+                entry.version = epSnap.version;
+            }
+            entry.seenSeqNum = snap.seqNum;
+            _body += entry.text;
+        }
+
+        // Forget endpoints that are no longer in the snapshot
+        if (cache.size() > snap.endpoints.size()) {
+            for (auto it = cache.begin(); it != cache.end(); ) {
+                if (it->second.seenSeqNum != snap.seqNum)
+                    it = cache.erase(it);
+                else
+                    it++;
+            }
+        }
+    }
+
+    // Sniffer counters are few, always rendered from scratch
+    _body += "# HELP ofsniff_packets_total Packets handed to the sniff loop\n"
+             "# TYPE ofsniff_packets_total counter\nofsniff_packets_total";
+    appendValue(_body, snap.packets);
+    _body += "# HELP ofsniff_of_messages_total Packets carrying an OpenFlow message\n"
+             "# TYPE ofsniff_of_messages_total counter\nofsniff_of_messages_total";
+    appendValue(_body, snap.ofMessages);
+    _body += "# HELP ofsniff_parse_errors_total Malformed OpenFlow or LLDP content\n"
+             "# TYPE ofsniff_parse_errors_total counter\nofsniff_parse_errors_total";
+    appendValue(_body, snap.parseErrors);
+    _body += "# HELP ofsniff_capture_received_total Packets received by the kernel capture filter\n"
+             "# TYPE ofsniff_capture_received_total counter\nofsniff_capture_received_total";
+    appendValue(_body, snap.captureRecv);
+    _body += "# HELP ofsniff_capture_drops_total Packets dropped by the kernel capture buffer\n"
+             "# TYPE ofsniff_capture_drops_total counter\nofsniff_capture_drops_total";
+    appendValue(_body, snap.captureDrops);
+    _body += "# HELP ofsniff_capture_if_drops_total Packets dropped by the network interface\n"
+             "# TYPE ofsniff_capture_if_drops_total counter\nofsniff_capture_if_drops_total";
+    appendValue(_body, snap.captureIfDrops);
+    _body += "# HELP ofsniff_overload_level Load shedding level of the overload governor (0 = none)\n"
+             "# TYPE ofsniff_overload_level gauge\nofsniff_overload_level";
+    appendValue(_body, (uint64_t)snap.overload.level);
+    _body += "# HELP ofsniff_overload_shed_messages_total OpenFlow messages only counted under overload\n"
+             "# TYPE ofsniff_overload_shed_messages_total counter\nofsniff_overload_shed_messages_total";
+    appendValue(_body, snap.overload.shedMessages);
+    _body += "# HELP ofsniff_memory_used_bytes Bytes of metadata kept for all switches\n"
+             "# TYPE ofsniff_memory_used_bytes gauge\nofsniff_memory_used_bytes";
+    appendValue(_body, snap.memory.used);
+    _body += "# HELP ofsniff_memory_budget_bytes Memory budget of the switch metadata (0 = unlimited)\n"
+             "# TYPE ofsniff_memory_budget_bytes gauge\nofsniff_memory_budget_bytes";
+    appendValue(_body, snap.memory.budget);
+    _body += "# HELP ofsniff_memory_compactions_total Switches whose probe tables were compacted to stay within the budget\n"
+             "# TYPE ofsniff_memory_compactions_total counter\nofsniff_memory_compactions_total";
+    appendValue(_body, snap.memory.compactions);
+    _body += "# HELP ofsniff_diagnostics_total Unexpected or malformed packets seen by the sniff loop\n"
+             "# TYPE ofsniff_diagnostics_total counter\n";
+    for (uint16_t i = 0; i < NUM_DIAG_REASONS; i++) {
+        DiagReason reason = (DiagReason)i;
+        _body += "ofsniff_diagnostics_total{reason=\"";
+        _body += Diagnostics::reasonName(reason);
+        _body += "\",severity=\"";
+        _body += Diagnostics::severityName(Diagnostics::severityOf(reason));
+        _body += "\"}";
+        appendValue(_body, snap.diagCounts[i]);
+    }
+
+    _renderedSeqNum = snap.seqNum;
+}
@@ -1,4 +1,7 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <memory>
 
 // Packet processing libs
 #include <ifaddrs.h>
@@ -11,7 +14,10 @@
 #include "OpenFlowPDUs.h"
 #include "OFSniffCommon.h"
 #include "EndpointLatencyMetadata.h"
+#include "CaptureSources.h"
+#include "FrameDecoder.h"
 #include "LLDP_TLV.h"
+#include "StageTimers.h"
 
 using std::cout;
 using std::endl;
@@ -25,21 +31,27 @@ using namespace Tins;
  *  true if intercepting an OpenFlow PacketIn (switch => ctrl)
  *  false if intercepting an OpenFlow PacketOut (ctrl => switch)
  */
+template <class Policy>
 void ProcessLLDP(Timestamp ts, IPv4EndpointType dpEndpoint, EthernetII& ethFrame,
-                        EndpointLatencyMetadata& epLatMeta, bool bPacketIn) {
+                        BasicEndpointLatencyMetadata<Policy>& epLatMeta, bool bPacketIn) {
+    STAGE_TIMER(STAGE_PROCESS_LLDP);
+
+    Diagnostics& diag = epLatMeta.diagnostics();
+
     if (ethFrame.payload_type() != ETHTYPE_LLDP) {
-        cout << "ERROR: Unknown eth type: " << ethFrame.payload_type() << endl;
+        diag.report(DIAG_UNKNOWN_ETH_TYPE, dpEndpoint, ethFrame.payload_type());
         return;
     }
 
     if (ethFrame.dst_addr() != LLDP_MAC_NEAREST_BRIDGE) {
-        cout << "ERROR: Unknown dest MAC" << endl;
+        diag.report(DIAG_UNKNOWN_DST_MAC, dpEndpoint);
         return;
     }
 
     RawPDU* lldp = ethFrame.find_pdu<RawPDU>(); // libtins lacks an LLDP PDU
     if (lldp == nullptr) {
-        cout << "ERROR: Could not find LLDP PDU in Ethernet frame" << endl;
+        diag.report(DIAG_NO_LLDP_PDU, dpEndpoint);
+        bump(epLatMeta.counters().parseErrors);
         return;
     }
 
@@ -72,7 +84,7 @@ void ProcessLLDP(Timestamp ts, IPv4EndpointType dpEndpoint, EthernetII& ethFrame
             case LLDP_TLV_TYPE::SYSTEM_NAME: {
                 string sysName = tlv->pValue<char>();
                 if (sysName.find(SYSTEM_NAME_PREFIX) != 0) {
-                    cout << "WARNING: Received LLDP w/ system name: " << sysName << endl;
+                    diag.report(DIAG_FOREIGN_LLDP, dpEndpoint, 0, 0, sysName.c_str());
                     packetID = "";
                 } else {
                     uint64_t firstSemiCol = sysName.find_first_of(';');
@@ -82,7 +94,8 @@ void ProcessLLDP(Timestamp ts, IPv4EndpointType dpEndpoint, EthernetII& ethFrame
                         dp2CtrlRTT = stod(sysName.substr(lastSemiCol + 1));
                     } else {
                         // Malformed System Name, abort processing of this packet
-                        cout << "ERROR: Malformed System Name field" << endl;
+                        diag.report(DIAG_MALFORMED_SYS_NAME, dpEndpoint, 0, 0, sysName.c_str());
+                        bump(epLatMeta.counters().parseErrors);
                         return;
                     }
                 }
@@ -118,6 +131,10 @@ void ProcessLLDP(Timestamp ts, IPv4EndpointType dpEndpoint, EthernetII& ethFrame
      *        PacketIn Ping, but we've already begun tracking this packetID.
      *  Thus, we must have a per-switch tracking of when packets are seen.
      */
+    // Under overload only a subset of probes (the same for ping and pong) is processed
+    if (!packetID.empty() && !epLatMeta.sampleProbe(dpEndpoint, packetID))
+        return;
+
     PacketSeenType& pktSeenMap = epLatMeta.getPacketSeenMap(dpEndpoint);
     bool isPing = (!dp2CtrlRTT) ? true : false; // Just to improve readability...
 
@@ -255,72 +272,20 @@ void ProcessLLDP(Timestamp ts, IPv4EndpointType dpEndpoint, EthernetII& ethFrame
     return;
 }
 
-/* TODO: THIS HAS BEEN DEPRECATED, REMOVE?
- * Processes OpenFlow Echo Request and Replies
- * Measures RTT to-and-from switch when echos are initiated by the controller
- */
-void ProcessEcho(Timestamp ts, IPv4EndpointType dpEndpoint, OFMsgPDU& ofMsg,
-                        EndpointLatencyMetadata& epLatMeta, bool toSwitch) {
-    /* Map datapath endpoint to vector of echo times
-     * NOTE: Currently if switch re-connects, it'll get a new endpoint (new source port)
-     *       Should we track across re-connections?
-     *       We can do this if we intercept Hello messages, but this assumes
-     *       we're already sniffing when switch connects.
-     *       For now, ignore re-connects.
-     */
-    static PacketSeenType pktIDSeen; /* Don't need to worry about different switches here
-                                      * Echo request & replies only to/from switch */
-
-    switch (ofMsg.type()) {
-        case of10::OFPT_ECHO_REQUEST: {
-            // Currently only process for echo requests initiated by the controller
-            if (!toSwitch)
-                break;
-
-            //cout << "Echo Request" << endl;
-            of10::EchoRequest echoReq;
-            echoReq.unpack((uint8_t*)ofMsg.get_buffer().data());
-
-            string packetID = string((const char*)echoReq.data(), echoReq.data_len());
-            pktIDSeen[packetID] = ts;
-            break;
-        }
-        case of10::OFPT_ECHO_REPLY: {
-            // Currently only process for echo requests initiated by the controller
-            if (toSwitch)
-                break;
-
-            //cout << "Echo Reply" << endl;
-            of10::EchoReply echoRep;
-            echoRep.unpack((uint8_t*)ofMsg.get_buffer().data());
-
-            string packetID = string((const char*)echoRep.data(), echoRep.data_len());
-            double echoRTT = CalcTimestampDiff(pktIDSeen[packetID], ts);
-            pktIDSeen.erase(packetID);
-
-            epLatMeta.updateEchoRTT(dpEndpoint, echoRTT);
-#ifdef PRINTOUT
-            cout << dpEndpoint << " Echo RTT MED is: " << epLatMeta.getEchoRTTMed(dpEndpoint) << " ms; stdev = " << sqrt(epLatMeta.getEchoRTTVar(dpEndpoint)) << endl;
-#endif
-            break;
-        }
-        default:
-            cout << "ERROR: Message type not OpenFlow Echo Request or Reply" << endl;
-            return;
-    }
-
-    return;
-}
-
+template <class Policy>
 void ParseOFPacket(Timestamp ts, IPv4EndpointType dpEndpoint, OFMsgPDU& ofMsg,
-                    EndpointLatencyMetadata& epLatMeta, bool toSwitch) {
+                    BasicEndpointLatencyMetadata<Policy>& epLatMeta, bool toSwitch) {
+    STAGE_TIMER(STAGE_PARSE_OF);
+
     switch (ofMsg.type()) {
         case of10::OFPT_PACKET_IN: {
             //cout << "OpenFlow PacketIn from port " << packetIn.in_port() << endl;
             // Convert generic OFMsgPDU to OFPacketInPDU
             of10::PacketIn packetIn;
+            STAGE_TIMER_START(unpackStart);
             packetIn.unpack((uint8_t*)ofMsg.get_buffer().data());
             EthernetII ethFrame((const uint8_t*)packetIn.data(), packetIn.total_len());
+            STAGE_TIMER_STOP(STAGE_OF_UNPACK, unpackStart);
 
             ProcessLLDP(ts, dpEndpoint, ethFrame, epLatMeta, true);
             break;
@@ -329,92 +294,493 @@ void ParseOFPacket(Timestamp ts, IPv4EndpointType dpEndpoint, OFMsgPDU& ofMsg,
             //cout << "OpenFlow PacketOut" << endl;
             // Convert generic OFMsgPDU to OFPacketOutPDU
             of10::PacketOut packetOut;
+            STAGE_TIMER_START(unpackStart);
             if (packetOut.unpack((uint8_t*)ofMsg.get_buffer().data()) == OF_ERROR) {
-                cout << "ERROR: Unable to parse PacketOut message" << endl;
+                epLatMeta.diagnostics().report(DIAG_PACKET_OUT_UNPACK, dpEndpoint);
+                bump(epLatMeta.counters().parseErrors);
             }
             else {
                 if (packetOut.buffer_id() == of10::OFP_NO_BUFFER) {
                     EthernetII ethFrame((const uint8_t*)packetOut.data(),
                                                     packetOut.data_len());
+                    STAGE_TIMER_STOP(STAGE_OF_UNPACK, unpackStart);
 
                     ProcessLLDP(ts, dpEndpoint, ethFrame, epLatMeta, false);
                 }
             }
             break;
         }
+        case of10::OFPT_FEATURES_REPLY: {
+            // Identifies the switch across controllers and sniffers (see Aggregator.h)
+            const vector<uint8_t>& buf = ofMsg.get_buffer();
+            if (buf.size() < OF_FEATURES_DPID_OFFSET + sizeof(uint64_t)) {
+                bump(epLatMeta.counters().parseErrors);
+                break;
+            }
+
+            uint64_t datapath_id = 0; // Network byte order
+            for (uint8_t i = 0; i < sizeof(uint64_t); i++)
+                datapath_id = (datapath_id << 8) | buf[OF_FEATURES_DPID_OFFSET + i];
+            epLatMeta.setDatapathID(dpEndpoint, datapath_id);
+            break;
+        }
         case of10::OFPT_FLOW_MOD: {
             //cout << "OpenFlow FlowMod" << endl;
             break;
         }
         case of10::OFPT_ECHO_REQUEST:
         case of10::OFPT_ECHO_REPLY: {
-            ProcessEcho(ts, dpEndpoint, ofMsg, epLatMeta, toSwitch);
+            // Timed by xid in EndpointLatencyMetadata::processOFHeaders()
             break;
         }
         default:
             if (ofMsg.type() <= of10::OFPT_QUEUE_GET_CONFIG_REPLY)
-                cout << "Unimplemented OF message type: " << (uint16_t)ofMsg.type() << endl;
-            else
-                cout << "Unknown OF message type: " << (uint16_t)ofMsg.type() << endl;
+                epLatMeta.diagnostics().report(DIAG_UNIMPLEMENTED_OF_TYPE, dpEndpoint, ofMsg.type());
+            else {
+                epLatMeta.diagnostics().report(DIAG_UNKNOWN_OF_TYPE, dpEndpoint, ofMsg.type());
+                bump(epLatMeta.counters().parseErrors);
+            }
             break;
     }
 
     return;
 }
 
+/* Advances to the next captured packet
+ * Separate function so the capture stage can be timed in the for-loop header.
+ */
+static inline void nextPacket(Sniffer::iterator& packet) {
+    STAGE_TIMER(STAGE_CAPTURE);
+    packet++;
+}
+
+/* Copies the fields needed for transport RTT and bytes-in-flight tracking
+ * wireLen is the TCP segment's length on the wire according to the IP header,
+ * 0 if unknown (e.g. IP length left 0 by segmentation offload).
+ */
+void FillTCPSegment(const TCP& tcp, const RawPDU* raw, const uint32_t wireLen, TCPSegment& seg) {
+    seg.seq = tcp.seq();
+    seg.ack = tcp.ack_seq();
+    seg.flags = tcp.flags();
+    seg.payloadLen = raw ? raw->payload().size() : 0;
+    seg.wireLen = (wireLen >= tcp.header_size() + seg.payloadLen) ? wireLen - tcp.header_size()
+                                                                  : seg.payloadLen;
+
+    // search_option() avoids the exception TCP::timestamp() throws when absent
+    const TCP::option* tsOpt = tcp.search_option(TCP::TSOPT);
+    seg.hasTimestamp = (tsOpt != nullptr && tsOpt->data_size() == 8);
+    if (seg.hasTimestamp) {
+        const uint8_t* data = tsOpt->data_ptr();
+        seg.tsval = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+                    ((uint32_t)data[2] << 8) | data[3];
+        seg.tsecr = ((uint32_t)data[4] << 24) | ((uint32_t)data[5] << 16) |
+                    ((uint32_t)data[6] << 8) | data[7];
+    }
+}
+
+// Port match for a single OpenFlow port, as CaptureSource::isOFPort() for several
+class SinglePortMatch {
+    private:
+        uint16_t _port;
+
+    public:
+        SinglePortMatch(const uint16_t port) : _port(port) {};
+
+        bool isOFPort(const uint16_t port) const {
+            return port == _port;
+        }
+};
+
+/* Applies reconfigurations, closes traffic and rollup intervals, publishes
+ * snapshots, takes checkpoints and sends summaries when they are due
+ */
+template <class Policy>
+static void RunPeriodicTasks(const Timestamp& ts, BasicEndpointLatencyMetadata<Policy>& epLatMeta) {
+    if (epLatMeta.reconfigureDue())
+        epLatMeta.applyReconfiguration();
+
+    if (epLatMeta.trafficIntervalDue(ts)) {
+        STAGE_TIMER(STAGE_SNAPSHOT);
+        epLatMeta.closeTrafficInterval(ts);
+    }
+
+    if (epLatMeta.rollupsDue(ts)) {
+        STAGE_TIMER(STAGE_SNAPSHOT);
+        epLatMeta.advanceRollups(ts);
+    }
+
+    if (epLatMeta.snapshotDue(ts)) {
+        STAGE_TIMER(STAGE_SNAPSHOT);
+        epLatMeta.publishSnapshot(ts);
+    }
+
+    if (epLatMeta.checkpointDue(ts)) {
+        STAGE_TIMER(STAGE_SNAPSHOT);
+        epLatMeta.writeCheckpoint(ts);
+    }
+
+    if (epLatMeta.summaryDue(ts)) {
+        STAGE_TIMER(STAGE_SNAPSHOT);
+        epLatMeta.sendSummary(ts);
+    }
+}
+
+/* Reports kernel drops of the capture interval that was just closed, and lets
+ * the overload governor react to them
+ */
+template <class Policy>
+static void CloseCaptureInterval(const CaptureInterval& interval,
+                                    BasicEndpointLatencyMetadata<Policy>& epLatMeta) {
+    Diagnostics& diag = epLatMeta.diagnostics();
+    if (interval.drop || interval.ifDrop)
+        diag.report(DIAG_CAPTURE_DROPS, 0, interval.drop + interval.ifDrop, interval.recv);
+
+    OverloadGovernor& governor = epLatMeta.governor();
+    if (governor.update(interval)) {
+        diag.report(DIAG_OVERLOAD_LEVEL, 0, governor.level(),
+                    governor.level() < 2 ? 1 : 1U << (governor.level() - 1));
+    }
+}
+
+/* Processes one TCP segment of an OpenFlow connection
+ * 'ports' tells whether a TCP port is an OpenFlow (controller) port.
+ * Returns true if the segment carried OpenFlow payload.
+ */
+template <class Policy, class PortMatch>
+static bool ProcessTCPFrame(const DecodedFrame& frame, const Timestamp& ts, const PortMatch& ports,
+                            BasicEndpointLatencyMetadata<Policy>& epLatMeta) {
+    // Sanity-check connection to controller
+    bool toSwitch = ports.isOFPort(frame.sport); // Is message to the switch?
+    if (!toSwitch && !ports.isOFPort(frame.dport)) {
+        epLatMeta.diagnostics().report(DIAG_UNRELATED_PACKET);
+        return false;
+    }
+
+    IPv4EndpointType dpEndpoint;
+    if (frame.ipv6) {
+        dpEndpoint = toSwitch ?
+                GenIPv6Endpoint(frame.dstAddr6, frame.dport) :
+                GenIPv6Endpoint(frame.srcAddr6, frame.sport);
+        if (dpEndpoint == 0) {
+            epLatMeta.diagnostics().report(DIAG_IPV6_TABLE_FULL, 0, IPv6AddressTable::global().size());
+            return false;
+        }
+    } else {
+        dpEndpoint = toSwitch ?
+                GenIPv4Endpoint(frame.dstAddr, frame.dport) :
+                GenIPv4Endpoint(frame.srcAddr, frame.sport);
+    }
+
+    // Every segment (including pure ACKs) feeds the transport RTT
+    STAGE_TIMER_START(tcpStart);
+    epLatMeta.processTCPSegment(ts, dpEndpoint, frame.tcp, toSwitch);
+    STAGE_TIMER_STOP(STAGE_DECODE, tcpStart);
+
+    // Payload cut off by the snapshot length still advances the message framing
+    if (frame.tcp.wireLen == 0)
+        return false;
+
+    STAGE_TIMER_START(decodeStart);
+    bool startsMessage = epLatMeta.processOFHeaders(ts, dpEndpoint, frame.tcp, frame.payload, toSwitch);
+    bump(epLatMeta.counters().ofMessages);
+
+    /* Counted above; only parsed if the segment starts with a message
+     * (not a continuation) and the overload governor doesn't shed its type
+     */
+    if (!startsMessage || epLatMeta.governor().sheds(frame.payload[1])) {
+        STAGE_TIMER_STOP(STAGE_DECODE, decodeStart);
+        return true;
+    }
+
+    OFMsgPDU ofMsg(frame.payload, frame.tcp.payloadLen);
+    STAGE_TIMER_STOP(STAGE_DECODE, decodeStart);
+
+    ParseOFPacket(ts, dpEndpoint, ofMsg, epLatMeta, toSwitch);
+    return true;
+}
+
+/* As ProcessTCPFrame, for a packet decoded by libtins
+ * Returns true if the packet carried OpenFlow payload.
+ */
+template <class Policy, class PortMatch>
+static bool ProcessPacket(const PDU& pdu, const Timestamp& ts, const PortMatch& ports,
+                            BasicEndpointLatencyMetadata<Policy>& epLatMeta) {
+    DecodedFrame frame;
+    IPv6Address src6, dst6; // Addresses are returned by value, frame points to these
+    uint32_t tcpWireLen = 0;
+    const IP *ip = pdu.find_pdu<IP>();
+    const IPv6 *ip6 = (ip == nullptr) ? pdu.find_pdu<IPv6>() : nullptr;
+    if (ip != nullptr) {
+        if (ip->flags() == 1) {
+            epLatMeta.diagnostics().report(DIAG_IP_FRAGMENT);
+            return false;
+        }
+
+        frame.ipv6 = false;
+        frame.srcAddr = ip->src_addr();
+        frame.dstAddr = ip->dst_addr();
+        if (ip->tot_len() > ip->header_size())
+            tcpWireLen = ip->tot_len() - ip->header_size();
+    } else if (ip6 != nullptr) {
+        frame.ipv6 = true;
+        src6 = ip6->src_addr();
+        dst6 = ip6->dst_addr();
+        frame.srcAddr6 = src6.begin();
+        frame.dstAddr6 = dst6.begin();
+        // header_size() includes the extension headers
+        uint32_t ipTotalLen = FRAME_IPV6_HDR_LEN + ip6->payload_length();
+        if (ipTotalLen > ip6->header_size())
+            tcpWireLen = ipTotalLen - ip6->header_size();
+    } else {
+        return false;
+    }
+
+    // Right now, assume only TCP & UDP above IP
+    const TCP *tcp = pdu.find_pdu<TCP>();
+    if (tcp == nullptr)
+        return false;
+
+    const RawPDU *raw = pdu.find_pdu<RawPDU>();
+
+    frame.sport = tcp->sport();
+    frame.dport = tcp->dport();
+    FillTCPSegment(*tcp, raw, tcpWireLen, frame.tcp);
+    frame.payload = raw ? raw->payload().data() : nullptr;
+
+    return ProcessTCPFrame(frame, ts, ports, epLatMeta);
+}
+
 /* OFSniffLoop is currently explicitly designed to not catch exceptions, as
  * different users may wish to handle different exceptions in their own way.
  */
+template <class Policy>
 void OFSniffLoop(Sniffer*& sniffer, uint16_t ofp_port,
-                    EndpointLatencyMetadata& epLatMeta) {
+                    BasicEndpointLatencyMetadata<Policy>& epLatMeta) {
     if (STATS_FILELOG && !epLatMeta.openStatsLog()) {
         cout << "ERROR: Unable to open statistics log for writing" << endl;
         exit(1);
     }
 
-    bool toSwitch = false; // Is message to the switch?
-    string pduType; // Used for debugging
-    IPv4EndpointType dpEndpoint;
-    for (auto packet = sniffer->begin(); packet != sniffer->end(); packet++) {
+    SinglePortMatch ports(ofp_port);
+    SniffCounters& counters = epLatMeta.counters();
+    CaptureStats& captureStats = epLatMeta.captureStats();
+    for (auto packet = sniffer->begin(); packet != sniffer->end(); nextPacket(packet)) {
+        bump(counters.packets);
 
-        if (const IP *ip = packet->pdu()->find_pdu<IP>()) {
-            pduType = "IP";
-            if (ip->flags() == 1) {
-                cout << "ERROR: Currently do not support packets w/ IPv4's More Fragments flag set" << endl;
-                continue;
-            }
+        if (captureStats.due(packet->timestamp())) {
+            CloseCaptureInterval(captureStats.collect(sniffer->get_pcap_handle(),
+                                                        packet->timestamp(), counters),
+                                    epLatMeta);
+        }
 
-            // Right now, assume only TCP & UDP above IP
-            if (const TCP *tcp = packet->pdu()->find_pdu<TCP>()) {
-                pduType = "TCP";
+        RunPeriodicTasks(packet->timestamp(), epLatMeta);
+        ProcessPacket(*packet->pdu(), packet->timestamp(), ports, epLatMeta);
+    }
 
-                // Sanity-check connection to controller
-                if (tcp->dport() == ofp_port || tcp->sport() == ofp_port) {
-                    const RawPDU *raw = packet->pdu()->find_pdu<RawPDU>();
-                    if (raw != nullptr) {
-                        pduType = "OpenFlow packet";
-                        toSwitch = (tcp->sport() == ofp_port) ? true : false;
-                        dpEndpoint = toSwitch ?
-                                GenIPv4Endpoint(ip->dst_addr(), tcp->dport()) :
-                                GenIPv4Endpoint(ip->src_addr(), tcp->sport());
+    // Close the last interval, so that totals include drops up to the very end
+    captureStats.collect(sniffer->get_pcap_handle(), Timestamp::current_time(), counters);
 
-                        OFMsgPDU ofMsg = raw->to<OFMsgPDU>();
+    return;
+}
 
-                        ParseOFPacket(packet->timestamp(), dpEndpoint, ofMsg, epLatMeta, toSwitch);
-                    }
-                } else {
-                    cout << "ERROR: Packet doesn't seem to be related to the OpenFlow connection" << endl;
-                }
-            } else if (packet->pdu()->find_pdu<UDP>()) {
-                pduType = "UDP";
-            } else {
-                pduType += "(Unknown transport protocol)";
+// One captured frame, copied out of the capture buffer
+typedef struct CapturedFrame {
+    Timestamp ts;
+    uint32_t len;     // Captured
+    uint32_t wireLen; // On the wire
+    uint8_t data[CAPTURE_MAX_LEN];
+} CapturedFrame;
+
+// Frames taken from one source by one pcap_dispatch() call
+typedef struct CaptureBatch {
+    vector<CapturedFrame> frames; // CAPTURE_MAX_BATCH, allocated once
+    uint32_t size;
+} CaptureBatch;
+
+// pcap_dispatch() callback, only copies the frame so the batch can be processed in bulk
+static void CopyFrame(u_char* user, const struct pcap_pkthdr* hdr, const u_char* data) {
+    CaptureBatch& batch = *(CaptureBatch*)user;
+    CapturedFrame& frame = batch.frames[batch.size++];
+
+    frame.ts = Timestamp(hdr->ts);
+    frame.len = std::min<uint32_t>(hdr->caplen, CAPTURE_MAX_LEN);
+    frame.wireLen = hdr->len;
+    memcpy(frame.data, data, frame.len);
+}
+
+/* Decodes the frame by fixed offsets if possible (see FrameDecoder.h), and
+ * only falls back to libtins for anything unusual
+ */
+template <class Policy>
+static void ProcessFrame(const CapturedFrame& frame, CaptureSources& sources, CaptureSource& source,
+                            BasicEndpointLatencyMetadata<Policy>& epLatMeta) {
+    SniffCounters& counters = epLatMeta.counters();
+    CaptureStats& captureStats = epLatMeta.captureStats();
+
+    bump(counters.packets);
+    source.packets.fetch_add(1, std::memory_order_relaxed);
+
+    if (captureStats.due(frame.ts)) {
+        CloseCaptureInterval(captureStats.collect(sources.collect(), frame.ts, counters),
+                                epLatMeta);
+    }
+
+    RunPeriodicTasks(frame.ts, epLatMeta);
+
+    DecodedFrame decoded;
+    STAGE_TIMER_START(captureStart);
+    FrameDecodeResult result = DecodeFrame(frame.data, frame.len, source.linkType(), decoded);
+    STAGE_TIMER_STOP(STAGE_CAPTURE, captureStart);
+
+    bool isOF = false;
+    if (result == FRAME_TCP) {
+        isOF = ProcessTCPFrame(decoded, frame.ts, source, epLatMeta);
+    } else if (result == FRAME_FALLBACK) {
+        source.fallbacks.fetch_add(1, std::memory_order_relaxed);
+
+        STAGE_TIMER_START(fallbackStart);
+        std::unique_ptr<PDU> pdu(source.decode(frame.data, frame.len));
+        STAGE_TIMER_STOP(STAGE_CAPTURE, fallbackStart);
+        if (!pdu) {
+            source.malformed.fetch_add(1, std::memory_order_relaxed);
+            epLatMeta.diagnostics().report(DIAG_UNDECODABLE_FRAME, 0, source.linkType());
+            return;
+        }
+
+        isOF = ProcessPacket(*pdu, frame.ts, source, epLatMeta);
+    }
+
+    if (isOF)
+        source.ofMessages.fetch_add(1, std::memory_order_relaxed);
+}
+
+/* Processes a batch taken from one source and records how late it was
+ * Later frames are prefetched while earlier ones are processed. Frames
+ * skipped as duplicates (see CaptureSource::isDuplicate()) aren't counted.
+ */
+template <class Policy>
+static void ProcessBatch(const CaptureBatch& batch, CaptureSources& sources, CaptureSource& source,
+                            BasicEndpointLatencyMetadata<Policy>& epLatMeta) {
+    DeliveryStats delivery;
+    memset(&delivery, 0, sizeof(delivery));
+    delivery.wakeups = 1;
+
+    Timestamp now = Timestamp::current_time();
+    for (uint32_t i = 0; i < batch.size; i++) {
+        const CapturedFrame& frame = batch.frames[i];
+        if (source.isDuplicate(frame.ts, frame.data, frame.len, frame.wireLen))
+            continue;
+
+        if (i + CAPTURE_PREFETCH_AHEAD < batch.size) {
+            // Ethernet + IP + TCP + OpenFlow headers span the first two cache lines
+            const uint8_t* ahead = batch.frames[i + CAPTURE_PREFETCH_AHEAD].data;
+            __builtin_prefetch(ahead);
+            __builtin_prefetch(ahead + 64);
+        }
+
+        double delayMs = CalcTimestampDiff(frame.ts, now);
+        delivery.packets++;
+        delivery.delayMs.add(delayMs);
+        if (delayMs > delivery.maxDelayMs)
+            delivery.maxDelayMs = delayMs;
+
+        ProcessFrame(frame, sources, source, epLatMeta);
+    }
+
+    epLatMeta.captureStats().addDelivery(delivery);
+}
+
+/* Processes everything a source still holds, before it is replaced or removed
+ * In non-blocking mode, pcap_dispatch() returns 0 once nothing is left.
+ */
+template <class Policy>
+static void DrainSource(CaptureSource& source, CaptureBatch& batch, const int batchSize,
+                        CaptureSources& sources, BasicEndpointLatencyMetadata<Policy>& epLatMeta) {
+    int ret;
+    do {
+        batch.size = 0;
+        ret = pcap_dispatch(source.handle(), batchSize, CopyFrame, (u_char*)&batch);
+        if (ret == PCAP_ERROR) {
+            cout << "ERROR: Capture on " << source.iface() << " failed: " <<
+                    pcap_geterr(source.handle()) << endl;
+        }
+
+        if (batch.size) {
+            source.setLastFrame(batch.frames[batch.size - 1].ts);
+            ProcessBatch(batch, sources, source, epLatMeta);
+        }
+    } while (ret > 0);
+}
+
+/* As OFSniffLoop, over all capture sources, until sources.stop() is called
+ * Sources with packets waiting take turns of up to the delivery's batch size,
+ * so a busy interface can't starve the others. Sources changed while it runs
+ * are handed over between turns.
+ */
+template <class Policy>
+void OFSniffMultiLoop(CaptureSources& sources, BasicEndpointLatencyMetadata<Policy>& epLatMeta) {
+    if (STATS_FILELOG && !epLatMeta.openStatsLog()) {
+        cout << "ERROR: Unable to open statistics log for writing" << endl;
+        exit(1);
+    }
+
+    CaptureBatch batch;
+    batch.frames.resize(CAPTURE_MAX_BATCH);
+    batch.size = 0;
+    int batchSize = std::min<uint32_t>(sources.delivery().batchSize, CAPTURE_MAX_BATCH);
+
+    uint32_t ready[CAPTURE_MAX_SOURCES];
+    int numReady;
+    while ((numReady = sources.wait(ready, CAPTURE_MAX_SOURCES, CAPTURE_WAIT_MS)) >= 0) {
+        for (int i = 0; i < numReady; i++) {
+            CaptureSource& source = sources[ready[i]];
+
+            batch.size = 0;
+            STAGE_TIMER_START(captureStart);
+            int ret = pcap_dispatch(source.handle(), batchSize, CopyFrame, (u_char*)&batch);
+            STAGE_TIMER_STOP(STAGE_CAPTURE, captureStart);
+            if (ret == PCAP_ERROR) {
+                cout << "ERROR: Capture on " << source.iface() << " failed: " <<
+                        pcap_geterr(source.handle()) << endl;
+            }
+
+            if (batch.size) {
+                // A full batch means more packets were waiting: a backlog
+                epLatMeta.governor().addBatch(batch.size, batchSize);
+                source.setLastFrame(batch.frames[batch.size - 1].ts);
+                ProcessBatch(batch, sources, source, epLatMeta);
             }
-        } else {
-            pduType = "Unknown";
         }
 
+        // Sources added, replaced or removed while the loop runs, see CaptureSources
+        if (sources.changesPending()) {
+            sources.applyChanges([&](CaptureSource& source) {
+                DrainSource(source, batch, batchSize, sources, epLatMeta);
+            });
+            batchSize = std::min<uint32_t>(sources.delivery().batchSize, CAPTURE_MAX_BATCH);
+        }
     }
 
+    // Close the last interval, so that totals include drops up to the very end
+    epLatMeta.captureStats().collect(sources.collect(), Timestamp::current_time(),
+                                        epLatMeta.counters());
+
     return;
 }
+
+// Same policies as instantiated in EndpointLatencyMetadata.cpp
+template void ProcessLLDP(Timestamp ts, IPv4EndpointType dpEndpoint, EthernetII& ethFrame,
+                            EndpointLatencyMetadata& epLatMeta, bool bPacketIn);
+template void ParseOFPacket(Timestamp ts, IPv4EndpointType dpEndpoint, OFMsgPDU& ofMsg,
+                            EndpointLatencyMetadata& epLatMeta, bool toSwitch);
+template void OFSniffLoop(Sniffer*& sniffer, uint16_t ofp_port,
+                            EndpointLatencyMetadata& epLatMeta);
+template void OFSniffMultiLoop(CaptureSources& sources, EndpointLatencyMetadata& epLatMeta);
+
+template void ProcessLLDP(Timestamp ts, IPv4EndpointType dpEndpoint, EthernetII& ethFrame,
+                            RuntimeEndpointLatencyMetadata& epLatMeta, bool bPacketIn);
+template void ParseOFPacket(Timestamp ts, IPv4EndpointType dpEndpoint, OFMsgPDU& ofMsg,
+                            RuntimeEndpointLatencyMetadata& epLatMeta, bool toSwitch);
+template void OFSniffLoop(Sniffer*& sniffer, uint16_t ofp_port,
+                            RuntimeEndpointLatencyMetadata& epLatMeta);
+template void OFSniffMultiLoop(CaptureSources& sources, RuntimeEndpointLatencyMetadata& epLatMeta);
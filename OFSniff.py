@@ -28,12 +28,19 @@ if os.getuid() != 0:
     print msg
     sys.exit(1)
 
+# Set in numerical endpoints of IPv6 connections
+ENDPOINT_IPV6_FLAG = 1 << 63
+
 # Given a numerical endpoint (i.e. those returned by OFSniff.getEndpoints()),
 # return an (IP, port #) tuple where the IP is a string, the port is an int
 # Endpoint expected to be either a long or an int
 def endpointNum2Pair(endpoint):
     assert type(endpoint) in (long, int)
     port = int(endpoint & 0xffff)
+    if endpoint & ENDPOINT_IPV6_FLAG:
+        # IPv6 endpoints hold an ID, resolved by this process's sniff loop
+        return (_OFSniff.getEndpointAddress(endpoint), port)
+
     ip = endpoint >> 16 # IP is in network byte-order
     ip = [ip & 0xff, (ip >> 8) & 0xff, (ip >> 16) & 0xff, (ip >> 24) & 0xff]
     ip = '.'.join(str(octet) for octet in ip) # Convert to string
@@ -41,10 +48,14 @@ def endpointNum2Pair(endpoint):
     return (ip, port)
 
 # Given an (IP, port #) tuple, return a numerical endpoint
-# IP is a string in decimal dot notation (i.e. 10.11.12.13)
+# IP is a string in decimal dot notation (i.e. 10.11.12.13), or an IPv6
+# address; returns 0 for IPv6 addresses not seen by the sniff loop
 # Port can be either a string or integer
 def endpointPair2Num(ip, port):
     port = int(port)
+    if ':' in ip:
+        return _OFSniff.findIPv6Endpoint(ip, port)
+
     ip = [int(octet) for octet in ip.split('.')]
     ip = (ip[3] << 24) | (ip[2] << 16) | (ip[1] << 8) | ip[0] # To network byte-order
 
@@ -63,15 +74,31 @@ class OFSniff(object):
     # If iface is None, OFSniff will sniff all interfaces
     # Returns True if loop successfully started w/ input parameters
     # Returns False otherwise
-    def startSniffLoop(self, iface, ofp_port):
+    # buffer_size is the kernel capture buffer size in bytes (0 = libpcap default)
+    # of_type_filter: Drop OpenFlow messages not needed for latency
+    # measurements (e.g. FlowMods) in the kernel, see include/OFTypeFilter.h
+    # pass_pure_acks: With of_type_filter, still pass pure ACKs (needed for
+    # getTCPStats())
+    # delivery_timeout_ms: 0 delivers every packet immediately; otherwise the
+    # kernel holds packets up to this long and they are processed up to
+    # batch_size (0 = default) at a time. Saves CPU on busy connections at the
+    # cost of later results; compare getCaptureStats()["delivery"]
+    def startSniffLoop(self, iface, ofp_port, buffer_size=0, of_type_filter=False,
+                        pass_pure_acks=True, delivery_timeout_ms=0, batch_size=0):
         if iface is None:
             iface = "any"
 
         assert type(iface) in (str, unicode)
         assert type(ofp_port) is int
         assert ofp_port <= 65535
+        assert type(buffer_size) is int
+        assert type(of_type_filter) is bool
+        assert type(pass_pure_acks) is bool
+        assert type(delivery_timeout_ms) is int
+        assert type(batch_size) is int
 
-        return _OFSniff.startSniffLoop(iface, ofp_port)
+        return _OFSniff.startSniffLoop(iface, ofp_port, buffer_size, of_type_filter,
+                                        pass_pure_acks, delivery_timeout_ms, batch_size)
 
     def stopSniffLoop(self):
         _OFSniff.stopSniffLoop()
@@ -80,6 +107,289 @@ class OFSniff(object):
     def isSniffing(self):
         return _OFSniff.isSniffing()
 
+    # Adds a capture source to the running sniff loop, or replaces the one of
+    # iface (e.g. to change its ports, and so its filter); ofp_ports is a port
+    # or a list of them, the other arguments are as in startSniffLoop(). The
+    # new capture takes over without losing or repeating packets, and all
+    # latency state is kept
+    def setCaptureSource(self, iface, ofp_ports, buffer_size=0, of_type_filter=False,
+                            pass_pure_acks=True):
+        if type(ofp_ports) is int:
+            ofp_ports = [ofp_ports]
+
+        assert type(iface) in (str, unicode)
+        assert type(ofp_ports) is list
+        assert all(type(port) is int and port <= 65535 for port in ofp_ports)
+        assert type(buffer_size) is int
+        assert type(of_type_filter) is bool
+        assert type(pass_pure_acks) is bool
+
+        return _OFSniff.setCaptureSource(iface, ofp_ports, buffer_size, of_type_filter,
+                                            pass_pure_acks)
+
+    # Stops capturing iface, once everything captured on it so far is processed
+    def removeCaptureSource(self, iface):
+        assert type(iface) in (str, unicode)
+        return _OFSniff.removeCaptureSource(iface)
+
+    # Changes the delivery of the running sniff loop (arguments as in
+    # startSniffLoop()), handing over every source to a new capture
+    def setDelivery(self, delivery_timeout_ms=0, batch_size=0):
+        assert type(delivery_timeout_ms) is int
+        assert type(batch_size) is int
+        return _OFSniff.setDelivery(delivery_timeout_ms, batch_size)
+
+    # Returns a list of (iface, [ofp_port]) tuples of the running sniff loop
+    def getCaptureSources(self):
+        return _OFSniff.getCaptureSources()
+
+    # Publishes all statistics into /dev/shm/<name>, readable from other
+    # processes through OFSniffShm.ShmStatsReader without their own sniffer
+    # Must be called before startSniffLoop()
+    def openShmTable(self, name, capacity=4096):
+        assert type(name) in (str, unicode)
+        assert type(capacity) is int
+        return _OFSniff.openShmTable(name, capacity)
+
+    # Placement of the sniff thread (capture) and all other threads of the
+    # module (worker), each "[<cpus>][@<policy>]", e.g. "2@fifo:50" or "4-7";
+    # CPUs as "0-3,6", policy "fifo:<priority>" or "other[:<nice>]". With
+    # lock_switches, the tables are reserved for that many switches and all
+    # memory is prefaulted and locked; numa_local allocates the sniff
+    # thread's memory on the NUMA node of its first CPU
+    # Must be called before startSniffLoop()
+    def setThreadPlacement(self, capture="", worker="", lock_switches=0, numa_local=False):
+        assert type(capture) in (str, unicode)
+        assert type(worker) in (str, unicode)
+        assert type(lock_switches) is int
+        assert type(numa_local) is bool
+        return _OFSniff.setThreadPlacement(capture, worker, lock_switches, numa_local)
+
+    # Window sizes (samples, at least 2), the outstanding LLDP probe limit
+    # per port, and the estimator smoothing each metric ("ema", "dema",
+    # "adaptive", "kalman" or "trimmed_mean"); arguments left as None keep
+    # their current value
+    # Once switches were seen (e.g. while sniffing), windows are resized in
+    # place, keeping their newest samples, and estimators can't be changed
+    def setLatencyConfig(self, echo_rtt_window=None, pktin_rtt_window=None,
+                            link_lat_window=None, max_outstanding_pkts=None,
+                            echo_rtt_estimator=None, pktin_rtt_estimator=None,
+                            link_lat_estimator=None):
+        kwargs = {}
+        for key, value in (("echo_rtt_window", echo_rtt_window),
+                            ("pktin_rtt_window", pktin_rtt_window),
+                            ("link_lat_window", link_lat_window),
+                            ("max_outstanding_pkts", max_outstanding_pkts)):
+            if value is not None:
+                assert type(value) is int
+                kwargs[key] = value
+        for key, value in (("echo_rtt_estimator", echo_rtt_estimator),
+                            ("pktin_rtt_estimator", pktin_rtt_estimator),
+                            ("link_lat_estimator", link_lat_estimator)):
+            if value is not None:
+                assert type(value) in (str, unicode)
+                kwargs[key] = value
+        return _OFSniff.setLatencyConfig(**kwargs)
+
+    # Returns a dict with the current window sizes, outstanding probe limit
+    # and estimators
+    def getLatencyConfig(self):
+        return _OFSniff.getLatencyConfig()
+
+    # Checkpoints windows, link estimators and endpoints into 'path' at most
+    # every interval_ms (packet time), and when the sniff loop is stopped
+    # Must be called before startSniffLoop()
+    def enableCheckpoints(self, path, interval_ms=60000):
+        assert type(path) in (str, unicode)
+        assert type(interval_ms) is int
+        return _OFSniff.enableCheckpoints(path, interval_ms)
+
+    # Warm restart: restores the state saved by enableCheckpoints() in an
+    # earlier run; windows of another size keep their newest samples
+    # Must be called before startSniffLoop(), and after setLatencyConfig()
+    def loadCheckpoint(self, path):
+        assert type(path) in (str, unicode)
+        return _OFSniff.loadCheckpoint(path)
+
+    # Returns a list of dicts, one per (thread, processing stage), with the
+    # count, mean and max time (us) and a log2 histogram of cycles spent
+    def getStageTimers(self):
+        return _OFSniff.getStageTimers()
+
+    # Converts the cycles in getStageTimers() histograms to microseconds
+    def getStageCyclesPerUs(self):
+        return _OFSniff.getStageCyclesPerUs()
+
+    # Returns a dict of kernel capture counters (recv, drop, if_drop) and
+    # probe losses (probes_matched, probes_expired) since sniffing started,
+    # plus a "history" list of the same dicts per recent 1s interval, and a
+    # "delivery" dict: batches, packets, delay_mean_ms and delay_max_ms (from
+    # capture until processed), and the sniff loop's cpu_ms over wall_ms
+    def getCaptureStats(self):
+        return _OFSniff.getCaptureStats()
+
+    # Diagnostic messages (unexpected or malformed packets) below min_severity
+    # ("debug", "info", "warning", "error") are only counted; the others are
+    # written to stdout, at most 'rate' per second and 'burst' at once per reason
+    def setDiagnostics(self, min_severity="info", rate=1.0, burst=5):
+        assert type(min_severity) in (str, unicode)
+        assert type(rate) in (float, int)
+        assert type(burst) in (float, int)
+        return _OFSniff.setDiagnostics(min_severity, float(rate), float(burst))
+
+    # Returns a dict of reason => (severity, count, suppressed)
+    def getDiagnostics(self):
+        return _OFSniff.getDiagnostics()
+
+    # Under overload, the sniff loop first sheds OpenFlow messages not needed
+    # for latency measurements (level 1), then processes only 1 in
+    # 2^(level - 1) LLDP probes, chosen by probe ID. max_level 0 disables it
+    def setOverloadLevel(self, max_level):
+        assert type(max_level) is int
+        return _OFSniff.setOverloadLevel(max_level)
+
+    # Returns a dict: level, max_level, sample_rate (share of probes
+    # processed), raised, lowered, shed_messages and skipped_probes
+    def getOverloadState(self):
+        return _OFSniff.getOverloadState()
+
+    # Bytes of switch metadata allowed (0 = unlimited); over it, the probe
+    # tables of the least recently active switches are compacted
+    def setMemoryBudget(self, budget):
+        assert type(budget) in (long, int)
+        return _OFSniff.setMemoryBudget(budget)
+
+    # Returns a dict: used, peak and budget (Bytes), compactions and
+    # shed_probes (outstanding probes given up on to stay within the budget)
+    def getMemoryUsage(self):
+        return _OFSniff.getMemoryUsage()
+
+    # Starts queueing events and returns a file descriptor that is readable
+    # while events are queued, e.g. for asyncio:
+    #   loop.add_reader(fd, lambda: handle(sniffer.drainObserverEvents()))
+    # samples: every new latency sample; thresholds: samples crossing their
+    # metric's threshold (see setObserverThreshold()); endpoints: switch
+    # connections coming up or going down; changes: a metric's level changing
+    # (see setChangeSensitivity())
+    def enableObserverEvents(self, samples=True, thresholds=True, endpoints=True, changes=True):
+        assert type(samples) is bool
+        assert type(thresholds) is bool
+        assert type(endpoints) is bool
+        assert type(changes) is bool
+        return _OFSniff.enableObserverEvents(samples, thresholds, endpoints, changes)
+
+    def disableObserverEvents(self):
+        return _OFSniff.disableObserverEvents()
+
+    # Returns a list of up to max_events (type, metric, endpoint, port_no,
+    # value, threshold, above, ts_us) tuples, oldest first. type is "sample",
+    # "threshold", "change", "endpoint_up" or "endpoint_down"; values are in
+    # ms. For "change", value is the new level and threshold the previous one
+    def drainObserverEvents(self, max_events=256):
+        assert type(max_events) is int
+        return _OFSniff.drainObserverEvents(max_events)
+
+    # metric is "echo_rtt", "pktin_rtt", "link_latency", "tcp_rtt_to_switch"
+    # or "tcp_rtt_from_switch"; a threshold (ms) <= 0 disables threshold events
+    def setObserverThreshold(self, metric, threshold):
+        assert type(metric) in (str, unicode)
+        assert type(threshold) in (float, int)
+        return _OFSniff.setObserverThreshold(metric, float(threshold))
+
+    # metric is "echo_rtt", "pktin_rtt" or "link_latency"; cusum and ewma are
+    # the detectors' thresholds in sigmas of the metric's baseline (lower is
+    # more sensitive, 0 disables a detector)
+    def setChangeSensitivity(self, metric, cusum, ewma):
+        assert type(metric) in (str, unicode)
+        assert type(cusum) in (float, int)
+        assert type(ewma) in (float, int)
+        return _OFSniff.setChangeSensitivity(metric, float(cusum), float(ewma))
+
+    # Returns a (cusum, ewma) tuple, None if changes of metric aren't detected
+    def getChangeSensitivity(self, metric):
+        assert type(metric) in (str, unicode)
+        return _OFSniff.getChangeSensitivity(metric)
+
+    # Keeps 1s, 1min and 1h rollups (count, min, max, mean, p50, p90, p99) of
+    # the echo RTT, PacketIn RTT and link latency samples; with log_path, one
+    # line per stream and closed log_level interval ("1s", "1min", "1h") is
+    # appended to that file
+    # Must be called before startSniffLoop()
+    def enableRollups(self, log_path="", log_level="1min"):
+        assert type(log_path) in (str, unicode)
+        assert type(log_level) in (str, unicode)
+        return _OFSniff.enableRollups(log_path, log_level)
+
+    # Returns the rollups of metric ("echo_rtt", "pktin_rtt", "link_latency"
+    # of the link at port_no) at level ("1s", "1min", "1h") of the intervals
+    # starting in [from_s, to_s) (packet time, seconds since the epoch; 0 for
+    # all that are kept), as a dict of "start", "resolution" and arrays with
+    # one entry per interval: "count", "min", "max", "mean", "p50", "p90",
+    # "p99" (ms, NaN for intervals without samples)
+    def getRollups(self, endpoint, metric, level="1s", from_s=0, to_s=0, port_no=0):
+        assert type(endpoint) in (int, long)
+        assert type(metric) in (str, unicode)
+        assert type(level) in (str, unicode)
+        assert type(from_s) in (int, long)
+        assert type(to_s) in (int, long)
+        assert type(port_no) is int
+        return _OFSniff.getRollups(endpoint, metric, level, from_s, to_s, port_no)
+
+    # Returns a (published, dropped) tuple of observer event counts
+    def getObserverStats(self):
+        return _OFSniff.getObserverStats()
+
+    # Returns {endpoint: {"window_sec", "unparsed_bytes", "from_switch", "to_switch"}}
+    # where from_switch/to_switch map OpenFlow type =>
+    # (msgs, bytes, msgs_per_sec, bytes_per_sec), refreshed every second
+    def getOFTraffic(self):
+        return _OFSniff.getOFTraffic()
+
+    def getOFTypeName(self, of_type):
+        assert type(of_type) is int
+        return _OFSniff.getOFTypeName(of_type)
+
+    # Returns {kind: (count, expired, mean, min, max, last)} of request/reply
+    # latencies (ms) timed by xid; kinds are echo, echo_from_switch, features,
+    # get_config, stats, barrier, queue_config, role and flow_install
+    # (earliest FlowMod before a barrier => barrier reply)
+    def getTransactionStats(self, endpoint):
+        assert type(endpoint) in (long, int)
+        return _OFSniff.getTransactionStats(endpoint)
+
+    # Returns a dict with "to_switch" and "from_switch" entries, each a
+    # (count, mean, min, max, srtt, last, in_flight, in_flight_peak) tuple:
+    # passive TCP RTT samples (ms) of segments sent in that direction, and
+    # the Bytes sent in that direction still unacknowledged (now, and the
+    # highest in the last second). Capturing on the controller host,
+    # to_switch RTTs are network delay and from_switch RTTs controller delay
+    def getTCPStats(self, endpoint):
+        assert type(endpoint) in (long, int)
+        return _OFSniff.getTCPStats(endpoint)
+
+    # Returns a (sent, matched, expired) tuple of LLDP probe counts
+    def getProbeStats(self, endpoint):
+        assert type(endpoint) in (long, int)
+        return _OFSniff.getProbeStats(endpoint)
+
+    # Returns a (sample_rate, skipped) tuple: the share of LLDP probes
+    # processed when the endpoint's last probe was seen, i.e. the rate its
+    # link latency and PacketIn RTT statistics are currently sampled at, and
+    # the probe messages skipped under overload
+    def getProbeSampling(self, endpoint):
+        assert type(endpoint) in (long, int)
+        return _OFSniff.getProbeSampling(endpoint)
+
+    # Returns the Bytes of metadata kept for the endpoint
+    def getEndpointMemory(self, endpoint):
+        assert type(endpoint) in (long, int)
+        return _OFSniff.getEndpointMemory(endpoint)
+
+    # Returns the switch's datapath ID (from its FeaturesReply), 0 if not seen yet
+    def getDatapathID(self, endpoint):
+        assert type(endpoint) in (long, int)
+        return _OFSniff.getDatapathID(endpoint)
+
     def getEndpoints(self):
         return _OFSniff.getEndpoints()
 
@@ -107,6 +417,20 @@ class OFSniff(object):
         assert type(endpoint) in (long, int)
         return _OFSniff.getPktInRTTMed(endpoint)
 
+    # Current values of the metrics' estimators (see setLatencyConfig())
+    def getEchoRTTSmoothed(self, endpoint):
+        assert type(endpoint) in (long, int)
+        return _OFSniff.getEchoRTTSmoothed(endpoint)
+
+    def getPktInRTTSmoothed(self, endpoint):
+        assert type(endpoint) in (long, int)
+        return _OFSniff.getPktInRTTSmoothed(endpoint)
+
+    def getLinkLatSmoothed(self, endpoint, port_no):
+        assert type(endpoint) in (long, int)
+        assert type(port_no) is int
+        return _OFSniff.getLinkLatSmoothed(endpoint, port_no)
+
     def getLinkLatAvg(self, endpoint, port_no):
         assert type(endpoint) in (long, int)
         assert type(port_no) is int
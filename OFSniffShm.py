@@ -0,0 +1,113 @@
+# vim: tabstop=4 shiftwidth=4 softtabstop=4
+#
+# Copyright (C) 2018, The SAVI Project.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+# implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Reader for the shared-memory statistics table published by OFSniff
+# (see include/ShmStatsTable.h for the binary layout, which this file mirrors)
+#
+# Unlike OFSniff.py, this module needs neither root access nor the _OFSniff
+# extension, so any local process can read the latest statistics.
+
+import os
+import mmap
+import struct
+
+SHM_TABLE_MAGIC = 0x4853464f
+SHM_TABLE_LAYOUT_VERSION = 1
+SHM_HASH_MULTIPLIER = 0x9E3779B97F4A7C15
+MASK64 = (1 << 64) - 1
+
+METRIC_ECHO_RTT = 1
+METRIC_PKT_IN_RTT = 2
+METRIC_LINK_LAT = 3
+
+_HEADER = struct.Struct("<IHHIIQQ")
+_HEADER_SIZE = 64
+_RECORD = struct.Struct("<IBBHQQddddq")
+_RECORD_SIZE = 64
+
+def _slotOf(endpoint, metric, port_no, capacity):
+    key = endpoint ^ (metric << 56) ^ (port_no << 48)
+    return (((key * SHM_HASH_MULTIPLIER) & MASK64) >> 32) & (capacity - 1)
+
+
+class ShmStatsReader(object):
+    # name is the one given to OFSniff (i.e. the table is /dev/shm/<name>)
+    def __init__(self, name):
+        self._fd = os.open("/dev/shm/" + name, os.O_RDONLY)
+        size = os.fstat(self._fd).st_size
+        self._map = mmap.mmap(self._fd, size, mmap.MAP_SHARED, mmap.PROT_READ)
+
+        magic, version, recordSize, self.capacity, self.writerPid, _, _ = \
+            _HEADER.unpack_from(self._map, 0)
+        if magic != SHM_TABLE_MAGIC or version != SHM_TABLE_LAYOUT_VERSION or \
+                recordSize != _RECORD_SIZE or \
+                _HEADER_SIZE + self.capacity * _RECORD_SIZE > size:
+            self.close()
+            raise ValueError("/dev/shm/%s is not a valid OFSniff statistics table" % name)
+
+    def close(self):
+        if self._map is not None:
+            self._map.close()
+            os.close(self._fd)
+            self._map = None
+
+    # True if OFSniff has since removed (or re-created) the table
+    def isStale(self):
+        return os.fstat(self._fd).st_nlink == 0
+
+    def numRecords(self):
+        return _HEADER.unpack_from(self._map, 0)[5]
+
+    # Consistent (seqlock-protected) copy of the record in the given slot
+    def _readSlot(self, slot):
+        offset = _HEADER_SIZE + slot * _RECORD_SIZE
+        while True:
+            rec = _RECORD.unpack_from(self._map, offset)
+            seq = struct.unpack_from("<I", self._map, offset)[0]
+            if rec[0] & 1 == 0 and rec[0] == seq:
+                return rec
+
+    @staticmethod
+    def _toDict(rec):
+        return {"metric": rec[1], "port_no": rec[3], "endpoint": rec[4],
+                "count": rec[5], "avg": rec[6], "var": rec[7], "med": rec[8],
+                "last": rec[9], "updatedUs": rec[10],
+                "sample_rate": 1.0 / (1 << rec[2])}
+
+    # Returns a dict of the statistics, or None if there are none (yet)
+    # port_no is only meaningful for METRIC_LINK_LAT
+    def lookup(self, endpoint, metric, port_no=0):
+        slot = _slotOf(endpoint, metric, port_no, self.capacity)
+        for _ in range(self.capacity):
+            rec = self._readSlot(slot)
+            if rec[1] == 0:
+                return None
+            if rec[4] == endpoint and rec[1] == metric and rec[3] == port_no:
+                return self._toDict(rec)
+            slot = (slot + 1) & (self.capacity - 1)
+
+        return None
+
+    # Returns a list of dicts, one for every record in the table
+    def records(self):
+        result = []
+        for slot in range(self.capacity):
+            rec = self._readSlot(slot)
+            if rec[1] != 0:
+                result.append(self._toDict(rec))
+
+        return result
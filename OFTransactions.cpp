@@ -0,0 +1,201 @@
+#include "OFTransactions.h"
+
+#include <cstring>
+
+#define OF_TYPE_FLOW_MOD 14 // Same in all OpenFlow versions
+#define OF_STATS_REPLY_MORE 0x1 // OFPSF_REPLY_MORE / OFPMPF_REPLY_MORE
+#define OF_STATS_FLAGS_OFFSET 10
+
+// Returns false if 'type' isn't a tracked request type in the given version
+static bool requestKind(const uint8_t version, const uint8_t type, OFTransactionKind& kind) {
+    switch (type) {
+        case 2: kind = OF_TXN_ECHO; return true;
+        case 5: kind = OF_TXN_FEATURES; return true;
+        case 7: kind = OF_TXN_GET_CONFIG; return true;
+        default: break;
+    }
+
+    if (version == 1) {
+        // OpenFlow 1.0
+        switch (type) {
+            case 16: kind = OF_TXN_STATS; return true;
+            case 18: kind = OF_TXN_BARRIER; return true;
+            case 20: kind = OF_TXN_QUEUE_CONFIG; return true;
+            default: return false;
+        }
+    }
+
+    // OpenFlow 1.1+
+    switch (type) {
+        case 18: kind = OF_TXN_STATS; return true;
+        case 20: kind = OF_TXN_BARRIER; return true;
+        case 22: kind = OF_TXN_QUEUE_CONFIG; return true;
+        case 24: kind = OF_TXN_ROLE; return version >= 3;
+        default: return false;
+    }
+}
+
+/* Classifies a message by version and type (the reply type of every
+ * tracked request is the request type + 1)
+ * Returns false if it isn't a tracked request or reply.
+ */
+static bool classify(const uint8_t version, const uint8_t type,
+                        OFTransactionKind& kind, bool& isRequest) {
+    if (requestKind(version, type, kind)) {
+        isRequest = true;
+        return true;
+    }
+
+    if (type > 0 && requestKind(version, type - 1, kind)) {
+        isRequest = false;
+        return true;
+    }
+
+    return false;
+}
+
+OFTransactionTable::OFTransactionTable() : _used(0), _flowModUs(0), overflows(0) {
+    memset(_slots, 0, sizeof(_slots));
+    memset(stats, 0, sizeof(stats));
+};
+
+// Returns the slot of the request, or -1
+int32_t OFTransactionTable::find(const uint32_t xid, const uint8_t kind) const {
+    for (uint16_t i = slotOf(xid), n = 0; n < OF_TXN_TABLE_SIZE && _slots[i].used;
+            i = (i + 1) & (OF_TXN_TABLE_SIZE - 1), n++) {
+        if (_slots[i].xid == xid && _slots[i].kind == kind)
+            return i;
+    }
+
+    return -1;
+}
+
+void OFTransactionTable::insert(const uint32_t xid, const uint8_t kind, const uint64_t reqUs,
+                                const uint64_t flowModUs) {
+    uint16_t i = slotOf(xid);
+    for (uint16_t n = 0; n < OF_TXN_TABLE_SIZE; i = (i + 1) & (OF_TXN_TABLE_SIZE - 1), n++) {
+        OFTransaction& slot = _slots[i];
+        if (!slot.used || (slot.xid == xid && slot.kind == kind)) {
+            // Same xid and kind => retransmitted or reused xid, restart timing
+            if (!slot.used)
+                _used++;
+            slot.reqUs = reqUs;
+            slot.flowModUs = flowModUs;
+            slot.xid = xid;
+            slot.kind = kind;
+            slot.used = true;
+            return;
+        }
+    }
+
+    overflows++;
+}
+
+void OFTransactionTable::erase(uint16_t slot) {
+    _slots[slot].used = false;
+    _used--;
+
+    // The probe chain ends at the first free slot (at worst the hole itself)
+    uint16_t next = slot;
+    while (true) {
+        next = (next + 1) & (OF_TXN_TABLE_SIZE - 1);
+        if (!_slots[next].used)
+            break;
+
+        // Move the entry back unless its home slot lies in (slot, next]
+        uint16_t home = slotOf(_slots[next].xid);
+        if (((next - home) & (OF_TXN_TABLE_SIZE - 1)) >= ((next - slot) & (OF_TXN_TABLE_SIZE - 1))) {
+            _slots[slot] = _slots[next];
+            _slots[next].used = false;
+            slot = next;
+        }
+    }
+}
+
+/* Processes one OpenFlow message header ('avail' Bytes of the
+ * message are readable, at least OF_HEADER_LEN)
+ * Returns true if it completed a transaction, whose kind and
+ * latency (ms) are returned through the parameters.
+ */
+bool OFTransactionTable::process(const uint8_t* header, const uint32_t avail, const bool toSwitch,
+                                    const uint64_t tsUs, OFTransactionKind& kind, double& latency) {
+    uint8_t version = header[0];
+    uint8_t type = header[1];
+    uint32_t xid = ((uint32_t)header[4] << 24) | ((uint32_t)header[5] << 16) |
+                    ((uint32_t)header[6] << 8) | header[7];
+
+    if (type == OF_TYPE_FLOW_MOD) {
+        if (toSwitch && _flowModUs == 0)
+            _flowModUs = tsUs;
+        return false;
+    }
+
+    bool isRequest;
+    if (!classify(version, type, kind, isRequest))
+        return false;
+
+    // Only echoes may be initiated by the switch
+    bool fromCtrl = (isRequest == toSwitch);
+    if (kind == OF_TXN_ECHO && !fromCtrl)
+        kind = OF_TXN_ECHO_FROM_SWITCH;
+    else if (!fromCtrl)
+        return false;
+
+    if (isRequest) {
+        if (_used == OF_TXN_TABLE_SIZE)
+            expire(tsUs);
+
+        uint64_t flowModUs = 0;
+        if (kind == OF_TXN_BARRIER) {
+            flowModUs = _flowModUs;
+            _flowModUs = 0;
+        }
+
+        insert(xid, kind, tsUs, flowModUs);
+        return false;
+    }
+
+    int32_t slot = find(xid, kind);
+    if (slot < 0)
+        return false;
+
+    // Multipart replies complete with their last part
+    if (kind == OF_TXN_STATS && avail >= OF_STATS_FLAGS_OFFSET + 2 &&
+            (header[OF_STATS_FLAGS_OFFSET + 1] & OF_STATS_REPLY_MORE))
+        return false;
+
+    const OFTransaction& txn = _slots[slot];
+    latency = (tsUs - txn.reqUs) / 1000.0;
+    stats[kind].add(latency);
+    if (txn.flowModUs)
+        stats[OF_TXN_FLOW_INSTALL].add((tsUs - txn.flowModUs) / 1000.0);
+
+    erase(slot);
+    return true;
+}
+
+// Expires requests older than OF_TXN_TIMEOUT_MS
+void OFTransactionTable::expire(const uint64_t nowUs) {
+    for (uint16_t i = 0; i < OF_TXN_TABLE_SIZE; i++) {
+        // Erasing may shift a later (possibly also expired) entry into slot i
+        while (_slots[i].used && nowUs - _slots[i].reqUs > OF_TXN_TIMEOUT_MS * 1000ULL) {
+            stats[_slots[i].kind].expired++;
+            erase(i);
+        }
+    }
+}
+
+const char* OFTransactionTable::kindName(const OFTransactionKind kind) {
+    switch (kind) {
+        case OF_TXN_ECHO: return "echo";
+        case OF_TXN_ECHO_FROM_SWITCH: return "echo_from_switch";
+        case OF_TXN_FEATURES: return "features";
+        case OF_TXN_GET_CONFIG: return "get_config";
+        case OF_TXN_STATS: return "stats";
+        case OF_TXN_BARRIER: return "barrier";
+        case OF_TXN_QUEUE_CONFIG: return "queue_config";
+        case OF_TXN_ROLE: return "role";
+        case OF_TXN_FLOW_INSTALL: return "flow_install";
+        default: return "unknown";
+    }
+}
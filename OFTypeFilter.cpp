@@ -0,0 +1,218 @@
+#include "OFTypeFilter.h"
+
+#include <iostream>
+
+using std::cout;
+using std::endl;
+
+#define ETH_HDR_LEN 14
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_IPV6 0x86DD
+#define IPV6_HDR_LEN 40
+#define IP_PROTO_TCP 6
+#define OF_HDR_LEN 8
+#define OF_MAX_VERSION 6 // OpenFlow 1.5
+#define TCP_FLAGS_CONN_CTRL 0x07 // FIN | SYN | RST
+
+/* Accepted packets are passed whole (the pcap snapshot length still applies)
+ * Rejected packets never leave the kernel.
+ */
+#define BPF_RET_ACCEPT 0x40000
+#define BPF_RET_REJECT 0
+
+/* Minimal assembler for classic BPF with forward jumps to named labels
+ * Jump offsets are 8 bits in classic BPF; the programs generated here are
+ * far below that limit.
+ */
+class BpfAssembler {
+    public:
+        enum Label { NEXT, ACCEPT, REJECT, PORT_OK, CHECK_TYPE, IPV6, NUM_LABELS };
+
+    private:
+        typedef struct Fixup {
+            uint32_t insn;
+            bool isTrue;
+            Label label;
+        } Fixup;
+
+        vector<struct bpf_insn> _prog;
+        vector<Fixup> _fixups;
+        int32_t _labels[NUM_LABELS];
+
+        void addFixup(const bool isTrue, const Label label) {
+            if (label != NEXT)
+                _fixups.push_back({(uint32_t)_prog.size() - 1, isTrue, label});
+        }
+
+    public:
+        BpfAssembler() {
+            for (uint16_t i = 0; i < NUM_LABELS; i++)
+                _labels[i] = -1;
+        };
+
+        void stmt(const uint16_t code, const uint32_t k) {
+            _prog.push_back({code, 0, 0, k});
+        }
+
+        void jump(const uint16_t code, const uint32_t k, const Label jt, const Label jf) {
+            _prog.push_back({code, 0, 0, k});
+            addFixup(true, jt);
+            addFixup(false, jf);
+        }
+
+        void label(const Label label) {
+            _labels[label] = _prog.size();
+        }
+
+        // Resolves all jumps, returns false on undefined labels or out-of-range jumps
+        bool finish(vector<struct bpf_insn>& prog) {
+            for (const Fixup& f : _fixups) {
+                int32_t offset = _labels[f.label] - (int32_t)f.insn - 1;
+                if (_labels[f.label] < 0 || offset < 0 || offset > 0xFF)
+                    return false;
+
+                if (f.isTrue)
+                    _prog[f.insn].jt = offset;
+                else
+                    _prog[f.insn].jf = offset;
+            }
+
+            prog = _prog;
+            return true;
+        }
+};
+
+/* Generates the BPF program for connections on any of the given ports
+ * Returns false if it could not be generated.
+ */
+bool BuildOFTypeFilter(const vector<uint16_t>& ofp_ports, const uint32_t ofTypeMask,
+                        const bool passPureAcks, vector<struct bpf_insn>& prog) {
+    typedef BpfAssembler A;
+    BpfAssembler a;
+
+    if (ofp_ports.empty())
+        return false;
+
+    /* Scratch memory:
+     *  M[0] = IP header length + TCP header length
+     *  M[1] = TCP payload length
+     *  M[2] = OpenFlow message type
+     */
+
+    // IPv4, TCP, first (or only) fragment
+    a.stmt(BPF_LD | BPF_H | BPF_ABS, 12);
+    a.jump(BPF_JMP | BPF_JEQ | BPF_K, ETHERTYPE_IPV4, A::NEXT, A::IPV6);
+    a.stmt(BPF_LD | BPF_B | BPF_ABS, ETH_HDR_LEN + 9);
+    a.jump(BPF_JMP | BPF_JEQ | BPF_K, IP_PROTO_TCP, A::NEXT, A::REJECT);
+    a.stmt(BPF_LD | BPF_H | BPF_ABS, ETH_HDR_LEN + 6);
+    a.jump(BPF_JMP | BPF_JSET | BPF_K, 0x1FFF, A::REJECT, A::NEXT);
+
+    // X = IP header length; either TCP port is one of the OpenFlow ports
+    a.stmt(BPF_LDX | BPF_B | BPF_MSH, ETH_HDR_LEN);
+    a.stmt(BPF_LD | BPF_H | BPF_IND, ETH_HDR_LEN);
+    for (uint16_t port : ofp_ports)
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, port, A::PORT_OK, A::NEXT);
+    a.stmt(BPF_LD | BPF_H | BPF_IND, ETH_HDR_LEN + 2);
+    for (uint32_t i = 0; i < ofp_ports.size(); i++) {
+        bool last = (i == ofp_ports.size() - 1);
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, ofp_ports[i], A::PORT_OK, last ? A::REJECT : A::NEXT);
+    }
+
+    // Connection control segments are always passed
+    a.label(A::PORT_OK);
+    a.stmt(BPF_LD | BPF_B | BPF_IND, ETH_HDR_LEN + 13);
+    a.jump(BPF_JMP | BPF_JSET | BPF_K, TCP_FLAGS_CONN_CTRL, A::ACCEPT, A::NEXT);
+
+    // M[0] = IP + TCP header lengths
+    a.stmt(BPF_LD | BPF_B | BPF_IND, ETH_HDR_LEN + 12);
+    a.stmt(BPF_ALU | BPF_AND | BPF_K, 0xF0);
+    a.stmt(BPF_ALU | BPF_RSH | BPF_K, 2);
+    a.stmt(BPF_ALU | BPF_ADD | BPF_X, 0);
+    a.stmt(BPF_ST, 0);
+
+    // M[1] = TCP payload length (IP total length - headers)
+    a.stmt(BPF_LDX | BPF_W | BPF_MEM, 0);
+    a.stmt(BPF_LD | BPF_H | BPF_ABS, ETH_HDR_LEN + 2);
+    a.stmt(BPF_ALU | BPF_SUB | BPF_X, 0);
+    a.jump(BPF_JMP | BPF_JEQ | BPF_K, 0, passPureAcks ? A::ACCEPT : A::REJECT, A::NEXT);
+    a.jump(BPF_JMP | BPF_JGE | BPF_K, OF_HDR_LEN, A::NEXT, A::ACCEPT);
+    a.stmt(BPF_ST, 1);
+
+    // Version byte must look like an OpenFlow header, else not on a message boundary
+    a.stmt(BPF_LD | BPF_B | BPF_IND, ETH_HDR_LEN);
+    a.jump(BPF_JMP | BPF_JEQ | BPF_K, 0, A::ACCEPT, A::NEXT);
+    a.jump(BPF_JMP | BPF_JGT | BPF_K, OF_MAX_VERSION, A::ACCEPT, A::NEXT);
+    a.stmt(BPF_LD | BPF_B | BPF_IND, ETH_HDR_LEN + 1);
+    a.stmt(BPF_ST, 2);
+
+    // Only a segment holding exactly one whole message can be judged by its type
+    a.stmt(BPF_LD | BPF_H | BPF_IND, ETH_HDR_LEN + 2);
+    a.stmt(BPF_LDX | BPF_W | BPF_MEM, 1);
+    a.jump(BPF_JMP | BPF_JEQ | BPF_X, 0, A::CHECK_TYPE, A::ACCEPT);
+
+    // Pass if bit 'type' of the mask is set; types beyond the mask are passed
+    a.label(A::CHECK_TYPE);
+    a.stmt(BPF_LD | BPF_W | BPF_MEM, 2);
+    a.jump(BPF_JMP | BPF_JGT | BPF_K, 31, A::ACCEPT, A::NEXT);
+    a.stmt(BPF_MISC | BPF_TAX, 0);
+    a.stmt(BPF_LD | BPF_IMM, 1);
+    a.stmt(BPF_ALU | BPF_LSH | BPF_X, 0);
+    a.jump(BPF_JMP | BPF_JSET | BPF_K, ofTypeMask, A::ACCEPT, A::REJECT);
+
+    // IPv6: TCP right after the fixed header on one of the ports, passed without type filtering
+    a.label(A::IPV6);
+    a.jump(BPF_JMP | BPF_JEQ | BPF_K, ETHERTYPE_IPV6, A::NEXT, A::REJECT);
+    a.stmt(BPF_LD | BPF_B | BPF_ABS, ETH_HDR_LEN + 6);
+    a.jump(BPF_JMP | BPF_JEQ | BPF_K, IP_PROTO_TCP, A::NEXT, A::REJECT);
+    a.stmt(BPF_LD | BPF_H | BPF_ABS, ETH_HDR_LEN + IPV6_HDR_LEN);
+    for (uint16_t port : ofp_ports)
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, port, A::ACCEPT, A::NEXT);
+    a.stmt(BPF_LD | BPF_H | BPF_ABS, ETH_HDR_LEN + IPV6_HDR_LEN + 2);
+    for (uint16_t port : ofp_ports)
+        a.jump(BPF_JMP | BPF_JEQ | BPF_K, port, A::ACCEPT, A::NEXT);
+    a.stmt(BPF_RET | BPF_K, BPF_RET_REJECT);
+
+    a.label(A::ACCEPT);
+    a.stmt(BPF_RET | BPF_K, BPF_RET_ACCEPT);
+    a.label(A::REJECT);
+    a.stmt(BPF_RET | BPF_K, BPF_RET_REJECT);
+
+    return a.finish(prog);
+}
+
+/* Installs the generated program on the handle (replacing its current filter)
+ * Returns false, leaving the current filter in place, if the handle's link
+ * type isn't supported or the program could not be installed.
+ */
+bool InstallOFTypeFilter(pcap_t* handle, const vector<uint16_t>& ofp_ports,
+                            const uint32_t ofTypeMask, const bool passPureAcks) {
+    if (handle == nullptr)
+        return false;
+
+    if (pcap_datalink(handle) != DLT_EN10MB) {
+        cout << "ERROR: OpenFlow type filter only supports Ethernet captures" << endl;
+        return false;
+    }
+
+    vector<struct bpf_insn> insns;
+    if (!BuildOFTypeFilter(ofp_ports, ofTypeMask, passPureAcks, insns)) {
+        cout << "ERROR: Unable to generate OpenFlow type filter" << endl;
+        return false;
+    }
+
+    struct bpf_program prog;
+    prog.bf_len = insns.size();
+    prog.bf_insns = insns.data();
+    if (pcap_setfilter(handle, &prog) != 0) {
+        cout << "ERROR: Unable to install OpenFlow type filter: " << pcap_geterr(handle) << endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Single OpenFlow port
+bool InstallOFTypeFilter(pcap_t* handle, const uint16_t ofp_port, const uint32_t ofTypeMask,
+                            const bool passPureAcks) {
+    return InstallOFTypeFilter(handle, vector<uint16_t>(1, ofp_port), ofTypeMask, passPureAcks);
+}
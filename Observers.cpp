@@ -0,0 +1,314 @@
+#include "Observers.h"
+
+#include <cerrno>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "ThreadPlacement.h"
+
+using std::cout;
+using std::endl;
+
+Observers::Observers() : _head(0), _tail(0), _signaled(false), _typeMask(0),
+                            _published(0), _dropped(0), _nextId(1), _pollingMask(0),
+                            _dispatcherRunning(false) {
+    for (uint16_t i = 0; i < NUM_OBS_METRICS; i++) {
+        _thresholds[i].store(0, std::memory_order_relaxed);
+        bool detects = detectsChanges((ObserverMetric)i);
+        _changeCusum[i].store(detects ? CHANGE_DEFAULT_CUSUM : 0, std::memory_order_relaxed);
+        _changeEwma[i].store(detects ? CHANGE_DEFAULT_EWMA : 0, std::memory_order_relaxed);
+    }
+
+    _eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_eventFd < 0)
+        cout << "ERROR: Unable to create observer eventfd (errno " << errno << ")" << endl;
+};
+
+Observers::~Observers() {
+    stopDispatcher();
+
+    if (_eventFd >= 0)
+        close(_eventFd);
+};
+
+uint64_t Observers::nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * MILLION + ts.tv_nsec / THOUSAND;
+}
+
+/* The seq_cst ordering of the _head store and the _signaled exchange pairs
+ * with the consumer clearing _signaled before reading _head: either the
+ * consumer sees the new event, or the producer sees _signaled cleared and
+ * signals the eventfd again.
+ */
+void Observers::push(const ObserverEvent& event) {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) >= OBS_QUEUE_SIZE) {
+        bump(_dropped);
+        return;
+    }
+
+    _queue[head & (OBS_QUEUE_SIZE - 1)] = event;
+    _head.store(head + 1);
+    bump(_published);
+
+    if (!_signaled.exchange(true) && _eventFd >= 0) {
+        uint64_t one = 1;
+        if (write(_eventFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            cout << "ERROR: Unable to signal observer eventfd (errno " << errno << ")" << endl;
+    }
+}
+
+void Observers::sampleSlow(const IPv4EndpointType endpoint, const ObserverMetric metric,
+                            const uint16_t port_no, const double value) {
+    uint32_t typeMask = _typeMask.load(std::memory_order_relaxed);
+    ObserverEvent event = {nowUs(), endpoint, value, 0, port_no, OBS_EVENT_SAMPLE,
+                            (uint8_t)metric, false};
+
+    if (typeMask & OBS_EVENT_BIT(OBS_EVENT_SAMPLE))
+        push(event);
+
+    double threshold = _thresholds[metric].load(std::memory_order_relaxed);
+    if (!(typeMask & OBS_EVENT_BIT(OBS_EVENT_THRESHOLD)) || threshold <= 0)
+        return;
+
+    // The first sample of a metric only crosses if it starts out above
+    bool above = value > threshold;
+    bool& wasAbove = _above[endpoint][((uint32_t)metric << 16) | port_no];
+    if (above == wasAbove)
+        return;
+
+    wasAbove = above;
+    event.type = OBS_EVENT_THRESHOLD;
+    event.threshold = threshold;
+    event.above = above;
+    push(event);
+}
+
+/* Publishes a change of the metric's level, detected by the caller's
+ * ChangeDetector (see changeSensitivity())
+ */
+void Observers::changePoint(const IPv4EndpointType endpoint, const ObserverMetric metric,
+                            const uint16_t port_no, const double level, const double baseline,
+                            const bool up) {
+    if (!(_typeMask.load(std::memory_order_relaxed) & OBS_EVENT_BIT(OBS_EVENT_CHANGE)))
+        return;
+
+    push({nowUs(), endpoint, level, baseline, port_no, OBS_EVENT_CHANGE, (uint8_t)metric, up});
+}
+
+void Observers::endpointUp(const IPv4EndpointType endpoint) {
+    if (!(_typeMask.load(std::memory_order_relaxed) & OBS_EVENT_BIT(OBS_EVENT_ENDPOINT_UP)))
+        return;
+
+    push({nowUs(), endpoint, 0, 0, 0, OBS_EVENT_ENDPOINT_UP, OBS_METRIC_NONE, false});
+}
+
+void Observers::endpointDown(const IPv4EndpointType endpoint) {
+    // Thresholds are crossed anew by the next connection
+    _above.erase(endpoint);
+
+    if (!(_typeMask.load(std::memory_order_relaxed) & OBS_EVENT_BIT(OBS_EVENT_ENDPOINT_DOWN)))
+        return;
+
+    push({nowUs(), endpoint, 0, 0, 0, OBS_EVENT_ENDPOINT_DOWN, OBS_METRIC_NONE, false});
+}
+
+/* THRESHOLD events are published when samples of 'metric' cross
+ * 'threshold' (ms); a threshold <= 0 disables them
+ */
+void Observers::setThreshold(const ObserverMetric metric, const double threshold) {
+    if (metric > OBS_METRIC_NONE && metric < NUM_OBS_METRICS)
+        _thresholds[metric].store(threshold, std::memory_order_relaxed);
+}
+
+double Observers::getThreshold(const ObserverMetric metric) const {
+    if (metric > OBS_METRIC_NONE && metric < NUM_OBS_METRICS)
+        return _thresholds[metric].load(std::memory_order_relaxed);
+    return 0;
+}
+
+/* Sets the sensitivity of the change detectors of 'metric', see
+ * ChangeDetector.h; both 0 disables change detection of the metric
+ * Returns false if changes of the metric aren't detected.
+ */
+bool Observers::setChangeSensitivity(const ObserverMetric metric, const ChangeSensitivity& sens) {
+    if (!detectsChanges(metric))
+        return false;
+
+    _changeCusum[metric].store(std::max(sens.cusum, 0.0), std::memory_order_relaxed);
+    _changeEwma[metric].store(std::max(sens.ewma, 0.0), std::memory_order_relaxed);
+    return true;
+}
+
+// Recomputes _typeMask, _subscribersMutex must be held
+void Observers::updateTypeMask() {
+    uint32_t typeMask = _pollingMask;
+    for (const Subscriber& sub : _subscribers)
+        typeMask |= sub.typeMask;
+
+    _typeMask.store(typeMask, std::memory_order_relaxed);
+}
+
+/* Registers a callback for the event types in typeMask (OBS_EVENT_BIT()s),
+ * starting the dispatcher thread if needed
+ * Callbacks run on the dispatcher thread and should return quickly;
+ * they must not call subscribe() or unsubscribe().
+ * Returns the subscription ID, or 0 if polling is enabled.
+ */
+uint32_t Observers::subscribe(const uint32_t typeMask, const ObserverCallback& callback) {
+    std::lock_guard<std::mutex> lock(_subscribersMutex);
+    if (_pollingMask || !callback)
+        return 0;
+
+    _subscribers.push_back({_nextId, typeMask & OBS_EVENTS_ALL, callback});
+    updateTypeMask();
+
+    if (!_dispatcherRunning.exchange(true))
+        _dispatcher = std::thread(&Observers::dispatchLoop, this);
+
+    return _nextId++;
+}
+
+// Returns false if there is no such subscription
+bool Observers::unsubscribe(const uint32_t id) {
+    std::lock_guard<std::mutex> lock(_subscribersMutex);
+    for (auto it = _subscribers.begin(); it != _subscribers.end(); it++) {
+        if (it->id == id) {
+            _subscribers.erase(it);
+            updateTypeMask();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Observers::dispatchLoop() {
+    ThreadPlacements::place(THREAD_WORKER, "observers");
+
+    ObserverEvent events[OBS_DISPATCH_BATCH];
+    struct pollfd pfd = {_eventFd, POLLIN, 0};
+
+    while (_dispatcherRunning.load(std::memory_order_relaxed)) {
+        if (_eventFd >= 0)
+            poll(&pfd, 1, OBS_DISPATCH_POLL_MS);
+        else
+            usleep(OBS_DISPATCH_POLL_MS * THOUSAND);
+
+        uint32_t numEvents;
+        while ((numEvents = drain(events, OBS_DISPATCH_BATCH)) > 0) {
+            std::lock_guard<std::mutex> lock(_subscribersMutex);
+            for (uint32_t i = 0; i < numEvents; i++) {
+                for (const Subscriber& sub : _subscribers) {
+                    if (sub.typeMask & OBS_EVENT_BIT(events[i].type))
+                        sub.callback(events[i]);
+                }
+            }
+        }
+    }
+}
+
+void Observers::stopDispatcher() {
+    if (!_dispatcherRunning.exchange(false))
+        return;
+
+    if (_dispatcher.joinable())
+        _dispatcher.join();
+}
+
+/* Enables queueing events of the types in typeMask for drain()
+ * Returns an eventfd that is readable while events are queued, or
+ * -1 if there are callback subscribers.
+ */
+int Observers::enablePolling(const uint32_t typeMask) {
+    std::lock_guard<std::mutex> lock(_subscribersMutex);
+    if (!_subscribers.empty())
+        return -1;
+
+    _pollingMask = typeMask & OBS_EVENTS_ALL;
+    updateTypeMask();
+    return _eventFd;
+}
+
+void Observers::disablePolling() {
+    std::lock_guard<std::mutex> lock(_subscribersMutex);
+    _pollingMask = 0;
+    updateTypeMask();
+}
+
+/* Takes up to maxEvents queued events out, oldest first, and resets
+ * the eventfd (it is signaled again if events remain)
+ * Returns the number of events copied into 'events'.
+ */
+uint32_t Observers::drain(ObserverEvent* events, const uint32_t maxEvents) {
+    std::lock_guard<std::mutex> lock(_consumerMutex);
+
+    uint64_t count;
+    if (_eventFd >= 0 && read(_eventFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        cout << "ERROR: Unable to read observer eventfd (errno " << errno << ")" << endl;
+    _signaled.store(false);
+
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    uint32_t head = _head.load();
+    uint32_t numEvents = 0;
+    while (tail != head && numEvents < maxEvents)
+        events[numEvents++] = _queue[tail++ & (OBS_QUEUE_SIZE - 1)];
+    _tail.store(tail, std::memory_order_release);
+
+    // Keep the eventfd readable for the events left behind
+    if (tail != head && !_signaled.exchange(true) && _eventFd >= 0) {
+        uint64_t one = 1;
+        if (write(_eventFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            cout << "ERROR: Unable to signal observer eventfd (errno " << errno << ")" << endl;
+    }
+
+    return numEvents;
+}
+
+uint64_t Observers::getPublished() const {
+    return _published.load(std::memory_order_relaxed);
+}
+
+// Events lost because the queue was full
+uint64_t Observers::getDropped() const {
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+const char* Observers::typeName(const ObserverEventType type) {
+    switch (type) {
+        case OBS_EVENT_SAMPLE: return "sample";
+        case OBS_EVENT_THRESHOLD: return "threshold";
+        case OBS_EVENT_ENDPOINT_UP: return "endpoint_up";
+        case OBS_EVENT_ENDPOINT_DOWN: return "endpoint_down";
+        case OBS_EVENT_CHANGE: return "change";
+        default: return "unknown";
+    }
+}
+
+const char* Observers::metricName(const ObserverMetric metric) {
+    switch (metric) {
+        case OBS_METRIC_NONE: return "none";
+        case OBS_METRIC_ECHO_RTT: return "echo_rtt";
+        case OBS_METRIC_PKT_IN_RTT: return "pktin_rtt";
+        case OBS_METRIC_LINK_LAT: return "link_latency";
+        case OBS_METRIC_TCP_RTT_TO_SWITCH: return "tcp_rtt_to_switch";
+        case OBS_METRIC_TCP_RTT_FROM_SWITCH: return "tcp_rtt_from_switch";
+        default: return "unknown";
+    }
+}
+
+// Parses a metricName(), returns false if unknown
+bool Observers::parseMetric(const string& name, ObserverMetric& metric) {
+    for (uint16_t i = OBS_METRIC_NONE + 1; i < NUM_OBS_METRICS; i++) {
+        if (name == metricName((ObserverMetric)i)) {
+            metric = (ObserverMetric)i;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,91 @@
+#include "OverloadGovernor.h"
+
+using std::endl;
+
+OverloadGovernor::OverloadGovernor() : _level(0), _maxLevel(OVERLOAD_MAX_LEVEL),
+        _raised(0), _lowered(0), _shedMessages(0), _skippedProbes(0) {};
+
+// FNV-1a, with a final mix so the top bits depend on all of the ID
+uint32_t OverloadGovernor::hashProbeID(const string& packetID) {
+    uint32_t hash = 2166136261U;
+    for (char c : packetID) {
+        hash ^= (uint8_t)c;
+        hash *= 16777619U;
+    }
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/* Highest level the governor may go to, 0 disables it
+ * Lowering it below the current level takes effect immediately.
+ */
+void OverloadGovernor::setMaxLevel(const uint8_t maxLevel) {
+    uint8_t newMax = std::min<uint8_t>(maxLevel, OVERLOAD_MAX_LEVEL);
+    _maxLevel.store(newMax, std::memory_order_relaxed);
+
+    if (level() > newMax)
+        _level.store(newMax, std::memory_order_relaxed);
+}
+
+/* Adjusts the level at the end of a capture stats interval
+ * Returns true if the level changed.
+ */
+bool OverloadGovernor::update(const CaptureInterval& interval) {
+    double fullShare = _batches ? (double)_fullBatches / _batches : 0;
+    _batches = 0;
+    _fullBatches = 0;
+
+    // Only capture buffer drops; interface drops aren't caused by the sniff loop
+    bool pressure = (interval.drop > 0 || fullShare >= OVERLOAD_FULL_BATCHES_HIGH);
+    bool calm = (interval.drop == 0 && fullShare < OVERLOAD_FULL_BATCHES_LOW);
+
+    uint8_t lvl = level();
+    if (pressure) {
+        _calmIntervals = 0;
+        if (lvl < _maxLevel.load(std::memory_order_relaxed)) {
+            _level.store(lvl + 1, std::memory_order_relaxed);
+            bump(_raised);
+            return true;
+        }
+    } else if (calm && lvl > 0) {
+        if (++_calmIntervals >= OVERLOAD_CALM_INTERVALS) {
+            _calmIntervals = 0;
+            _level.store(lvl - 1, std::memory_order_relaxed);
+            bump(_lowered);
+            return true;
+        }
+    } else {
+        _calmIntervals = 0;
+    }
+
+    return false;
+}
+
+OverloadState OverloadGovernor::state() const {
+    OverloadState state;
+    state.level = level();
+    state.maxLevel = _maxLevel.load(std::memory_order_relaxed);
+    state.sampleRate = sampleRate();
+    state.raised = _raised.load(std::memory_order_relaxed);
+    state.lowered = _lowered.load(std::memory_order_relaxed);
+    state.shedMessages = _shedMessages.load(std::memory_order_relaxed);
+    state.skippedProbes = _skippedProbes.load(std::memory_order_relaxed);
+    return state;
+}
+
+// Human-readable level and counters
+void OverloadGovernor::dump(std::ostream& os) const {
+    OverloadState s = state();
+
+    os << "Overload: level " << (uint32_t)s.level << " of " << (uint32_t)s.maxLevel;
+    if (s.maxLevel == 0)
+        os << " (disabled)";
+    os << ", probe sampling rate " << s.sampleRate << ", raised " << s.raised <<
+        " times, lowered " << s.lowered << " times; " << s.shedMessages <<
+        " messages shed, " << s.skippedProbes << " probe messages skipped" << endl;
+}
@@ -0,0 +1,148 @@
+#include "Rollups.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+const char* RollupLevelName(const RollupLevel level) {
+    switch (level) {
+        case ROLLUP_SECOND: return "1s";
+        case ROLLUP_MINUTE: return "1min";
+        case ROLLUP_HOUR: return "1h";
+        default: return "unknown";
+    }
+}
+
+// Parses a RollupLevelName() ("1s", "1min", "1h"), returns false if unknown
+bool ParseRollupLevel(const char* name, RollupLevel& level) {
+    for (uint8_t i = 0; i < NUM_ROLLUP_LEVELS; i++) {
+        if (strcmp(name, RollupLevelName((RollupLevel)i)) == 0) {
+            level = (RollupLevel)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint16_t RollupTable::bucket(const double val) {
+    if (!(val > ROLLUP_MIN_MS))
+        return 0;
+
+    double b = 1 + std::floor(std::log2(val / ROLLUP_MIN_MS) * ROLLUP_BUCKETS_PER_OCTAVE);
+    return b < ROLLUP_BUCKETS - 1 ? (uint16_t)b : ROLLUP_BUCKETS - 1;
+}
+
+// Estimated q-quantile of an open interval's samples
+float RollupTable::quantile(const RollupAccum& acc, const double q) {
+    uint64_t rank = (uint64_t)std::ceil(q * acc.count);
+    uint64_t seen = 0;
+    uint16_t b = 0;
+    while (b < ROLLUP_BUCKETS - 1 && (seen += acc.buckets[b]) < rank)
+        b++;
+
+    // Geometric middle of the bucket, within what was seen
+    double val = b == 0 ? ROLLUP_MIN_MS :
+                    ROLLUP_MIN_MS * std::exp2((b - 0.5) / ROLLUP_BUCKETS_PER_OCTAVE);
+    return std::min(std::max((float)val, acc.min), acc.max);
+}
+
+void RollupTable::fillSlot(const RollupAccum& acc, const uint32_t interval, RollupSlot& slot) {
+    slot.interval = interval;
+    slot.count = acc.count;
+    if (acc.count == 0) {
+        slot.min = slot.max = slot.mean = std::numeric_limits<float>::quiet_NaN();
+        slot.p50 = slot.p90 = slot.p99 = std::numeric_limits<float>::quiet_NaN();
+        return;
+    }
+
+    slot.min = acc.min;
+    slot.max = acc.max;
+    slot.mean = acc.sum / acc.count;
+    slot.p50 = quantile(acc, 0.5);
+    slot.p90 = quantile(acc, 0.9);
+    slot.p99 = quantile(acc, 0.99);
+}
+
+void RollupTable::resetAccum(RollupAccum& acc) {
+    memset(&acc, 0, sizeof(RollupAccum));
+}
+
+// Returns the index of a new, empty row
+uint32_t RollupTable::addRow() {
+    for (uint8_t level = 0; level < NUM_ROLLUP_LEVELS; level++) {
+        _open[level].emplace_back();
+        resetAccum(_open[level].back());
+        _slots[level].resize(_slots[level].size() + ROLLUP_SLOTS[level]);
+        _head[level].push_back(0);
+        _len[level].push_back(0);
+    }
+
+    return rows() - 1;
+}
+
+// Reserves room for 'rows' rows, so adding them won't reallocate
+void RollupTable::reserve(const uint32_t rows) {
+    for (uint8_t level = 0; level < NUM_ROLLUP_LEVELS; level++) {
+        _open[level].reserve(rows);
+        _slots[level].reserve((size_t)rows * ROLLUP_SLOTS[level]);
+        _head[level].reserve(rows);
+        _len[level].reserve(rows);
+    }
+}
+
+// Bytes of one row, all levels
+size_t RollupTable::rowBytes() {
+    size_t bytes = 0;
+    for (uint8_t level = 0; level < NUM_ROLLUP_LEVELS; level++)
+        bytes += sizeof(RollupAccum) + ROLLUP_SLOTS[level] * sizeof(RollupSlot) + 2 * sizeof(uint16_t);
+
+    return bytes;
+}
+
+/* Intervals of the row at 'level' starting in [fromS, toS), including
+ * the open one; only the last ROLLUP_SLOTS[level] intervals are kept
+ */
+void RollupTable::query(const uint32_t row, const RollupLevel level, const uint64_t fromS,
+                        const uint64_t toS, RollupSeries& out) const {
+    uint32_t res = ROLLUP_RESOLUTION_S[level];
+    uint16_t slots = ROLLUP_SLOTS[level];
+    uint64_t open = _interval[level];
+    uint64_t first = std::max<uint64_t>(fromS / res, open >= slots ? open - slots + 1 : 0);
+    uint64_t last = std::min<uint64_t>(toS ? (toS - 1) / res : 0, open);
+    size_t n = (toS > fromS && last >= first) ? last - first + 1 : 0;
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    out.startS = first * res;
+    out.resolutionS = res;
+    out.count.assign(n, 0);
+    out.min.assign(n, nan);
+    out.max.assign(n, nan);
+    out.mean.assign(n, nan);
+    out.p50.assign(n, nan);
+    out.p90.assign(n, nan);
+    out.p99.assign(n, nan);
+    if (n == 0)
+        return;
+
+    RollupSlot current;
+    fillSlot(_open[level][row], open, current);
+
+    uint16_t len = _len[level][row];
+    for (uint16_t i = 0; i <= len; i++) {
+        const RollupSlot& slot = (i < len) ?
+                _slots[level][(size_t)row * slots + (_head[level][row] + i) % slots] : current;
+        if (slot.count == 0 || slot.interval < first || slot.interval > last)
+            continue;
+
+        size_t j = slot.interval - first;
+        out.count[j] = slot.count;
+        out.min[j] = slot.min;
+        out.max[j] = slot.max;
+        out.mean[j] = slot.mean;
+        out.p50[j] = slot.p50;
+        out.p90[j] = slot.p90;
+        out.p99[j] = slot.p99;
+    }
+}
@@ -0,0 +1,130 @@
+#include "ShmStatsTable.h"
+
+#include <cerrno>
+#include <ctime>
+
+using std::cout;
+using std::endl;
+
+ShmStatsWriter::ShmStatsWriter() {};
+
+// Unlinks the region, readers that still have it mapped may notice via isStale()
+ShmStatsWriter::~ShmStatsWriter() {
+    close();
+};
+
+/* Creates (or re-creates) /dev/shm/<name> with room for 'capacity'
+ * records (rounded up to a power of 2). Returns false on failure.
+ */
+bool ShmStatsWriter::open(const string& name, const uint32_t capacity) {
+    close();
+
+    uint32_t cap = 1;
+    while (cap < capacity)
+        cap <<= 1;
+
+    // Start from a fresh region so readers of an old one see it as stale
+    string shmName = "/" + name;
+    shm_unlink(shmName.c_str());
+
+    _fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (_fd < 0) {
+        cout << "ERROR: Unable to create shared memory region " << shmName <<
+            ": " << strerror(errno) << endl;
+        return false;
+    }
+
+    _mapLen = sizeof(ShmTableHeader) + (size_t)cap * sizeof(ShmStatsRecord);
+    if (ftruncate(_fd, _mapLen) != 0) {
+        cout << "ERROR: Unable to size shared memory region " << shmName <<
+            ": " << strerror(errno) << endl;
+        ::close(_fd);
+        shm_unlink(shmName.c_str());
+        _fd = -1;
+        return false;
+    }
+
+    void* addr = mmap(nullptr, _mapLen, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (addr == MAP_FAILED) {
+        cout << "ERROR: Unable to map shared memory region " << shmName <<
+            ": " << strerror(errno) << endl;
+        ::close(_fd);
+        shm_unlink(shmName.c_str());
+        _fd = -1;
+        return false;
+    }
+
+    // ftruncate() zero-fills, so all records start out empty
+    _name = shmName;
+    _header = (ShmTableHeader*)addr;
+    _records = (ShmStatsRecord*)(_header + 1);
+
+    _header->layoutVersion = SHM_TABLE_LAYOUT_VERSION;
+    _header->recordSize = sizeof(ShmStatsRecord);
+    _header->capacity = cap;
+    _header->writerPid = getpid();
+    __atomic_store_n(&_header->magic, SHM_TABLE_MAGIC, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+void ShmStatsWriter::close() {
+    if (_header) {
+        munmap(_header, _mapLen);
+        shm_unlink(_name.c_str());
+    }
+    if (_fd >= 0)
+        ::close(_fd);
+
+    _header = nullptr;
+    _records = nullptr;
+    _fd = -1;
+}
+
+void ShmStatsWriter::publish(const IPv4EndpointType endpoint, const ShmMetricType metric,
+                const uint16_t port_no, const uint64_t count,
+                const double avg, const double var, const double med,
+                const double last, const uint8_t sampleShift) {
+    uint32_t mask = _header->capacity - 1;
+    uint32_t slot = ShmSlotOf(endpoint, metric, port_no, _header->capacity);
+
+    // Single writer, so the records can be probed without the seqlock
+    ShmStatsRecord* rec = nullptr;
+    for (uint32_t probes = 0; probes <= mask; probes++, slot = (slot + 1) & mask) {
+        ShmStatsRecord& cur = _records[slot];
+        if (cur.metric == SHM_METRIC_NONE ||
+                (cur.endpoint == endpoint && cur.metric == metric && cur.port_no == port_no)) {
+            rec = &cur;
+            break;
+        }
+    }
+
+    if (rec == nullptr) {
+        if (_header->overflows.fetch_add(1, std::memory_order_relaxed) == 0)
+            cout << "ERROR: Shared memory statistics table " << _name << " is full" << endl;
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+
+    uint32_t seq = rec->seq.load(std::memory_order_relaxed);
+    rec->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (rec->metric == SHM_METRIC_NONE) {
+        rec->endpoint = endpoint;
+        rec->port_no = port_no;
+        rec->metric = metric;
+        _header->numRecords.fetch_add(1, std::memory_order_relaxed);
+    }
+    rec->sampleShift = sampleShift;
+    rec->count = count;
+    rec->avg = avg;
+    rec->var = var;
+    rec->med = med;
+    rec->last = last;
+    rec->updatedUs = (int64_t)now.tv_sec * MILLION + now.tv_nsec / THOUSAND;
+
+    rec->seq.store(seq + 2, std::memory_order_release);
+}
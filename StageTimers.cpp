@@ -0,0 +1,146 @@
+#include "StageTimers.h"
+
+#include <chrono>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+
+using std::endl;
+
+// All StageTimers ever created. Threads are long-lived, so entries are never freed.
+static std::mutex registryMutex;
+static vector<StageTimers*> registry;
+
+static thread_local StageTimers* localTimers = nullptr;
+
+StageTimers::StageTimers(const string& name) : threadName(name) {
+    for (uint16_t i = 0; i < NUM_SNIFF_STAGES; i++) {
+        StageStats& s = _stages[i];
+        s.count = 0;
+        s.totalCycles = 0;
+        s.maxCycles = 0;
+        for (uint16_t b = 0; b < STAGE_HIST_BUCKETS; b++)
+            s.hist[b] = 0;
+    }
+};
+
+void StageTimers::copy(const SniffStage stage, StageStatsCopy& out) const {
+    const StageStats& s = _stages[stage];
+    out.threadName = threadName;
+    out.stage = stage;
+    out.count = s.count.load(std::memory_order_relaxed);
+    out.totalCycles = s.totalCycles.load(std::memory_order_relaxed);
+    out.maxCycles = s.maxCycles.load(std::memory_order_relaxed);
+    for (uint16_t b = 0; b < STAGE_HIST_BUCKETS; b++)
+        out.hist[b] = s.hist[b].load(std::memory_order_relaxed);
+}
+
+// Returns the calling thread's timers, registering them on first use
+StageTimers& StageTimers::local() {
+    if (localTimers == nullptr) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        localTimers = new StageTimers("thread-" + std::to_string(registry.size()));
+        registry.push_back(localTimers);
+    }
+
+    return *localTimers;
+}
+
+// Names the calling thread's timers (e.g. "main", "python-sniff")
+void StageTimers::setThreadName(const string& name) {
+    StageTimers& timers = local();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    timers.threadName = name;
+}
+
+// Copies of all stages of all threads that recorded anything
+vector<StageStatsCopy> StageTimers::collect() {
+    vector<StageStatsCopy> result;
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    for (StageTimers* timers : registry) {
+        for (uint16_t i = 0; i < NUM_SNIFF_STAGES; i++) {
+            StageStatsCopy c;
+            timers->copy((SniffStage)i, c);
+            if (c.count)
+                result.push_back(c);
+        }
+    }
+
+    return result;
+}
+
+/* Cycles per microsecond of StageClock(), measured once over ~20ms
+ * Returns 1000 (i.e. ns) on platforms without a TSC.
+ */
+double StageTimers::cyclesPerUs() {
+#if defined(__x86_64__) || defined(__i386__)
+    static double rate = 0;
+    static std::once_flag calibrated;
+
+    std::call_once(calibrated, []() {
+        auto wallStart = std::chrono::steady_clock::now();
+        uint64_t tscStart = StageClock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        uint64_t tscEnd = StageClock();
+        auto wallEnd = std::chrono::steady_clock::now();
+
+        double us = std::chrono::duration<double, std::micro>(wallEnd - wallStart).count();
+        rate = (tscEnd - tscStart) / us;
+    });
+
+    return rate;
+#else
+    return 1000;
+#endif
+}
+
+const char* StageTimers::stageName(const SniffStage stage) {
+    switch (stage) {
+        case STAGE_CAPTURE: return "capture";
+        case STAGE_DECODE: return "decode";
+        case STAGE_PARSE_OF: return "parse_of";
+        case STAGE_OF_UNPACK: return "of_unpack";
+        case STAGE_PROCESS_LLDP: return "process_lldp";
+        case STAGE_UPDATE_STATS: return "update_stats";
+        case STAGE_STATS_LOG: return "stats_log";
+        case STAGE_SNAPSHOT: return "snapshot";
+        default: return "unknown";
+    }
+}
+
+// Upper bound (in cycles) of the bucket containing the given quantile
+static uint64_t histQuantile(const StageStatsCopy& c, const double q) {
+    uint64_t target = (uint64_t)(c.count * q);
+    uint64_t seen = 0;
+    for (uint16_t b = 0; b < STAGE_HIST_BUCKETS; b++) {
+        seen += c.hist[b];
+        if (seen > target)
+            return 2ULL << b;
+    }
+
+    return c.maxCycles;
+}
+
+// Human-readable table of collect()
+void StageTimers::dump(std::ostream& os) {
+#ifdef OFSNIFF_NO_STAGE_TIMERS
+    os << "Stage timers were compiled out (OFSNIFF_NO_STAGE_TIMERS)" << endl;
+#else
+    double rate = cyclesPerUs();
+    os << "Stage timers (us; p50/p99 are histogram bucket upper bounds):" << endl;
+    os << std::left << std::setw(14) << "thread" << std::setw(14) << "stage" <<
+        std::right << std::setw(12) << "count" << std::setw(10) << "mean" <<
+        std::setw(10) << "p50" << std::setw(10) << "p99" << std::setw(10) << "max" << endl;
+
+    for (const StageStatsCopy& c : collect()) {
+        os << std::left << std::setw(14) << c.threadName << std::setw(14) << stageName(c.stage) <<
+            std::right << std::setw(12) << c.count << std::fixed << std::setprecision(2) <<
+            std::setw(10) << c.totalCycles / rate / c.count <<
+            std::setw(10) << histQuantile(c, 0.5) / rate <<
+            std::setw(10) << histQuantile(c, 0.99) / rate <<
+            std::setw(10) << c.maxCycles / rate << endl;
+        os.unsetf(std::ios::floatfield);
+    }
+#endif
+}
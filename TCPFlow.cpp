@@ -0,0 +1,126 @@
+#include "TCPFlow.h"
+
+#include <cstring>
+
+// Sequence numbers and TSvals wrap around, compare them modulo 2^32
+static inline bool seqAfter(const uint32_t a, const uint32_t b) {
+    return (int32_t)(a - b) > 0;
+}
+
+TCPFlowTracker::TCPFlowTracker() {
+    memset(_dirs, 0, sizeof(_dirs));
+    memset(&stats, 0, sizeof(stats));
+};
+
+void TCPFlowTracker::reset(Direction& d) {
+    d.head = 0;
+    d.len = 0;
+    d.seqValid = false;
+    d.ackValid = false;
+}
+
+void TCPFlowTracker::updateInFlight(const uint16_t dir) {
+    const Direction& d = _dirs[dir];
+    uint32_t inFlight = 0;
+    if (d.seqValid && d.ackValid && seqAfter(d.sndNxt, d.sndUna))
+        inFlight = d.sndNxt - d.sndUna;
+
+    stats.inFlight[dir] = inFlight;
+    if (inFlight > d.peak)
+        _dirs[dir].peak = inFlight;
+}
+
+/* Processes one segment of the connection, sent towards the switch
+ * if toSwitch is true
+ * Returns true if it completed an RTT sample, whose direction and
+ * value (ms) are returned through the parameters.
+ */
+bool TCPFlowTracker::process(const TCPSegment& seg, const bool toSwitch, const uint64_t tsUs,
+                                OFDirection& rttDir, double& rtt) {
+    uint16_t dir = toSwitch ? OF_TO_SWITCH : OF_FROM_SWITCH;
+    uint16_t other = toSwitch ? OF_FROM_SWITCH : OF_TO_SWITCH;
+    Direction& d = _dirs[dir];
+    Direction& o = _dirs[other];
+
+    if (seg.flags & TCP_FLAG_RST) {
+        reset(d);
+        reset(o);
+        updateInFlight(dir);
+        updateInFlight(other);
+        return false;
+    }
+
+    // A new connection from the same endpoint starts over
+    if (seg.flags & TCP_FLAG_SYN)
+        reset(d);
+
+    // SYN and FIN each take up one sequence number
+    uint32_t end = seg.seq + seg.wireLen + ((seg.flags & TCP_FLAG_SYN) ? 1 : 0) +
+                    ((seg.flags & TCP_FLAG_FIN) ? 1 : 0);
+    if (!d.seqValid || seqAfter(end, d.sndNxt)) {
+        d.sndNxt = end;
+        d.seqValid = true;
+    }
+
+    if (seg.flags & TCP_FLAG_ACK) {
+        if (!o.ackValid || seqAfter(seg.ack, o.sndUna)) {
+            o.sndUna = seg.ack;
+            o.ackValid = true;
+        }
+
+        // Acknowledges data not seen (e.g. filtered out or dropped)
+        if (o.seqValid && seqAfter(seg.ack, o.sndNxt))
+            o.sndNxt = seg.ack;
+    }
+
+    updateInFlight(dir);
+    updateInFlight(other);
+
+    if (!seg.hasTimestamp)
+        return false;
+
+    /* Record the first sighting of each new TSval, dropping the oldest when
+     * full. Pure ACKs aren't recorded: nothing makes the receiver respond to
+     * them, so their echo would include any idle time.
+     */
+    bool consumesSeq = seg.wireLen || (seg.flags & (TCP_FLAG_SYN | TCP_FLAG_FIN));
+    if (consumesSeq && seg.tsval != 0 && (d.len == 0 ||
+            seqAfter(seg.tsval, d.tsvals[(d.head + d.len - 1) % TCP_TS_TABLE_SIZE].tsval))) {
+        if (d.len == TCP_TS_TABLE_SIZE) {
+            d.head = (d.head + 1) % TCP_TS_TABLE_SIZE;
+            d.len--;
+        }
+        d.tsvals[(d.head + d.len) % TCP_TS_TABLE_SIZE] = {seg.tsval, tsUs};
+        d.len++;
+    }
+
+    if (seg.tsecr == 0 || !(seg.flags & TCP_FLAG_ACK))
+        return false;
+
+    /* TSvals older than the echoed one will never be matched any more, and
+     * only the first echo of a TSval gives an RTT sample
+     */
+    while (o.len && seqAfter(seg.tsecr, o.tsvals[o.head].tsval)) {
+        o.head = (o.head + 1) % TCP_TS_TABLE_SIZE;
+        o.len--;
+    }
+
+    if (o.len == 0 || o.tsvals[o.head].tsval != seg.tsecr)
+        return false;
+
+    rttDir = (OFDirection)other;
+    rtt = (tsUs - o.tsvals[o.head].seenUs) / 1000.0;
+    stats.rtt[other].add(rtt);
+
+    o.head = (o.head + 1) % TCP_TS_TABLE_SIZE;
+    o.len--;
+    return true;
+}
+
+// Moves the in-flight peaks of the current interval into stats
+void TCPFlowTracker::closeInterval() {
+    for (uint16_t dir = 0; dir < NUM_OF_DIRECTIONS; dir++) {
+        stats.inFlightPeak[dir] = _dirs[dir].peak;
+        _dirs[dir].peak = stats.inFlight[dir];
+    }
+}
@@ -0,0 +1,367 @@
+#include "ThreadPlacement.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h> // For MPOL_PREFERRED (set_mempolicy() has no glibc wrapper)
+
+using std::cout;
+using std::endl;
+
+#define PLACEMENT_MAX_NODES 1024 // NUMA nodes set_mempolicy() is given a mask of
+
+// Placement in effect on a placed thread
+typedef struct PlacedThread {
+    string name;
+    ThreadRole role;
+    vector<uint16_t> cpus;
+    int policy;
+    int priority;
+    int node; // Preferred NUMA node, -1 if none
+} PlacedThread;
+
+static std::mutex placementMutex; // Guards everything below
+static ThreadPlacement configured[NUM_THREAD_ROLES] = {THREAD_PLACEMENT_INHERITED,
+                                                        THREAD_PLACEMENT_INHERITED};
+static bool numaLocal = false;
+static bool memoryLocked = false;
+static vector<PlacedThread> placed;
+
+/* Parses "<cpu>[-<cpu>][,...]" (e.g. "0-3,6"), returns false if invalid or
+ * if any of them is beyond PLACEMENT_MAX_CPUS
+ */
+bool ParseCPUList(const string& str, vector<uint16_t>& cpus) {
+    cpus.clear();
+
+    size_t start = 0;
+    while (true) {
+        size_t end = str.find(',', start);
+        string item = str.substr(start, end - start);
+        size_t dash = item.find('-');
+        string first = item.substr(0, dash);
+        string last = (dash == string::npos) ? first : item.substr(dash + 1);
+
+        if (first.empty() || last.empty() || first.length() > 5 || last.length() > 5 ||
+                first.find_first_not_of("0123456789") != string::npos ||
+                last.find_first_not_of("0123456789") != string::npos)
+            return false;
+
+        unsigned long lo = stoul(first);
+        unsigned long hi = stoul(last);
+        if (lo > hi || hi >= PLACEMENT_MAX_CPUS)
+            return false;
+        for (unsigned long cpu = lo; cpu <= hi; cpu++)
+            cpus.push_back((uint16_t)cpu);
+
+        if (end == string::npos)
+            break;
+        start = end + 1;
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return true;
+}
+
+// Sorted CPUs as "0-3,6"
+string CPUListToString(const vector<uint16_t>& cpus) {
+    string str;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        size_t last = i;
+        while (last + 1 < cpus.size() && cpus[last + 1] == cpus[last] + 1)
+            last++;
+
+        if (!str.empty())
+            str += ",";
+        str += std::to_string(cpus[i]);
+        if (last > i)
+            str += "-" + std::to_string(cpus[last]);
+        i = last;
+    }
+
+    return str;
+}
+
+/* Parses "fifo:<priority>" or "other[:<nice>]" into the policy and priority
+ * of 'placement', returns false if invalid
+ */
+bool ParseSchedPolicy(const string& str, ThreadPlacement& placement) {
+    size_t colon = str.find(':');
+    string name = str.substr(0, colon);
+    string value = (colon == string::npos) ? "" : str.substr(colon + 1);
+
+    long priority = 0;
+    if (!value.empty()) {
+        char* end = nullptr;
+        priority = strtol(value.c_str(), &end, 10);
+        if (*end != '\0' || value.length() > 3)
+            return false;
+    }
+
+    if (name == "fifo") {
+        if (colon == string::npos || priority < sched_get_priority_min(SCHED_FIFO) ||
+                priority > sched_get_priority_max(SCHED_FIFO))
+            return false;
+        placement.policy = SCHED_FIFO;
+    } else if (name == "other") {
+        if ((colon != string::npos && value.empty()) || priority < -20 || priority > 19)
+            return false;
+        placement.policy = SCHED_OTHER;
+    } else {
+        return false;
+    }
+
+    placement.priority = (int)priority;
+    return true;
+}
+
+/* Parses "<role>=[<cpus>][@<policy>]" (role capture or worker, see
+ * ParseCPUList() and ParseSchedPolicy()) into its entry of 'placements'
+ * (NUM_THREAD_ROLES of them), returns false if invalid
+ */
+bool ParseThreadPlacement(const string& str, ThreadPlacement* placements) {
+    size_t eq = str.find('=');
+    if (eq == string::npos)
+        return false;
+
+    string role = str.substr(0, eq);
+    ThreadPlacement* placement;
+    if (role == ThreadPlacements::roleName(THREAD_CAPTURE))
+        placement = &placements[THREAD_CAPTURE];
+    else if (role == ThreadPlacements::roleName(THREAD_WORKER))
+        placement = &placements[THREAD_WORKER];
+    else
+        return false;
+
+    size_t at = str.find('@', eq);
+    string cpus = str.substr(eq + 1, at == string::npos ? string::npos : at - eq - 1);
+    if (cpus.empty() && at == string::npos)
+        return false;
+
+    ThreadPlacement parsed = THREAD_PLACEMENT_INHERITED;
+    if (!cpus.empty() && !ParseCPUList(cpus, parsed.cpus))
+        return false;
+    if (at != string::npos && !ParseSchedPolicy(str.substr(at + 1), parsed))
+        return false;
+
+    *placement = parsed;
+    return true;
+}
+
+// Human-readable CPUs, policy and priority
+static void dumpPlacement(std::ostream& os, const vector<uint16_t>& cpus, const int policy,
+                            const int priority) {
+    os << "CPUs " << (cpus.empty() ? "inherited" : CPUListToString(cpus)) << ", ";
+    if (policy == SCHED_FIFO)
+        os << "SCHED_FIFO priority " << priority;
+    else if (policy == SCHED_OTHER)
+        os << "SCHED_OTHER nice " << priority;
+    else if (policy == PLACEMENT_UNCHANGED)
+        os << "inherited scheduling";
+    else
+        os << "scheduling policy " << policy;
+}
+
+// Sets the placement of a role, applied by threads started later
+void ThreadPlacements::configure(const ThreadRole role, const ThreadPlacement& placement) {
+    std::lock_guard<std::mutex> lock(placementMutex);
+    configured[role] = placement;
+}
+
+// Allocates the capture thread's memory on the NUMA node of its CPUs
+void ThreadPlacements::setNumaLocal(const bool local) {
+    std::lock_guard<std::mutex> lock(placementMutex);
+    numaLocal = local;
+}
+
+/* Applies the role's placement to the calling thread, and records the
+ * placement in effect under 'name' (see dump())
+ * With NUMA-local allocation set, the capture thread's later
+ * allocations (table rows, and the pages lockMemory() faults in)
+ * prefer the node of its CPUs. Returns false, after printing why, if
+ * any of it could not be applied; the thread runs on regardless.
+ */
+bool ThreadPlacements::place(const ThreadRole role, const string& name) {
+    ThreadPlacement placement;
+    bool local;
+    {
+        std::lock_guard<std::mutex> lock(placementMutex);
+        placement = configured[role];
+        local = numaLocal && role == THREAD_CAPTURE;
+    }
+
+    bool ok = true;
+    int err;
+    if (!placement.cpus.empty()) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (uint16_t cpu : placement.cpus)
+            CPU_SET(cpu, &cpuSet);
+
+        err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+        if (err) {
+            cout << "ERROR: Could not pin thread " << name << " to CPUs " <<
+                    CPUListToString(placement.cpus) << " (" << strerror(err) << ")" << endl;
+            ok = false;
+        }
+    }
+
+    if (placement.policy != PLACEMENT_UNCHANGED) {
+        struct sched_param param;
+        param.sched_priority = (placement.policy == SCHED_FIFO) ? placement.priority : 0;
+        err = pthread_setschedparam(pthread_self(), placement.policy, &param);
+
+        // Nice values are per thread on Linux
+        if (!err && placement.policy == SCHED_OTHER &&
+                setpriority(PRIO_PROCESS, syscall(SYS_gettid), placement.priority) != 0)
+            err = errno;
+        if (err) {
+            cout << "ERROR: Could not set the scheduling of thread " << name << " (" <<
+                    strerror(err) << ")" << endl;
+            ok = false;
+        }
+    }
+
+    // Placement in effect, whatever failed
+    PlacedThread thread;
+    thread.name = name;
+    thread.role = role;
+    thread.node = -1;
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    pthread_getaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+    for (uint16_t cpu = 0; cpu < PLACEMENT_MAX_CPUS; cpu++) {
+        if (CPU_ISSET(cpu, &cpuSet))
+            thread.cpus.push_back(cpu);
+    }
+
+    struct sched_param param;
+    pthread_getschedparam(pthread_self(), &thread.policy, &param);
+    thread.priority = (thread.policy == SCHED_OTHER) ?
+                        getpriority(PRIO_PROCESS, syscall(SYS_gettid)) : param.sched_priority;
+
+    // The node of the first CPU the thread may run on
+    if (local) {
+        int node = thread.cpus.empty() ? -1 : cpuNode(thread.cpus[0]);
+        unsigned long nodeMask[PLACEMENT_MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+        if (node >= 0 && node < PLACEMENT_MAX_NODES) {
+            nodeMask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+            if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodeMask, PLACEMENT_MAX_NODES + 1) == 0)
+                thread.node = node;
+        }
+
+        if (thread.node < 0) {
+            cout << "ERROR: Could not allocate the memory of thread " << name <<
+                    " on its NUMA node (" << (node < 0 ? "node unknown" : strerror(errno)) << ")" << endl;
+            ok = false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(placementMutex);
+    placed.push_back(thread);
+    return ok;
+}
+
+/* Locks all memory of the process, faulting in what is mapped but
+ * not yet touched (e.g. reserved table capacity); memory mapped later
+ * is locked as it is first touched. Returns false, after printing
+ * why (mostly RLIMIT_MEMLOCK without CAP_IPC_LOCK), if it failed.
+ */
+bool ThreadPlacements::lockMemory() {
+    /* MCL_CURRENT alone prefaults what is mapped now. Prefaulting all that
+     * is mapped later as well would fault in whole thread stacks and
+     * capture rings, so later mappings are only locked on fault, if the
+     * kernel supports that.
+     */
+    bool locked = (mlockall(MCL_CURRENT) == 0);
+#ifdef MCL_ONFAULT
+    locked = locked && (mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT) == 0 ||
+                        mlockall(MCL_CURRENT | MCL_FUTURE) == 0);
+#else
+    locked = locked && mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+#endif
+    if (!locked) {
+        cout << "ERROR: Could not lock memory (" << strerror(errno) << ")" << endl;
+        munlockall();
+    }
+
+    std::lock_guard<std::mutex> lock(placementMutex);
+    memoryLocked = locked;
+    return locked;
+}
+
+// NUMA node of a CPU, -1 if unknown (e.g. no NUMA support)
+int ThreadPlacements::cpuNode(const uint16_t cpu) {
+    string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir)
+        return -1;
+
+    // The CPU's directory links to its node as "node<n>"
+    int node = -1;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && isdigit(entry->d_name[4])) {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+
+    closedir(dir);
+    return node;
+}
+
+string ThreadPlacements::roleName(const ThreadRole role) {
+    switch (role) {
+        case THREAD_CAPTURE: return "capture";
+        case THREAD_WORKER: return "worker";
+        default: return "unknown";
+    }
+}
+
+// Configured placements, memory locking, and the placement of each placed thread
+void ThreadPlacements::dump(std::ostream& os) {
+    // Locked Bytes as the kernel accounts them
+    string lockedKiB;
+    std::ifstream status("/proc/self/status");
+    string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmLck:") == 0) {
+            lockedKiB = line.substr(line.find_first_not_of(" \t", 6));
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(placementMutex);
+    os << "Thread placement:" << endl;
+    for (uint8_t role = 0; role < NUM_THREAD_ROLES; role++) {
+        os << "  " << roleName((ThreadRole)role) << " threads: ";
+        dumpPlacement(os, configured[role].cpus, configured[role].policy, configured[role].priority);
+        os << endl;
+    }
+
+    os << "  memory: " << (memoryLocked ? "locked" : "not locked");
+    if (!lockedKiB.empty())
+        os << " (" << lockedKiB << " locked)";
+    os << ", " << (numaLocal ? "allocated on the capture CPUs' NUMA node" : "default NUMA policy") << endl;
+
+    for (const PlacedThread& thread : placed) {
+        os << "  " << thread.name << " (" << roleName(thread.role) << "): ";
+        dumpPlacement(os, thread.cpus, thread.policy, thread.priority);
+        if (thread.node >= 0)
+            os << ", NUMA node " << thread.node;
+        os << endl;
+    }
+}
@@ -0,0 +1,220 @@
+#ifndef AGGREGATOR_H
+#define AGGREGATOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OFSniffCommon.h"
+#include "StatsSnapshot.h"
+#include "Checkpoint.h"
+
+using std::string;
+using std::vector;
+
+#define SUMMARY_MAGIC 0x4D53464FU // "OFSM"
+#define SUMMARY_VERSION 1
+#define SUMMARY_INTERVAL_MS 1000 // Default interval between summaries (packet time)
+#define SUMMARY_MAX_PAYLOAD (64U << 20) // Larger summaries are refused, their node dropped
+#define SUMMARY_MAX_NODES 256 // Nodes one aggregator accepts at a time
+#define SUMMARY_MAX_NAME_LEN 255
+
+/* Federated aggregation: many sniffers (nodes), one global view
+ *
+ * Every node periodically sends a summary of its statistics to the
+ * aggregator, over TCP or a Unix socket. A summary is a SummaryHeader
+ * followed by a payload in host byte order (so nodes and aggregator must
+ * share an architecture; they are meant to run on one machine or cluster):
+ *  - node name (Byte count, then the Bytes)
+ *  - SummaryCounters
+ *  - number of endpoints, then per endpoint its EndpointSnapshot (smoothed
+ *    estimates, windowed statistics and histograms, datapath ID), its IPv6
+ *    address if it is an IPv6 endpoint, and its links (LinkSnapshots, the
+ *    edges of the link graph from the switch's ports)
+ * See BasicEndpointLatencyMetadata::fillSummary(). Each node's latest summary
+ * is kept until it disconnects.
+ *
+ * Switches connected to several controllers (or seen by several nodes) are
+ * reported more than once. The aggregator merges reports by datapath ID
+ * (learned from the FeaturesReply): the report with the most samples
+ * stands for the switch, and each link (port) is taken from the report with
+ * the most samples of it. Switches whose datapath ID is not known yet are
+ * kept per node.
+ */
+typedef struct SummaryHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t payloadLen;
+    uint64_t checksum;  // FNV-1a of the payload
+    uint64_t createdUs; // Packet time the node's state was copied at
+} SummaryHeader;
+
+// Node-wide counters of a summary, summed up over all nodes in the global view
+typedef struct SummaryCounters {
+    uint64_t packets;
+    uint64_t ofMessages;
+    uint64_t parseErrors;
+    uint64_t captureRecv;
+    uint64_t captureDrops;
+    uint64_t captureIfDrops;
+} SummaryCounters;
+
+// Where summaries are sent to: a Unix socket path, or an IPv4 address and TCP port
+typedef struct SummaryAddress {
+    string path; // Unix socket if not empty
+    string host;
+    uint16_t port;
+} SummaryAddress;
+
+/* Parses "<path>" (containing a '/') or "[<IPv4 address>:]<port>" (default
+ * address 127.0.0.1), returns false if invalid
+ */
+bool ParseSummaryAddress(const string& str, SummaryAddress& addr);
+
+string SummaryAddressToString(const SummaryAddress& addr);
+
+/* Sends summaries to the aggregator from a thread of its own
+ *
+ * As CheckpointWriter: the sniff loop fills a payload and hands it over
+ * with submit(), which only swaps buffers; if the sender falls behind, only
+ * the latest payload is kept. The connection is (re)opened on demand, so
+ * nodes may be started before the aggregator, and survive its restarts.
+ */
+class SummarySender {
+    private:
+        SummaryAddress _addr;
+        int _fd = -1; // Only touched by the sender thread (and stop())
+        bool _warned = false; // Connection failure reported
+        std::thread _sender;
+        bool _running = false;
+
+        std::mutex _mutex; // Guards everything below
+        std::condition_variable _cond;
+        bool _stopping = false;
+        bool _pending = false;
+        vector<uint8_t> _payload;
+        uint64_t _createdUs = 0;
+
+        std::atomic<uint64_t> _sent;
+        std::atomic<uint64_t> _failed;
+        std::atomic<uint64_t> _lastBytes;
+        std::atomic<bool> _connected;
+
+        void senderLoop();
+
+        // Connects if not connected yet, returns false if that failed
+        bool connectAggregator();
+
+        // Sends a header and payload, returns false (and disconnects) on errors
+        bool sendSummary(const vector<uint8_t>& payload, const uint64_t createdUs);
+
+    public:
+        SummarySender();
+
+        ~SummarySender();
+
+        // Starts the sender thread, summaries go to 'addr'
+        bool start(const SummaryAddress& addr);
+
+        /* Sends any pending summary, then stops the sender thread
+         * Function is idempotent
+         */
+        void stop();
+
+        bool running() const {
+            return _running;
+        }
+
+        /* Hands a payload to the sender thread, taken at packet time createdUs
+         * 'payload' is swapped with the sender's previous buffer.
+         */
+        void submit(vector<uint8_t>& payload, const uint64_t createdUs);
+
+        // Human-readable address and counters
+        void dump(std::ostream& os) const;
+};
+
+/* Receives summaries from the nodes and merges them into one global view
+ *
+ * The view is published as a StatsSnapshot (see SnapshotExchange), so a
+ * MetricsExporter serves it as it would a single sniffer's; endpoint
+ * versions in it are only compared for equality. A thread of its own
+ * accepts nodes, reads their summaries and rebuilds the view whenever one
+ * arrives or a node leaves.
+ */
+class SummaryAggregator {
+    private:
+        // Latest summary of a connected node
+        typedef struct NodeState {
+            int fd;
+            uint32_t id; // Unique per connection, never reused
+            vector<uint8_t> inBuf; // Partial summary read so far
+            bool hasSummary;
+            string name;
+            uint64_t createdUs;
+            uint64_t summaries;
+            SummaryCounters counters;
+            vector<EndpointSnapshot> endpoints; // firstLink indexes 'links'
+            vector<LinkSnapshot> links;
+        } NodeState;
+
+        // Endpoint of the view, and the node its report came from
+        typedef struct ViewSource {
+            uint32_t node;  // Index into _nodes
+            uint32_t index; // Index into the node's endpoints
+            uint32_t reports; // Reports merged into it (1 unless deduplicated)
+        } ViewSource;
+
+        SummaryAddress _addr;
+        int _listenFd = -1;
+        std::atomic<bool> _running;
+        std::thread _thread;
+        uint32_t _nextNodeId = 0;
+        uint64_t _viewSeqNum = 0;
+
+        mutable std::mutex _mutex; // Guards the nodes and view against dump()
+        vector<NodeState> _nodes;
+        StatsSnapshot _view;
+        vector<ViewSource> _viewSources; // Per endpoint of _view
+        std::atomic<uint64_t> _rejected; // Malformed summaries (their nodes were dropped)
+
+        SnapshotExchange<StatsSnapshot> _snapshots;
+
+        void serveLoop();
+
+        // Reads what is available from a node, returns false if it must be dropped
+        bool readNode(NodeState& node, bool& updated);
+
+        // Decodes a complete payload into the node's state, false if malformed
+        bool decodeSummary(NodeState& node, const vector<uint8_t>& payload);
+
+        // Merges the latest summaries of all nodes into _view and publishes it
+        void rebuildView();
+
+    public:
+        SummaryAggregator();
+
+        ~SummaryAggregator();
+
+        /* Listens on 'addr' and starts aggregating in a new thread
+         * Returns false if the socket could not be set up
+         */
+        bool start(const SummaryAddress& addr);
+
+        void stop();
+
+        /* The global view, for a single reader (e.g. a MetricsExporter)
+         * See SnapshotExchange for the reader-side interface.
+         */
+        SnapshotExchange<StatsSnapshot>& snapshots();
+
+        // Human-readable nodes and global view, with the node of each switch
+        void dump(std::ostream& os) const;
+};
+
+#endif
@@ -0,0 +1,332 @@
+#ifndef CAPTURESOURCES_H
+#define CAPTURESOURCES_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <tins/tins.h>
+
+#include "OFSniffCommon.h"
+#include "CaptureStats.h"
+
+using std::string;
+using std::vector;
+
+using Tins::PDU;
+using Tins::Sniffer;
+
+#define CAPTURE_DEFAULT_PORTS {6633, 6653} // OpenFlow ports captured if none are given
+#define CAPTURE_MAX_SOURCES 64 // Interfaces captured by one loop
+#define CAPTURE_MAX_PORTS 32 // OpenFlow ports per source
+#define CAPTURE_MAX_LEN 1522 // Max Bytes to capture per packet (1500 MTU + Ethernet header + 2 VLAN tags)
+#define CAPTURE_WAIT_MS 100 // Longest wait for packets before the loop checks whether it should stop
+#define CAPTURE_SOURCE_BATCH 64 // Packets taken from one source before the next ready one gets a turn
+#define CAPTURE_BATCH_TIMEOUT_MS 5 // Default longest time the kernel holds packets with batched delivery
+#define CAPTURE_MAX_BATCH 256 // Largest batch taken from one source at once
+#define CAPTURE_PREFETCH_AHEAD 2 // Frames of a batch prefetched ahead of the one processed
+#define CAPTURE_HANDOVER_MS 10 // Overlap of a replaced capture with its successor, beyond the delivery timeout
+
+/* How captured packets reach the sniff loop
+ *  immediate: every packet wakes the loop as soon as it is captured. Lowest
+ *             delay, but under load one wakeup per packet.
+ *  batched:   the kernel holds packets until timeoutMs has passed or its
+ *             buffer block is full, and the loop then processes up to
+ *             batchSize of them at once. Fewer wakeups and less CPU per
+ *             packet, results are up to timeoutMs later.
+ * Capture timestamps are taken by the kernel in both modes, so the latency
+ * samples are the same; see DeliveryStats for measuring the trade-off.
+ */
+typedef struct CaptureDelivery {
+    bool immediate;
+    uint32_t timeoutMs; // Batched only
+    uint32_t batchSize; // Packets taken from one source per turn (1 - CAPTURE_MAX_BATCH)
+} CaptureDelivery;
+
+const CaptureDelivery CAPTURE_DELIVERY_IMMEDIATE = {true, 0, CAPTURE_SOURCE_BATCH};
+const CaptureDelivery CAPTURE_DELIVERY_BATCHED = {false, CAPTURE_BATCH_TIMEOUT_MS, CAPTURE_MAX_BATCH};
+
+/* One live capture: an interface, filtered down to the TCP connections of
+ * one or more OpenFlow ports
+ *
+ * The counters are written by the sniff loop only and may be read from
+ * any thread.
+ */
+class CaptureSource {
+    private:
+        string _iface;
+        vector<uint16_t> _ports;
+        Sniffer* _sniffer;
+        int _linkType;
+        uint32_t _bufferSize;
+        bool _ofTypeFilter;
+        bool _passPureAcks;
+        vector<struct bpf_insn> _filter; // BPF program in place on the capture, empty if unknown
+
+        PcapCounters _pcap; // Sniff loop only
+
+        // Capture time (us) of the last frame taken, and of the last one the replaced source took
+        uint64_t _lastUs = 0;
+        uint64_t _skipUntilUs = 0;
+        vector<struct bpf_insn> _skipFilter; // BPF program of the replaced source
+
+    public:
+        std::atomic<uint64_t> packets;    // Packets handed to the sniff loop
+        std::atomic<uint64_t> ofMessages; // Packets carrying OpenFlow payload
+        std::atomic<uint64_t> fallbacks;  // Frames decoded by libtins instead of FrameDecoder.h
+        std::atomic<uint64_t> malformed;  // Frames that could not be decoded
+        std::atomic<uint64_t> recv;       // Received by the capture filter (pcap_stats)
+        std::atomic<uint64_t> drop;       // Dropped, capture buffer full (pcap_stats)
+        std::atomic<uint64_t> ifDrop;     // Dropped by the interface (pcap_stats)
+        std::atomic<uint64_t> duplicates; // Frames the replaced source already handed over
+
+        /* Takes ownership of the sniffer
+         * bufferSize, ofTypeFilter and passPureAcks are what it was opened
+         * with (see CaptureSources::add()), to reopen it with; filter is the
+         * BPF program it was left with (see CaptureSources::open()).
+         */
+        CaptureSource(const string& iface, const vector<uint16_t>& ports, Sniffer* sniffer,
+                        const uint32_t bufferSize = 0, const bool ofTypeFilter = false,
+                        const bool passPureAcks = true,
+                        const vector<struct bpf_insn>& filter = vector<struct bpf_insn>());
+
+        ~CaptureSource();
+
+        const string& iface() const {
+            return _iface;
+        }
+
+        const vector<uint16_t>& ports() const {
+            return _ports;
+        }
+
+        pcap_t* handle() const {
+            return _sniffer->get_pcap_handle();
+        }
+
+        int linkType() const {
+            return _linkType;
+        }
+
+        uint32_t bufferSize() const {
+            return _bufferSize;
+        }
+
+        bool ofTypeFilter() const {
+            return _ofTypeFilter;
+        }
+
+        bool passPureAcks() const {
+            return _passPureAcks;
+        }
+
+        // Records the capture time of the last frame taken (sniff loop only)
+        void setLastFrame(const Timestamp& ts) {
+            _lastUs = TimestampToUs(ts);
+        }
+
+        /* Returns true for frames up to the last one taken from the source
+         * this one replaced that its filter passed as well, i.e. that it
+         * captured too (sniff loop only)
+         * len Bytes of the frame were captured, wireLen were on the wire.
+         */
+        bool isDuplicate(const Timestamp& ts, const uint8_t* data, const uint32_t len,
+                            const uint32_t wireLen) {
+            if (!_skipUntilUs)
+                return false;
+
+            if (TimestampToUs(ts) > _skipUntilUs) {
+                _skipUntilUs = 0; // Past the overlap
+                return false;
+            }
+
+            // E.g. a port added, or the type filter turned off
+            if (!_skipFilter.empty() && bpf_filter(_skipFilter.data(), data, wireLen, len) == 0)
+                return false;
+
+            duplicates.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        /* Continues the counters of the source this one replaces, and skips
+         * the frames it already took (sniff loop only)
+         */
+        void takeOver(CaptureSource& old);
+
+        bool isOFPort(const uint16_t port) const {
+            for (uint16_t p : _ports) {
+                if (p == port)
+                    return true;
+            }
+
+            return false;
+        }
+
+        /* Decodes a captured frame according to the link type
+         * Returns nullptr if it is malformed or the link type isn't supported.
+         */
+        PDU* decode(const uint8_t* data, const uint32_t len) const;
+
+        /* Reads pcap_stats and updates the capture counters
+         * Returns the cumulative counters (sniff loop only).
+         */
+        const PcapTotals& collect();
+};
+
+/* Capture sources multiplexed in one epoll loop
+ * add() must not be called once the sniff loop runs.
+ *
+ * While it runs, sources can be added, replaced (e.g. to swap their filter)
+ * and removed from other threads with update(), remove() and
+ * updateDelivery(). The new capture is opened right away and captures
+ * alongside the old one, and the sniff loop hands over between them
+ * once the old one has delivered everything captured until then (its
+ * delivery timeout plus CAPTURE_HANDOVER_MS later): it processes what is
+ * left in the old capture, then closes it and continues with the new one,
+ * skipping the frames both captured: those up to the last one taken from
+ * the old one (the kernel stamps a packet with the same time for all
+ * captures) that the old one's BPF program passes as well, so packets
+ * only the new filter takes are kept. So no packet is lost or processed
+ * twice, and the latency state carries on as if nothing happened.
+ */
+class CaptureSources {
+    private:
+        // A change requested while the sniff loop runs
+        typedef struct CaptureChange {
+            string iface;
+            std::unique_ptr<CaptureSource> source; // Added or replacing source, nullptr to remove 'iface'
+            bool setsDelivery;
+            CaptureDelivery delivery;
+            uint64_t readyUs; // Wall-clock time the old capture has delivered everything by
+        } CaptureChange;
+
+        vector<std::unique_ptr<CaptureSource>> _sources;
+        int _epollFd;
+        int _stopFd; // eventfd, readable once stop() was called
+        std::atomic<bool> _stopped;
+        CaptureDelivery _delivery;
+
+        /* Guards _sources against changes while other threads read them (the
+         * sniff loop reads them without), and the members below
+         */
+        mutable std::mutex _mutex;
+        vector<CaptureChange> _changes; // Applied in order
+        std::atomic<bool> _changesPending;
+        CaptureDelivery _nextDelivery; // Of captures opened from now on
+        PcapTotals _removedTotals; // pcap_stats of removed sources, sniff loop only
+
+        /* Opens a live capture of 'iface' filtered to the given OpenFlow ports,
+         * ready to be polled; returns nullptr on errors
+         * The BPF program it is left with is returned through 'program'
+         * (empty if it could not be reproduced).
+         */
+        static Sniffer* open(const string& iface, const vector<uint16_t>& ports,
+                                const uint32_t bufferSize, const bool ofTypeFilter,
+                                const bool passPureAcks, const CaptureDelivery& delivery,
+                                vector<struct bpf_insn>& program);
+
+        // Index of the source capturing 'iface', -1 if none
+        int find(const string& iface) const;
+
+        // Adds (op EPOLL_CTL_ADD), re-indexes (EPOLL_CTL_MOD) or removes (EPOLL_CTL_DEL) the source at 'index' in the epoll set
+        bool poll(const int op, const uint32_t index);
+
+        // Queues a change, applied once the current capture had time to deliver
+        void queueChange(CaptureChange& change);
+
+    public:
+        CaptureSources();
+
+        ~CaptureSources();
+
+        /* Sets how packets of sources added afterwards are delivered
+         * Returns false if sources were already added or it is invalid.
+         */
+        bool setDelivery(const CaptureDelivery& delivery);
+
+        const CaptureDelivery& delivery() const {
+            return _delivery;
+        }
+
+        /* Opens a live capture of 'iface' filtered to the given OpenFlow ports,
+         * optionally with the in-kernel OpenFlow type filter (see OFTypeFilter.h)
+         * bufferSize 0 keeps libpcap's default. Returns false on errors.
+         */
+        bool add(const string& iface, const vector<uint16_t>& ports, const uint32_t bufferSize,
+                    const bool ofTypeFilter = false, const bool passPureAcks = true);
+
+        uint32_t size() const {
+            return _sources.size();
+        }
+
+        CaptureSource& operator[](const uint32_t i) {
+            return *_sources[i];
+        }
+
+        const CaptureSource& operator[](const uint32_t i) const {
+            return *_sources[i];
+        }
+
+        /* Waits up to timeoutMs for sources with packets to read, and writes
+         * their indices into 'ready'
+         * Returns the number of ready sources, or -1 once stopped.
+         */
+        int wait(uint32_t* ready, const uint32_t maxReady, const int timeoutMs);
+
+        /* Adds a source, or replaces the one capturing 'iface' (e.g. to change
+         * its ports or filter), while the sniff loop runs; see above
+         * Returns false if the capture could not be opened, leaving the
+         * sources as they are.
+         */
+        bool update(const string& iface, const vector<uint16_t>& ports, const uint32_t bufferSize,
+                    const bool ofTypeFilter = false, const bool passPureAcks = true);
+
+        /* Stops capturing 'iface' while the sniff loop runs, once it has
+         * delivered everything captured until now
+         * Returns false if 'iface' isn't captured.
+         */
+        bool remove(const string& iface);
+
+        /* Changes how packets are delivered while the sniff loop runs, by
+         * replacing every source with one of the new delivery mode
+         * Returns false if it is invalid or a capture could not be opened.
+         */
+        bool updateDelivery(const CaptureDelivery& delivery);
+
+        bool changesPending() const {
+            return _changesPending.load(std::memory_order_relaxed);
+        }
+
+        /* Applies the changes whose captures had time to deliver (sniff loop
+         * only): drain(source) is called for every source about to be
+         * replaced or removed, and must process all frames it still holds
+         */
+        void applyChanges(const std::function<void(CaptureSource&)>& drain);
+
+        // Interfaces and ports of all sources
+        vector<std::pair<string, vector<uint16_t>>> list() const;
+
+        // Makes the sniff loop return; async-signal-safe
+        void stop();
+
+        bool stopped() const {
+            return _stopped.load(std::memory_order_relaxed);
+        }
+
+        /* Reads pcap_stats of all sources
+         * Returns the counters summed over all sources (sniff loop only).
+         */
+        PcapTotals collect();
+
+        // Human-readable delivery mode and per-source counters
+        void dump(std::ostream& os) const;
+
+        // "tcp port A or tcp port B ..."
+        static string portFilter(const vector<uint16_t>& ports);
+};
+
+#endif
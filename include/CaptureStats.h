@@ -0,0 +1,131 @@
+#ifndef CAPTURESTATS_H
+#define CAPTURESTATS_H
+
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include <pcap.h>
+
+#include "OFSniffCommon.h"
+#include "LatencyHistogram.h"
+
+using std::vector;
+
+#define CAPTURE_STATS_INTERVAL_MS 1000 // How often the sniff loop reads pcap_stats
+#define CAPTURE_STATS_HISTORY 60 // Number of past intervals kept
+
+/* Kernel capture counters and probe losses over one collection interval
+ * Probe losses are counted alongside kernel drops so that losses caused by
+ * the capture buffer can be told apart from losses in the network.
+ */
+typedef struct CaptureInterval {
+    Timestamp ts; // End of the interval (packet time)
+    double durationMs;
+    uint64_t recv;   // Packets received by the capture filter
+    uint64_t drop;   // Dropped because the capture buffer was full
+    uint64_t ifDrop; // Dropped by the network interface or its driver
+    uint64_t probesMatched; // LLDP probes whose reply was seen
+    uint64_t probesExpired; // LLDP probes given up on (reply never seen)
+} CaptureInterval;
+
+/* Delay and cost of getting captured packets through the sniff loop, for
+ * choosing between immediate and batched delivery (see CaptureSources.h)
+ *
+ * The delay runs from the kernel's capture timestamp until the sniff loop has
+ * processed the batch holding the packet, i.e. how late results are. Latency
+ * samples themselves are computed from the capture timestamps, so they are
+ * equally accurate in both modes; what batching costs is how fresh they are.
+ * The CPU time is that of the sniff loop thread, processing included.
+ */
+typedef struct DeliveryStats {
+    uint64_t wakeups; // Batches taken from a capture source (including single packets)
+    uint64_t packets;
+    LatencyHistogram delayMs;
+    double maxDelayMs;
+    double cpuMs;  // Sniff loop thread CPU time...
+    double wallMs; // ... over this much wall-clock time
+} DeliveryStats;
+
+/* Cumulative pcap_stats counters of one or more capture handles */
+typedef struct PcapTotals {
+    uint64_t recv;   // Packets received by the capture filter
+    uint64_t drop;   // Dropped because the capture buffer was full
+    uint64_t ifDrop; // Dropped by the network interface or its driver
+} PcapTotals;
+
+/* Extends the 32-bit (wrapping) pcap_stats counters of one handle to 64 bits */
+class PcapCounters {
+    private:
+        struct pcap_stat _lastStat;
+
+    public:
+        PcapTotals totals;
+
+        PcapCounters();
+
+        /* Reads pcap_stats from the handle and adds the increments to 'totals'
+         * The first reading includes everything counted before it.
+         * Returns false if the counters could not be read.
+         */
+        bool read(pcap_t* handle);
+};
+
+/* Periodically collected pcap_stats, extended to 64 bits
+ * Only the sniff loop calls collect(); other threads may call the getters.
+ */
+class CaptureStats {
+    private:
+        mutable std::mutex _mutex;
+
+        bool _started = false;
+        PcapCounters _pcap; // Only used by collect(handle, ...)
+        PcapTotals _lastTotals;
+        uint64_t _lastProbesMatched = 0;
+        uint64_t _lastProbesExpired = 0;
+        Timestamp _lastTs;
+        double _lastCpuMs = 0;
+        double _lastWallMs = 0;
+
+        DeliveryStats _delivery;
+
+        CaptureInterval _totals;
+        vector<CaptureInterval> _history; // Ring buffer, oldest entry at _historyHead
+        uint32_t _historyHead = 0;
+
+    public:
+        CaptureStats();
+
+        // Returns true if the collection interval has elapsed
+        bool due(const Timestamp& ts) const {
+            return CalcTimestampDiff(_lastTs, ts) >= CAPTURE_STATS_INTERVAL_MS;
+        }
+
+        /* Reads pcap_stats from the handle, closes the current interval and
+         * updates the capture counters in 'counters'
+         * Returns the interval that was just closed.
+         */
+        CaptureInterval collect(pcap_t* handle, const Timestamp& ts, SniffCounters& counters);
+
+        /* As above, for cumulative counters read by the caller (e.g. summed
+         * over several handles, see CaptureSources)
+         */
+        CaptureInterval collect(const PcapTotals& totals, const Timestamp& ts, SniffCounters& counters);
+
+        // Adds the delivery delays of a batch (sniff loop only)
+        void addDelivery(const DeliveryStats& batch);
+
+        CaptureInterval getTotals() const;
+
+        DeliveryStats getDelivery() const;
+
+        // Past intervals, oldest first
+        vector<CaptureInterval> getHistory() const;
+
+        /* Human-readable summary of the totals, the worst recent interval and
+         * the delivery delay and CPU cost
+         */
+        void dump(std::ostream& os) const;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef CHANGEDETECTOR_H
+#define CHANGEDETECTOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#define CHANGE_WARMUP_SAMPLES 50 // Samples a baseline is learned from before detection starts
+#define CHANGE_BASELINE_SAMPLES 500 // ... and refined from until it's fixed
+#define CHANGE_CUSUM_SLACK 0.5 // Drift (in baseline sigmas) CUSUM tolerates per sample
+#define CHANGE_EWMA_WEIGHT 0.2 // Weight of a new sample in the EWMA level
+#define CHANGE_MIN_SIGMA_MS 0.01 // Floor of the baseline sigma, for near-constant streams
+#define CHANGE_MIN_SIGMA_SHARE 0.01 // ... and as a share of the baseline mean
+#define CHANGE_MAX_DEVIATION 4.0 // Samples are clipped to baseline +- this many sigmas
+
+#define CHANGE_DEFAULT_CUSUM 10.0 // Default CUSUM decision threshold (sigmas)
+#define CHANGE_DEFAULT_EWMA 4.5 // Default EWMA control limit (sigmas of the EWMA)
+
+/* Sensitivity of the change detectors of one metric, in baseline sigmas
+ * Lower is more sensitive; 0 disables that detector.
+ */
+typedef struct ChangeSensitivity {
+    double cusum; // CUSUM decision threshold (h)
+    double ewma;  // EWMA control limit (L)
+} ChangeSensitivity;
+
+enum ChangeDirection {
+    CHANGE_NONE = 0,
+    CHANGE_UP,
+    CHANGE_DOWN
+};
+
+/* Online change-point detection on one latency stream, O(1) per sample
+ *
+ * The first CHANGE_WARMUP_SAMPLES samples give a baseline (mean and sigma),
+ * which is refined until CHANGE_BASELINE_SAMPLES samples have been seen (an
+ * underestimated sigma from few samples would mean false alarms). After the
+ * warm-up, every sample feeds two detectors:
+ *  - two-sided CUSUM of the standardized samples, quick on sustained
+ *    shifts of about a sigma or more
+ *  - an EWMA of the samples against control limits around the baseline,
+ *    quick on large sudden shifts
+ * Samples are clipped to a few sigmas around the baseline first, so single
+ * outliers (e.g. a delayed probe) can't complete a change on their own.
+ * When either fires, the change is reported once and a new baseline is
+ * learned from the following samples, so a persistent shift is reported
+ * once rather than on every sample.
+ *
+ * Plain values only (64 Bytes), kept in dense arrays next to the metric rows.
+ */
+class ChangeDetector {
+    private:
+        uint32_t _count = 0; // Baseline samples so far
+        double _mean = 0;    // Running mean ...
+        double _m2 = 0;      // ... and sum of squared differences (Welford)
+        double _baseline = 0;
+        double _sigma = 0;
+        double _cusumUp = 0;
+        double _cusumDown = 0;
+        double _ewma = 0;
+
+        void restart() {
+            _count = 0;
+            _mean = 0;
+            _m2 = 0;
+        }
+
+    public:
+        /* Adds a sample, returns CHANGE_UP or CHANGE_DOWN if it completes a
+         * change of the stream's level
+         */
+        ChangeDirection update(const double sample, const ChangeSensitivity& sens) {
+            if (_count < CHANGE_BASELINE_SAMPLES) {
+                double delta = sample - _mean;
+                _mean += delta / ++_count;
+                _m2 += delta * (sample - _mean);
+                if (_count < CHANGE_WARMUP_SAMPLES)
+                    return CHANGE_NONE;
+
+                _baseline = _mean;
+                _sigma = std::max(std::sqrt(_m2 / (_count - 1)),
+                                    std::max(CHANGE_MIN_SIGMA_MS, CHANGE_MIN_SIGMA_SHARE * std::fabs(_mean)));
+                if (_count == CHANGE_WARMUP_SAMPLES) {
+                    _cusumUp = 0;
+                    _cusumDown = 0;
+                    _ewma = _baseline;
+                    return CHANGE_NONE;
+                }
+            }
+
+            double z = std::min(std::max((sample - _baseline) / _sigma, -CHANGE_MAX_DEVIATION),
+                                CHANGE_MAX_DEVIATION);
+            _cusumUp = std::max(0.0, _cusumUp + z - CHANGE_CUSUM_SLACK);
+            _cusumDown = std::max(0.0, _cusumDown - z - CHANGE_CUSUM_SLACK);
+            _ewma += CHANGE_EWMA_WEIGHT * (_baseline + z * _sigma - _ewma);
+
+            // Control limit, in sigmas of the EWMA in steady state
+            double ewmaLimit = sens.ewma * _sigma *
+                                std::sqrt(CHANGE_EWMA_WEIGHT / (2 - CHANGE_EWMA_WEIGHT));
+
+            ChangeDirection dir = CHANGE_NONE;
+            if ((sens.cusum > 0 && _cusumUp > sens.cusum) ||
+                    (sens.ewma > 0 && _ewma - _baseline > ewmaLimit))
+                dir = CHANGE_UP;
+            else if ((sens.cusum > 0 && _cusumDown > sens.cusum) ||
+                    (sens.ewma > 0 && _baseline - _ewma > ewmaLimit))
+                dir = CHANGE_DOWN;
+
+            if (dir != CHANGE_NONE)
+                restart();
+
+            return dir;
+        }
+
+        // Baseline the last change was detected against (or the current one)
+        double baseline() const {
+            return _baseline;
+        }
+
+        // Smoothed level of the stream when the last change was detected (or now)
+        double level() const {
+            return _ewma;
+        }
+};
+
+#endif
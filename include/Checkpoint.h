@@ -0,0 +1,173 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+#define CHECKPOINT_MAGIC 0x4B43464FU // "OFCK"
+#define CHECKPOINT_VERSION 3
+#define CHECKPOINT_INTERVAL_MS 60000 // Default interval between checkpoints (packet time)
+
+/* Checkpoints of the latency state, for warm restarts
+ *
+ * A checkpoint file is a CheckpointHeader followed by a payload, whose
+ * layout is defined by whoever fills it (see
+ * BasicEndpointLatencyMetadata::fillCheckpoint()). Values are stored in host
+ * byte order, so a checkpoint is only meant to be read on the machine (or
+ * architecture) that wrote it.
+ *
+ * Files are replaced atomically: the payload is written to <path>.tmp,
+ * synced, and renamed over <path>, so a crash leaves either the previous or
+ * the new checkpoint, never a torn one. The checksum catches the rest
+ * (e.g. a truncated copy).
+ */
+typedef struct CheckpointHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t payloadLen;
+    uint64_t checksum;  // FNV-1a of the payload
+    uint64_t createdUs; // Packet time the state was copied at
+} CheckpointHeader;
+
+// Appends plain values to a checkpoint payload
+class CheckpointBuffer {
+    private:
+        vector<uint8_t> _data;
+
+    public:
+        void clear() {
+            _data.clear();
+        }
+
+        void putBytes(const void* src, const size_t len) {
+            size_t off = _data.size();
+            _data.resize(off + len);
+            memcpy(&_data[off], src, len);
+        }
+
+        template <typename T>
+        void put(const T& val) {
+            static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be checkpointed");
+            putBytes(&val, sizeof(T));
+        }
+
+        vector<uint8_t>& data() {
+            return _data;
+        }
+};
+
+/* Reads plain values back from a checkpoint payload
+ * Reads past the end fail (return false) and leave the value untouched.
+ */
+class CheckpointReader {
+    private:
+        const uint8_t* _pos;
+        const uint8_t* _end;
+
+    public:
+        CheckpointReader(const vector<uint8_t>& payload) :
+                _pos(payload.data()), _end(payload.data() + payload.size()) {};
+
+        bool getBytes(void* dst, const size_t len) {
+            if ((size_t)(_end - _pos) < len)
+                return false;
+
+            memcpy(dst, _pos, len);
+            _pos += len;
+            return true;
+        }
+
+        template <typename T>
+        bool get(T& val) {
+            static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be checkpointed");
+            return getBytes(&val, sizeof(T));
+        }
+
+        size_t remaining() const {
+            return _end - _pos;
+        }
+};
+
+/* Writes checkpoints to a file from a thread of its own
+ *
+ * The sniff loop copies its state into a payload and hands it over with
+ * submit(), which only swaps buffers; the file is written, synced and
+ * renamed by the writer thread. If the writer falls behind, only the latest
+ * payload is kept.
+ */
+class CheckpointWriter {
+    private:
+        string _path;
+        std::thread _writer;
+        bool _running = false;
+
+        std::mutex _mutex; // Guards everything below
+        std::condition_variable _cond;
+        bool _stopping = false;
+        bool _pending = false;
+        vector<uint8_t> _payload;
+        uint64_t _createdUs = 0;
+
+        std::atomic<uint64_t> _written;
+        std::atomic<uint64_t> _failed;
+        std::atomic<uint64_t> _lastBytes;
+
+        void writerLoop();
+
+    public:
+        CheckpointWriter();
+
+        ~CheckpointWriter();
+
+        // Starts the writer thread, checkpoints go to 'path'
+        bool start(const string& path);
+
+        /* Writes any pending checkpoint, then stops the writer thread
+         * Function is idempotent
+         */
+        void stop();
+
+        bool running() const {
+            return _running;
+        }
+
+        /* Hands a payload to the writer thread, taken at packet time createdUs
+         * 'payload' is swapped with the writer's previous buffer, so neither
+         * side allocates once both have grown.
+         */
+        void submit(vector<uint8_t>& payload, const uint64_t createdUs);
+
+        const string& path() const {
+            return _path;
+        }
+
+        // Human-readable path and counters
+        void dump(std::ostream& os) const;
+
+        // FNV-1a over 'len' Bytes
+        static uint64_t checksum(const uint8_t* data, const size_t len);
+
+        /* Writes a checkpoint file atomically (see above)
+         * Returns false, and leaves any previous file in place, on errors.
+         */
+        static bool writeFile(const string& path, const vector<uint8_t>& payload,
+                                const uint64_t createdUs);
+
+        /* Reads and verifies a checkpoint file, its payload goes into 'payload'
+         * Returns false if the file is missing, of another version or corrupt.
+         */
+        static bool readFile(const string& path, vector<uint8_t>& payload, uint64_t& createdUs);
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <atomic>
+#include <ostream>
+#include <thread>
+#include <time.h>
+
+#include "OFSniffCommon.h"
+
+/* Diagnostics of the sniff loop (unexpected packets, malformed messages, ...)
+ *
+ * The sniff loop only calls report(), which counts the occurrence and, if
+ * the reason's severity is high enough and its token bucket has a token,
+ * queues a small fixed-size event. Formatting and writing happen in a
+ * separate writer thread (or whoever calls flush()), so the capture thread
+ * never blocks on the output stream.
+ *
+ * report() must only be called from one thread (the sniff loop).
+ */
+enum DiagSeverity {
+    DIAG_DEBUG,
+    DIAG_INFO,
+    DIAG_WARNING,
+    DIAG_ERROR,
+    NUM_DIAG_SEVERITIES
+};
+
+enum DiagReason {
+    DIAG_UNKNOWN_ETH_TYPE,      // PacketIn/Out frame isn't LLDP
+    DIAG_UNKNOWN_DST_MAC,       // LLDP frame not sent to the nearest bridge MAC
+    DIAG_NO_LLDP_PDU,           // Ethernet frame without payload
+    DIAG_FOREIGN_LLDP,          // LLDP not generated by the SAVI controller
+    DIAG_MALFORMED_SYS_NAME,    // SAVI LLDP with unparseable System Name
+    DIAG_PACKET_OUT_UNPACK,     // PacketOut that libfluid couldn't unpack
+    DIAG_UNIMPLEMENTED_OF_TYPE, // Valid OpenFlow type the sniffer ignores
+    DIAG_UNKNOWN_OF_TYPE,       // Invalid OpenFlow type
+    DIAG_IP_FRAGMENT,           // IPv4 fragment
+    DIAG_UNRELATED_PACKET,      // TCP packet not to/from the OpenFlow port
+    DIAG_CAPTURE_DROPS,         // Kernel dropped packets in the last interval
+    DIAG_UNDECODABLE_FRAME,     // Captured frame malformed, or of an unsupported link type
+    DIAG_IPV6_TABLE_FULL,       // Too many IPv6 addresses, connection not tracked
+    DIAG_OVERLOAD_LEVEL,        // Overload governor changed its level
+    DIAG_MEMORY_BUDGET,         // Probe tables compacted to stay within the memory budget
+    NUM_DIAG_REASONS
+};
+
+#define DIAG_QUEUE_SIZE 256 // Queued events, must be a power of 2
+#define DIAG_TEXT_LEN 48 // Bytes of text kept per event (incl. terminator)
+#define DIAG_DEFAULT_RATE 1.0 // Messages per second per reason
+#define DIAG_DEFAULT_BURST 5 // Messages per reason that may be written back-to-back
+#define DIAG_WRITER_PERIOD_MS 100 // How often the writer thread drains the queue
+
+typedef struct DiagEvent {
+    DiagReason reason;
+    IPv4EndpointType endpoint; // 0 if not related to an endpoint
+    uint64_t value;
+    uint64_t value2;
+    uint64_t suppressed; // Messages of the same reason rate-limited since the last one
+    char text[DIAG_TEXT_LEN];
+} DiagEvent;
+
+class Diagnostics {
+    private:
+        typedef struct ReasonState {
+            DiagSeverity severity;
+            std::atomic<uint64_t> count;
+            std::atomic<uint64_t> suppressed;
+
+            // Token bucket, only touched by the reporting thread
+            double tokens;
+            uint64_t lastRefillNs;
+            uint64_t suppressedSinceMsg;
+        } ReasonState;
+
+        ReasonState _reasons[NUM_DIAG_REASONS];
+
+        std::atomic<int> _minSeverity;
+        std::atomic<double> _rate;
+        std::atomic<double> _burst;
+
+        // Single producer (report) / single consumer (flush) ring
+        DiagEvent _queue[DIAG_QUEUE_SIZE];
+        std::atomic<uint32_t> _head; // Next slot to write
+        std::atomic<uint32_t> _tail; // Next slot to read
+
+        std::thread _writer;
+        std::atomic<bool> _writerRunning;
+
+        static uint64_t nowNs() {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+            return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        }
+
+        void reportSlow(const DiagReason reason, const IPv4EndpointType endpoint,
+                        const uint64_t value, const uint64_t value2, const char* text);
+
+        void writerLoop(std::ostream* os);
+
+    public:
+        Diagnostics();
+
+        ~Diagnostics();
+
+        /* Counts an occurrence of 'reason' and queues a message for it, unless
+         * its severity is below the minimum or it is being rate-limited
+         * 'text' (optional) is truncated to DIAG_TEXT_LEN - 1 characters.
+         */
+        inline void report(const DiagReason reason, const IPv4EndpointType endpoint = 0,
+                            const uint64_t value = 0, const uint64_t value2 = 0,
+                            const char* text = nullptr) {
+            ReasonState& state = _reasons[reason];
+            bump(state.count);
+            if (state.severity >= _minSeverity.load(std::memory_order_relaxed))
+                reportSlow(reason, endpoint, value, value2, text);
+        }
+
+        // Messages below minSeverity are only counted
+        void setMinSeverity(const DiagSeverity minSeverity);
+
+        DiagSeverity getMinSeverity() const;
+
+        // Per-reason token bucket: 'rate' messages per second, up to 'burst' at once
+        void setRateLimit(const double rate, const double burst);
+
+        uint64_t getCount(const DiagReason reason) const;
+
+        // Messages of 'reason' at or above the minimum severity that were rate-limited
+        uint64_t getSuppressed(const DiagReason reason) const;
+
+        // Writes queued messages to os, returns the number written
+        uint32_t flush(std::ostream& os);
+
+        /* Starts a thread writing queued messages to os every DIAG_WRITER_PERIOD_MS
+         * flush() must not be called while it runs.
+         */
+        void startWriter(std::ostream& os);
+
+        // Stops the writer thread after it wrote all queued messages
+        void stopWriter();
+
+        // Per-reason counts, for the reasons that occurred
+        void dump(std::ostream& os) const;
+
+        static DiagSeverity severityOf(const DiagReason reason);
+
+        static const char* reasonName(const DiagReason reason);
+
+        static const char* severityName(const DiagSeverity severity);
+
+        // Returns false if name isn't one of severityName()'s values
+        static bool parseSeverity(const string& name, DiagSeverity& severity);
+};
+
+#endif
@@ -1,104 +1,469 @@
 #ifndef ENDPOINTLATENCYMETADATA_H
 #define ENDPOINTLATENCYMETADATA_H
 
+#include <atomic>
 #include <unordered_map>
+#include <deque>
 #include <fstream>
+#include <mutex>
 
 #include "OFSniffCommon.h"
 #include "LatencyMetadata.h"
+#include "LatencyPolicy.h"
+#include "MetricTable.h"
+#include "StatsSnapshot.h"
+#include "ShmStatsTable.h"
+#include "CaptureStats.h"
+#include "Diagnostics.h"
+#include "OverloadGovernor.h"
+#include "Observers.h"
+#include "Checkpoint.h"
+#include "Aggregator.h"
+#include "Rollups.h"
 
 using std::unordered_map;
 using std::endl;
 
-class EndpointLatencyMetadata {
+/* Latency statistics of all switches, with window sizes, limits and
+ * estimators given by Policy (see LatencyPolicy.h)
+ *
+ * The member functions are explicitly instantiated in
+ * EndpointLatencyMetadata.cpp for DefaultLatencyPolicy and
+ * RuntimeLatencyPolicy; add an instantiation there for other policies.
+ */
+template <class Policy>
+class BasicEndpointLatencyMetadata {
     private:
-        /* Window sizes for different measurement samples */
-        const uint16_t ECHO_RTT_WINDOW = 15;
-        const uint16_t PKT_IN_RTT_WINDOW = 60;
-        const uint16_t LINK_LAT_WINDOW = 20;
+        typedef typename Policy::LinkLatEstimator LinkLatEstimator;
 
-        /* Maximum outstanding packet IDs per port */
-        const uint16_t MAX_OUTSTANDING_PKTS = 20;
+        static const uint32_t NO_INDEX = UINT32_MAX;
 
-        unordered_map<IPv4EndpointType, LatencyMetadata> _endpoint2LatMeta;
+        /* Window sizes and limits, those not fixed by Policy are set at run time */
+        LatencyConfig _config;
+
+        /* Configuration handed to the sniff loop by reconfigure(), applied
+         * by it with applyReconfiguration(). _appliedConfig is the copy of
+         * _config that reconfigure() checks against from other threads.
+         */
+        std::mutex _reconfigMutex;
+        std::atomic<bool> _reconfigPending;
+        LatencyConfig _pendingConfig;
+        LatencyConfig _appliedConfig;
+
+        /* Memory of all switches, see MemoryAccounting.h
+         * Declared before the switches, whose containers release into it.
+         */
+        MemoryBudget _memory;
+        uint64_t _activityTick = 0;
+        vector<uint32_t> _compactOrder; // Scratch space of enforceMemoryBudget()
+
+        /* Endpoints are interned to dense indices at first sight. Per-switch
+         * state is kept in a deque (indexed by endpoint index) so references
+         * to it stay valid as switches are added; windowed statistics live in
+         * the metric tables below, one row per endpoint (or link).
+         */
+        unordered_map<IPv4EndpointType, uint32_t> _endpointIndex;
+        vector<IPv4EndpointType> _endpointKeys;
+        std::deque<LatencyMetadata> _endpoints;
+
+        // Last endpoint interned, consecutive packets are mostly from the same switch
+        IPv4EndpointType _lastEndpoint = 0;
+        uint32_t _lastEndpointIdx = NO_INDEX;
+
+        MetricTable<Policy::ECHO_RTT_WINDOW> _echoRTT;
+
+        /* PacketIn RTT = Time from PacketIn Ping to PacketOut Pong */
+        MetricTable<Policy::PKT_IN_RTT_WINDOW> _pktInRTT;
+
+        /* Smoothed echo and PacketIn RTT, one estimator per endpoint, of the
+         * kinds set in _config (link estimators are kept with the links)
+         */
+        vector<LatencyEstimator> _echoEstimator;
+        vector<LatencyEstimator> _pktInEstimator;
+
+        /* Change-point detectors of the raw samples, one per endpoint (link)
+         * like the table rows; not checkpointed, they relearn their baseline
+         */
+        vector<ChangeDetector> _echoChange;
+        vector<ChangeDetector> _pktInChange;
+
+        /* Links (switch ports) are interned by (endpoint index << 16) | port_no
+         * The table windows the smoothed estimates; its histograms are of
+         * the raw (unsmoothed) ones.
+         */
+        unordered_map<uint64_t, uint32_t> _linkIndex;
+        MetricTable<Policy::LINK_LAT_WINDOW> _linkLat;
+        vector<LinkLatEstimator> _linkEstimator;
+        vector<uint32_t> _linkEndpoint; // Endpoint index of each link
+        vector<uint16_t> _linkPort;
+        vector<ChangeDetector> _linkChange;
 
         std::ofstream _statsLog;
 
-        double RTTAvg(const vector<double>& vTimes) {
-            double sum = 0;
-            for (auto i : vTimes)
-                sum += i;
+        SniffCounters _counters;
+        CaptureStats _captureStats;
+        Diagnostics _diagnostics;
+        OverloadGovernor _governor;
+        Observers _observers;
+
+        /* Snapshots are only taken if a consumer asked for them */
+        uint32_t _snapshotIntervalMs = 0;
+        Timestamp _lastSnapshotTs;
+        uint64_t _snapshotSeqNum = 0;
+        SnapshotExchange<StatsSnapshot> _snapshots;
+
+        ShmStatsWriter _shmTable;
 
-            return sum / vTimes.size();
+        /* Checkpoints are only written if enabled; the sniff loop copies its
+         * state into _checkpointBuf, the writer thread writes it out
+         */
+        uint32_t _checkpointIntervalMs = 0;
+        Timestamp _lastCheckpointTs;
+        CheckpointBuffer _checkpointBuf;
+        CheckpointWriter _checkpoints;
+
+        /* Summaries for an aggregator (see Aggregator.h) are only sent if
+         * enabled; filled by the sniff loop, sent by a thread of their own
+         */
+        uint32_t _summaryIntervalMs = 0;
+        Timestamp _lastSummaryTs;
+        string _nodeName;
+        CheckpointBuffer _summaryBuf;
+        SummarySender _summaries;
+
+        /* Rollups of the raw samples (see Rollups.h) are only kept if
+         * enabled, with rows as in the metric tables. The sniff loop adds
+         * samples and closes intervals under _rollupMutex, against queries
+         * reading the open interval.
+         */
+        bool _rollupsEnabled = false;
+        uint64_t _rollupNowS = 0; // Packet time of the last advanceRollups()
+        RollupTable _echoRollups;
+        RollupTable _pktInRollups;
+        RollupTable _linkRollups;
+        std::ofstream _rollupLog;
+        RollupLevel _rollupLogLevel = ROLLUP_MINUTE;
+        mutable std::mutex _rollupMutex;
+
+        /* OpenFlow traffic rates, recomputed by the sniff loop every
+         * OF_TRAFFIC_INTERVAL_MS and handed to other threads under a mutex
+         */
+        Timestamp _lastTrafficTs;
+        vector<OFTrafficStats> _trafficStatsBack; // Only used by the sniff loop
+        vector<OFTrafficStats> _trafficStats;
+        mutable std::mutex _trafficMutex;
+
+        void fillMetricSnapshot(MetricSnapshot& snap, const MetricColumns& table,
+                                const uint32_t row) {
+            snap.avg = table.avg[row];
+            snap.var = table.var[row];
+            snap.med = table.med[row];
+            snap.hist = table.hist[row];
+        }
+
+        // Copies an endpoint's statistics, except its links, into a snapshot
+        void fillEndpointSnapshot(EndpointSnapshot& epSnap, const uint32_t epIdx);
+
+        void fillLinkSnapshot(LinkSnapshot& linkSnap, const uint32_t linkIdx) {
+            linkSnap.port_no = _linkPort[linkIdx];
+            linkSnap.srtt = _linkEstimator[linkIdx].value();
+            fillMetricSnapshot(linkSnap.lat, _linkLat, linkIdx);
+            linkSnap.lat.smoothed = linkSnap.srtt;
         }
 
-        // Sample (not population) variance
-        double RTTVar(const vector<double>& vTimes, const double rttAvg) {
-            double sum = 0, diff = 0;
-            for (auto i : vTimes) {
-                diff = i - rttAvg;
-                sum += (diff * diff);
-            }
-
-            if (vTimes.size() > 1)
-                return sum / (vTimes.size() - 1);
-            else
-                return 0; // Can't divide by 0, so this is undefined
+        // Probes of the endpoint are sampled 1 in 2^shift (overload)
+        static uint8_t probeSampleShift(const LatencyMetadata& latMeta) {
+            return latMeta.probeLevel < 2 ? 0 : latMeta.probeLevel - 1;
         }
 
-        /* Updates vTimes structure given the new value newVal
-         *
-         * sampleAvg and sampleVar contains current avg and variance.
-         * The function will calculate updated avg and variance values, and
-         * update the sampleAvg and sampleVar parameters.
-         */
-        void updateStats(vector<double>& vTimes, const uint16_t maxVecSize,
-                            const double newVal, double& sampleAvg,
-                            double& sampleVar, double& sampleMed) {
-
-            vTimes.push_back(newVal);
-            if (vTimes.size() > maxVecSize) {
-                double oldestVal = vTimes.front();
-                double oldAvg = sampleAvg;
-
-                vTimes.erase(vTimes.begin()); // Keep it bounded
-                sampleAvg += (newVal - oldestVal) / maxVecSize;
-                sampleVar += (newVal - oldestVal) * (newVal - sampleAvg + oldestVal - oldAvg) / (maxVecSize - 1);
-
-            } else {
-                /* If pre-insertion size is less than maxVecSize, then
-                 * we shouldn't use simplified rolling update formulas. Do
-                 * full calculations from scratch. */
-                sampleAvg = RTTAvg(vTimes);
-                sampleVar = RTTVar(vTimes, sampleAvg);
-            }
-
-            /* TODO: Median calculation currently super-inefficient.
-             *       Copying + sorting each time increases cost as maxVecSize increases.
-             *       Fix later using max-heap and min-heap.
-             */
-            vector<double> tmpVec = vTimes;
-            std::sort(tmpVec.begin(), tmpVec.end());
-            if (tmpVec.size() == 0)
-                sampleMed = 0;
-            else if (tmpVec.size() % 2 == 0)
-                sampleMed = (tmpVec[tmpVec.size() / 2 - 1] + tmpVec[tmpVec.size() / 2]) / 2;
-            else
-                sampleMed = tmpVec[tmpVec.size() / 2];
-
-            return;
+        // Resolves 'config' against Policy, falling back to the defaults if it is invalid
+        static LatencyConfig checkedConfig(const LatencyConfig& config);
+
+        // Outstanding probe IDs per port, a constant unless set at run time
+        uint16_t maxOutstandingPkts() const {
+            return Policy::MAX_OUTSTANDING_PKTS ? Policy::MAX_OUTSTANDING_PKTS :
+                                                    _config.maxOutstandingPkts;
         }
 
+        // Returns the endpoint's index, adding it if it hasn't been seen yet
+        uint32_t internEndpoint(const IPv4EndpointType dpEndpoint);
+
+        // Returns the endpoint's index, or NO_INDEX if it hasn't been seen yet
+        uint32_t findEndpoint(const IPv4EndpointType dpEndpoint) const;
+
+        // Returns the link's index, adding it if it hasn't been seen yet
+        uint32_t internLink(const uint32_t epIdx, const uint16_t port_no);
+
+        // Returns the link's index, or NO_INDEX if it hasn't been seen yet
+        uint32_t findLink(const IPv4EndpointType dpEndpoint, const uint16_t port_no) const;
+
+        // Fixed-size table Bytes of a switch and of a link, charged when they are added
+        size_t endpointFixedBytes() const;
+        size_t linkFixedBytes() const;
+
+        /* Feeds a sample to a change detector, publishing detected changes to
+         * the observers and counting them against the endpoint
+         */
+        void detectChange(ChangeDetector& detector, const IPv4EndpointType dpEndpoint,
+                            const ObserverMetric metric, const uint16_t port_no,
+                            const double sample, LatencyMetadata& latMeta);
+
+        /* Gives up on all outstanding probes of the endpoint and frees its
+         * probe tables, returns the number of probes given up on
+         */
+        uint64_t compactEndpoint(const uint32_t epIdx);
+
+        /* Compacts the endpoints whose probes were least recently active until
+         * memory usage is within the budget; the active endpoint goes last
+         */
+        void enforceMemoryBudget(const uint32_t activeIdx);
+
+        // Appends a row's window samples and histogram to a checkpoint
+        template <class Table>
+        static void putCheckpointRow(CheckpointBuffer& buf, const Table& table,
+                                        const uint32_t row, vector<double>& scratch);
+
+        /* Replays a row's window samples from a checkpoint into the table
+         * Only the newest samples are kept if the table's window is smaller.
+         */
+        template <class Table>
+        static bool getCheckpointRow(CheckpointReader& in, Table& table,
+                                        const uint32_t row, vector<double>& scratch);
+
+        // Copies endpoints, links, windows and estimators into a checkpoint payload
+        void fillCheckpoint(CheckpointBuffer& buf);
+
+        /* Checks that a checkpoint payload is complete and consistent,
+         * so restoreCheckpoint() won't stop halfway through it
+         */
+        static bool checkCheckpoint(CheckpointReader& in);
+
+        // Skips a row written by putCheckpointRow()
+        static bool skipCheckpointRow(CheckpointReader& in, vector<double>& scratch);
+
+        // Adds the endpoints and links of a checkpoint payload
+        bool restoreCheckpoint(CheckpointReader& in);
+
+        // Copies counters, endpoints and links into a summary payload
+        void fillSummary(CheckpointBuffer& buf);
+
+        // Appends a closed rollup interval of a stream to the rollup log (port_no -1: no link)
+        void logRollup(const RollupLevel level, const RollupSlot& slot,
+                        const IPv4EndpointType dpEndpoint, const char* metric, const int port_no);
+
     public:
-        EndpointLatencyMetadata();
+        /* Sizes and limits that Policy does not fix are taken from 'config'
+         * See also configure().
+         */
+        BasicEndpointLatencyMetadata(const LatencyConfig& config = DEFAULT_LATENCY_CONFIG);
 
-        ~EndpointLatencyMetadata();
+        ~BasicEndpointLatencyMetadata();
+
+        /* Changes the sizes and limits that Policy does not fix
+         * Only possible before any switch has been seen (i.e. before the sniff
+         * loop starts); returns false otherwise, or if 'config' is invalid.
+         */
+        bool configure(const LatencyConfig& config);
+
+        const LatencyConfig& config() const;
+
+        /* Changes the window sizes and the probe limit once switches were seen
+         * May be called from any thread while the sniff loop runs: the sniff
+         * loop applies the change before the next packet, see
+         * applyReconfiguration(). Estimators can't be changed this way.
+         * Returns false if 'config' is invalid or changes an estimator.
+         */
+        bool reconfigure(const LatencyConfig& config);
+
+        bool reconfigureDue() const {
+            return _reconfigPending.load(std::memory_order_relaxed);
+        }
+
+        /* Applies the last reconfigure() in place: every endpoint and link
+         * keeps the newest samples of its windows (as many as fit), and the
+         * memory charged for them is adjusted. Sniff loop only, or while it
+         * is stopped.
+         */
+        void applyReconfiguration();
+
+        /* Reserves the tables and indices for 'endpoints' switches and
+         * 'links' links, so the sniff loop doesn't reallocate them (or fault
+         * in their pages) until there are more; see ThreadPlacement.h
+         */
+        void reserve(const uint32_t endpoints, const uint32_t links);
 
         /* Open statistics log file for writing
          * Function is idempotent
          */
         bool openStatsLog();
 
+        SniffCounters& counters();
+
+        CaptureStats& captureStats();
+
+        Diagnostics& diagnostics();
+
+        // Load shedding when the sniff loop can't keep up, see OverloadGovernor.h
+        OverloadGovernor& governor();
+
+        // Memory usage of all switches and its budget, see MemoryAccounting.h
+        MemoryBudget& memoryBudget();
+
+        /* Callbacks and polling for new samples, threshold crossings and
+         * switch connections coming and going, see Observers.h
+         */
+        Observers& observers();
+
+        /* Enables periodic snapshots of all statistics, taken by the sniff
+         * loop at most once every intervalMs (in packet time).
+         * Must be called before the sniff loop starts.
+         */
+        void enableSnapshots(const uint32_t intervalMs);
+
+        // Returns true if snapshots are enabled and the interval has elapsed
+        bool snapshotDue(const Timestamp& ts);
+
+        /* Copies current statistics into a snapshot and publishes it
+         * Endpoints are copied in index order, reading the metric tables sequentially.
+         */
+        void publishSnapshot(const Timestamp& ts);
+
+        /* Snapshots are published for a single reader thread
+         * See SnapshotExchange for the reader-side interface.
+         */
+        SnapshotExchange<StatsSnapshot>& snapshots();
+
+        /* Publishes every statistics update into the shared-memory table
+         * /dev/shm/<name>, see ShmStatsTable.h for readers.
+         * Must be called before the sniff loop starts.
+         */
+        bool openShmTable(const string& name, const uint32_t capacity);
+
+        /* Enables periodic checkpoints of the latency state (see Checkpoint.h)
+         * into 'path', taken by the sniff loop at most once every intervalMs
+         * (in packet time) and written by a thread of their own.
+         * Must be called before the sniff loop starts.
+         */
+        bool enableCheckpoints(const string& path, const uint32_t intervalMs = CHECKPOINT_INTERVAL_MS);
+
+        // Returns true if checkpoints are enabled and the interval has elapsed
+        bool checkpointDue(const Timestamp& ts);
+
+        // Copies the latency state and hands it to the checkpoint writer
+        void writeCheckpoint(const Timestamp& ts);
+
+        /* Writes a last checkpoint and stops the writer thread
+         * Must be called after the sniff loop stopped; function is idempotent.
+         */
+        void closeCheckpoints();
+
+        const CheckpointWriter& checkpoints() const;
+
+        /* Warm restart: restores the windows, link estimators and endpoints of
+         * a checkpoint file written by an earlier run
+         * Windows of another size keep their newest samples. Only possible
+         * before any switch has been seen (i.e. before the sniff loop starts);
+         * returns false otherwise, or if the file is missing or corrupt (in
+         * which case nothing is restored).
+         */
+        bool loadCheckpoint(const string& path);
+
+        /* Enables periodic summaries of all statistics for an aggregator
+         * (see Aggregator.h) at 'addr', taken by the sniff loop at most once
+         * every intervalMs (in packet time) and sent by a thread of their own.
+         * Must be called before the sniff loop starts.
+         */
+        bool enableSummaries(const SummaryAddress& addr, const string& nodeName,
+                                const uint32_t intervalMs = SUMMARY_INTERVAL_MS);
+
+        // Returns true if summaries are enabled and the interval has elapsed
+        bool summaryDue(const Timestamp& ts);
+
+        // Copies current statistics and hands them to the summary sender
+        void sendSummary(const Timestamp& ts);
+
+        /* Sends a last summary and stops the sender thread
+         * Must be called after the sniff loop stopped; function is idempotent.
+         */
+        void closeSummaries();
+
+        const SummarySender& summaries() const;
+
+        /* Keeps 1s, 1min and 1h rollups of the echo RTT, PacketIn RTT and
+         * link latency samples of every switch and link (see Rollups.h).
+         * If logPath is not empty, a line is appended to it for every closed
+         * interval of logLevel of every stream, instead of one per sample:
+         * "<start s> <resolution s> <endpoint> <metric> <count> <min> <max> <mean> <p50> <p90> <p99>"
+         * Must be called before the sniff loop starts; returns false if the
+         * log could not be opened.
+         */
+        bool enableRollups(const string& logPath = "", const RollupLevel logLevel = ROLLUP_MINUTE);
+
+        // Returns true if rollups are enabled and ts is in a later second than their intervals
+        bool rollupsDue(const Timestamp& ts) const;
+
+        // Closes the rollup intervals that ended before ts, logging them if enabled
+        void advanceRollups(const Timestamp& ts);
+
+        /* Rollups at 'level' of the intervals starting in [fromS, toS) (packet
+         * time, seconds since the epoch) of a metric: OBS_METRIC_ECHO_RTT,
+         * OBS_METRIC_PKT_IN_RTT, or OBS_METRIC_LINK_LAT of the link at port_no.
+         * Returns false if rollups are disabled, or the stream wasn't seen yet.
+         */
+        bool getRollups(const IPv4EndpointType dpEndpoint, const ObserverMetric metric,
+                        const uint16_t port_no, const RollupLevel level, const uint64_t fromS,
+                        const uint64_t toS, RollupSeries& out) const;
+
+        /* Counts every OpenFlow message whose header starts in the given TCP
+         * segment (direction given by toSwitch), continuing messages that
+         * started in earlier segments of the same direction, and times
+         * request/reply transactions by xid
+         * Returns true if the payload starts with a complete message header.
+         */
+        bool processOFHeaders(const Timestamp& ts, const IPv4EndpointType dpEndpoint,
+                                const TCPSegment& seg, const uint8_t* payload, const bool toSwitch);
+
+        /* Tracks TCP timestamps and sequence numbers of every segment of the
+         * endpoint's control connection (direction given by toSwitch)
+         */
+        void processTCPSegment(const Timestamp& ts, const IPv4EndpointType dpEndpoint,
+                                const TCPSegment& seg, const bool toSwitch);
+
+        // Returns true if the current traffic interval has elapsed
+        bool trafficIntervalDue(const Timestamp& ts);
+
+        /* Closes the current traffic interval of all endpoints and publishes
+         * their counters and sliding-window rates for getOFTraffic()
+         * Also expires transactions whose reply was never seen, and closes
+         * the bytes-in-flight peak interval.
+         */
+        void closeTrafficInterval(const Timestamp& ts);
+
+        // Counters and rates of all endpoints, as of the last closed interval
+        vector<OFTrafficStats> getOFTraffic() const;
+
+        // Returns false if the endpoint has no closed interval yet
+        bool getOFTraffic(const IPv4EndpointType dpEndpoint, OFTrafficStats& stats) const;
+
+        // Human-readable counters and rates of all endpoints, by message type
+        void dumpOFTraffic(std::ostream& os) const;
+
+        /* Copies request/reply latency statistics of all transaction kinds
+         * into 'stats' (NUM_OF_TXN_KINDS entries)
+         * Returns false if the endpoint is unknown.
+         */
+        bool getTransactionStats(const IPv4EndpointType dpEndpoint, OFTransactionStats* stats);
+
+        /* Copies transport RTT and bytes-in-flight statistics into 'stats'
+         * Returns false if the endpoint is unknown.
+         */
+        bool getTCPStats(const IPv4EndpointType dpEndpoint, TCPFlowStats& stats);
+
+        /* Returns true if the endpoint's LLDP probe message should be
+         * processed, false if the overload governor skips it
+         */
+        bool sampleProbe(const IPv4EndpointType dpEndpoint, const string& packetID);
+
         // Returns by ref
         // TODO: Re-evaluate need for this, remove this function when new accessors added
         PacketSeenType& getPacketSeenMap(IPv4EndpointType dpEndpoint);
@@ -109,6 +474,9 @@ class EndpointLatencyMetadata {
         void remOutstandingPkt(const IPv4EndpointType dpEndpoint,
                                 const uint16_t port_no, const string& packetID);
 
+        // Datapath ID from the switch's FeaturesReply, identifies it across sniffers
+        void setDatapathID(const IPv4EndpointType dpEndpoint, const uint64_t datapathID);
+
         void updateEchoRTT(const IPv4EndpointType dpEndpoint, const double rtt);
 
         void updatePktInRTT(const IPv4EndpointType dpEndpoint, const double rtt);
@@ -116,6 +484,9 @@ class EndpointLatencyMetadata {
         void updateLinkLat(const IPv4EndpointType dpEndpoint,
                             const uint16_t port_no, const double latEstimate);
 
+        /* The getters below return 0 for endpoints and links that haven't been
+         * seen yet, without adding them
+         */
         double getEchoRTTAvg(const IPv4EndpointType dpEndpoint);
 
         double getEchoRTTVar(const IPv4EndpointType dpEndpoint);
@@ -128,6 +499,13 @@ class EndpointLatencyMetadata {
 
         double getPktInRTTMed(const IPv4EndpointType dpEndpoint);
 
+        // Current values of the metrics' estimators (see LatencyConfig)
+        double getEchoRTTSmoothed(const IPv4EndpointType dpEndpoint);
+
+        double getPktInRTTSmoothed(const IPv4EndpointType dpEndpoint);
+
+        double getLinkLatSmoothed(const IPv4EndpointType dpEndpoint, const uint16_t port_no);
+
         // TODO: Input should really be a pair of endpoints
         double getLinkLatAvg(const IPv4EndpointType dpEndpoint, const uint16_t port_no);
 
@@ -137,11 +515,35 @@ class EndpointLatencyMetadata {
         // TODO: Input should really be a pair of endpoints
         double getLinkLatMed(const IPv4EndpointType dpEndpoint, const uint16_t port_no);
 
+        uint64_t getProbesSent(const IPv4EndpointType dpEndpoint);
+
+        uint64_t getProbesMatched(const IPv4EndpointType dpEndpoint);
+
+        uint64_t getProbesExpired(const IPv4EndpointType dpEndpoint);
+
+        uint64_t getProbesSkipped(const IPv4EndpointType dpEndpoint);
+
+        // Share of probes processed when the endpoint's last probe message was seen
+        double getProbeSampleRate(const IPv4EndpointType dpEndpoint);
+
+        // Bytes charged to the endpoint (see MemoryAccounting.h)
+        uint64_t getMemoryBytes(const IPv4EndpointType dpEndpoint);
+
+        // 0 until the switch's FeaturesReply was seen
+        uint64_t getDatapathID(const IPv4EndpointType dpEndpoint);
+
+        // In the order the endpoints were first seen
         vector<IPv4EndpointType> getEndpoints();
 
         double getDp2CtrlRTT(IPv4EndpointType dpEndpoint);
 
 };
 
+// Fixed window sizes, used by the OFSniff binary
+typedef BasicEndpointLatencyMetadata<DefaultLatencyPolicy> EndpointLatencyMetadata;
+
+// Window sizes set at run time, used by the Python module
+typedef BasicEndpointLatencyMetadata<RuntimeLatencyPolicy> RuntimeEndpointLatencyMetadata;
+
 
 #endif
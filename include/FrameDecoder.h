@@ -0,0 +1,253 @@
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+#include <cstdint>
+#include <cstring>
+
+#include <pcap.h>
+
+#include "TCPFlow.h"
+
+/* Decoding of captured frames straight from the raw bytes
+ *
+ * Control channel frames, TCP over IPv4 or IPv6, are decoded by fixed
+ * offsets into a DecodedFrame on the caller's stack. No PDU objects are
+ * allocated and no virtual calls are made. Supported are Ethernet (with up
+ * to two 802.1Q/802.1ad tags, i.e. QinQ), Linux cooked captures (SLL and
+ * SLL2, e.g. on the "any" interface) and raw IP. Anything else is left to
+ * libtins (FRAME_FALLBACK), so the result is the same as decoding every
+ * frame with libtins, only cheaper.
+ */
+
+#define FRAME_ETH_HDR_LEN 14
+#define FRAME_SLL_HDR_LEN 16
+#define FRAME_SLL2_HDR_LEN 20
+#define FRAME_VLAN_TAG_LEN 4
+#define FRAME_MAX_VLAN_TAGS 2 // QinQ
+#define FRAME_ETHERTYPE_IPV4 0x0800
+#define FRAME_ETHERTYPE_IPV6 0x86DD
+#define FRAME_ETHERTYPE_VLAN 0x8100  // 802.1Q
+#define FRAME_ETHERTYPE_QINQ 0x88A8  // 802.1ad service tag
+#define FRAME_ETHERTYPE_QINQ_OLD 0x9100 // Pre-standard QinQ
+#define FRAME_IPV4_MIN_HDR_LEN 20
+#define FRAME_IPV6_HDR_LEN 40
+#define FRAME_IPV6_MAX_EXT_HDRS 4 // Extension headers skipped before giving up
+#define FRAME_IP_PROTO_HOP_BY_HOP 0
+#define FRAME_IP_PROTO_TCP 6
+#define FRAME_IP_PROTO_ROUTING 43
+#define FRAME_IP_PROTO_FRAGMENT 44
+#define FRAME_IP_PROTO_DST_OPTS 60
+#define FRAME_IP_FLAG_MF 0x2000 // More fragments
+#define FRAME_IP_FRAG_OFFSET 0x1FFF
+#define FRAME_TCP_MIN_HDR_LEN 20
+#define FRAME_TCP_OPT_END 0
+#define FRAME_TCP_OPT_NOP 1
+#define FRAME_TCP_OPT_TIMESTAMP 8
+#define FRAME_TCP_OPT_TIMESTAMP_LEN 10
+
+#ifndef DLT_LINUX_SLL2
+#define DLT_LINUX_SLL2 276 // libpcap >= 1.10
+#endif
+
+enum FrameDecodeResult {
+    FRAME_TCP,      // TCP over IPv4 or IPv6, decoded
+    FRAME_OTHER,    // IP, but not TCP; nothing to do
+    FRAME_FALLBACK  // Not handled here (link type, encapsulation, fragment, truncated, ...)
+};
+
+/* Headers of a TCP frame
+ * The pointers point into the captured frame. tcp.payloadLen is the number
+ * of payload Bytes captured at 'payload', tcp.wireLen the payload length on
+ * the wire (larger when the snapshot length cut the frame short). Neither
+ * includes Ethernet padding. FillTCPSegment() fills both the same way for
+ * frames decoded by libtins.
+ */
+typedef struct DecodedFrame {
+    bool ipv6;
+    uint32_t srcAddr; // IPv4: as IPv4Address's uint32_t, i.e. in network byte order
+    uint32_t dstAddr;
+    const uint8_t* srcAddr6; // IPv6: 16 Bytes
+    const uint8_t* dstAddr6;
+    uint16_t sport;
+    uint16_t dport;
+    TCPSegment tcp;
+    const uint8_t* payload;
+} DecodedFrame;
+
+inline uint16_t ReadBE16(const uint8_t* p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+inline uint32_t ReadBE32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Finds the TCP timestamps option
+ * Returns false if the options are malformed.
+ */
+inline bool DecodeTCPOptions(const uint8_t* opt, const uint32_t len, TCPSegment& seg) {
+    seg.hasTimestamp = false;
+
+    uint32_t i = 0;
+    while (i < len) {
+        if (opt[i] == FRAME_TCP_OPT_END)
+            break;
+        if (opt[i] == FRAME_TCP_OPT_NOP) {
+            i++;
+            continue;
+        }
+
+        if (i + 1 >= len || opt[i + 1] < 2 || i + opt[i + 1] > len)
+            return false;
+
+        if (opt[i] == FRAME_TCP_OPT_TIMESTAMP && opt[i + 1] == FRAME_TCP_OPT_TIMESTAMP_LEN) {
+            seg.hasTimestamp = true;
+            seg.tsval = ReadBE32(opt + i + 2);
+            seg.tsecr = ReadBE32(opt + i + 6);
+        }
+        i += opt[i + 1];
+    }
+
+    return true;
+}
+
+/* Decodes the TCP segment at 'tcp'
+ * 'len' Bytes are captured up to the end of the IP packet, 'wireLen' (>= len)
+ * is the segment's length on the wire according to the IP header.
+ */
+inline FrameDecodeResult DecodeTCP(const uint8_t* tcp, const uint32_t len, const uint32_t wireLen,
+                                    DecodedFrame& frame) {
+    if (len < FRAME_TCP_MIN_HDR_LEN)
+        return FRAME_FALLBACK;
+
+    uint32_t tcpHdrLen = (tcp[12] >> 4) * 4;
+    if (tcpHdrLen < FRAME_TCP_MIN_HDR_LEN || tcpHdrLen > len)
+        return FRAME_FALLBACK;
+
+    if (!DecodeTCPOptions(tcp + FRAME_TCP_MIN_HDR_LEN, tcpHdrLen - FRAME_TCP_MIN_HDR_LEN, frame.tcp))
+        return FRAME_FALLBACK;
+
+    frame.sport = ReadBE16(tcp);
+    frame.dport = ReadBE16(tcp + 2);
+    frame.tcp.seq = ReadBE32(tcp + 4);
+    frame.tcp.ack = ReadBE32(tcp + 8);
+    frame.tcp.flags = ReadBE16(tcp + 12) & 0x0FFF;
+    frame.tcp.payloadLen = len - tcpHdrLen;
+    frame.tcp.wireLen = wireLen - tcpHdrLen;
+    frame.payload = tcp + tcpHdrLen;
+
+    return FRAME_TCP;
+}
+
+// Decodes the IPv4 packet at 'ip' ('len' Bytes captured)
+inline FrameDecodeResult DecodeIPv4(const uint8_t* ip, const uint32_t len, DecodedFrame& frame) {
+    if (len < FRAME_IPV4_MIN_HDR_LEN || (ip[0] >> 4) != 4)
+        return FRAME_FALLBACK;
+
+    uint32_t ipHdrLen = (ip[0] & 0x0F) * 4;
+    uint32_t ipTotalLen = ReadBE16(ip + 2);
+    if (ipHdrLen < FRAME_IPV4_MIN_HDR_LEN || ipTotalLen < ipHdrLen)
+        return FRAME_FALLBACK;
+
+    if (ReadBE16(ip + 6) & (FRAME_IP_FLAG_MF | FRAME_IP_FRAG_OFFSET))
+        return FRAME_FALLBACK;
+
+    if (ip[9] != FRAME_IP_PROTO_TCP)
+        return FRAME_OTHER;
+
+    // Ethernet padding follows the IP packet, and the snapshot length may cut it short
+    uint32_t ipLen = (ipTotalLen < len) ? ipTotalLen : len;
+    if (ipLen < ipHdrLen)
+        return FRAME_FALLBACK;
+
+    frame.ipv6 = false;
+    memcpy(&frame.srcAddr, ip + 12, sizeof(uint32_t));
+    memcpy(&frame.dstAddr, ip + 16, sizeof(uint32_t));
+
+    return DecodeTCP(ip + ipHdrLen, ipLen - ipHdrLen, ipTotalLen - ipHdrLen, frame);
+}
+
+// Decodes the IPv6 packet at 'ip' ('len' Bytes captured), skipping extension headers
+inline FrameDecodeResult DecodeIPv6(const uint8_t* ip, const uint32_t len, DecodedFrame& frame) {
+    if (len < FRAME_IPV6_HDR_LEN || (ip[0] >> 4) != 6)
+        return FRAME_FALLBACK;
+
+    uint32_t ipTotalLen = FRAME_IPV6_HDR_LEN + ReadBE16(ip + 4);
+    uint32_t ipLen = (ipTotalLen < len) ? ipTotalLen : len;
+
+    uint8_t nextHdr = ip[6];
+    uint32_t offset = FRAME_IPV6_HDR_LEN;
+    for (uint16_t i = 0; nextHdr != FRAME_IP_PROTO_TCP; i++) {
+        if (nextHdr == FRAME_IP_PROTO_FRAGMENT || i == FRAME_IPV6_MAX_EXT_HDRS)
+            return FRAME_FALLBACK;
+
+        if (nextHdr != FRAME_IP_PROTO_HOP_BY_HOP && nextHdr != FRAME_IP_PROTO_ROUTING &&
+                nextHdr != FRAME_IP_PROTO_DST_OPTS)
+            return FRAME_OTHER;
+
+        if (offset + 8 > ipLen)
+            return FRAME_FALLBACK;
+        nextHdr = ip[offset];
+        offset += (ip[offset + 1] + 1) * 8;
+    }
+
+    if (offset > ipLen)
+        return FRAME_FALLBACK;
+
+    frame.ipv6 = true;
+    frame.srcAddr6 = ip + 8;
+    frame.dstAddr6 = ip + 24;
+
+    return DecodeTCP(ip + offset, ipLen - offset, ipTotalLen - offset, frame);
+}
+
+// Decodes the packet of the given EtherType, after skipping VLAN tags
+inline FrameDecodeResult DecodeEtherType(uint16_t etherType, const uint8_t* data, uint32_t len,
+                                            DecodedFrame& frame) {
+    for (uint16_t tags = 0; etherType == FRAME_ETHERTYPE_VLAN || etherType == FRAME_ETHERTYPE_QINQ ||
+                            etherType == FRAME_ETHERTYPE_QINQ_OLD; tags++) {
+        if (tags == FRAME_MAX_VLAN_TAGS || len < FRAME_VLAN_TAG_LEN)
+            return FRAME_FALLBACK;
+
+        etherType = ReadBE16(data + 2);
+        data += FRAME_VLAN_TAG_LEN;
+        len -= FRAME_VLAN_TAG_LEN;
+    }
+
+    if (etherType == FRAME_ETHERTYPE_IPV4)
+        return DecodeIPv4(data, len, frame);
+    if (etherType == FRAME_ETHERTYPE_IPV6)
+        return DecodeIPv6(data, len, frame);
+
+    return FRAME_FALLBACK;
+}
+
+// Decodes a frame captured on a handle of the given link type
+inline FrameDecodeResult DecodeFrame(const uint8_t* data, const uint32_t len, const int linkType,
+                                        DecodedFrame& frame) {
+    switch (linkType) {
+        case DLT_EN10MB:
+            if (len < FRAME_ETH_HDR_LEN)
+                return FRAME_FALLBACK;
+            return DecodeEtherType(ReadBE16(data + 12), data + FRAME_ETH_HDR_LEN,
+                                    len - FRAME_ETH_HDR_LEN, frame);
+        case DLT_LINUX_SLL:
+            if (len < FRAME_SLL_HDR_LEN)
+                return FRAME_FALLBACK;
+            return DecodeEtherType(ReadBE16(data + 14), data + FRAME_SLL_HDR_LEN,
+                                    len - FRAME_SLL_HDR_LEN, frame);
+        case DLT_LINUX_SLL2:
+            if (len < FRAME_SLL2_HDR_LEN)
+                return FRAME_FALLBACK;
+            return DecodeEtherType(ReadBE16(data), data + FRAME_SLL2_HDR_LEN,
+                                    len - FRAME_SLL2_HDR_LEN, frame);
+        case DLT_RAW:
+            if (len && (data[0] >> 4) == 6)
+                return DecodeIPv6(data, len, frame);
+            return DecodeIPv4(data, len, frame);
+        default:
+            return FRAME_FALLBACK;
+    }
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef IPV6ADDRESSES_H
+#define IPV6ADDRESSES_H
+
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#define IPV6_ADDR_LEN 16
+#define IPV6_MAX_ADDRS 65536 // Distinct IPv6 addresses one process can track
+#define IPV6_NO_ID UINT32_MAX
+
+typedef std::array<uint8_t, IPV6_ADDR_LEN> IPv6AddrBytes;
+
+struct IPv6AddrHash {
+    size_t operator()(const IPv6AddrBytes& addr) const {
+        uint64_t hi, lo;
+        memcpy(&hi, addr.data(), sizeof(hi));
+        memcpy(&lo, addr.data() + sizeof(hi), sizeof(lo));
+        return std::hash<uint64_t>()(hi ^ (lo * 0x9E3779B97F4A7C15ULL));
+    }
+};
+
+/* Dense IDs for IPv6 addresses
+ *
+ * Endpoints are 64-bit keys everywhere (see IPv4EndpointType). An IPv6
+ * endpoint carries the ID of its address instead of the address itself, so
+ * IPv6 support doesn't widen the keys of any hot structure. IDs are never
+ * reused.
+ *
+ * intern() may be called from any thread (it takes a lock); address() is
+ * lock-free and may be called concurrently with intern().
+ */
+class IPv6AddressTable {
+    private:
+        std::mutex _mutex; // Serializes intern()
+        std::unordered_map<IPv6AddrBytes, uint32_t, IPv6AddrHash> _ids;
+        std::unique_ptr<IPv6AddrBytes[]> _addrs; // IPV6_MAX_ADDRS, allocated on first use
+        std::atomic<uint32_t> _size;
+
+    public:
+        IPv6AddressTable();
+
+        // The table used by GenIPv6Endpoint() and EndpointToString()
+        static IPv6AddressTable& global();
+
+        // Returns the ID of the address (16 Bytes), adding it if new; IPV6_NO_ID if full
+        uint32_t intern(const uint8_t* addr);
+
+        // Returns the ID of the address, or IPV6_NO_ID if it was never interned
+        uint32_t find(const uint8_t* addr);
+
+        // Copies the address with the given ID into 'addr' (16 Bytes), false if unknown
+        bool address(const uint32_t id, uint8_t* addr) const;
+
+        uint32_t size() const {
+            return _size.load(std::memory_order_acquire);
+        }
+};
+
+#endif
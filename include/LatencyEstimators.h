@@ -0,0 +1,307 @@
+#ifndef LATENCYESTIMATORS_H
+#define LATENCYESTIMATORS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+#define ESTIMATOR_EMA_GAIN 0.125 // Weight of a new sample in EMA and DEMA (as TCP's SRTT)
+#define ESTIMATOR_ADAPTIVE_MIN_GAIN 0.05 // Gain range of the adaptive-alpha EMA
+#define ESTIMATOR_ADAPTIVE_MAX_GAIN 0.5
+#define ESTIMATOR_ADAPTIVE_ERR_GAIN 0.2 // Weight of a new error in its tracking signal
+#define ESTIMATOR_KALMAN_NOISE_GAIN 0.05 // Weight of a new sample in the Kalman noise estimates
+#define ESTIMATOR_TRIM_WINDOW 9 // Samples of the trimmed mean, the lowest and highest are dropped
+
+/* Estimators smoothing a stream of latency samples
+ *
+ * Since the link latency estimate is the result of a subtraction operation
+ * involving other estimated values, it can potentially be 0, and its raw
+ * values are noisy; estimators smooth them out. Each of them:
+ *  - returns the smoothed value from update(sample), and from value()
+ *  - seeds itself from the first sample, to avoid slow convergence at start
+ *  - is O(1) per sample, allocation-free and trivially copyable (checkpoints
+ *    save and restore them as is)
+ *
+ * Their trade-offs between responsiveness and variance can be compared on
+ * recorded statistics logs, see EstimatorReplay.cpp ('make replay').
+ */
+enum EstimatorKind {
+    ESTIMATOR_EMA = 0,     // Exponential moving average (SRTT, low-pass filter)
+    ESTIMATOR_DEMA,        // Double EMA, follows trends with less lag than EMA
+    ESTIMATOR_ADAPTIVE,    // EMA whose gain follows a tracking signal (Trigg-Leach)
+    ESTIMATOR_KALMAN,      // 1-D Kalman filter (random walk) with estimated noise
+    ESTIMATOR_TRIMMED_MEAN, // Mean of a short window without its lowest and highest samples
+    NUM_ESTIMATOR_KINDS
+};
+
+inline const char* EstimatorName(const EstimatorKind kind) {
+    switch (kind) {
+        case ESTIMATOR_EMA: return "ema";
+        case ESTIMATOR_DEMA: return "dema";
+        case ESTIMATOR_ADAPTIVE: return "adaptive";
+        case ESTIMATOR_KALMAN: return "kalman";
+        case ESTIMATOR_TRIMMED_MEAN: return "trimmed_mean";
+        default: return "unknown";
+    }
+}
+
+// Returns false if 'name' isn't one of the EstimatorName()s
+inline bool ParseEstimatorKind(const char* name, EstimatorKind& kind) {
+    for (uint8_t i = 0; i < NUM_ESTIMATOR_KINDS; i++) {
+        if (strcmp(name, EstimatorName((EstimatorKind)i)) == 0) {
+            kind = (EstimatorKind)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+class EMAEstimator {
+    private:
+        double _value = 0;
+
+    public:
+        double update(const double sample) {
+            if (_value == 0)
+                _value = sample;
+
+            _value += ESTIMATOR_EMA_GAIN * (sample - _value);
+            return _value;
+        }
+
+        double value() const {
+            return _value;
+        }
+};
+
+// The original link latency estimator
+typedef EMAEstimator SRTTEstimator;
+
+/* EMA of the samples corrected by the EMA of that EMA, which removes most of
+ * the EMA's lag on trends and steps (at the cost of some overshoot)
+ */
+class DEMAEstimator {
+    private:
+        double _ema = 0;
+        double _ema2 = 0;
+
+    public:
+        double update(const double sample) {
+            if (_ema == 0) {
+                _ema = sample;
+                _ema2 = sample;
+            }
+
+            _ema += ESTIMATOR_EMA_GAIN * (sample - _ema);
+            _ema2 += ESTIMATOR_EMA_GAIN * (_ema - _ema2);
+            return value();
+        }
+
+        double value() const {
+            return 2 * _ema - _ema2;
+        }
+};
+
+/* EMA whose gain is the tracking signal |smoothed error| / smoothed |error|:
+ * near 0 while errors cancel out (noise around a stable level), near 1 while
+ * they pile up on one side (the level moved)
+ */
+class AdaptiveEMAEstimator {
+    private:
+        double _value = 0;
+        double _err = 0;    // Smoothed error
+        double _absErr = 0; // Smoothed absolute error
+
+    public:
+        double update(const double sample) {
+            if (_value == 0) {
+                _value = sample;
+                return _value;
+            }
+
+            double err = sample - _value;
+            _err += ESTIMATOR_ADAPTIVE_ERR_GAIN * (err - _err);
+            _absErr += ESTIMATOR_ADAPTIVE_ERR_GAIN * (std::fabs(err) - _absErr);
+
+            double gain = _absErr > 0 ? std::fabs(_err) / _absErr : 0;
+            gain = std::min(std::max(gain, ESTIMATOR_ADAPTIVE_MIN_GAIN), ESTIMATOR_ADAPTIVE_MAX_GAIN);
+            _value += gain * err;
+            return _value;
+        }
+
+        double value() const {
+            return _value;
+        }
+};
+
+/* Kalman filter of a level following a random walk, observed with noise
+ * Neither noise is known in advance, both are estimated from the stream:
+ *  - measurement noise R from successive samples, E[(z[t] - z[t-1])^2] ~ 2R
+ *  - process noise Q from the innovations the filter did not expect
+ * so the gain rises while the level moves and falls while it's stable.
+ */
+class KalmanEstimator {
+    private:
+        double _x = 0;    // Level estimate
+        double _p = 0;    // Its variance
+        double _r = 0;    // Measurement noise (variance)
+        double _q = 0;    // Process noise (variance)
+        double _last = 0; // Previous sample
+
+    public:
+        double update(const double sample) {
+            if (_x == 0) {
+                _x = sample;
+                _last = sample;
+                return _x;
+            }
+
+            double diff = sample - _last;
+            _last = sample;
+            _r += ESTIMATOR_KALMAN_NOISE_GAIN * (diff * diff / 2 - _r);
+
+            _p += _q;
+            double innov = sample - _x;
+            double s = _p + _r;
+            _q += ESTIMATOR_KALMAN_NOISE_GAIN * (std::max(innov * innov - s, 0.0) - _q);
+
+            double gain = s > 0 ? _p / s : 1;
+            _x += gain * innov;
+            _p *= 1 - gain;
+            return _x;
+        }
+
+        double value() const {
+            return _x;
+        }
+};
+
+/* Mean of the last N samples without the lowest and the highest one, robust
+ * to single outliers; O(N) per sample with N a small constant
+ */
+template <uint16_t N>
+class TrimmedMeanEstimatorN {
+    static_assert(N >= 3, "Trimmed mean needs at least 3 samples");
+
+    private:
+        double _window[N] = {};
+        uint16_t _count = 0;
+        uint16_t _next = 0;
+        double _value = 0;
+
+    public:
+        double update(const double sample) {
+            _window[_next] = sample;
+            _next = (_next + 1) % N;
+            if (_count < N)
+                _count++;
+
+            double sum = 0;
+            double min = _window[0];
+            double max = _window[0];
+            for (uint16_t i = 0; i < _count; i++) {
+                sum += _window[i];
+                min = std::min(min, _window[i]);
+                max = std::max(max, _window[i]);
+            }
+
+            _value = _count < 3 ? sum / _count : (sum - min - max) / (_count - 2);
+            return _value;
+        }
+
+        double value() const {
+            return _value;
+        }
+};
+
+typedef TrimmedMeanEstimatorN<ESTIMATOR_TRIM_WINDOW> TrimmedMeanEstimator;
+
+/* Any of the above, chosen at run time (e.g. per metric, see LatencyConfig)
+ * The kinds share their storage, so it's as large as the largest one.
+ */
+class LatencyEstimator {
+    private:
+        uint8_t _kind;
+        union {
+            EMAEstimator _ema;
+            DEMAEstimator _dema;
+            AdaptiveEMAEstimator _adaptive;
+            KalmanEstimator _kalman;
+            TrimmedMeanEstimator _trimmedMean;
+        };
+
+        static_assert(sizeof(TrimmedMeanEstimator) >= sizeof(KalmanEstimator) &&
+                        sizeof(TrimmedMeanEstimator) >= sizeof(AdaptiveEMAEstimator),
+                        "reset() clears the kinds' storage through the largest one");
+
+    public:
+        explicit LatencyEstimator(const EstimatorKind kind = ESTIMATOR_EMA) : _trimmedMean() {
+            reset(kind);
+        }
+
+        // Starts over as an estimator of 'kind' (EMA if it's invalid)
+        void reset(const EstimatorKind kind) {
+            // Clears the largest kind first, so no state of another kind is left over
+            new (&_trimmedMean) TrimmedMeanEstimator();
+            _kind = kind < NUM_ESTIMATOR_KINDS ? kind : ESTIMATOR_EMA;
+            switch (_kind) {
+                case ESTIMATOR_DEMA: new (&_dema) DEMAEstimator(); break;
+                case ESTIMATOR_ADAPTIVE: new (&_adaptive) AdaptiveEMAEstimator(); break;
+                case ESTIMATOR_KALMAN: new (&_kalman) KalmanEstimator(); break;
+                case ESTIMATOR_TRIMMED_MEAN: new (&_trimmedMean) TrimmedMeanEstimator(); break;
+                default: new (&_ema) EMAEstimator(); break;
+            }
+        }
+
+        EstimatorKind kind() const {
+            return (EstimatorKind)_kind;
+        }
+
+        double update(const double sample) {
+            switch (_kind) {
+                case ESTIMATOR_DEMA: return _dema.update(sample);
+                case ESTIMATOR_ADAPTIVE: return _adaptive.update(sample);
+                case ESTIMATOR_KALMAN: return _kalman.update(sample);
+                case ESTIMATOR_TRIMMED_MEAN: return _trimmedMean.update(sample);
+                default: return _ema.update(sample);
+            }
+        }
+
+        double value() const {
+            switch (_kind) {
+                case ESTIMATOR_DEMA: return _dema.value();
+                case ESTIMATOR_ADAPTIVE: return _adaptive.value();
+                case ESTIMATOR_KALMAN: return _kalman.value();
+                case ESTIMATOR_TRIMMED_MEAN: return _trimmedMean.value();
+                default: return _ema.value();
+            }
+        }
+};
+
+/* Makes a policy's estimator of 'kind'; estimators of a fixed kind ignore it
+ * See LatencyPolicy.h.
+ */
+template <class Estimator>
+inline Estimator MakeEstimator(const EstimatorKind) {
+    return Estimator();
+}
+
+template <>
+inline LatencyEstimator MakeEstimator<LatencyEstimator>(const EstimatorKind kind) {
+    return LatencyEstimator(kind);
+}
+
+// Returns false if 'estimator' is of another kind than 'kind' (e.g. restored from a checkpoint)
+template <class Estimator>
+inline bool IsEstimatorKind(const Estimator&, const EstimatorKind) {
+    return true;
+}
+
+inline bool IsEstimatorKind(const LatencyEstimator& estimator, const EstimatorKind kind) {
+    return estimator.kind() == kind;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <cstdint>
+
+/* Upper bounds (in ms) of the latency histogram buckets
+ * Samples greater than the last bound fall into an implicit +Inf bucket.
+ */
+const double LAT_HIST_BOUNDS[] = {0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000};
+#define LAT_HIST_NUM_BOUNDS (sizeof(LAT_HIST_BOUNDS) / sizeof(LAT_HIST_BOUNDS[0]))
+
+/* Non-cumulative counts per bucket, plus the running sum of all samples
+ * Kept as plain arrays so the metadata structs stay trivially copyable.
+ */
+typedef struct LatencyHistogram {
+    uint64_t buckets[LAT_HIST_NUM_BOUNDS + 1]; // Last bucket is +Inf
+    uint64_t count;
+    double sum;
+
+    void add(const double val) {
+        uint16_t i = 0;
+        while (i < LAT_HIST_NUM_BOUNDS && val > LAT_HIST_BOUNDS[i])
+            i++;
+
+        buckets[i]++;
+        count++;
+        sum += val;
+    }
+} LatencyHistogram;
+
+#endif
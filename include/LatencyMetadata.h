@@ -6,25 +6,102 @@
 
 #include <tins/tins.h>
 
+#include "OFTraffic.h"
+#include "OFTransactions.h"
+#include "TCPFlow.h"
+#include "MemoryAccounting.h"
+
 using std::unordered_map;
 using std::string;
 using std::vector;
 
 using Tins::Timestamp;
 
-// Maps packet IDs to Timestamps when they were first seen
-typedef unordered_map<string, Timestamp> PacketSeenType;
+/* Maps packet IDs to Timestamps when they were first seen
+ * Nodes and buckets are charged to the switch's MemoryAccount by the
+ * allocator, the IDs' heap buffers as entries are added and erased.
+ */
+class PacketSeenType {
+    private:
+        typedef unordered_map<string, Timestamp, std::hash<string>, std::equal_to<string>,
+                                TrackingAllocator<std::pair<const string, Timestamp>>> Map;
+
+        Map _map;
+
+    public:
+        typedef Map::iterator iterator;
+
+        explicit PacketSeenType(MemoryAccount* account) :
+                _map(0, Map::hasher(), Map::key_equal(), Map::allocator_type(account)) {};
+
+        iterator find(const string& packetID) {
+            return _map.find(packetID);
+        }
+
+        iterator end() {
+            return _map.end();
+        }
+
+        size_t size() const {
+            return _map.size();
+        }
+
+        // Returns the entry of packetID, adding it if new
+        Timestamp& operator[](const string& packetID) {
+            iterator it = _map.find(packetID);
+            if (it == _map.end()) {
+                it = _map.emplace(packetID, Timestamp()).first;
+                _map.get_allocator().account()->charge(StringHeapBytes(it->first));
+            }
+
+            return it->second;
+        }
+
+        iterator erase(iterator it) {
+            _map.get_allocator().account()->release(StringHeapBytes(it->first));
+            return _map.erase(it);
+        }
+
+        size_t erase(const string& packetID) {
+            iterator it = _map.find(packetID);
+            if (it == _map.end())
+                return 0;
 
-typedef struct LinkLatMetadata {
-    vector<double> linkLatSamples;
-    double linkLatAvg;
-    double linkLatVar;
-    double linkLatSRTT;
-    double linkLatMed;
-} LinkLatMetadata;
+            erase(it);
+            return 1;
+        }
 
-/* Each instance of LatencyMetadata tracks data related to a single switch */
+        // Removes all entries and frees the buckets
+        void clear() {
+            for (iterator it = _map.begin(); it != _map.end(); )
+                it = erase(it);
+            Map(0, _map.hash_function(), _map.key_eq(), _map.get_allocator()).swap(_map);
+        }
+};
+
+// Outstanding probe IDs per port, charged as PacketSeenType
+typedef vector<string, TrackingAllocator<string>> OutstandingIDs;
+typedef unordered_map<uint16_t, OutstandingIDs, std::hash<uint16_t>, std::equal_to<uint16_t>,
+                        TrackingAllocator<std::pair<const uint16_t, OutstandingIDs>>> OutstandingPktsType;
+
+// State of a switch's control connection, as seen by the sniffer
+enum EndpointConnState {
+    EP_CONN_UNSEEN, // No segment seen yet
+    EP_CONN_UP,     // Segments seen since the connection started (or the sniffer did)
+    EP_CONN_DOWN    // FIN/RST seen, until the next SYN
+};
+
+/* Each instance of LatencyMetadata tracks data related to a single switch
+ * Its windowed latency statistics live in EndpointLatencyMetadata's
+ * MetricTables, in the row given by the switch's endpoint index.
+ */
 typedef struct LatencyMetadata {
+    MemoryAccount memory; // Must outlive the containers below
+
+    uint64_t version; // Incremented on every statistics update
+    uint8_t connState; // EndpointConnState
+    uint64_t datapathID; // From the switch's FeaturesReply, 0 until one was seen
+
     PacketSeenType packetSeen;
 
     /* Tracks per-port outstanding packet IDs.
@@ -32,23 +109,38 @@ typedef struct LatencyMetadata {
      * that are conected to hosts or other switches that don't understand
      * our LLDP-based link latency discovery protocol.
      */
-    unordered_map<uint16_t, vector<string>> outstandingPkts;
+    OutstandingPktsType outstandingPkts;
 
-    vector<double> echoRTTSamples;
-    double echoRTTAvg;
-    double echoRTTVar;
-    double echoRTTMed;
+    /* Probe accounting, for correlating probe loss with capture drops */
+    uint64_t probesSent;    // Added to outstandingPkts
+    uint64_t probesMatched; // Removed from outstandingPkts when the reply was seen
+    uint64_t probesExpired; // Evicted from outstandingPkts (reply never seen)
+    uint64_t probesSkipped; // Probe messages not processed by the overload governor
+    uint8_t probeLevel;     // Overload level when the last probe message was seen
+    uint64_t lastActive;    // Activity tick of the last probe added or matched
+    uint64_t changePoints;  // Latency changes detected on the switch's metrics (see ChangeDetector.h)
 
-    /* PacketIn RTT = Time from PacketIn Ping to PacketOut Pong */
-    vector<double> pktInRTTSamples;
-    double pktInRTTAvg;
-    double pktInRTTVar;
-    double pktInRTTMed;
-
-    /* Tracks per-port link latency metadata.
-     * Link latency samples over a window, sample average, and sample variance.
+    /* Link indices (rows of the link latency table) of the switch's ports,
+     * in the order the ports were first seen
      */
-    unordered_map<uint16_t, LinkLatMetadata> linkLatMeta;
+    vector<uint32_t, TrackingAllocator<uint32_t>> links;
+
+    /* Messages and bytes per OpenFlow message type */
+    OFTrafficMetadata ofTraffic;
+
+    /* Outstanding requests and request/reply latencies by xid */
+    OFTransactionTable ofTransactions;
+
+    /* Transport RTT (TCP timestamps) and bytes in flight of the connection */
+    TCPFlowTracker tcpFlow;
+
+    // Everything else starts zeroed; heap memory is charged to 'budget'
+    explicit LatencyMetadata(MemoryBudget* budget) : memory(budget), version(), connState(), datapathID(),
+            packetSeen(&memory), outstandingPkts(0, OutstandingPktsType::hasher(),
+            OutstandingPktsType::key_equal(), OutstandingPktsType::allocator_type(&memory)),
+            probesSent(), probesMatched(), probesExpired(), probesSkipped(), probeLevel(),
+            lastActive(), changePoints(), links(TrackingAllocator<uint32_t>(&memory)), ofTraffic(),
+            ofTransactions(), tcpFlow() {};
 } LatencyMetadata;
 
 
@@ -0,0 +1,85 @@
+#ifndef LATENCYPOLICY_H
+#define LATENCYPOLICY_H
+
+#include <cstdint>
+
+#include "LatencyEstimators.h"
+
+/* Window sizes, limits and estimators of an EndpointLatencyMetadata, as
+ * used at run time
+ */
+typedef struct LatencyConfig {
+    uint16_t echoRTTWindow;      // Samples in the echo RTT window
+    uint16_t pktInRTTWindow;     // Samples in the PacketIn RTT window
+    uint16_t linkLatWindow;      // Smoothed estimates in each link latency window
+    uint16_t maxOutstandingPkts; // Outstanding probe IDs per port
+    uint8_t echoRTTEstimator;    // EstimatorKind of each metric's smoothed value
+    uint8_t pktInRTTEstimator;
+    uint8_t linkLatEstimator;    // Only if the policy's LinkLatEstimator is a LatencyEstimator
+} LatencyConfig;
+
+/* A policy fixes, at compile time, the window capacities, the probe limit
+ * and the estimator kinds of a BasicEndpointLatencyMetadata:
+ *  - ECHO_RTT_WINDOW, PKT_IN_RTT_WINDOW, LINK_LAT_WINDOW: window sizes, at least 2
+ *  - MAX_OUTSTANDING_PKTS: outstanding probe IDs per port
+ *  - LinkLatEstimator: smooths the raw link latency estimates, default
+ *    constructible with update(sample) and value(), and trivially copyable
+ *    (checkpoints save and restore it as is); see LatencyEstimators.h. A
+ *    LatencyEstimator is of the kind set at run time, others are fixed.
+ * Sizes and limits of 0 are set at run time instead, from a LatencyConfig.
+ */
+struct DefaultLatencyPolicy {
+    static const uint16_t ECHO_RTT_WINDOW = 15;
+    static const uint16_t PKT_IN_RTT_WINDOW = 60;
+    static const uint16_t LINK_LAT_WINDOW = 20;
+    static const uint16_t MAX_OUTSTANDING_PKTS = 20;
+    typedef LatencyEstimator LinkLatEstimator;
+};
+
+// Everything set at run time (e.g. by the Python module)
+struct RuntimeLatencyPolicy {
+    static const uint16_t ECHO_RTT_WINDOW = 0;
+    static const uint16_t PKT_IN_RTT_WINDOW = 0;
+    static const uint16_t LINK_LAT_WINDOW = 0;
+    static const uint16_t MAX_OUTSTANDING_PKTS = 0;
+    typedef LatencyEstimator LinkLatEstimator;
+};
+
+const LatencyConfig DEFAULT_LATENCY_CONFIG = {
+    DefaultLatencyPolicy::ECHO_RTT_WINDOW,
+    DefaultLatencyPolicy::PKT_IN_RTT_WINDOW,
+    DefaultLatencyPolicy::LINK_LAT_WINDOW,
+    DefaultLatencyPolicy::MAX_OUTSTANDING_PKTS,
+    ESTIMATOR_EMA,
+    ESTIMATOR_EMA,
+    ESTIMATOR_EMA
+};
+
+/* Returns 'config' with everything Policy fixes at compile time overridden
+ * by the policy's values
+ */
+template <class Policy>
+LatencyConfig ResolveLatencyConfig(const LatencyConfig& config) {
+    LatencyConfig resolved = config;
+    if (Policy::ECHO_RTT_WINDOW)
+        resolved.echoRTTWindow = Policy::ECHO_RTT_WINDOW;
+    if (Policy::PKT_IN_RTT_WINDOW)
+        resolved.pktInRTTWindow = Policy::PKT_IN_RTT_WINDOW;
+    if (Policy::LINK_LAT_WINDOW)
+        resolved.linkLatWindow = Policy::LINK_LAT_WINDOW;
+    if (Policy::MAX_OUTSTANDING_PKTS)
+        resolved.maxOutstandingPkts = Policy::MAX_OUTSTANDING_PKTS;
+
+    return resolved;
+}
+
+// Windows need at least 2 samples for a (sample) variance
+inline bool ValidLatencyConfig(const LatencyConfig& config) {
+    return config.echoRTTWindow >= 2 && config.pktInRTTWindow >= 2 &&
+            config.linkLatWindow >= 2 && config.maxOutstandingPkts >= 1 &&
+            config.echoRTTEstimator < NUM_ESTIMATOR_KINDS &&
+            config.pktInRTTEstimator < NUM_ESTIMATOR_KINDS &&
+            config.linkLatEstimator < NUM_ESTIMATOR_KINDS;
+}
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef MEMORYACCOUNTING_H
+#define MEMORYACCOUNTING_H
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <ostream>
+#include <string>
+
+#include "OFSniffCommon.h"
+
+using std::string;
+
+/* Memory accounting of the per-switch metadata
+ *
+ * Every switch (LatencyMetadata) has a MemoryAccount, charged with its
+ * share of the fixed-size tables (metric rows, link rows) when it and its
+ * links are added, and with every heap allocation of its containers
+ * (TrackingAllocator). All accounts add up in one MemoryBudget.
+ *
+ * Once a budget is set and exceeded, the switches whose probes were least
+ * recently active have their probe tables compacted (outstanding probes are
+ * given up on and their memory freed) until usage is within the budget; see
+ * BasicEndpointLatencyMetadata::enforceMemoryBudget(). Fixed-size rows are
+ * never freed, as switches and links are never removed.
+ *
+ * Accounts are only charged by the sniff loop (or before it starts); the
+ * getters may be called from any thread.
+ */
+typedef struct MemoryState {
+    uint64_t used;        // Bytes charged to all accounts
+    uint64_t peak;
+    uint64_t budget;      // 0 => unlimited
+    uint64_t compactions; // Switches whose probe tables were compacted
+    uint64_t shedProbes;  // Outstanding probes given up on by compactions
+} MemoryState;
+
+class MemoryBudget {
+    private:
+        std::atomic<uint64_t> _used;
+        std::atomic<uint64_t> _peak;
+        std::atomic<uint64_t> _budget;
+        std::atomic<uint64_t> _compactions;
+        std::atomic<uint64_t> _shedProbes;
+
+    public:
+        MemoryBudget();
+
+        // Bytes all accounts may use together, 0 for no limit
+        void setBudget(const uint64_t bytes) {
+            _budget.store(bytes, std::memory_order_relaxed);
+        }
+
+        uint64_t used() const {
+            return _used.load(std::memory_order_relaxed);
+        }
+
+        // Returns true if a budget is set and usage exceeds it
+        bool over() const {
+            uint64_t budget = _budget.load(std::memory_order_relaxed);
+            return budget && used() > budget;
+        }
+
+        void charge(const uint64_t bytes) {
+            uint64_t used = _used.load(std::memory_order_relaxed) + bytes;
+            _used.store(used, std::memory_order_relaxed);
+            if (used > _peak.load(std::memory_order_relaxed))
+                _peak.store(used, std::memory_order_relaxed);
+        }
+
+        void release(const uint64_t bytes) {
+            _used.store(_used.load(std::memory_order_relaxed) - bytes, std::memory_order_relaxed);
+        }
+
+        // Counts a switch whose probe tables were compacted, giving up on shedProbes
+        void countCompaction(const uint64_t shedProbes) {
+            bump(_compactions);
+            bump(_shedProbes, shedProbes);
+        }
+
+        MemoryState state() const;
+
+        // Human-readable usage and counters
+        void dump(std::ostream& os) const;
+};
+
+// Bytes of one switch, also charged to the budget it belongs to
+class MemoryAccount {
+    private:
+        MemoryBudget* _budget;
+        std::atomic<uint64_t> _bytes;
+
+    public:
+        explicit MemoryAccount(MemoryBudget* budget) : _budget(budget), _bytes(0) {};
+
+        MemoryAccount(const MemoryAccount&) = delete;
+        MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+        uint64_t bytes() const {
+            return _bytes.load(std::memory_order_relaxed);
+        }
+
+        void charge(const uint64_t bytes) {
+            bump(_bytes, bytes);
+            _budget->charge(bytes);
+        }
+
+        void release(const uint64_t bytes) {
+            _bytes.store(_bytes.load(std::memory_order_relaxed) - bytes, std::memory_order_relaxed);
+            _budget->release(bytes);
+        }
+};
+
+/* Allocator charging all allocations of a container to a MemoryAccount
+ * The account must outlive the container.
+ */
+template <typename T>
+class TrackingAllocator {
+    template <typename U> friend class TrackingAllocator;
+
+    private:
+        MemoryAccount* _account;
+
+    public:
+        typedef T value_type;
+
+        explicit TrackingAllocator(MemoryAccount* account) noexcept : _account(account) {};
+
+        template <typename U>
+        TrackingAllocator(const TrackingAllocator<U>& other) noexcept : _account(other._account) {};
+
+        T* allocate(const size_t n) {
+            T* ptr = static_cast<T*>(::operator new(n * sizeof(T)));
+            _account->charge(n * sizeof(T));
+            return ptr;
+        }
+
+        void deallocate(T* ptr, const size_t n) noexcept {
+            _account->release(n * sizeof(T));
+            ::operator delete(ptr);
+        }
+
+        MemoryAccount* account() const {
+            return _account;
+        }
+
+        template <typename U>
+        bool operator==(const TrackingAllocator<U>& other) const {
+            return _account == other._account;
+        }
+
+        template <typename U>
+        bool operator!=(const TrackingAllocator<U>& other) const {
+            return _account != other._account;
+        }
+};
+
+/* Heap Bytes held by a string, 0 if it fits into the string itself
+ * Strings kept in tracked containers allocate with std::allocator, so
+ * their buffers are charged explicitly when stored (e.g. 32-Byte probe IDs).
+ */
+inline size_t StringHeapBytes(const string& str) {
+    const char* data = str.data();
+    const char* self = reinterpret_cast<const char*>(&str);
+    if (data >= self && data < self + sizeof(string))
+        return 0;
+
+    return str.capacity() + 1;
+}
+
+#endif
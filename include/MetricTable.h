@@ -0,0 +1,233 @@
+#ifndef METRICTABLE_H
+#define METRICTABLE_H
+
+#include <algorithm>
+#include <array>
+#include <type_traits>
+#include <vector>
+
+#include "LatencyHistogram.h"
+
+using std::vector;
+
+/* Structure-of-arrays storage of one windowed latency metric
+ *
+ * Each series (an endpoint's echo RTT, a link's latency, ...) is a row,
+ * identified by a dense index handed out by addRow(). Every statistic is
+ * kept in its own contiguous array, indexed by row, so scans over all
+ * series (snapshots, exports) read memory sequentially. Each row's samples
+ * are kept in a ring of 'window' samples.
+ *
+ * MetricTable<N> has rings of N samples fixed at compile time (std::arrays,
+ * with the ring arithmetic constant-folded); MetricTable<0> takes the window
+ * size at run time.
+ *
+ * Rows are never removed.
+ */
+class MetricColumns {
+    protected:
+        vector<uint16_t> _head;  // Oldest sample of each row's ring
+        vector<uint16_t> _len;   // Samples in each row's ring
+
+        // Adds a row to the statistics arrays, returns its index
+        uint32_t addColumns();
+
+        // Reserves the statistics arrays for 'rows' rows
+        void reserveColumns(const uint32_t rows);
+
+        static double mean(const double* samples, const uint16_t n);
+
+        // Sample (not population) variance
+        static double variance(const double* samples, const uint16_t n, const double avg);
+
+        /* Adds newVal to the row's ring of 'window' samples and updates its
+         * avg, var and med; 'sorted' is scratch space for 'window' samples
+         * WindowT is a std::integral_constant for windows fixed at compile time.
+         */
+        template <typename WindowT>
+        void updateRow(const uint32_t row, double* ring, double* sorted,
+                        const WindowT window, const double newVal);
+
+        // Copies the row's samples into 'out', oldest first, returns how many
+        uint16_t copyRow(const uint32_t row, const double* ring, const uint16_t window,
+                            double* out) const;
+
+        /* Refills the row's ring of 'window' samples with 'n' samples, oldest
+         * first, and recomputes its avg, var and med from scratch
+         * 'sorted' is scratch space for n samples.
+         */
+        void refillRow(const uint32_t row, double* ring, double* sorted, const uint16_t window,
+                        const double* in, const uint16_t n);
+
+    public:
+        vector<double> avg;
+        vector<double> var;
+        vector<double> med;
+        vector<LatencyHistogram> hist;
+
+        uint32_t rows() const {
+            return avg.size();
+        }
+
+        // Samples in the row's window
+        uint16_t length(const uint32_t row) const {
+            return _len[row];
+        }
+
+        // Bytes of one row's statistics, without its ring
+        static size_t columnBytes() {
+            return 2 * sizeof(uint16_t) + 3 * sizeof(double) + sizeof(LatencyHistogram);
+        }
+};
+
+template <typename WindowT>
+void MetricColumns::updateRow(const uint32_t row, double* ring, double* sorted,
+                                const WindowT window, const double newVal) {
+    uint16_t& head = _head[row];
+    uint16_t& len = _len[row];
+
+    if (len == window) {
+        double oldestVal = ring[head];
+        double oldAvg = avg[row];
+
+        ring[head] = newVal; // Keep it bounded
+        head = (head + 1) % window;
+        avg[row] += (newVal - oldestVal) / window;
+        var[row] += (newVal - oldestVal) * (newVal - avg[row] + oldestVal - oldAvg) / (window - 1);
+
+        for (uint16_t i = 0; i < len; i++)
+            sorted[i] = ring[(head + i) % window];
+    } else {
+        ring[(head + len) % window] = newVal;
+        len++;
+
+        /* If pre-insertion size is less than the window, then we shouldn't
+         * use simplified rolling update formulas. Do full calculations from
+         * scratch, oldest sample first.
+         */
+        for (uint16_t i = 0; i < len; i++)
+            sorted[i] = ring[(head + i) % window];
+        avg[row] = mean(sorted, len);
+        var[row] = variance(sorted, len, avg[row]);
+    }
+
+    /* TODO: Median calculation still copies + sorts the window each time.
+     *       Fix later using max-heap and min-heap.
+     */
+    std::sort(sorted, sorted + len);
+    if (len % 2 == 0)
+        med[row] = (sorted[len / 2 - 1] + sorted[len / 2]) / 2;
+    else
+        med[row] = sorted[len / 2];
+}
+
+template <uint16_t Window>
+class MetricTable : public MetricColumns {
+    private:
+        vector<std::array<double, Window>> _rings;
+        std::array<double, Window> _sorted; // Scratch space for medians
+
+    public:
+        // The window is fixed at compile time, the argument is ignored
+        explicit MetricTable(const uint16_t = Window) {};
+
+        uint16_t window() const {
+            return Window;
+        }
+
+        // Bytes of one row, ring included
+        size_t rowBytes() const {
+            return columnBytes() + Window * sizeof(double);
+        }
+
+        // Only succeeds for the compile-time window, while the table has no rows
+        bool setWindow(const uint16_t window) {
+            return window == Window && !rows();
+        }
+
+        // Only succeeds for the compile-time window, see MetricTable<0>
+        bool resizeWindow(const uint16_t window) {
+            return window == Window;
+        }
+
+        // Returns the index of a new, empty row
+        uint32_t addRow() {
+            _rings.emplace_back();
+            return addColumns();
+        }
+
+        // Reserves room for 'rows' rows, so adding them won't reallocate
+        void reserve(const uint32_t rows) {
+            _rings.reserve(rows);
+            reserveColumns(rows);
+        }
+
+        /* Adds newVal to the row's window and updates its avg, var and med
+         * Once the window is full, the oldest sample is replaced and avg and
+         * var are updated incrementally.
+         */
+        void update(const uint32_t row, const double newVal) {
+            updateRow(row, _rings[row].data(), _sorted.data(),
+                        std::integral_constant<uint16_t, Window>(), newVal);
+        }
+
+        /* Copies the row's samples into 'out' (room for window() samples),
+         * oldest first, returns how many
+         */
+        uint16_t samples(const uint32_t row, double* out) const {
+            return copyRow(row, _rings[row].data(), Window, out);
+        }
+};
+
+// Window set at run time; the rings of all rows share one array
+template <>
+class MetricTable<0> : public MetricColumns {
+    private:
+        uint16_t _window;
+        vector<double> _samples; // _window samples per row
+        vector<double> _sorted;  // Scratch space for medians
+
+    public:
+        explicit MetricTable(const uint16_t window);
+
+        uint16_t window() const {
+            return _window;
+        }
+
+        // Bytes of one row, ring included
+        size_t rowBytes() const {
+            return columnBytes() + _window * sizeof(double);
+        }
+
+        // Only possible while the table has no rows, returns false otherwise
+        bool setWindow(const uint16_t window);
+
+        /* Changes the window of all rows in place: each keeps its newest
+         * samples (as many as fit), and its avg, var and med are recomputed
+         * from them; histograms are kept. Returns false if window < 2.
+         */
+        bool resizeWindow(const uint16_t window);
+
+        // Returns the index of a new, empty row
+        uint32_t addRow();
+
+        // Reserves room for 'rows' rows, so adding them won't reallocate
+        void reserve(const uint32_t rows);
+
+        /* Adds newVal to the row's window and updates its avg, var and med
+         * Once the window is full, the oldest sample is replaced and avg and
+         * var are updated incrementally.
+         */
+        void update(const uint32_t row, const double newVal) {
+            updateRow(row, &_samples[(size_t)row * _window], _sorted.data(), _window, newVal);
+        }
+
+        /* Copies the row's samples into 'out' (room for window() samples),
+         * oldest first, returns how many
+         */
+        uint16_t samples(const uint32_t row, double* out) const {
+            return copyRow(row, &_samples[(size_t)row * _window], _window, out);
+        }
+};
+
+#endif
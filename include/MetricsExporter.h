@@ -0,0 +1,74 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <atomic>
+#include <thread>
+#include <string>
+#include <unordered_map>
+
+#include "OFSniffCommon.h"
+#include "StatsSnapshot.h"
+
+using std::string;
+using std::unordered_map;
+
+/* Serves the latest StatsSnapshot in the Prometheus text exposition format
+ * (GET /metrics) from its own thread.
+ *
+ * The exporter is the single reader of the snapshot exchange, so scrapes
+ * never block the sniff loop. Rendered text is cached per (metric family,
+ * endpoint) and only re-rendered when the endpoint's version changes.
+ */
+class MetricsExporter {
+    private:
+        typedef struct RenderCacheEntry {
+            uint64_t version;
+            uint64_t seenSeqNum; // Last snapshot this endpoint appeared in
+            string text;
+        } RenderCacheEntry;
+
+        typedef void (*RenderFunc)(const StatsSnapshot& snap,
+                                    const EndpointSnapshot& epSnap, string& out);
+
+        typedef struct MetricFamily {
+            const char* name;
+            const char* type;
+            const char* help;
+            RenderFunc render;
+        } MetricFamily;
+
+        static const MetricFamily FAMILIES[];
+        static const uint16_t NUM_FAMILIES;
+
+        SnapshotExchange<StatsSnapshot>& _snapshots;
+
+        int _listenFd = -1;
+        std::atomic<bool> _running;
+        std::thread _thread;
+
+        // Only touched by the exporter thread
+        vector<unordered_map<IPv4EndpointType, RenderCacheEntry>> _cache;
+        uint64_t _renderedSeqNum = 0;
+        string _body;
+
+        void serveLoop();
+
+        void handleConnection(const int connFd);
+
+        // Re-renders _body if a newer snapshot was published
+        void render();
+
+    public:
+        MetricsExporter(SnapshotExchange<StatsSnapshot>& snapshots);
+
+        ~MetricsExporter();
+
+        /* Binds to bindAddr:port and starts serving in a new thread
+         * Returns false if the socket could not be set up
+         */
+        bool start(const uint16_t port, const string& bindAddr = "127.0.0.1");
+
+        void stop();
+};
+
+#endif
@@ -7,31 +7,47 @@
 #include "OpenFlowPDUs.h"
 #include "OFSniffCommon.h"
 #include "EndpointLatencyMetadata.h"
+#include "CaptureSources.h"
 
 using Tins::Sniffer;
 using Tins::EthernetII;
 using Tins::Timestamp;
+using Tins::TCP;
+using Tins::RawPDU;
 
 /* bool bPacketIn
  *  true if intercepting an OpenFlow PacketIn (switch => ctrl)
  *  false if intercepting an OpenFlow PacketOut (ctrl => switch)
  */
+template <class Policy>
 void ProcessLLDP(Timestamp ts, IPv4EndpointType dpEndpoint, EthernetII& ethFrame,
-                        EndpointLatencyMetadata& epLatMeta, bool bPacketIn);
-
-/* Processes OpenFlow Echo Request and Replies
- * Measures RTT to-and-from switch when echos are initiated by the controller
- */
-void ProcessEcho(Timestamp ts, IPv4EndpointType dpEndpoint, OFMsgPDU& ofMsg,
-                        EndpointLatencyMetadata& epLatMeta, bool toSwitch);
+                        BasicEndpointLatencyMetadata<Policy>& epLatMeta, bool bPacketIn);
 
+template <class Policy>
 void ParseOFPacket(Timestamp ts, IPv4EndpointType dpEndpoint, OFMsgPDU& ofMsg,
-                    EndpointLatencyMetadata& epLatMeta, bool toSwitch);
+                    BasicEndpointLatencyMetadata<Policy>& epLatMeta, bool toSwitch);
+
+/* Copies the fields needed for transport RTT and bytes-in-flight tracking
+ * wireLen is the TCP segment's length on the wire according to the IP header,
+ * 0 if unknown (e.g. IP length left 0 by segmentation offload).
+ */
+void FillTCPSegment(const TCP& tcp, const RawPDU* raw, const uint32_t wireLen, TCPSegment& seg);
 
 /* OFSniffLoop is currently explicitly designed to not catch exceptions, as
  * different users may wish to handle different exceptions in their own way.
+ *
+ * The functions above taking a BasicEndpointLatencyMetadata are instantiated
+ * in OFSniff.cpp for EndpointLatencyMetadata and RuntimeEndpointLatencyMetadata.
  */
+template <class Policy>
 void OFSniffLoop(Sniffer*& sniffer, uint16_t ofp_port,
-                    EndpointLatencyMetadata& epLatMeta);
+                    BasicEndpointLatencyMetadata<Policy>& epLatMeta);
+
+/* As OFSniffLoop, over all capture sources, until sources.stop() is called
+ * Sources with packets waiting take turns of up to the delivery's batch size,
+ * so a busy interface can't starve the others.
+ */
+template <class Policy>
+void OFSniffMultiLoop(CaptureSources& sources, BasicEndpointLatencyMetadata<Policy>& epLatMeta);
 
 #endif
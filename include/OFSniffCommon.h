@@ -2,15 +2,20 @@
 #define OFSNIFFCOMMON_H
 
 #include <iostream>
+#include <atomic>
+#include <cstdio> // For snprintf()
 #include <sys/time.h> // For struct timeval
 
 // Packet processing libs
+#include <arpa/inet.h>
 #include <ifaddrs.h>
 #include <netinet/in.h>
 
 // Libtins
 #include <tins/tins.h>
 
+#include "IPv6Addresses.h"
+
 using std::string;
 
 using Tins::IPv4Address;
@@ -19,6 +24,9 @@ using Tins::Timestamp;
 #define MILLION 1000000
 #define THOUSAND 1000
 #define ETHTYPE_LLDP 0x88cc
+#define OF_HEADER_LEN 8
+#define OF_MAX_VERSION 6 // OpenFlow 1.5
+#define OF_FEATURES_DPID_OFFSET 8 // datapath_id in FeaturesReply (identical in OF 1.0 - 1.5)
 
 // START SAVI LLDP system-dependent macros
 #define CHASSIS_ID_DPID_OFFSET 6 // Offsets prefix of string ("dpid:")
@@ -29,14 +37,93 @@ using Tins::Timestamp;
 const unsigned char LLDP_MAC_NEAREST_BRIDGE[] = {0x01, 0x80, 0xc2, 0x00, 0x00, 0x0e};
 
 // Inspired by Tin's TCP_IP Stream Identifier (16 Bytes to accomodate portNum)
+// IPv6 endpoints have ENDPOINT_IPV6_FLAG set and an interned address ID
+// (see IPv6Addresses.h) in place of the IPv4 address
 typedef uint64_t IPv4EndpointType;
 
+#define ENDPOINT_IPV6_FLAG (1ULL << 63)
+
 // IPv4Address class overloads uint32_t operator
 // So we must use that first, then cast to uint64_t
 inline IPv4EndpointType GenIPv4Endpoint(const IPv4Address ipAddr, const uint16_t portNum) {
     return ((uint64_t)((uint32_t)ipAddr) << 16) | portNum;
 }
 
+/* Interns the IPv6 address (16 Bytes, network byte order)
+ * Returns 0 if the address table is full.
+ */
+inline IPv4EndpointType GenIPv6Endpoint(const uint8_t* ipAddr, const uint16_t portNum) {
+    uint32_t id = IPv6AddressTable::global().intern(ipAddr);
+    if (id == IPV6_NO_ID)
+        return 0;
+
+    return ENDPOINT_IPV6_FLAG | ((uint64_t)id << 16) | portNum;
+}
+
+inline bool IsIPv6Endpoint(const IPv4EndpointType endpoint) {
+    return endpoint & ENDPOINT_IPV6_FLAG;
+}
+
+// Returns the endpoint's address, "a.b.c.d" or an IPv6 address ("" if unknown)
+inline string EndpointAddress(const IPv4EndpointType endpoint) {
+    if (!IsIPv6Endpoint(endpoint))
+        return IPv4Address((uint32_t)(endpoint >> 16)).to_string();
+
+    uint8_t addr[IPV6_ADDR_LEN];
+    char str[INET6_ADDRSTRLEN];
+    if (!IPv6AddressTable::global().address((uint32_t)(endpoint >> 16), addr) ||
+            inet_ntop(AF_INET6, addr, str, sizeof(str)) == nullptr)
+        return "";
+
+    return str;
+}
+
+// Reverses GenIPv4Endpoint() and GenIPv6Endpoint(), returns "a.b.c.d:port" or "[v6 addr]:port"
+inline string EndpointToString(const IPv4EndpointType endpoint) {
+    if (IsIPv6Endpoint(endpoint))
+        return "[" + EndpointAddress(endpoint) + "]:" + std::to_string(endpoint & 0xffff);
+
+    return EndpointAddress(endpoint) + ":" + std::to_string(endpoint & 0xffff);
+}
+
+// Datapath ID as 16 hex digits, as controllers print it
+inline string DatapathIDToString(const uint64_t datapathID) {
+    char str[17];
+    snprintf(str, sizeof(str), "%016llx", (unsigned long long)datapathID);
+    return str;
+}
+
+/* Counters describing the sniffer itself (rather than the switches)
+ * Only the sniff loop thread writes to these, other threads may read them.
+ * The writer uses bump() (relaxed load + store) to avoid locked instructions.
+ */
+typedef struct SniffCounters {
+    std::atomic<uint64_t> packets;        // Packets handed to the sniff loop
+    std::atomic<uint64_t> ofMessages;     // Packets carrying OpenFlow payload
+    std::atomic<uint64_t> parseErrors;    // Malformed OpenFlow or LLDP content
+
+    std::atomic<uint64_t> captureRecv;    // Received by the capture filter (pcap_stats)
+    std::atomic<uint64_t> captureDrops;   // Dropped, capture buffer full (pcap_stats)
+    std::atomic<uint64_t> captureIfDrops; // Dropped by the interface (pcap_stats)
+
+    std::atomic<uint64_t> probesSent;     // LLDP probes whose reply is awaited
+    std::atomic<uint64_t> probesMatched;  // ... whose reply was seen
+    std::atomic<uint64_t> probesExpired;  // ... given up on (reply never seen)
+
+    SniffCounters() : packets(0), ofMessages(0), parseErrors(0),
+                        captureRecv(0), captureDrops(0), captureIfDrops(0),
+                        probesSent(0), probesMatched(0), probesExpired(0) {};
+} SniffCounters;
+
+inline void bump(std::atomic<uint64_t>& counter, const uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                    std::memory_order_relaxed);
+}
+
+inline uint64_t TimestampToUs(const Timestamp& ts) {
+    return (uint64_t)ts.seconds() * MILLION + ts.microseconds();
+}
+
 // Calculates difference between request and reply Timestamp values
 // Returns in ms granularity
 inline double CalcTimestampDiff(const Timestamp& request, const Timestamp& reply) {
@@ -0,0 +1,97 @@
+#ifndef OFTRAFFIC_H
+#define OFTRAFFIC_H
+
+#include <tins/tins.h>
+
+#include "OFSniffCommon.h"
+
+using Tins::Timestamp;
+
+/* Per-endpoint OpenFlow traffic accounting by message type
+ *
+ * Counters are plain fixed-size arrays indexed by [direction][OF type], so
+ * counting a message touches a single 16-Byte entry and snapshots are
+ * memcpy-able. Types >= OF_TRAFFIC_TYPES are counted under the last index.
+ */
+#define OF_TRAFFIC_TYPES 32 // Covers all types up to OpenFlow 1.5
+#define OF_TRAFFIC_INTERVAL_MS 1000 // Rate sliding window granularity (packet time)
+#define OF_TRAFFIC_WINDOW 10 // Intervals in the rate sliding window
+
+enum OFDirection {
+    OF_FROM_SWITCH, // Switch => controller
+    OF_TO_SWITCH,   // Controller => switch
+    NUM_OF_DIRECTIONS
+};
+
+typedef struct OFTypeCounter {
+    uint64_t msgs;
+    uint64_t bytes;
+} OFTypeCounter;
+
+typedef struct OFTypeCounters {
+    OFTypeCounter type[NUM_OF_DIRECTIONS][OF_TRAFFIC_TYPES];
+} OFTypeCounters;
+
+typedef struct OFTrafficMetadata {
+    OFTypeCounters total;
+
+    /* TCP payload bytes that could not be attributed to a message type
+     * (e.g. segments not starting on a message boundary after packet loss)
+     */
+    uint64_t unparsedBytes[NUM_OF_DIRECTIONS];
+
+    /* Message framing of each direction's byte stream
+     * If inSync, the next message header starts at TCP sequence number
+     * nextHeaderSeq (messages before it were counted when their header was
+     * seen). A header cut off by the end of a segment has its first
+     * partialLen Bytes kept in partialHeader.
+     */
+    bool inSync[NUM_OF_DIRECTIONS];
+    uint32_t nextHeaderSeq[NUM_OF_DIRECTIONS];
+    uint8_t partialLen[NUM_OF_DIRECTIONS];
+    uint8_t partialHeader[NUM_OF_DIRECTIONS][OF_HEADER_LEN - 1];
+
+    /* Sliding window: cumulative counters at the end of the last
+     * OF_TRAFFIC_WINDOW intervals (ring buffer, oldest at windowHead)
+     */
+    OFTypeCounters window[OF_TRAFFIC_WINDOW];
+    Timestamp windowTs[OF_TRAFFIC_WINDOW];
+    uint16_t windowHead;
+    uint16_t windowLen;
+} OFTrafficMetadata;
+
+typedef struct OFTypeRate {
+    double msgsPerSec;
+    double bytesPerSec;
+} OFTypeRate;
+
+// Bulk copy of one endpoint's counters and rates
+typedef struct OFTrafficStats {
+    uint64_t endpoint;
+    OFTypeCounters total;
+    uint64_t unparsedBytes[NUM_OF_DIRECTIONS];
+
+    /* Average rates over the sliding window (windowSec long)
+     * All 0 until at least two intervals have closed.
+     */
+    double windowSec;
+    OFTypeRate rate[NUM_OF_DIRECTIONS][OF_TRAFFIC_TYPES];
+} OFTrafficStats;
+
+// OpenFlow 1.0 name of a message type (e.g. "packet_in"), "unknown" beyond
+inline const char* OFTypeName(const uint8_t type) {
+    static const char* names[] = {
+        "hello", "error", "echo_request", "echo_reply", "vendor",
+        "features_request", "features_reply", "get_config_request",
+        "get_config_reply", "set_config", "packet_in", "flow_removed",
+        "port_status", "packet_out", "flow_mod", "port_mod", "stats_request",
+        "stats_reply", "barrier_request", "barrier_reply",
+        "queue_get_config_request", "queue_get_config_reply"
+    };
+
+    if (type < sizeof(names) / sizeof(names[0]))
+        return names[type];
+    return "unknown";
+}
+
+#endif
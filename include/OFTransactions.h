@@ -0,0 +1,103 @@
+#ifndef OFTRANSACTIONS_H
+#define OFTRANSACTIONS_H
+
+#include <cstdint>
+
+#include "LatencyHistogram.h"
+
+/* Per-connection OpenFlow request/reply tracking by xid
+ *
+ * Requests are kept in a fixed-size open-addressing table (linear probing,
+ * backward-shift deletion) until their reply is seen or they expire. The
+ * time between request and (final) reply is recorded per transaction kind.
+ *
+ * FlowMods are timed through barriers: a barrier request covers all
+ * FlowMods sent since the previous barrier request, and its reply gives the
+ * flow installation latency of the earliest of them.
+ */
+#define OF_TXN_TABLE_SIZE 64 // Outstanding requests per connection, must be a power of 2
+#define OF_TXN_TIMEOUT_MS 5000 // Requests without reply are expired after this long
+
+enum OFTransactionKind {
+    OF_TXN_ECHO,             // Echo request from the controller
+    OF_TXN_ECHO_FROM_SWITCH, // Echo request from the switch
+    OF_TXN_FEATURES,
+    OF_TXN_GET_CONFIG,
+    OF_TXN_STATS,            // Stats (OpenFlow 1.0) / multipart, until the last reply part
+    OF_TXN_BARRIER,
+    OF_TXN_QUEUE_CONFIG,
+    OF_TXN_ROLE,             // OpenFlow 1.2+
+    OF_TXN_FLOW_INSTALL,     // First FlowMod before a barrier => barrier reply
+    NUM_OF_TXN_KINDS
+};
+
+typedef struct OFTransactionStats {
+    uint64_t count;   // Completed transactions
+    uint64_t expired; // Requests whose reply was never seen
+    double last;      // Latencies in ms
+    double min;
+    double max;
+    LatencyHistogram hist; // hist.sum / count is the mean
+
+    void add(const double latency) {
+        if (count == 0 || latency < min)
+            min = latency;
+        if (latency > max)
+            max = latency;
+        last = latency;
+        count++;
+        hist.add(latency);
+    }
+} OFTransactionStats;
+
+typedef struct OFTransaction {
+    uint64_t reqUs;     // Request time (packet time, us)
+    uint64_t flowModUs; // Barriers only: earliest FlowMod covered, 0 if none
+    uint32_t xid;
+    uint8_t kind;
+    bool used;
+} OFTransaction;
+
+class OFTransactionTable {
+    private:
+        OFTransaction _slots[OF_TXN_TABLE_SIZE];
+        uint16_t _used;
+        uint64_t _flowModUs; // Earliest FlowMod not yet covered by a barrier request
+
+        static uint16_t slotOf(const uint32_t xid) {
+            return (uint16_t)((xid * 2654435769U) >> 16) & (OF_TXN_TABLE_SIZE - 1);
+        }
+
+        // Returns the slot of the request, or -1
+        int32_t find(const uint32_t xid, const uint8_t kind) const;
+
+        void insert(const uint32_t xid, const uint8_t kind, const uint64_t reqUs,
+                    const uint64_t flowModUs);
+
+        void erase(uint16_t slot);
+
+    public:
+        OFTransactionStats stats[NUM_OF_TXN_KINDS];
+        uint64_t overflows; // Requests not tracked because the table was full
+
+        OFTransactionTable();
+
+        /* Processes one OpenFlow message header ('avail' Bytes of the
+         * message are readable, at least OF_HEADER_LEN)
+         * Returns true if it completed a transaction, whose kind and
+         * latency (ms) are returned through the parameters.
+         */
+        bool process(const uint8_t* header, const uint32_t avail, const bool toSwitch,
+                        const uint64_t tsUs, OFTransactionKind& kind, double& latency);
+
+        // Expires requests older than OF_TXN_TIMEOUT_MS
+        void expire(const uint64_t nowUs);
+
+        uint16_t outstanding() const {
+            return _used;
+        }
+
+        static const char* kindName(const OFTransactionKind kind);
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef OFTYPEFILTER_H
+#define OFTYPEFILTER_H
+
+#include <vector>
+
+#include <pcap.h>
+
+using std::vector;
+
+/* Kernel-side (classic BPF) filtering of the OpenFlow connection by message type
+ *
+ * Instead of "tcp port N", the generated program looks at the OpenFlow
+ * header at the start of the TCP payload and drops segments whose message
+ * type isn't in the given mask, before they are copied to user space.
+ *
+ * A segment is only dropped when it is certain to hold exactly one OpenFlow
+ * message of an unwanted type: the version byte is valid and the OpenFlow
+ * length equals the TCP payload length. Segments that don't start on a
+ * message boundary, hold several messages or only part of one are passed,
+ * as are SYN/FIN/RST segments. Payload-less segments (pure ACKs) are passed
+ * if requested; they carry the TCP timestamp echoes and acknowledgements
+ * needed for transport RTT and bytes in flight (see TCPFlow.h).
+ *
+ * Only untagged Ethernet captures (DLT_EN10MB) are supported. Type
+ * filtering applies to IPv4; IPv6 segments on the ports are passed whole,
+ * as long as TCP directly follows the fixed IPv6 header.
+ */
+
+// Bit i set => pass OpenFlow message type i
+#define OF_TYPE_BIT(type) (1U << (type))
+
+/* Message types needed for latency measurements (identical in OF 1.0 - 1.5):
+ * HELLO, ERROR, ECHO_REQUEST/REPLY, FEATURES_REQUEST/REPLY, PACKET_IN, PACKET_OUT
+ */
+#define OF_TYPES_LATENCY (OF_TYPE_BIT(0) | OF_TYPE_BIT(1) | OF_TYPE_BIT(2) | \
+                          OF_TYPE_BIT(3) | OF_TYPE_BIT(5) | OF_TYPE_BIT(6) | \
+                          OF_TYPE_BIT(10) | OF_TYPE_BIT(13))
+
+/* Generates the BPF program for connections on any of the given ports
+ * Returns false if it could not be generated.
+ */
+bool BuildOFTypeFilter(const vector<uint16_t>& ofp_ports, const uint32_t ofTypeMask,
+                        const bool passPureAcks, vector<struct bpf_insn>& prog);
+
+/* Installs the generated program on the handle (replacing its current filter)
+ * Returns false, leaving the current filter in place, if the handle's link
+ * type isn't supported or the program could not be installed.
+ */
+bool InstallOFTypeFilter(pcap_t* handle, const vector<uint16_t>& ofp_ports,
+                            const uint32_t ofTypeMask = OF_TYPES_LATENCY,
+                            const bool passPureAcks = true);
+
+// Single OpenFlow port
+bool InstallOFTypeFilter(pcap_t* handle, const uint16_t ofp_port,
+                            const uint32_t ofTypeMask = OF_TYPES_LATENCY,
+                            const bool passPureAcks = true);
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef OBSERVERS_H
+#define OBSERVERS_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "OFSniffCommon.h"
+#include "ChangeDetector.h"
+
+using std::unordered_map;
+using std::vector;
+
+/* Push-based notification of statistics updates
+ *
+ * The sniff loop publishes events (new samples, threshold crossings,
+ * latency changes, endpoints connecting/disconnecting) into a bounded single-producer ring;
+ * it never blocks on, or calls into, consumers. Events are consumed either:
+ *  - by C++ callbacks registered with subscribe(), which are invoked from a
+ *    separate dispatcher thread, or
+ *  - by polling consumers (e.g. the Python module): enablePolling() returns
+ *    an eventfd that is readable while events are queued, and drain()
+ *    takes them out in batches.
+ * The two are mutually exclusive. Events are dropped (and counted) when the
+ * ring is full, or not generated at all while nobody consumes them.
+ *
+ * The publishing functions must only be called from one thread (the sniff loop).
+ */
+enum ObserverEventType {
+    OBS_EVENT_SAMPLE,        // New latency sample
+    OBS_EVENT_THRESHOLD,     // Sample crossed its metric's threshold (either way)
+    OBS_EVENT_ENDPOINT_UP,   // First segment of a switch connection seen
+    OBS_EVENT_ENDPOINT_DOWN, // Switch connection closed (FIN/RST)
+    OBS_EVENT_CHANGE,        // Metric changed its level (see ChangeDetector.h)
+    NUM_OBS_EVENT_TYPES
+};
+
+#define OBS_EVENT_BIT(type) (1U << (type))
+#define OBS_EVENTS_ALL (OBS_EVENT_BIT(NUM_OBS_EVENT_TYPES) - 1)
+
+enum ObserverMetric {
+    OBS_METRIC_NONE,                 // Endpoint events
+    OBS_METRIC_ECHO_RTT,
+    OBS_METRIC_PKT_IN_RTT,
+    OBS_METRIC_LINK_LAT,             // Only metric where port_no is meaningful
+    OBS_METRIC_TCP_RTT_TO_SWITCH,
+    OBS_METRIC_TCP_RTT_FROM_SWITCH,
+    NUM_OBS_METRICS
+};
+
+#define OBS_QUEUE_SIZE 1024 // Queued events, must be a power of 2
+#define OBS_DISPATCH_BATCH 64 // Events taken out of the ring at once by the dispatcher
+#define OBS_DISPATCH_POLL_MS 100 // How often the dispatcher checks whether it should stop
+
+typedef struct ObserverEvent {
+    uint64_t tsUs;             // Wall-clock time the event was published (us)
+    IPv4EndpointType endpoint;
+    double value;              // Sample (ms), SAMPLE and THRESHOLD; CHANGE: new level (ms)
+    double threshold;          // THRESHOLD; CHANGE: previous level (baseline, ms)
+    uint16_t port_no;          // OBS_METRIC_LINK_LAT only
+    uint8_t type;              // ObserverEventType
+    uint8_t metric;            // ObserverMetric
+    bool above;                // THRESHOLD: true if the sample is above the threshold
+                               // CHANGE: true if the level went up
+} ObserverEvent;
+
+typedef std::function<void(const ObserverEvent&)> ObserverCallback;
+
+class Observers {
+    private:
+        typedef struct Subscriber {
+            uint32_t id;
+            uint32_t typeMask; // OBS_EVENT_BIT()s of the wanted event types
+            ObserverCallback callback;
+        } Subscriber;
+
+        // Single producer (sniff loop) / single consumer (dispatcher or drain()) ring
+        ObserverEvent _queue[OBS_QUEUE_SIZE];
+        std::atomic<uint32_t> _head; // Next slot to write
+        std::atomic<uint32_t> _tail; // Next slot to read
+
+        /* Set by the producer when it signals the eventfd, cleared by the
+         * consumer before it drains, so the eventfd is written to at most
+         * once per drain rather than once per event
+         */
+        std::atomic<bool> _signaled;
+        int _eventFd;
+
+        std::atomic<uint32_t> _typeMask; // Union of all consumers' masks, 0 => disabled
+        std::atomic<double> _thresholds[NUM_OBS_METRICS]; // <= 0 => no threshold
+        std::atomic<double> _changeCusum[NUM_OBS_METRICS]; // Change detector sensitivity, 0 => off
+        std::atomic<double> _changeEwma[NUM_OBS_METRICS];
+
+        std::atomic<uint64_t> _published;
+        std::atomic<uint64_t> _dropped;
+
+        /* Threshold state per endpoint, keyed by (metric << 16) | port_no
+         * Only touched by the producer.
+         */
+        unordered_map<IPv4EndpointType, unordered_map<uint32_t, bool>> _above;
+
+        std::mutex _consumerMutex; // Serializes drain() callers
+        std::mutex _subscribersMutex;
+        vector<Subscriber> _subscribers;
+        uint32_t _nextId;
+        uint32_t _pollingMask;
+
+        std::thread _dispatcher;
+        std::atomic<bool> _dispatcherRunning;
+
+        void push(const ObserverEvent& event);
+
+        void sampleSlow(const IPv4EndpointType endpoint, const ObserverMetric metric,
+                        const uint16_t port_no, const double value);
+
+        // Recomputes _typeMask, _subscribersMutex must be held
+        void updateTypeMask();
+
+        void dispatchLoop();
+
+        void stopDispatcher();
+
+        static uint64_t nowUs();
+
+    public:
+        Observers();
+
+        ~Observers();
+
+        // Publishing (sniff loop only)
+
+        /* Publishes a new sample of 'metric', and a THRESHOLD event if it is
+         * on the other side of the metric's threshold than the previous one
+         */
+        void sample(const IPv4EndpointType endpoint, const ObserverMetric metric,
+                    const uint16_t port_no, const double value) {
+            if (_typeMask.load(std::memory_order_relaxed) & (OBS_EVENT_BIT(OBS_EVENT_SAMPLE) |
+                                                            OBS_EVENT_BIT(OBS_EVENT_THRESHOLD)))
+                sampleSlow(endpoint, metric, port_no, value);
+        }
+
+        /* Publishes a change of the metric's level, detected by the caller's
+         * ChangeDetector (see changeSensitivity())
+         */
+        void changePoint(const IPv4EndpointType endpoint, const ObserverMetric metric,
+                            const uint16_t port_no, const double level, const double baseline,
+                            const bool up);
+
+        void endpointUp(const IPv4EndpointType endpoint);
+
+        void endpointDown(const IPv4EndpointType endpoint);
+
+        // Configuration (any thread)
+
+        /* THRESHOLD events are published when samples of 'metric' cross
+         * 'threshold' (ms); a threshold <= 0 disables them
+         */
+        void setThreshold(const ObserverMetric metric, const double threshold);
+
+        double getThreshold(const ObserverMetric metric) const;
+
+        /* Sets the sensitivity of the change detectors of 'metric', see
+         * ChangeDetector.h; both 0 disables change detection of the metric
+         * Returns false if changes of the metric aren't detected.
+         */
+        bool setChangeSensitivity(const ObserverMetric metric, const ChangeSensitivity& sens);
+
+        // Changes are detected on echo RTT, PacketIn RTT and link latency
+        static bool detectsChanges(const ObserverMetric metric) {
+            return metric == OBS_METRIC_ECHO_RTT || metric == OBS_METRIC_PKT_IN_RTT ||
+                    metric == OBS_METRIC_LINK_LAT;
+        }
+
+        ChangeSensitivity changeSensitivity(const ObserverMetric metric) const {
+            return {_changeCusum[metric].load(std::memory_order_relaxed),
+                    _changeEwma[metric].load(std::memory_order_relaxed)};
+        }
+
+        /* Registers a callback for the event types in typeMask (OBS_EVENT_BIT()s),
+         * starting the dispatcher thread if needed
+         * Callbacks run on the dispatcher thread and should return quickly;
+         * they must not call subscribe() or unsubscribe().
+         * Returns the subscription ID, or 0 if polling is enabled.
+         */
+        uint32_t subscribe(const uint32_t typeMask, const ObserverCallback& callback);
+
+        // Returns false if there is no such subscription
+        bool unsubscribe(const uint32_t id);
+
+        /* Enables queueing events of the types in typeMask for drain()
+         * Returns an eventfd that is readable while events are queued, or
+         * -1 if there are callback subscribers.
+         */
+        int enablePolling(const uint32_t typeMask);
+
+        void disablePolling();
+
+        /* Takes up to maxEvents queued events out, oldest first, and resets
+         * the eventfd (it is signaled again if events remain)
+         * Returns the number of events copied into 'events'.
+         */
+        uint32_t drain(ObserverEvent* events, const uint32_t maxEvents);
+
+        uint64_t getPublished() const;
+
+        // Events lost because the queue was full
+        uint64_t getDropped() const;
+
+        static const char* typeName(const ObserverEventType type);
+
+        static const char* metricName(const ObserverMetric metric);
+
+        // Parses a metricName(), returns false if unknown
+        static bool parseMetric(const string& name, ObserverMetric& metric);
+};
+
+#endif
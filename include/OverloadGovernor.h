@@ -0,0 +1,133 @@
+#ifndef OVERLOADGOVERNOR_H
+#define OVERLOADGOVERNOR_H
+
+#include <atomic>
+#include <ostream>
+#include <string>
+
+#include "OFSniffCommon.h"
+#include "OFTypeFilter.h"
+#include "CaptureStats.h"
+
+using std::string;
+
+#define OVERLOAD_MAX_LEVEL 5 // Highest level: 1 in 2^(5 - 1) = 16 probes kept
+#define OVERLOAD_FULL_BATCHES_HIGH 0.5 // Share of full batches that means a backlog
+#define OVERLOAD_FULL_BATCHES_LOW 0.05 // ... and below which the backlog is gone
+#define OVERLOAD_CALM_INTERVALS 5 // Intervals without pressure before the level is lowered
+
+/* Load shedding when the sniff loop can't keep up
+ *
+ * Without it, the kernel drops packets at random once the capture buffer is
+ * full, which breaks ping/pong matching of every switch at once. Instead,
+ * work is shed deterministically, in levels:
+ *  0: everything is processed
+ *  1: OpenFlow messages of types not needed for latency measurements (see
+ *     OF_TYPES_LATENCY) are only counted, not parsed or timed
+ *  2+: in addition, only a subset of LLDP probes is processed, 1 in
+ *     2^(level - 1). Probes are selected by a hash of the probe ID, so the
+ *     ping and the pong of a probe are kept or skipped together, and each
+ *     level's subset contains the next level's.
+ *
+ * The sniff loop calls update() at the end of every capture stats interval.
+ * The level goes up by one per interval with kernel drops or a backlog
+ * (most batches taken from the capture buffer were full), and down by one
+ * after OVERLOAD_CALM_INTERVALS intervals without either.
+ *
+ * Only the sniff loop calls update() and addBatch(); the getters and
+ * setMaxLevel() may be called from any thread.
+ */
+typedef struct OverloadState {
+    uint8_t level;
+    uint8_t maxLevel;    // 0 => governor disabled
+    double sampleRate;   // Share of probes processed
+    uint64_t raised;     // Level changes up...
+    uint64_t lowered;    // ... and down
+    uint64_t shedMessages;  // OpenFlow messages only counted (level 1+)
+    uint64_t skippedProbes; // LLDP probe messages not processed (level 2+)
+} OverloadState;
+
+class OverloadGovernor {
+    private:
+        std::atomic<uint8_t> _level;
+        std::atomic<uint8_t> _maxLevel;
+
+        // Sniff loop only
+        uint64_t _batches = 0;
+        uint64_t _fullBatches = 0;
+        uint32_t _calmIntervals = 0;
+
+        std::atomic<uint64_t> _raised;
+        std::atomic<uint64_t> _lowered;
+        std::atomic<uint64_t> _shedMessages;
+        std::atomic<uint64_t> _skippedProbes;
+
+        static uint32_t hashProbeID(const string& packetID);
+
+    public:
+        OverloadGovernor();
+
+        /* Highest level the governor may go to, 0 disables it
+         * Lowering it below the current level takes effect immediately.
+         */
+        void setMaxLevel(const uint8_t maxLevel);
+
+        uint8_t level() const {
+            return _level.load(std::memory_order_relaxed);
+        }
+
+        // Records how full a batch taken from a capture source was
+        void addBatch(const uint32_t size, const uint32_t capacity) {
+            _batches++;
+            if (size >= capacity)
+                _fullBatches++;
+        }
+
+        /* Adjusts the level at the end of a capture stats interval
+         * Returns true if the level changed.
+         */
+        bool update(const CaptureInterval& interval);
+
+        // Returns true if OpenFlow messages of the given type are only counted
+        inline bool sheds(const uint8_t type) const {
+            return level() > 0 && (type >= 32 || !(OF_TYPE_BIT(type) & OF_TYPES_LATENCY));
+        }
+
+        // As sheds(), and counts the message as shed
+        inline bool shed(const uint8_t type) {
+            if (!sheds(type))
+                return false;
+
+            bump(_shedMessages);
+            return true;
+        }
+
+        /* Returns true if the LLDP probe should be processed, otherwise
+         * counts it as skipped
+         */
+        inline bool keepProbe(const string& packetID) {
+            uint8_t lvl = level();
+            if (lvl < 2 || (hashProbeID(packetID) >> (33 - lvl)) == 0)
+                return true;
+
+            bump(_skippedProbes);
+            return false;
+        }
+
+        // Share of probes processed at the given level
+        static double sampleRateOf(const uint8_t level) {
+            return level < 2 ? 1.0 : 1.0 / (1U << (level - 1));
+        }
+
+        // Share of probes processed at the current level
+        double sampleRate() const {
+            return sampleRateOf(level());
+        }
+
+        OverloadState state() const;
+
+        // Human-readable level and counters
+        void dump(std::ostream& os) const;
+};
+
+#endif
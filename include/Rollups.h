@@ -0,0 +1,186 @@
+#ifndef ROLLUPS_H
+#define ROLLUPS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+#define ROLLUP_BUCKETS_PER_OCTAVE 4 // Quantile resolution: bucket bounds grow by 2^(1/4), ~19% apart
+#define ROLLUP_BUCKETS 96 // Bucket 0 holds samples up to ROLLUP_MIN_MS, the last one those above ~14s
+#define ROLLUP_MIN_MS 0.001
+
+/* Multi-resolution history of latency samples
+ *
+ * Every metric stream (an endpoint's echo RTT, a link's latency, ...) is
+ * rolled up into intervals of 1s, 1min and 1h, in packet time aligned to
+ * the epoch. An interval keeps the count, min, max and mean of its samples,
+ * and their p50, p90 and p99, estimated from log-spaced buckets (within
+ * about 10% of the true value). Each level keeps the last ROLLUP_SLOTS
+ * intervals in a ring per stream, so the history of a stream takes fixed
+ * memory (RollupTable::rowBytes()) however long it runs:
+ *  - 1s:   2 minutes
+ *  - 1min: 2 hours
+ *  - 1h:   2 days
+ *
+ * Samples are added to the open interval of every level; the sniff loop
+ * closes the intervals of all streams together as packet time moves on.
+ */
+enum RollupLevel {
+    ROLLUP_SECOND = 0,
+    ROLLUP_MINUTE,
+    ROLLUP_HOUR,
+    NUM_ROLLUP_LEVELS
+};
+
+const uint32_t ROLLUP_RESOLUTION_S[NUM_ROLLUP_LEVELS] = {1, 60, 3600};
+const uint16_t ROLLUP_SLOTS[NUM_ROLLUP_LEVELS] = {120, 120, 48};
+
+// A closed interval of one stream
+typedef struct RollupSlot {
+    uint32_t interval; // Start of the interval, in its level's resolution since the epoch
+    uint32_t count;
+    float min;
+    float max;
+    float mean;
+    float p50;
+    float p90;
+    float p99;
+} RollupSlot;
+
+// The open interval of one stream
+typedef struct RollupAccum {
+    uint32_t count;
+    float min;
+    float max;
+    double sum;
+    uint32_t buckets[ROLLUP_BUCKETS];
+} RollupAccum;
+
+/* Consecutive intervals of one stream and level, as contiguous arrays
+ * Entry i is the interval starting at startS + i * resolutionS. Intervals
+ * without samples have a count of 0 and NaN statistics.
+ */
+typedef struct RollupSeries {
+    uint64_t startS; // Packet time, seconds since the epoch
+    uint32_t resolutionS;
+    vector<uint32_t> count;
+    vector<float> min;
+    vector<float> max;
+    vector<float> mean;
+    vector<float> p50;
+    vector<float> p90;
+    vector<float> p99;
+} RollupSeries;
+
+const char* RollupLevelName(const RollupLevel level);
+
+// Parses a RollupLevelName() ("1s", "1min", "1h"), returns false if unknown
+bool ParseRollupLevel(const char* name, RollupLevel& level);
+
+/* Rollups of one metric, one row per stream (as MetricTable)
+ * Not thread-safe; the sniff loop adds samples and rows, and advances.
+ * Queries from other threads need the owner to serialize all of these.
+ */
+class RollupTable {
+    private:
+        // Open interval of all rows, per level; 0 until the first advance()
+        uint32_t _interval[NUM_ROLLUP_LEVELS] = {};
+
+        vector<RollupAccum> _open[NUM_ROLLUP_LEVELS];
+        vector<RollupSlot> _slots[NUM_ROLLUP_LEVELS]; // A ring of ROLLUP_SLOTS[level] per row
+        vector<uint16_t> _head[NUM_ROLLUP_LEVELS];    // Oldest slot of each row's ring
+        vector<uint16_t> _len[NUM_ROLLUP_LEVELS];     // Slots in each row's ring
+
+        static uint16_t bucket(const double val);
+
+        // Estimated q-quantile of an open interval's samples
+        static float quantile(const RollupAccum& acc, const double q);
+
+        static void fillSlot(const RollupAccum& acc, const uint32_t interval, RollupSlot& slot);
+
+        static void resetAccum(RollupAccum& acc);
+
+    public:
+        uint32_t rows() const {
+            return _open[ROLLUP_SECOND].size();
+        }
+
+        // Returns the index of a new, empty row
+        uint32_t addRow();
+
+        // Reserves room for 'rows' rows, so adding them won't reallocate
+        void reserve(const uint32_t rows);
+
+        // Bytes of one row, all levels
+        static size_t rowBytes();
+
+        // Adds a sample (ms) to the row's open intervals
+        void add(const uint32_t row, const double val) {
+            uint16_t b = bucket(val);
+            for (uint8_t level = 0; level < NUM_ROLLUP_LEVELS; level++) {
+                RollupAccum& acc = _open[level][row];
+                if (acc.count == 0 || val < acc.min)
+                    acc.min = val;
+                if (acc.count == 0 || val > acc.max)
+                    acc.max = val;
+                acc.count++;
+                acc.sum += val;
+                acc.buckets[b]++;
+            }
+        }
+
+        /* Moves every level on to the interval containing nowS (packet time,
+         * seconds since the epoch), closing the open intervals of all rows.
+         * closed(level, row, slot) is called for every closed interval that
+         * had samples. Time never goes back: an earlier nowS is ignored, and
+         * samples added until the next advance() count to the open intervals.
+         */
+        template <class Callback>
+        void advance(const uint64_t nowS, Callback closed);
+
+        /* Intervals of the row at 'level' starting in [fromS, toS), including
+         * the open one; only the last ROLLUP_SLOTS[level] intervals are kept
+         */
+        void query(const uint32_t row, const RollupLevel level, const uint64_t fromS,
+                    const uint64_t toS, RollupSeries& out) const;
+};
+
+template <class Callback>
+void RollupTable::advance(const uint64_t nowS, Callback closed) {
+    for (uint8_t level = 0; level < NUM_ROLLUP_LEVELS; level++) {
+        uint32_t interval = nowS / ROLLUP_RESOLUTION_S[level];
+        if (interval <= _interval[level])
+            continue;
+
+        // First advance, any samples so far count to the new interval
+        if (_interval[level] == 0) {
+            _interval[level] = interval;
+            continue;
+        }
+
+        uint16_t slots = ROLLUP_SLOTS[level];
+        for (uint32_t row = 0; row < rows(); row++) {
+            RollupAccum& acc = _open[level][row];
+            if (acc.count == 0)
+                continue;
+
+            uint16_t& head = _head[level][row];
+            uint16_t& len = _len[level][row];
+            RollupSlot& slot = _slots[level][(size_t)row * slots + (head + len) % slots];
+            if (len == slots)
+                head = (head + 1) % slots; // Overwrites the oldest
+            else
+                len++;
+
+            fillSlot(acc, _interval[level], slot);
+            resetAccum(acc);
+            closed((RollupLevel)level, row, slot);
+        }
+
+        _interval[level] = interval;
+    }
+}
+
+#endif
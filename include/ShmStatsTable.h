@@ -0,0 +1,236 @@
+#ifndef SHMSTATSTABLE_H
+#define SHMSTATSTABLE_H
+
+#include <atomic>
+#include <string>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "OFSniffCommon.h"
+
+using std::string;
+
+/* Fixed binary layout of the shared-memory statistics table
+ *
+ * The region (/dev/shm/<name>) holds one ShmTableHeader followed by
+ * 'capacity' ShmStatsRecords. Records are found by open addressing:
+ * start at ShmSlotOf(key) and probe linearly until the key matches or an
+ * empty record (metric == SHM_METRIC_NONE) is found. Records are never
+ * removed, so probe chains stay valid while the writer inserts.
+ *
+ * Each record is protected by its own seqlock: 'seq' is odd while the
+ * writer is updating it. Readers copy the record and retry if 'seq' was odd
+ * or changed during the copy. See OFSniffShm.py for the Python reader,
+ * which must be kept in sync with this layout.
+ */
+#define SHM_TABLE_MAGIC 0x4853464f // "OFSH" in little-endian
+#define SHM_TABLE_LAYOUT_VERSION 1
+#define SHM_HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+enum ShmMetricType : uint8_t {
+    SHM_METRIC_NONE = 0, // Empty record
+    SHM_METRIC_ECHO_RTT = 1,
+    SHM_METRIC_PKT_IN_RTT = 2,
+    SHM_METRIC_LINK_LAT = 3, // Only metric where port_no is meaningful
+};
+
+typedef struct ShmTableHeader {
+    uint32_t magic; // Written last by the writer, once the table is initialized
+    uint16_t layoutVersion;
+    uint16_t recordSize;
+    uint32_t capacity; // Number of records, always a power of 2
+    uint32_t writerPid;
+    std::atomic<uint64_t> numRecords;
+    std::atomic<uint64_t> overflows; // Updates dropped because the table was full
+    uint8_t reserved[32];
+} ShmTableHeader;
+
+typedef struct ShmStatsRecord {
+    std::atomic<uint32_t> seq;
+    uint8_t metric; // ShmMetricType
+    uint8_t sampleShift; // Probes sampled 1 in 2^sampleShift (overload), see OverloadGovernor.h
+    uint16_t port_no;
+    IPv4EndpointType endpoint;
+    uint64_t count; // Total samples seen
+    double avg;
+    double var;
+    double med;
+    double last; // Last sample (smoothed estimate for link latency)
+    int64_t updatedUs; // Wall-clock time of the last update, in us since epoch
+} ShmStatsRecord;
+
+static_assert(sizeof(ShmTableHeader) == 64, "ShmTableHeader layout changed");
+static_assert(sizeof(ShmStatsRecord) == 64, "ShmStatsRecord layout changed");
+
+inline uint32_t ShmSlotOf(const IPv4EndpointType endpoint, const uint8_t metric,
+                            const uint16_t port_no, const uint32_t capacity) {
+    uint64_t key = endpoint ^ ((uint64_t)metric << 56) ^ ((uint64_t)port_no << 48);
+    return (uint32_t)((key * SHM_HASH_MULTIPLIER) >> 32) & (capacity - 1);
+}
+
+/* Writer side, owned by EndpointLatencyMetadata
+ * Only the sniff loop thread may call publish().
+ */
+class ShmStatsWriter {
+    private:
+        string _name;
+        int _fd = -1;
+        size_t _mapLen = 0;
+        ShmTableHeader* _header = nullptr;
+        ShmStatsRecord* _records = nullptr;
+
+    public:
+        ShmStatsWriter();
+
+        // Unlinks the region, readers that still have it mapped may notice via isStale()
+        ~ShmStatsWriter();
+
+        /* Creates (or re-creates) /dev/shm/<name> with room for 'capacity'
+         * records (rounded up to a power of 2). Returns false on failure.
+         */
+        bool open(const string& name, const uint32_t capacity);
+
+        void close();
+
+        bool isOpen() const {
+            return _header != nullptr;
+        }
+
+        void publish(const IPv4EndpointType endpoint, const ShmMetricType metric,
+                        const uint16_t port_no, const uint64_t count,
+                        const double avg, const double var, const double med,
+                        const double last, const uint8_t sampleShift = 0);
+};
+
+/* Reader side, header-only so that other local processes only need this file
+ *
+ * Example:
+ *      ShmStatsReader reader;
+ *      ShmStatsRecord rec;
+ *      if (reader.open("ofsniff") &&
+ *              reader.lookup(endpoint, SHM_METRIC_ECHO_RTT, 0, rec))
+ *          cout << rec.med << endl;
+ */
+class ShmStatsReader {
+    private:
+        int _fd = -1;
+        size_t _mapLen = 0;
+        const ShmTableHeader* _header = nullptr;
+        const ShmStatsRecord* _records = nullptr;
+
+    public:
+        ShmStatsReader() {};
+
+        ~ShmStatsReader() {
+            close();
+        };
+
+        bool open(const string& name) {
+            close();
+
+            _fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+            if (_fd < 0)
+                return false;
+
+            struct stat st;
+            if (fstat(_fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmTableHeader)) {
+                close();
+                return false;
+            }
+
+            void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, _fd, 0);
+            if (addr == MAP_FAILED) {
+                close();
+                return false;
+            }
+            _mapLen = st.st_size;
+            _header = (const ShmTableHeader*)addr;
+            _records = (const ShmStatsRecord*)(_header + 1);
+
+            if (__atomic_load_n(&_header->magic, __ATOMIC_ACQUIRE) != SHM_TABLE_MAGIC ||
+                    _header->layoutVersion != SHM_TABLE_LAYOUT_VERSION ||
+                    _header->recordSize != sizeof(ShmStatsRecord) ||
+                    sizeof(ShmTableHeader) + (size_t)_header->capacity *
+                        sizeof(ShmStatsRecord) > _mapLen) {
+                close();
+                return false;
+            }
+
+            return true;
+        }
+
+        void close() {
+            if (_header)
+                munmap((void*)_header, _mapLen);
+            if (_fd >= 0)
+                ::close(_fd);
+
+            _header = nullptr;
+            _records = nullptr;
+            _fd = -1;
+        }
+
+        // True if the writer has since removed (or re-created) the region
+        bool isStale() const {
+            struct stat st;
+            return _fd < 0 || fstat(_fd, &st) != 0 || st.st_nlink == 0;
+        }
+
+        uint32_t capacity() const {
+            return _header ? _header->capacity : 0;
+        }
+
+        /* Consistent copy of the record in slot 'slot'
+         * Spins (briefly) while the writer is updating that record.
+         */
+        void readSlot(const uint32_t slot, ShmStatsRecord& out) const {
+            const ShmStatsRecord& rec = _records[slot];
+            uint32_t seq1, seq2;
+            do {
+                seq1 = rec.seq.load(std::memory_order_acquire);
+                if (seq1 & 1)
+                    continue;
+
+                out.metric = rec.metric;
+                out.port_no = rec.port_no;
+                out.endpoint = rec.endpoint;
+                out.count = rec.count;
+                out.avg = rec.avg;
+                out.var = rec.var;
+                out.med = rec.med;
+                out.last = rec.last;
+                out.updatedUs = rec.updatedUs;
+                out.sampleShift = rec.sampleShift;
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                seq2 = rec.seq.load(std::memory_order_relaxed);
+            } while ((seq1 & 1) || seq1 != seq2);
+        }
+
+        // Returns false if no statistics exist (yet) for the given key
+        bool lookup(const IPv4EndpointType endpoint, const ShmMetricType metric,
+                    const uint16_t port_no, ShmStatsRecord& out) const {
+            if (!_header)
+                return false;
+
+            uint32_t mask = _header->capacity - 1;
+            uint32_t slot = ShmSlotOf(endpoint, metric, port_no, _header->capacity);
+            for (uint32_t probes = 0; probes <= mask; probes++, slot = (slot + 1) & mask) {
+                readSlot(slot, out);
+                if (out.metric == SHM_METRIC_NONE)
+                    return false;
+
+                if (out.endpoint == endpoint && out.metric == metric &&
+                        out.port_no == port_no)
+                    return true;
+            }
+
+            return false;
+        }
+};
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef STAGETIMERS_H
+#define STAGETIMERS_H
+
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // For __rdtsc()
+#else
+#include <time.h>
+#endif
+
+using std::string;
+using std::vector;
+
+/* Per-stage hot path instrumentation
+ *
+ * Each thread that runs instrumented code gets its own StageTimers, so the
+ * hot path only does relaxed loads/stores to thread-private cache lines.
+ * Other threads (e.g. SIGUSR1 dump, Python) may read them at any time.
+ *
+ * Stage times are inclusive of nested stages (e.g. PROCESS_LLDP includes
+ * UPDATE_STATS, which includes STATS_LOG).
+ *
+ * Building with -DOFSNIFF_NO_STAGE_TIMERS (make STAGE_TIMERS=0) compiles
+ * all STAGE_TIMER() scopes out.
+ */
+enum SniffStage {
+    STAGE_CAPTURE,       // Reading from pcap + decoding headers (FrameDecoder.h, or libtins)
+    STAGE_DECODE,        // Finding IP/TCP/Raw PDUs and copying out the OpenFlow message
+    STAGE_PARSE_OF,      // ParseOFPacket()
+    STAGE_OF_UNPACK,     // libfluid unpack() of PacketIn/PacketOut + Ethernet frame
+    STAGE_PROCESS_LLDP,  // ProcessLLDP()
+    STAGE_UPDATE_STATS,  // EndpointLatencyMetadata::update*()
+    STAGE_STATS_LOG,     // Writing the statistics log
+    STAGE_SNAPSHOT,      // Publishing a statistics snapshot
+    NUM_SNIFF_STAGES
+};
+
+#define STAGE_HIST_BUCKETS 32 // Bucket i counts durations in [2^i, 2^(i+1)) cycles
+
+typedef struct StageStats {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> totalCycles;
+    std::atomic<uint64_t> maxCycles;
+    std::atomic<uint64_t> hist[STAGE_HIST_BUCKETS];
+} StageStats;
+
+// Plain copy of a StageStats, for reporting
+typedef struct StageStatsCopy {
+    string threadName;
+    SniffStage stage;
+    uint64_t count;
+    uint64_t totalCycles;
+    uint64_t maxCycles;
+    uint64_t hist[STAGE_HIST_BUCKETS];
+} StageStatsCopy;
+
+inline uint64_t StageClock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+class StageTimers {
+    private:
+        StageStats _stages[NUM_SNIFF_STAGES];
+
+    public:
+        string threadName;
+
+        StageTimers(const string& name);
+
+        void record(const SniffStage stage, const uint64_t cycles) {
+            StageStats& s = _stages[stage];
+            uint16_t bucket = cycles ? 63 - __builtin_clzll(cycles) : 0;
+            if (bucket >= STAGE_HIST_BUCKETS)
+                bucket = STAGE_HIST_BUCKETS - 1;
+
+            // Single writer per instance, no need for locked read-modify-writes
+            s.count.store(s.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            s.totalCycles.store(s.totalCycles.load(std::memory_order_relaxed) + cycles,
+                                std::memory_order_relaxed);
+            s.hist[bucket].store(s.hist[bucket].load(std::memory_order_relaxed) + 1,
+                                    std::memory_order_relaxed);
+            if (cycles > s.maxCycles.load(std::memory_order_relaxed))
+                s.maxCycles.store(cycles, std::memory_order_relaxed);
+        }
+
+        void copy(const SniffStage stage, StageStatsCopy& out) const;
+
+        // Returns the calling thread's timers, registering them on first use
+        static StageTimers& local();
+
+        // Names the calling thread's timers (e.g. "main", "python-sniff")
+        static void setThreadName(const string& name);
+
+        // Copies of all stages of all threads that recorded anything
+        static vector<StageStatsCopy> collect();
+
+        /* Cycles per microsecond of StageClock(), measured once over ~20ms
+         * Returns 1000 (i.e. ns) on platforms without a TSC.
+         */
+        static double cyclesPerUs();
+
+        static const char* stageName(const SniffStage stage);
+
+        // Human-readable table of collect()
+        static void dump(std::ostream& os);
+};
+
+// Times the enclosing scope
+class StageTimer {
+    private:
+        SniffStage _stage;
+        uint64_t _start;
+
+    public:
+        StageTimer(const SniffStage stage) : _stage(stage), _start(StageClock()) {};
+
+        ~StageTimer() {
+            StageTimers::local().record(_stage, StageClock() - _start);
+        };
+};
+
+/* STAGE_TIMER(stage) times the enclosing scope
+ * STAGE_TIMER_START(var) / STAGE_TIMER_STOP(stage, var) time a range of
+ * statements that doesn't match a scope.
+ */
+#ifndef OFSNIFF_NO_STAGE_TIMERS
+#define STAGE_TIMER_CONCAT2(a, b) a##b
+#define STAGE_TIMER_CONCAT(a, b) STAGE_TIMER_CONCAT2(a, b)
+#define STAGE_TIMER(stage) StageTimer STAGE_TIMER_CONCAT(_stageTimer, __LINE__)(stage)
+#define STAGE_TIMER_START(var) uint64_t var = StageClock()
+#define STAGE_TIMER_STOP(stage, var) StageTimers::local().record(stage, StageClock() - var)
+#else
+#define STAGE_TIMER(stage)
+#define STAGE_TIMER_START(var)
+#define STAGE_TIMER_STOP(stage, var)
+#endif
+
+#endif
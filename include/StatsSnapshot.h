@@ -0,0 +1,116 @@
+#ifndef STATSSNAPSHOT_H
+#define STATSSNAPSHOT_H
+
+#include <atomic>
+#include <vector>
+
+#include "OFSniffCommon.h"
+#include "LatencyMetadata.h"
+#include "Diagnostics.h"
+#include "OverloadGovernor.h"
+#include "MemoryAccounting.h"
+
+using std::vector;
+
+/* Point-in-time copies of the statistics in EndpointLatencyMetadata
+ * Only holds plain values (no maps, no strings), so a snapshot can be
+ * refilled in place without freeing and re-allocating its vectors.
+ */
+typedef struct MetricSnapshot {
+    double avg;
+    double var;
+    double med;
+    double smoothed; // Current value of the metric's estimator (see LatencyConfig)
+    LatencyHistogram hist;
+} MetricSnapshot;
+
+typedef struct LinkSnapshot {
+    uint16_t port_no;
+    double srtt;
+    MetricSnapshot lat;
+} LinkSnapshot;
+
+typedef struct EndpointSnapshot {
+    IPv4EndpointType endpoint;
+    uint64_t datapathID; // 0 until the switch's FeaturesReply was seen
+    uint64_t version; // Unchanged version => unchanged statistics
+    MetricSnapshot echoRTT;
+    MetricSnapshot pktInRTT;
+    TCPFlowStats tcp;
+    uint64_t probesSent;
+    uint64_t probesMatched;
+    uint64_t probesExpired;
+    uint64_t probesSkipped;
+    double probeSampleRate; // Share of probes processed when the last one was seen
+    uint64_t memoryBytes;   // Charged to the endpoint, see MemoryAccounting.h
+    uint64_t changePoints;  // Latency changes detected, see ChangeDetector.h
+    uint32_t firstLink; // Index into StatsSnapshot::links
+    uint32_t numLinks;
+} EndpointSnapshot;
+
+typedef struct StatsSnapshot {
+    Timestamp ts; // Packet time at which the snapshot was taken
+    uint64_t seqNum;
+
+    uint64_t packets;
+    uint64_t ofMessages;
+    uint64_t parseErrors;
+    uint64_t captureRecv;
+    uint64_t captureDrops;
+    uint64_t captureIfDrops;
+    uint64_t diagCounts[NUM_DIAG_REASONS]; // Diagnostics occurrences per DiagReason
+    OverloadState overload;
+    MemoryState memory;
+
+    vector<EndpointSnapshot> endpoints;
+    vector<LinkSnapshot> links; // Links of all endpoints, grouped by endpoint
+} StatsSnapshot;
+
+/* Triple buffer for handing snapshots from a single writer (the sniff loop)
+ * to a single reader (e.g. the metrics exporter) without locks.
+ *
+ * The writer fills back(), then publish() swaps it with the shared middle
+ * buffer. The reader calls update() to swap the middle buffer into front()
+ * if a newer one was published. Neither side ever waits on the other.
+ */
+template <typename T>
+class SnapshotExchange {
+    private:
+        static const uint8_t FRESH_BIT = 0x4;
+
+        T _buffers[3]{}; // Zeroed, so front() before the first publish() has seqNum 0
+        uint8_t _back = 0;
+        uint8_t _front = 1;
+        std::atomic<uint8_t> _middle;
+
+    public:
+        SnapshotExchange() : _middle(2) {};
+
+        // Writer side
+        T& back() {
+            return _buffers[_back];
+        }
+
+        void publish() {
+            uint8_t prev = _middle.exchange(_back | FRESH_BIT, std::memory_order_acq_rel);
+            _back = prev & ~FRESH_BIT;
+        }
+
+        /* Reader side
+         * Returns true if front() changed since the last call
+         */
+        bool update() {
+            if (!(_middle.load(std::memory_order_relaxed) & FRESH_BIT))
+                return false;
+
+            uint8_t prev = _middle.exchange(_front, std::memory_order_acq_rel);
+            _front = prev & ~FRESH_BIT;
+            return true;
+        }
+
+        const T& front() const {
+            return _buffers[_front];
+        }
+};
+
+#endif
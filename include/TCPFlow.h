@@ -0,0 +1,119 @@
+#ifndef TCPFLOW_H
+#define TCPFLOW_H
+
+#include <cstdint>
+
+#include "LatencyHistogram.h"
+#include "OFTraffic.h"
+
+/* Passive transport RTT and bytes in flight of an OpenFlow connection
+ *
+ * RTTs are measured as in pping (https://github.com/pollere/pping): the
+ * first time a TCP timestamp value (TSval) is seen in one direction is
+ * recorded, and the first segment of the other direction echoing it (TSecr)
+ * completes an RTT sample. Only segments carrying data, SYN or FIN are
+ * timed (as in ePPing), since the echo of a pure ACK can be delayed
+ * indefinitely. The samples of a direction are the time from the
+ * capture point to the receiver of that direction and back, so when
+ * capturing on the controller host:
+ *  - OF_TO_SWITCH:   network path + switch TCP stack
+ *  - OF_FROM_SWITCH: controller host (stack, socket queueing, delayed ACKs)
+ *
+ * Bytes in flight of a direction are its highest sequence number sent minus
+ * the highest acknowledgement seen from the other direction.
+ */
+#define TCP_TS_TABLE_SIZE 16 // TSvals awaiting their echo per direction
+#define TCP_SRTT_GAIN 0.125 // Same as the RFC 6298 SRTT gain
+
+#define TCP_FLAG_FIN 0x01
+#define TCP_FLAG_SYN 0x02
+#define TCP_FLAG_RST 0x04
+#define TCP_FLAG_ACK 0x10
+
+// The parts of a TCP segment needed for tracking, filled by the sniff loop
+typedef struct TCPSegment {
+    uint32_t seq;
+    uint32_t ack;
+    uint16_t flags;      // As in the TCP header (FIN = 0x01, SYN = 0x02, ...)
+    uint32_t payloadLen; // Payload Bytes captured (less than wireLen if cut by the snapshot length)
+    uint32_t wireLen;    // Payload Bytes on the wire, from the IP length; what the sequence space counts
+    bool hasTimestamp;   // Timestamps option present
+    uint32_t tsval;
+    uint32_t tsecr;
+} TCPSegment;
+
+typedef struct TCPRTTStats {
+    uint64_t count;
+    double last; // RTTs in ms
+    double min;
+    double max;
+    double srtt;
+    LatencyHistogram hist; // hist.sum / count is the mean
+
+    void add(const double rtt) {
+        if (count == 0) {
+            min = rtt;
+            srtt = rtt;
+        } else {
+            if (rtt < min)
+                min = rtt;
+            srtt += TCP_SRTT_GAIN * (rtt - srtt);
+        }
+        if (rtt > max)
+            max = rtt;
+        last = rtt;
+        count++;
+        hist.add(rtt);
+    }
+} TCPRTTStats;
+
+// Both directions of one connection, indexed by OFDirection
+typedef struct TCPFlowStats {
+    TCPRTTStats rtt[NUM_OF_DIRECTIONS];   // Segments sent in that direction, echoed back
+    uint32_t inFlight[NUM_OF_DIRECTIONS]; // Unacknowledged Bytes sent in that direction
+    uint32_t inFlightPeak[NUM_OF_DIRECTIONS]; // Highest inFlight in the last closed interval
+} TCPFlowStats;
+
+class TCPFlowTracker {
+    private:
+        typedef struct TSvalSeen {
+            uint32_t tsval;
+            uint64_t seenUs;
+        } TSvalSeen;
+
+        typedef struct Direction {
+            TSvalSeen tsvals[TCP_TS_TABLE_SIZE]; // Ring, ascending TSvals from 'head'
+            uint16_t head;
+            uint16_t len;
+
+            uint32_t sndNxt; // Highest sequence number sent + 1
+            uint32_t sndUna; // Highest acknowledgement from the other direction
+            bool seqValid;
+            bool ackValid;
+            uint32_t peak;   // Highest bytes in flight in the current interval
+        } Direction;
+
+        Direction _dirs[NUM_OF_DIRECTIONS];
+
+        void reset(Direction& d);
+
+        void updateInFlight(const uint16_t dir);
+
+    public:
+        TCPFlowStats stats;
+
+        TCPFlowTracker();
+
+        /* Processes one segment of the connection, sent towards the switch
+         * if toSwitch is true
+         * Returns true if it completed an RTT sample, whose direction and
+         * value (ms) are returned through the parameters.
+         */
+        bool process(const TCPSegment& seg, const bool toSwitch, const uint64_t tsUs,
+                        OFDirection& rttDir, double& rtt);
+
+        // Moves the in-flight peaks of the current interval into stats
+        void closeInterval();
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef THREADPLACEMENT_H
+#define THREADPLACEMENT_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <sched.h>
+
+using std::string;
+using std::vector;
+
+#define PLACEMENT_UNCHANGED -1 // Scheduling policy of a placement that keeps the inherited one
+#define PLACEMENT_MAX_CPUS CPU_SETSIZE
+#define PLACEMENT_RESERVE_SWITCHES 256 // Default switches the locked tables have room for
+#define PLACEMENT_LINKS_PER_SWITCH 16 // ... and links per switch
+
+/* Where the sniffer's threads run, and where its hot tables live
+ *
+ * Timestamps are taken when the sniff loop reads a packet, so any time the
+ * capture thread spends descheduled (behind a busy controller's own threads)
+ * or page-faulting ends up as jitter in the latency samples. Threads come in
+ * two roles:
+ *  - THREAD_CAPTURE: the sniff loop ("main", or "python-sniff")
+ *  - THREAD_WORKER: all others (diagnostics writer, observers dispatcher,
+ *    checkpoint writer, summary sender, metrics exporter, signal loops)
+ * each with a set of CPUs and a scheduling policy. Every thread applies the
+ * placement of its role to itself when it starts, see place(); roles
+ * without a placement keep what their threads inherited.
+ *
+ * The hot tables (metric rows, estimators, indices) can additionally be
+ * reserved up front, prefaulted and locked into memory (no page faults in
+ * the sniff loop, no swapping), and allocated on the NUMA node of the
+ * capture CPUs; see lockMemory() and BasicEndpointLatencyMetadata::reserve().
+ *
+ * All placement must be configured before the threads are started.
+ */
+enum ThreadRole {
+    THREAD_CAPTURE = 0,
+    THREAD_WORKER,
+    NUM_THREAD_ROLES
+};
+
+typedef struct ThreadPlacement {
+    vector<uint16_t> cpus; // Empty => the inherited CPUs
+    int policy;            // SCHED_OTHER, SCHED_FIFO or PLACEMENT_UNCHANGED
+    int priority;          // Real-time priority (1 - 99) for SCHED_FIFO, nice value (-20 - 19) for SCHED_OTHER
+} ThreadPlacement;
+
+#define THREAD_PLACEMENT_INHERITED {{}, PLACEMENT_UNCHANGED, 0}
+
+/* Parses "<cpu>[-<cpu>][,...]" (e.g. "0-3,6"), returns false if invalid or
+ * if any of them is beyond PLACEMENT_MAX_CPUS
+ */
+bool ParseCPUList(const string& str, vector<uint16_t>& cpus);
+
+// Sorted CPUs as "0-3,6"
+string CPUListToString(const vector<uint16_t>& cpus);
+
+/* Parses "fifo:<priority>" or "other[:<nice>]" into the policy and priority
+ * of 'placement', returns false if invalid
+ */
+bool ParseSchedPolicy(const string& str, ThreadPlacement& placement);
+
+/* Parses "<role>=[<cpus>][@<policy>]" (role capture or worker, see
+ * ParseCPUList() and ParseSchedPolicy()) into its entry of 'placements'
+ * (NUM_THREAD_ROLES of them), returns false if invalid
+ */
+bool ParseThreadPlacement(const string& str, ThreadPlacement* placements);
+
+class ThreadPlacements {
+    public:
+        // Sets the placement of a role, applied by threads started later
+        static void configure(const ThreadRole role, const ThreadPlacement& placement);
+
+        // Allocates the capture thread's memory on the NUMA node of its CPUs
+        static void setNumaLocal(const bool numaLocal);
+
+        /* Applies the role's placement to the calling thread, and records the
+         * placement in effect under 'name' (see dump())
+         * With NUMA-local allocation set, the capture thread's later
+         * allocations (table rows, and the pages lockMemory() faults in)
+         * prefer the node of its CPUs. Returns false, after printing why, if
+         * any of it could not be applied; the thread runs on regardless.
+         */
+        static bool place(const ThreadRole role, const string& name);
+
+        /* Locks all memory of the process, faulting in what is mapped but
+         * not yet touched (e.g. reserved table capacity); memory mapped later
+         * is locked as it is first touched. Returns false, after printing
+         * why (mostly RLIMIT_MEMLOCK without CAP_IPC_LOCK), if it failed.
+         */
+        static bool lockMemory();
+
+        // NUMA node of a CPU, -1 if unknown (e.g. no NUMA support)
+        static int cpuNode(const uint16_t cpu);
+
+        static string roleName(const ThreadRole role);
+
+        // Configured placements, memory locking, and the placement of each placed thread
+        static void dump(std::ostream& os);
+};
+
+#endif
@@ -1,24 +1,240 @@
 #include <iostream>
+#include <vector>
 #include <signal.h>
-//#include <thread>
+#include <climits> // For HOST_NAME_MAX
+#include <net/if.h> // For if_nametoindex()
+#include <unistd.h> // For getopt()
+#include <pthread.h>
+#include <thread>
 
 // Packet processing libs
 #include <tins/tins.h>
 
 #include "OFSniff.h"
+#include "CaptureSources.h"
+#include "MetricsExporter.h"
+#include "Aggregator.h"
+#include "StageTimers.h"
+#include "ThreadPlacement.h"
 
 using std::cout;
 using std::endl;
 using std::string;
+using std::vector;
 using namespace Tins;
 
-#define MAX_CAP_LEN 1500 // Max Bytes to capture per packet
+#define METRICS_SNAPSHOT_MS 1000 // How often the sniff loop refreshes exported metrics
+#define SHM_TABLE_CAPACITY 16384 // Records in the shared-memory statistics table
+#define AGGREGATOR_WAIT_MS 100 // How often the aggregator mode checks for SIGINT/SIGTERM
 
-static Sniffer *sniffer = nullptr;
+static CaptureSources *sources = nullptr;
+static volatile sig_atomic_t aggregatorStop = 0;
 
 static void signalHandler(int sigVal) {
-    if (sniffer)
-        sniffer->stop_sniff();
+    if (sources)
+        sources->stop();
+    aggregatorStop = 1;
+}
+
+/* Waits for SIGUSR1 (blocked in all other threads) and dumps diagnostics
+ * Runs in its own thread, so the dump is not restricted to signal-safe calls.
+ */
+static void diagnosticsSignalLoop(sigset_t sigSet, EndpointLatencyMetadata& epLatMeta,
+                                    const CaptureSources& captureSources) {
+    ThreadPlacements::place(THREAD_WORKER, "signal");
+
+    int sigVal;
+    while (sigwait(&sigSet, &sigVal) == 0) {
+        epLatMeta.captureStats().dump(cout);
+        captureSources.dump(cout);
+        epLatMeta.governor().dump(cout);
+        epLatMeta.memoryBudget().dump(cout);
+        epLatMeta.diagnostics().dump(cout);
+        epLatMeta.dumpOFTraffic(cout);
+        StageTimers::dump(cout);
+        ThreadPlacements::dump(cout);
+        cout.flush();
+    }
+}
+
+// As diagnosticsSignalLoop, for the aggregator mode
+static void aggregatorSignalLoop(sigset_t sigSet, const SummaryAggregator& aggregator) {
+    ThreadPlacements::place(THREAD_WORKER, "signal");
+
+    int sigVal;
+    while (sigwait(&sigSet, &sigVal) == 0) {
+        aggregator.dump(cout);
+        cout.flush();
+    }
+}
+
+/* Aggregator mode: merges the summaries of other OFSniff instances (-A) into
+ * one global view until SIGINT/SIGTERM, served as metrics if metricsPort is set
+ */
+static int runAggregator(const SummaryAddress& addr, const uint16_t metricsPort, sigset_t usr1Set) {
+    SummaryAggregator aggregator;
+    if (!aggregator.start(addr))
+        return 1;
+    cout << "Aggregating summaries on " << SummaryAddressToString(addr) << endl;
+
+    std::thread(aggregatorSignalLoop, usr1Set, std::cref(aggregator)).detach();
+
+    MetricsExporter exporter(aggregator.snapshots());
+    if (metricsPort) {
+        if (!exporter.start(metricsPort))
+            return 1;
+        cout << "Serving metrics on http://127.0.0.1:" << metricsPort << "/metrics" << endl;
+    }
+
+    while (!aggregatorStop)
+        usleep(AGGREGATOR_WAIT_MS * 1000);
+
+    exporter.stop();
+    aggregator.stop();
+    aggregator.dump(cout);
+    return 0;
+}
+
+static void printUsage(const char* progName) {
+    cout << "Usage: " << progName << " [options] <interface name>[:<port>[,<port>...]] ..." << endl;
+    cout << "       " << progName << " [options] <interface name> <openflow listening port number>" << endl;
+    cout << "       " << progName << " -a <address> [-m <port>]" << endl;
+    cout << "All interfaces are captured by one loop, into one set of statistics. Interfaces" << endl;
+    cout << "given without ports capture the default OpenFlow ports (see -p). \"any\" captures all" << endl;
+    cout << "interfaces. IPv4 and IPv6 connections are captured, also behind VLAN/QinQ tags." << endl;
+    cout << "Options:" << endl;
+    cout << "  -p <ports>   Comma-separated default OpenFlow ports (default: 6633,6653)" << endl;
+    cout << "  -m <port>    Serve Prometheus metrics on http://127.0.0.1:<port>/metrics" << endl;
+    cout << "  -s <name>    Publish statistics into the shared-memory table /dev/shm/<name>" << endl;
+    cout << "  -b <bytes>   Kernel capture buffer size (default: libpcap's default)" << endl;
+    cout << "  -d <ms>[:<n>] Batched delivery: the kernel holds packets up to <ms>, processed up to <n>" << endl;
+    cout << "               (default 256) at a time. Less CPU, later results (default: immediate delivery)" << endl;
+    cout << "  -g <level>   Highest overload level (default 5): 1 sheds messages not needed for latency" << endl;
+    cout << "               measurements, each further level halves the probes processed. 0 disables it" << endl;
+    cout << "  -M <MiB>     Memory budget of the switch metadata; over it, the probe tables of the least" << endl;
+    cout << "               recently active switches are compacted (default: unlimited)" << endl;
+    cout << "  -c <file>    Checkpoint latency state into <file>, and restore it from there at startup" << endl;
+    cout << "  -C <s>       Seconds between checkpoints (default: 60), also written at exit" << endl;
+    cout << "  -e <list>    Estimators of the smoothed metrics, comma-separated <metric>=<estimator> with" << endl;
+    cout << "               metrics echo, pktin, link and estimators ema (default), dema, adaptive, kalman," << endl;
+    cout << "               trimmed_mean; compare them on a statistics log with 'make replay'" << endl;
+    cout << "  -R <level>:<file> Keep 1s, 1min and 1h rollups of every metric, and append one line per" << endl;
+    cout << "               stream and closed <level> interval (1s, 1min, 1h) to <file>" << endl;
+    cout << "  -A <address> Send summaries to an aggregator every second; <address> is a Unix socket path" << endl;
+    cout << "               (containing a '/') or [<IPv4 address>:]<port> (default address 127.0.0.1)" << endl;
+    cout << "  -n <name>    Name of this instance in the aggregator (default: <hostname>:<pid>)" << endl;
+    cout << "  -a <address> Aggregator mode: capture nothing, merge the summaries of other instances (-A)" << endl;
+    cout << "               into one view, with switches deduplicated by datapath ID (-m serves it)" << endl;
+    cout << "  -P <role>=[<cpus>][@<policy>] Placement of the capture thread (role capture) or all other" << endl;
+    cout << "               threads (worker): CPUs as 0-3,6 and scheduling fifo:<priority> or" << endl;
+    cout << "               other[:<nice>], e.g. -P capture=2@fifo:50 -P worker=4-7 (default: inherited)" << endl;
+    cout << "  -L <n>       Reserve the statistics tables for <n> switches, and prefault and lock all memory" << endl;
+    cout << "  -N           Allocate the capture thread's memory on the NUMA node of its first CPU" << endl;
+    cout << "  -v <level>   Minimum severity of diagnostic messages: debug, info (default), warning, error" << endl;
+    cout << "  -k           Drop OpenFlow messages not needed for latency measurements in the kernel" << endl;
+    cout << "  -K           As -k, but also drop pure ACKs (no transport RTT or bytes in flight)" << endl;
+    cout << "Send SIGUSR1 to print capture drop statistics (in total and per interface), delivery delay" << endl;
+    cout << "and CPU cost, overload level, memory usage, diagnostics counts, OpenFlow traffic per endpoint and" << endl;
+    cout << "message type, per-stage processing times and thread placement (in aggregator mode: nodes and" << endl;
+    cout << "the global view)" << endl;
+}
+
+// Returns false if str is not a valid port number
+static bool parsePort(const string& str, uint16_t& port) {
+    if (str.empty())
+        return false;
+
+    for (uint32_t i = 0; i < str.length(); i++) {
+        if (!isdigit(str[i]))
+            return false;
+    }
+
+    if (str.length() > 5 || stoul(str) > 65535)
+        return false;
+
+    port = (uint16_t)stoul(str);
+    return true;
+}
+
+// Parses "port[,port...]", returns false if any of them is invalid
+static bool parsePortList(const string& str, vector<uint16_t>& ports) {
+    ports.clear();
+
+    size_t start = 0;
+    while (true) {
+        size_t end = str.find(',', start);
+        uint16_t port;
+        if (!parsePort(str.substr(start, end - start), port) || port == 0)
+            return false;
+        ports.push_back(port);
+
+        if (end == string::npos)
+            return true;
+        start = end + 1;
+    }
+}
+
+/* Parses "<metric>=<estimator>[,...]" into the estimators of 'config',
+ * returns false if any of them is invalid
+ */
+static bool parseEstimators(const string& str, LatencyConfig& config) {
+    size_t start = 0;
+    while (true) {
+        size_t end = str.find(',', start);
+        string item = str.substr(start, end - start);
+        size_t eq = item.find('=');
+        string metric = item.substr(0, eq);
+
+        EstimatorKind kind;
+        if (eq == string::npos || !ParseEstimatorKind(item.substr(eq + 1).c_str(), kind))
+            return false;
+        if (metric == "echo")
+            config.echoRTTEstimator = kind;
+        else if (metric == "pktin")
+            config.pktInRTTEstimator = kind;
+        else if (metric == "link")
+            config.linkLatEstimator = kind;
+        else
+            return false;
+
+        if (end == string::npos)
+            return true;
+        start = end + 1;
+    }
+}
+
+// Returns true if all characters of str are digits
+static bool isNumber(const string& str) {
+    if (str.empty())
+        return false;
+
+    for (uint32_t i = 0; i < str.length(); i++) {
+        if (!isdigit(str[i]))
+            return false;
+    }
+
+    return true;
+}
+
+// Parses "<ms>[:<batch size>]" into batched delivery, returns false if invalid
+static bool parseDelivery(const string& str, CaptureDelivery& delivery) {
+    size_t colon = str.find(':');
+    string timeout = str.substr(0, colon);
+    string batchSize = (colon == string::npos) ? "" : str.substr(colon + 1);
+
+    delivery = CAPTURE_DELIVERY_BATCHED;
+    if (!isNumber(timeout) || timeout.length() > 5 || stoul(timeout) == 0)
+        return false;
+    delivery.timeoutMs = stoul(timeout);
+
+    if (colon != string::npos) {
+        if (!isNumber(batchSize) || batchSize.length() > 5 || stoul(batchSize) == 0 ||
+                stoul(batchSize) > CAPTURE_MAX_BATCH)
+            return false;
+        delivery.batchSize = stoul(batchSize);
+    }
+
+    return true;
 }
 
 int main(int argc, char *argv[]) {
@@ -30,65 +246,326 @@ int main(int argc, char *argv[]) {
     sigaction (SIGINT, &action, NULL);
     sigaction (SIGTERM, &action, NULL);
 
-    string iface;
-    string ofpPort;
+    // SIGUSR1 is handled synchronously by a dedicated thread
+    // Block it before any other thread is created so they inherit the mask
+    sigset_t usr1Set;
+    sigemptyset(&usr1Set);
+    sigaddset(&usr1Set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &usr1Set, NULL);
 
-    if (argc == 1) {
-        cout << "Usage: " << argv[0] << " <interface name> <openflow listening port number>" << endl;
-        exit(0);
-    } else if (argc == 2) {
-        iface = argv[1];
-        if (localAddrOf(iface).empty()) {
-            cout << "ERROR: Could not identify interface" << endl;
+    vector<uint16_t> defaultPorts = CAPTURE_DEFAULT_PORTS;
+    uint16_t metricsPort = 0;
+    string shmName;
+    uint32_t bufferSize = 0;
+    CaptureDelivery delivery = CAPTURE_DELIVERY_IMMEDIATE;
+    bool ofTypeFilter = false;
+    bool passPureAcks = true;
+    DiagSeverity minSeverity = DIAG_INFO;
+    uint8_t maxOverloadLevel = OVERLOAD_MAX_LEVEL;
+    uint64_t memoryBudget = 0;
+    string checkpointPath;
+    uint32_t checkpointIntervalMs = CHECKPOINT_INTERVAL_MS;
+    LatencyConfig latencyConfig = DEFAULT_LATENCY_CONFIG;
+    string rollupPath;
+    RollupLevel rollupLevel = ROLLUP_MINUTE;
+    SummaryAddress summaryAddr;
+    bool sendSummaries = false;
+    bool aggregate = false;
+    string nodeName;
+    ThreadPlacement placements[NUM_THREAD_ROLES] = {THREAD_PLACEMENT_INHERITED,
+                                                    THREAD_PLACEMENT_INHERITED};
+    uint32_t lockedSwitches = 0;
+    bool numaLocal = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:m:s:b:d:g:M:c:C:e:R:A:n:a:P:L:Nv:kKh")) != -1) {
+        switch (opt) {
+            case 'p':
+                if (!parsePortList(optarg, defaultPorts)) {
+                    cout << "ERROR: Invalid OpenFlow port list (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                break;
+            case 'm':
+                if (!parsePort(optarg, metricsPort) || metricsPort == 0) {
+                    cout << "ERROR: Invalid metrics port number (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                break;
+            case 's':
+                shmName = optarg;
+                if (shmName.empty() || shmName.find('/') != string::npos) {
+                    cout << "ERROR: Invalid shared memory table name (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                break;
+            case 'b': {
+                char* end = nullptr;
+                unsigned long val = strtoul(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || val == 0 || val > UINT32_MAX) {
+                    cout << "ERROR: Invalid capture buffer size (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                bufferSize = (uint32_t)val;
+                break;
+            }
+            case 'd':
+                if (!parseDelivery(optarg, delivery)) {
+                    cout << "ERROR: Invalid capture delivery (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                break;
+            case 'g':
+                if (!isNumber(optarg) || string(optarg).length() > 1 || optarg[0] - '0' > OVERLOAD_MAX_LEVEL) {
+                    cout << "ERROR: Invalid overload level (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                maxOverloadLevel = optarg[0] - '0';
+                break;
+            case 'M':
+                if (!isNumber(optarg) || string(optarg).length() > 7 || stoul(string(optarg)) == 0) {
+                    cout << "ERROR: Invalid memory budget (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                memoryBudget = (uint64_t)stoul(string(optarg)) << 20;
+                break;
+            case 'c':
+                checkpointPath = optarg;
+                if (checkpointPath.empty()) {
+                    cout << "ERROR: Invalid checkpoint file (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                break;
+            case 'C':
+                if (!isNumber(optarg) || string(optarg).length() > 6 || stoul(string(optarg)) == 0) {
+                    cout << "ERROR: Invalid checkpoint interval (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                checkpointIntervalMs = stoul(string(optarg)) * 1000;
+                break;
+            case 'e':
+                if (!parseEstimators(optarg, latencyConfig)) {
+                    cout << "ERROR: Invalid estimators (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                break;
+            case 'R': {
+                string arg = optarg;
+                size_t colon = arg.find(':');
+                if (colon == string::npos || colon + 1 == arg.length() ||
+                        !ParseRollupLevel(arg.substr(0, colon).c_str(), rollupLevel)) {
+                    cout << "ERROR: Invalid rollup log (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                rollupPath = arg.substr(colon + 1);
+                break;
+            }
+            case 'A':
+            case 'a':
+                if (!ParseSummaryAddress(optarg, summaryAddr)) {
+                    cout << "ERROR: Invalid aggregator address (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                sendSummaries = (opt == 'A');
+                aggregate = (opt == 'a');
+                break;
+            case 'n':
+                nodeName = optarg;
+                if (nodeName.empty() || nodeName.length() > SUMMARY_MAX_NAME_LEN) {
+                    cout << "ERROR: Invalid node name (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                break;
+            case 'P':
+                if (!ParseThreadPlacement(optarg, placements)) {
+                    cout << "ERROR: Invalid thread placement (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                break;
+            case 'L':
+                if (!isNumber(optarg) || string(optarg).length() > 6 || stoul(string(optarg)) == 0) {
+                    cout << "ERROR: Invalid number of switches to lock memory for (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                lockedSwitches = stoul(string(optarg));
+                break;
+            case 'N':
+                numaLocal = true;
+                break;
+            case 'v':
+                if (!Diagnostics::parseSeverity(optarg, minSeverity)) {
+                    cout << "ERROR: Invalid diagnostics severity (" << optarg << ")" << endl;
+                    exit(1);
+                }
+                break;
+            case 'k':
+                ofTypeFilter = true;
+                break;
+            case 'K':
+                ofTypeFilter = true;
+                passPureAcks = false;
+                break;
+            default:
+                printUsage(argv[0]);
+                exit(opt == 'h' ? 0 : 1);
+        }
+    }
+
+    // Applied by every thread as it starts
+    for (uint8_t role = 0; role < NUM_THREAD_ROLES; role++)
+        ThreadPlacements::configure((ThreadRole)role, placements[role]);
+    ThreadPlacements::setNumaLocal(numaLocal);
+
+    int numArgs = argc - optind;
+    if (aggregate) {
+        if (numArgs != 0) {
+            cout << "ERROR: The aggregator mode (-a) captures no interfaces" << endl;
             exit(1);
         }
-    } else {
-        iface = argv[1];
-        ofpPort = argv[2];
-
-        // Verify that ofpPort is a number
-        for (uint32_t i = 0; i < ofpPort.length(); i++) {
-            if (!isdigit(ofpPort[i])) {
-                cout << "ERROR: Second parameter is not a number" << endl;
+        return runAggregator(summaryAddr, metricsPort, usr1Set);
+    }
+
+    if (numArgs == 0) {
+        printUsage(argv[0]);
+        exit(0);
+    }
+
+    // <interface name>:<ports> ..., or <interface name> <port>
+    vector<string> ifaces;
+    vector<vector<uint16_t>> ifacePorts;
+    bool legacyArgs = (numArgs == 2 && isNumber(argv[optind + 1]));
+    for (int i = optind; i < (legacyArgs ? optind + 1 : argc); i++) {
+        string arg = argv[i];
+        size_t colon = arg.find(':');
+        string iface = arg.substr(0, colon);
+        vector<uint16_t> ports = defaultPorts;
+
+        if (legacyArgs) {
+            uint16_t port;
+            if (!parsePort(argv[i + 1], port)) {
+                cout << "ERROR: Invalid port number (" << argv[i + 1] << ")" << endl;
                 exit(1);
             }
+            ports.assign(1, port);
+        } else if (colon != string::npos && !parsePortList(arg.substr(colon + 1), ports)) {
+            cout << "ERROR: Invalid OpenFlow port list for " << iface << " (" << arg << ")" << endl;
+            exit(1);
         }
 
-        // Verify ofpPort is a valid port number
-        if (stoul(ofpPort) > 65535) {
-            cout << "ERROR: Invalid port number (" << ofpPort << " > 65535)" << endl;
+        // "any" captures all interfaces (Linux cooked capture)
+        if (iface != "any" && if_nametoindex(iface.c_str()) == 0) {
+            cout << "ERROR: Could not identify interface " << iface << endl;
             exit(1);
         }
+
+        ifaces.push_back(iface);
+        ifacePorts.push_back(ports);
     }
 
-    string filter = "tcp port " + ofpPort;
+    CaptureSources captureSources;
+    if (!captureSources.setDelivery(delivery))
+        exit(1);
+    for (uint32_t i = 0; i < ifaces.size(); i++) {
+        if (!captureSources.add(ifaces[i], ifacePorts[i], bufferSize, ofTypeFilter, passPureAcks))
+            exit(1);
+        cout << "Capturing on " << ifaces[i] << ": " <<
+                CaptureSources::portFilter(ifacePorts[i]) << endl;
+    }
+    sources = &captureSources;
 
-    SnifferConfiguration config;
-    config.set_filter(filter);
-    config.set_promisc_mode(false);
-    config.set_snap_len(MAX_CAP_LEN);
-    config.set_immediate_mode(true);
+    EndpointLatencyMetadata epLatMeta(latencyConfig);
+    std::thread(diagnosticsSignalLoop, usr1Set, std::ref(epLatMeta),
+                std::cref(captureSources)).detach();
 
-    try {
-        sniffer = new Sniffer(iface, config);
-    } catch (const std::exception &ex) {
-        cout << "ERROR: Unable to create new Sniffer object" << endl;
-        cout << ex.what() << endl;
-        exit(1);
+    epLatMeta.diagnostics().setMinSeverity(minSeverity);
+    epLatMeta.governor().setMaxLevel(maxOverloadLevel);
+    epLatMeta.memoryBudget().setBudget(memoryBudget);
+    epLatMeta.diagnostics().startWriter(cout);
+
+    MetricsExporter exporter(epLatMeta.snapshots());
+    if (metricsPort) {
+        epLatMeta.enableSnapshots(METRICS_SNAPSHOT_MS);
+        if (!exporter.start(metricsPort))
+            exit(1);
+        cout << "Serving metrics on http://127.0.0.1:" << metricsPort << "/metrics" << endl;
+    }
+
+    // Warm restart from the last checkpoint, if there is one
+    if (!checkpointPath.empty()) {
+        if (access(checkpointPath.c_str(), F_OK) == 0) {
+            if (epLatMeta.loadCheckpoint(checkpointPath))
+                cout << "Restored " << epLatMeta.getEndpoints().size() << " endpoints from " <<
+                        checkpointPath << endl;
+            else
+                cout << "ERROR: Could not restore " << checkpointPath << ", starting without it" << endl;
+        }
+
+        if (!epLatMeta.enableCheckpoints(checkpointPath, checkpointIntervalMs))
+            exit(1);
+        cout << "Checkpointing to " << checkpointPath << " every " <<
+                checkpointIntervalMs / 1000 << "s" << endl;
+    }
+
+    if (!shmName.empty()) {
+        if (!epLatMeta.openShmTable(shmName, SHM_TABLE_CAPACITY))
+            exit(1);
+        cout << "Publishing statistics to /dev/shm/" << shmName << endl;
+    }
+
+    if (!rollupPath.empty()) {
+        if (!epLatMeta.enableRollups(rollupPath, rollupLevel))
+            exit(1);
+        cout << "Logging " << RollupLevelName(rollupLevel) << " rollups to " << rollupPath << endl;
+    }
+
+    if (sendSummaries) {
+        if (nodeName.empty()) {
+            char hostname[HOST_NAME_MAX + 1] = {0};
+            gethostname(hostname, HOST_NAME_MAX);
+            nodeName = string(hostname) + ":" + std::to_string(getpid());
+        }
+
+        if (!epLatMeta.enableSummaries(summaryAddr, nodeName))
+            exit(1);
+        cout << "Summarizing as node " << nodeName << " for aggregator " <<
+                SummaryAddressToString(summaryAddr) << endl;
+    }
+
+    /* The sniff loop runs on this thread. It is placed after all workers
+     * were started, so they didn't inherit its placement; the tables are
+     * reserved and prefaulted from here, on its NUMA node.
+     */
+    ThreadPlacements::place(THREAD_CAPTURE, "main");
+    if (lockedSwitches) {
+        epLatMeta.reserve(lockedSwitches, lockedSwitches * PLACEMENT_LINKS_PER_SWITCH);
+        ThreadPlacements::lockMemory();
     }
+    ThreadPlacements::dump(cout);
 
-    EndpointLatencyMetadata epLatMeta;
+    StageTimers::setThreadName("main");
 
     try {
-        OFSniffLoop(sniffer, (uint16_t)stoul(ofpPort), epLatMeta);
+        OFSniffMultiLoop(captureSources, epLatMeta);
     } catch (const std::exception &ex) {
-        cout << "ERROR: Unexpected exit of OFSniffLoop" << endl;
+        cout << "ERROR: Unexpected exit of OFSniffMultiLoop" << endl;
         cout << ex.what() << endl;
     }
 
-    if (sniffer)
-        delete sniffer;
+    exporter.stop();
+    epLatMeta.closeCheckpoints();
+    epLatMeta.closeSummaries();
+    epLatMeta.diagnostics().stopWriter();
+    epLatMeta.captureStats().dump(cout);
+    captureSources.dump(cout);
+    epLatMeta.governor().dump(cout);
+    epLatMeta.memoryBudget().dump(cout);
+    if (!checkpointPath.empty())
+        epLatMeta.checkpoints().dump(cout);
+    if (sendSummaries)
+        epLatMeta.summaries().dump(cout);
+    epLatMeta.diagnostics().dump(cout);
 
+    sources = nullptr;
     return 0;
 }
 
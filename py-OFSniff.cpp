@@ -9,16 +9,19 @@
 
 // OpenFlow connection processing
 #include "OFSniff.h"
+#include "CaptureSources.h"
+#include "StageTimers.h"
+#include "ThreadPlacement.h"
 
 using std::cout;
 using std::endl;
 
 using namespace Tins;
 
-#define MAX_CAP_LEN 1500 // Standard Ethernet frame length
 #define STATS_FILELOG false // TODO: Make cmd-line arg
+#define OBS_DRAIN_DEFAULT_MAX 256 // Events returned by one drainObserverEvents() call
 
-/* Class to wrap the thread and sniffer objects.
+/* Class to wrap the thread and capture objects.
  * This class exists simply so we can use the destructor.
  *
  * When the Python interpreter ends and instances go out-of-scope,
@@ -27,132 +30,1375 @@ using namespace Tins;
 class ThreadWrapper {
     public:
         std::thread threadHandle;
-        Sniffer *sniffer;
+        CaptureSources *sources;
 
         ThreadWrapper() {
-            sniffer = nullptr;
+            sources = nullptr;
         };
 
         ~ThreadWrapper() {
-            if (sniffer) {
-                sniffer->stop_sniff();
+            if (sources) {
+                sources->stop();
                 threadHandle.join(); // Or use detach? In case thread doesn't stop...
+                delete sources;
             }
         };
 };
 
 // Global objects and handles
 static ThreadWrapper threadWrap;
-static EndpointLatencyMetadata epLatMeta;
+static RuntimeEndpointLatencyMetadata epLatMeta;
+static uint32_t lockedSwitches = 0; // Switches the tables are reserved and locked for, see setThreadPlacement()
 
-/* Wraps OFSniffLoop to catch any exceptions that may occur.
+/* Wraps OFSniffMultiLoop to catch any exceptions that may occur.
  * This function can run in its own separate thread.
  * Used to either handle the exceptions or print out the error messages, then
  * gracefully exit the loop without crashing the program.
  */
-void OFSniffLoopWrapper(Sniffer*& sniffer, uint16_t ofp_port,
-                        EndpointLatencyMetadata& epLatMeta) {
+void OFSniffLoopWrapper(CaptureSources& sources, RuntimeEndpointLatencyMetadata& epLatMeta) {
+    StageTimers::setThreadName("python-sniff");
+
+    // Tables are reserved and prefaulted from the sniff thread, on its NUMA node
+    ThreadPlacements::place(THREAD_CAPTURE, "python-sniff");
+    if (lockedSwitches) {
+        epLatMeta.reserve(lockedSwitches, lockedSwitches * PLACEMENT_LINKS_PER_SWITCH);
+        ThreadPlacements::lockMemory();
+    }
+    ThreadPlacements::dump(cout);
+
     try {
-        OFSniffLoop(sniffer, ofp_port, epLatMeta);
+        OFSniffMultiLoop(sources, epLatMeta);
     } catch (const std::exception &ex) {
         // General exception handler for now, until we know of specific cases
-        cout << "ERROR: Unexpected exit of OFSniffLoop" << endl;
+        cout << "ERROR: Unexpected exit of OFSniffMultiLoop" << endl;
         cout << ex.what() << endl;
     }
 
-    return;
+    return;
+}
+
+/* Parses argument for "endpoint" keyword
+ * Writes parsed value to the "endpoint" output argument
+ *
+ * Returns true upon success, or false upon failure
+ */
+bool parseEndpointFromArgs(PyObject *args, PyObject *keywords, IPv4EndpointType& endpoint) {
+    static char *kwlist[] = {(char*)"endpoint", NULL};
+
+    // "K" = unsigned long long (aka uint64_t)
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "K", kwlist, &endpoint))
+        return false;
+
+    return true;
+}
+
+
+/* ========== EXPOSED MODULE METHODS ========== */
+
+static PyObject* _OFSniff_isSniffing(PyObject *self, PyObject *args) {
+    if (threadWrap.sources)
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+/* Opens the capture and starts sniffing
+ * Only starts sniff loop if there's no current capture
+ *
+ * delivery_timeout_ms > 0 selects batched delivery (see CaptureDelivery in
+ * include/CaptureSources.h), processing up to batch_size packets at a time
+ */
+static PyObject* _OFSniff_startSniffLoop(PyObject *self, PyObject *args, PyObject *keywords) {
+    if ( !threadWrap.sources ) {
+        char* iface = NULL;
+        uint16_t ofp_port = 0;
+        unsigned int buffer_size = 0;
+        PyObject* of_type_filter = NULL;
+        PyObject* pass_pure_acks = NULL;
+        unsigned int delivery_timeout_ms = 0;
+        unsigned int batch_size = 0;
+
+        static char *kwlist[] = {(char*)"iface", (char*)"ofp_port", (char*)"buffer_size",
+                                    (char*)"of_type_filter", (char*)"pass_pure_acks",
+                                    (char*)"delivery_timeout_ms", (char*)"batch_size", NULL};
+
+        // "s" = char * (NULL-terminated C-string)
+        // "H" = unsigned short (aka uint16_t)
+        // "I" = unsigned int
+        // "O" = PyObject*
+        if (!PyArg_ParseTupleAndKeywords(args, keywords, "sH|IOOII", kwlist, &iface, &ofp_port,
+                                            &buffer_size, &of_type_filter, &pass_pure_acks,
+                                            &delivery_timeout_ms, &batch_size)) {
+            cout << "ERROR: Unable to parse input parameters" << endl;
+            Py_RETURN_FALSE;
+        }
+
+        CaptureDelivery delivery = CAPTURE_DELIVERY_IMMEDIATE;
+        if (delivery_timeout_ms) {
+            delivery = CAPTURE_DELIVERY_BATCHED;
+            delivery.timeoutMs = delivery_timeout_ms;
+        }
+        if (batch_size)
+            delivery.batchSize = batch_size;
+
+        bool ofTypeFilter = of_type_filter && PyObject_IsTrue(of_type_filter);
+        bool passPureAcks = !pass_pure_acks || PyObject_IsTrue(pass_pure_acks);
+
+        // Falls back to the plain port filter if the type filter isn't supported
+        CaptureSources* sources = new CaptureSources();
+        if (!sources->setDelivery(delivery) ||
+                !sources->add(iface, vector<uint16_t>(1, ofp_port), buffer_size,
+                                ofTypeFilter, passPureAcks)) {
+            cout << "ERROR in _OFSniff_startSniffLoop: Unable to open capture" << endl;
+            delete sources;
+            Py_RETURN_FALSE;
+        }
+
+        epLatMeta.diagnostics().startWriter(cout);
+        try {
+            threadWrap.threadHandle = std::thread(OFSniffLoopWrapper, std::ref(*sources),
+                                                    std::ref(epLatMeta));
+        } catch (const std::exception &ex) {
+            cout << "ERROR in _OFSniff_startSniffLoop: Thread creation failed" << endl;
+            cout << ex.what() << endl;
+            delete sources;
+            Py_RETURN_FALSE;
+        }
+
+        threadWrap.sources = sources;
+    } else {
+        cout << "ERROR: Sniffing already started. Stop the current sniff loop first if changing sniffing parameters." << endl;
+        Py_RETURN_FALSE;
+    }
+
+    Py_RETURN_TRUE;
+}
+
+static PyObject* _OFSniff_stopSniffLoop(PyObject *self, PyObject *args) {
+    if (threadWrap.sources) {
+        threadWrap.sources->stop();
+        threadWrap.threadHandle.join(); // Or use detach? In case the thread doesn't end...
+        epLatMeta.diagnostics().stopWriter();
+        epLatMeta.writeCheckpoint(Timestamp::current_time()); // If enabled
+
+        delete threadWrap.sources;
+        threadWrap.sources = nullptr;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/* Takes up to five parameters:
+ *  - iface: string
+ *              Interface to capture ("any" for all)
+ *  - ofp_ports: list of unsigned short values
+ *              OpenFlow ports to capture on it
+ *  - buffer_size, of_type_filter, pass_pure_acks: optional, as in startSniffLoop()
+ *
+ * Adds a capture source to the running sniff loop, or replaces the one of
+ * iface (e.g. to change its ports, and so its filter). The new capture
+ * takes over from the old one without losing or repeating packets, and all
+ * latency state is kept; see CaptureSources in include/CaptureSources.h.
+ */
+static PyObject* _OFSniff_setCaptureSource(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (!threadWrap.sources) {
+        cout << "ERROR: No sniff loop started" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    char* iface = NULL;
+    PyObject* ofp_ports = NULL;
+    unsigned int buffer_size = 0;
+    PyObject* of_type_filter = NULL;
+    PyObject* pass_pure_acks = NULL;
+
+    static char *kwlist[] = {(char*)"iface", (char*)"ofp_ports", (char*)"buffer_size",
+                                (char*)"of_type_filter", (char*)"pass_pure_acks", NULL};
+
+    // "s" = char * (NULL-terminated C-string)
+    // "O" = PyObject*
+    // "I" = unsigned int
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "sO|IOO", kwlist, &iface, &ofp_ports,
+                                        &buffer_size, &of_type_filter, &pass_pure_acks)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    PyObject* seq = PySequence_Fast(ofp_ports, "ofp_ports must be a list");
+    if (seq == NULL) {
+        PyErr_Clear();
+        cout << "ERROR: ofp_ports must be a list of ports" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    vector<uint16_t> ports;
+    for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+        long port = PyInt_AsLong(PySequence_Fast_GET_ITEM(seq, i));
+        if (port <= 0 || port > UINT16_MAX) {
+            PyErr_Clear();
+            Py_DECREF(seq);
+            cout << "ERROR: Invalid OpenFlow port" << endl;
+            Py_RETURN_FALSE;
+        }
+        ports.push_back(port);
+    }
+    Py_DECREF(seq);
+
+    bool ofTypeFilter = of_type_filter && PyObject_IsTrue(of_type_filter);
+    bool passPureAcks = !pass_pure_acks || PyObject_IsTrue(pass_pure_acks);
+
+    if (threadWrap.sources->update(iface, ports, buffer_size, ofTypeFilter, passPureAcks))
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+/* Takes one parameter:
+ *  - iface: string
+ *              Interface to stop capturing
+ *
+ * Removes a capture source from the running sniff loop, once everything it
+ * captured so far is processed
+ */
+static PyObject* _OFSniff_removeCaptureSource(PyObject *self, PyObject *args) {
+    if (!threadWrap.sources) {
+        cout << "ERROR: No sniff loop started" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    char* iface = NULL;
+
+    // "s" = char * (NULL-terminated C-string)
+    if (!PyArg_ParseTuple(args, "s", &iface)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    if (threadWrap.sources->remove(iface))
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+/* Takes up to two parameters (both optional):
+ *  - delivery_timeout_ms, batch_size: unsigned int values
+ *              As in startSniffLoop()
+ *
+ * Changes the delivery of the running sniff loop, by replacing all capture
+ * sources as setCaptureSource() does
+ */
+static PyObject* _OFSniff_setDelivery(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (!threadWrap.sources) {
+        cout << "ERROR: No sniff loop started" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    unsigned int delivery_timeout_ms = 0;
+    unsigned int batch_size = 0;
+
+    static char *kwlist[] = {(char*)"delivery_timeout_ms", (char*)"batch_size", NULL};
+
+    // "I" = unsigned int
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "|II", kwlist, &delivery_timeout_ms,
+                                        &batch_size)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    CaptureDelivery delivery = CAPTURE_DELIVERY_IMMEDIATE;
+    if (delivery_timeout_ms) {
+        delivery = CAPTURE_DELIVERY_BATCHED;
+        delivery.timeoutMs = delivery_timeout_ms;
+    }
+    if (batch_size)
+        delivery.batchSize = batch_size;
+
+    if (threadWrap.sources->updateDelivery(delivery))
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+/* Returns a list of (iface, [ofp_port]) tuples, one per capture source of
+ * the running sniff loop; changes not handed over yet aren't included
+ */
+static PyObject* _OFSniff_getCaptureSources(PyObject *self, PyObject *args) {
+    PyObject* pyList = PyList_New(0);
+    if (pyList == NULL || !threadWrap.sources)
+        return pyList;
+
+    for (auto& source : threadWrap.sources->list()) {
+        PyObject* pyPorts = PyList_New(0);
+        for (uint16_t port : source.second) {
+            PyObject* pyPort = Py_BuildValue("H", port);
+            PyList_Append(pyPorts, pyPort);
+            Py_XDECREF(pyPort);
+        }
+
+        // "s" = char *, "N" = PyObject* (reference stolen)
+        PyObject* pySource = Py_BuildValue("(sN)", source.first.c_str(), pyPorts);
+        if (pySource == NULL || PyList_Append(pyList, pySource) != 0) {
+            cout << "ERROR in _OFSniff_getCaptureSources: Unable to append " <<
+                source.first << " to Python List" << endl;
+        }
+        Py_XDECREF(pySource);
+    }
+
+    return pyList;
+}
+
+/* Takes up to two parameters:
+ *  - name: string
+ *              Name of the shared-memory region (created as /dev/shm/<name>)
+ *  - capacity: unsigned int value (optional)
+ *              Maximum number of records, rounded up to a power of 2
+ *
+ * Must be called before startSniffLoop()
+ */
+static PyObject* _OFSniff_openShmTable(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (threadWrap.sources) {
+        cout << "ERROR: Stop the current sniff loop before opening the shared memory table" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    char* name = NULL;
+    unsigned int capacity = 4096;
+
+    static char *kwlist[] = {(char*)"name", (char*)"capacity", NULL};
+
+    // "s" = char * (NULL-terminated C-string)
+    // "I" = unsigned int
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "s|I", kwlist, &name, &capacity)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    if (epLatMeta.openShmTable(name, capacity))
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+/* Takes up to four parameters (all optional):
+ *  - capture: string
+ *              Placement of the sniff thread, "[<cpus>][@<policy>]" with CPUs
+ *              as "0-3,6" and policy "fifo:<priority>" or "other[:<nice>]"
+ *  - worker: string
+ *              Placement of all other threads of the module, as 'capture'
+ *  - lock_switches: unsigned int value
+ *              If not 0, reserve the statistics tables for that many switches,
+ *              and prefault and lock all memory of the process
+ *  - numa_local: boolean
+ *              Allocate the sniff thread's memory on the NUMA node of its first CPU
+ *
+ * Empty placements are inherited (the Python interpreter's threads are left
+ * alone). The placement in effect is printed when the sniff loop starts.
+ * Must be called before startSniffLoop()
+ */
+static PyObject* _OFSniff_setThreadPlacement(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (threadWrap.sources) {
+        cout << "ERROR: Stop the current sniff loop before placing its threads" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    char* capture = NULL;
+    char* worker = NULL;
+    unsigned int lock_switches = 0;
+    PyObject* numa_local = NULL;
+
+    static char *kwlist[] = {(char*)"capture", (char*)"worker", (char*)"lock_switches",
+                                (char*)"numa_local", NULL};
+
+    // "s" = char * (NULL-terminated C-string)
+    // "I" = unsigned int
+    // "O" = PyObject*
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "|ssIO", kwlist, &capture, &worker,
+                                        &lock_switches, &numa_local)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    ThreadPlacement placements[NUM_THREAD_ROLES] = {THREAD_PLACEMENT_INHERITED,
+                                                    THREAD_PLACEMENT_INHERITED};
+    if ((capture && capture[0] && !ParseThreadPlacement(string("capture=") + capture, placements)) ||
+            (worker && worker[0] && !ParseThreadPlacement(string("worker=") + worker, placements))) {
+        cout << "ERROR: Invalid thread placement" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    for (uint8_t role = 0; role < NUM_THREAD_ROLES; role++)
+        ThreadPlacements::configure((ThreadRole)role, placements[role]);
+    ThreadPlacements::setNumaLocal(numa_local && PyObject_IsTrue(numa_local));
+    lockedSwitches = lock_switches;
+
+    Py_RETURN_TRUE;
+}
+
+/* Takes up to two parameters:
+ *  - path: string
+ *              Checkpoint file, replaced atomically on every checkpoint
+ *  - interval_ms: unsigned int value (optional)
+ *              Minimum time between checkpoints, in packet time
+ *
+ * A checkpoint is also written when the sniff loop is stopped.
+ * Must be called before startSniffLoop()
+ */
+static PyObject* _OFSniff_enableCheckpoints(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (threadWrap.sources) {
+        cout << "ERROR: Stop the current sniff loop before enabling checkpoints" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    char* path = NULL;
+    unsigned int intervalMs = CHECKPOINT_INTERVAL_MS;
+
+    static char *kwlist[] = {(char*)"path", (char*)"interval_ms", NULL};
+
+    // "s" = char * (NULL-terminated C-string)
+    // "I" = unsigned int
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "s|I", kwlist, &path, &intervalMs)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    if (epLatMeta.enableCheckpoints(path, intervalMs))
+        Py_RETURN_TRUE;
+
+    cout << "ERROR: Checkpoints are already enabled" << endl;
+    Py_RETURN_FALSE;
+}
+
+/* Takes one parameter:
+ *  - path: string
+ *              Checkpoint file written by an earlier run
+ *
+ * Restores windows, link estimators and endpoints, so statistics continue
+ * where the earlier run left off.
+ * Must be called before startSniffLoop(), and before any switch was seen
+ */
+static PyObject* _OFSniff_loadCheckpoint(PyObject *self, PyObject *args) {
+    if (threadWrap.sources) {
+        cout << "ERROR: Stop the current sniff loop before loading a checkpoint" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    char* path = NULL;
+
+    // "s" = char * (NULL-terminated C-string)
+    if (!PyArg_ParseTuple(args, "s", &path)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    if (epLatMeta.loadCheckpoint(path))
+        Py_RETURN_TRUE;
+    else
+        Py_RETURN_FALSE;
+}
+
+/* Takes up to seven parameters (all optional, default: current value):
+ *  - echo_rtt_window: unsigned short value
+ *              Samples in the echo RTT window (at least 2)
+ *  - pktin_rtt_window: unsigned short value
+ *              Samples in the PacketIn RTT window (at least 2)
+ *  - link_lat_window: unsigned short value
+ *              Smoothed estimates in each link latency window (at least 2)
+ *  - max_outstanding_pkts: unsigned short value
+ *              Outstanding LLDP probe IDs kept per port
+ *  - echo_rtt_estimator, pktin_rtt_estimator, link_lat_estimator: string
+ *              Estimator of each metric's smoothed value: "ema", "dema",
+ *              "adaptive", "kalman" or "trimmed_mean"
+ *
+ * Once switches were seen (e.g. while the sniff loop runs), the windows and
+ * the probe limit are changed in place, keeping the newest samples, and
+ * the estimators can't be changed; see BasicEndpointLatencyMetadata::reconfigure()
+ */
+static PyObject* _OFSniff_setLatencyConfig(PyObject *self, PyObject *args, PyObject *keywords) {
+    LatencyConfig config = epLatMeta.config();
+    char* estimatorNames[3] = {NULL, NULL, NULL};
+    uint8_t* estimators[3] = {&config.echoRTTEstimator, &config.pktInRTTEstimator,
+                                &config.linkLatEstimator};
+
+    static char *kwlist[] = {(char*)"echo_rtt_window", (char*)"pktin_rtt_window",
+                                (char*)"link_lat_window", (char*)"max_outstanding_pkts",
+                                (char*)"echo_rtt_estimator", (char*)"pktin_rtt_estimator",
+                                (char*)"link_lat_estimator", NULL};
+
+    // "H" = unsigned short
+    // "s" = char * (NULL-terminated C-string)
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "|HHHHsss", kwlist, &config.echoRTTWindow,
+                                        &config.pktInRTTWindow, &config.linkLatWindow,
+                                        &config.maxOutstandingPkts, &estimatorNames[0],
+                                        &estimatorNames[1], &estimatorNames[2])) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    for (uint8_t i = 0; i < 3; i++) {
+        EstimatorKind kind;
+        if (!estimatorNames[i])
+            continue;
+        if (!ParseEstimatorKind(estimatorNames[i], kind)) {
+            cout << "ERROR: Unknown estimator (" << estimatorNames[i] << ")" << endl;
+            Py_RETURN_FALSE;
+        }
+        *estimators[i] = kind;
+    }
+
+    if (!threadWrap.sources && epLatMeta.configure(config))
+        Py_RETURN_TRUE;
+
+    // The sniff loop applies it before its next packet, or it's applied here if stopped
+    if (epLatMeta.reconfigure(config)) {
+        if (!threadWrap.sources)
+            epLatMeta.applyReconfiguration();
+        Py_RETURN_TRUE;
+    }
+
+    cout << "ERROR: Invalid latency configuration" << endl;
+    Py_RETURN_FALSE;
+}
+
+/* Returns a dict:
+ *  {"echo_rtt_window": int, "pktin_rtt_window": int,
+ *   "link_lat_window": int, "max_outstanding_pkts": int,
+ *   "echo_rtt_estimator": str, "pktin_rtt_estimator": str,
+ *   "link_lat_estimator": str}
+ */
+static PyObject* _OFSniff_getLatencyConfig(PyObject *self, PyObject *args) {
+    const LatencyConfig& config = epLatMeta.config();
+    return Py_BuildValue("{s:H,s:H,s:H,s:H,s:s,s:s,s:s}",
+                            "echo_rtt_window", config.echoRTTWindow,
+                            "pktin_rtt_window", config.pktInRTTWindow,
+                            "link_lat_window", config.linkLatWindow,
+                            "max_outstanding_pkts", config.maxOutstandingPkts,
+                            "echo_rtt_estimator", EstimatorName((EstimatorKind)config.echoRTTEstimator),
+                            "pktin_rtt_estimator", EstimatorName((EstimatorKind)config.pktInRTTEstimator),
+                            "link_lat_estimator", EstimatorName((EstimatorKind)config.linkLatEstimator));
+}
+
+/* Returns a list of dicts, one per (thread, stage) that recorded anything:
+ *  {"thread": str, "stage": str, "count": int, "mean_us": float,
+ *   "max_us": float, "hist": [int] * STAGE_HIST_BUCKETS}
+ * Histogram bucket i counts durations in [2^i, 2^(i+1)) cycles, convert with
+ * getStageCyclesPerUs(). Returns an empty list if timers were compiled out.
+ */
+static PyObject* _OFSniff_getStageTimers(PyObject *self, PyObject *args) {
+    PyObject* pyList = PyList_New(0);
+    if (pyList == NULL)
+        return NULL;
+
+    double rate = StageTimers::cyclesPerUs();
+    for (const StageStatsCopy& c : StageTimers::collect()) {
+        PyObject* pyHist = PyList_New(STAGE_HIST_BUCKETS);
+        for (uint16_t b = 0; b < STAGE_HIST_BUCKETS; b++)
+            PyList_SET_ITEM(pyHist, b, Py_BuildValue("K", c.hist[b]));
+
+        // "N" = PyObject*, reference is stolen
+        PyObject* pyDict = Py_BuildValue("{s:s,s:s,s:K,s:d,s:d,s:N}",
+                                "thread", c.threadName.c_str(),
+                                "stage", StageTimers::stageName(c.stage),
+                                "count", c.count,
+                                "mean_us", c.totalCycles / rate / c.count,
+                                "max_us", c.maxCycles / rate,
+                                "hist", pyHist);
+        if (pyDict == NULL || PyList_Append(pyList, pyDict) != 0)
+            cout << "ERROR in _OFSniff_getStageTimers: Unable to append stage to Python List" << endl;
+        Py_XDECREF(pyDict);
+    }
+
+    return pyList;
+}
+
+static PyObject* _OFSniff_getStageCyclesPerUs(PyObject *self, PyObject *args) {
+    return Py_BuildValue("d", StageTimers::cyclesPerUs());
+}
+
+// Converts a CaptureInterval to a new Python dict
+static PyObject* captureInterval2Dict(const CaptureInterval& interval) {
+    return Py_BuildValue("{s:d,s:d,s:K,s:K,s:K,s:K,s:K}",
+                "ts", interval.ts.seconds() + interval.ts.microseconds() / (double)MILLION,
+                "duration_ms", interval.durationMs,
+                "recv", interval.recv,
+                "drop", interval.drop,
+                "if_drop", interval.ifDrop,
+                "probes_matched", interval.probesMatched,
+                "probes_expired", interval.probesExpired);
+}
+
+// Converts DeliveryStats to a new Python dict
+static PyObject* deliveryStats2Dict(const DeliveryStats& delivery) {
+    double delayMean = delivery.delayMs.count ? delivery.delayMs.sum / delivery.delayMs.count : 0;
+    return Py_BuildValue("{s:K,s:K,s:d,s:d,s:d,s:d}",
+                "batches", delivery.wakeups,
+                "packets", delivery.packets,
+                "delay_mean_ms", delayMean,
+                "delay_max_ms", delivery.maxDelayMs,
+                "cpu_ms", delivery.cpuMs,
+                "wall_ms", delivery.wallMs);
+}
+
+/* Returns a dict of kernel capture counters and probe losses since the
+ * sniff loop started, with an additional "history" key holding a list of
+ * the same dicts for each recent collection interval (oldest first), and
+ * a "delivery" key holding the delivery delay and sniff loop CPU time
+ */
+static PyObject* _OFSniff_getCaptureStats(PyObject *self, PyObject *args) {
+    PyObject* pyDict = captureInterval2Dict(epLatMeta.captureStats().getTotals());
+    if (pyDict == NULL)
+        return NULL;
+
+    PyObject* pyList = PyList_New(0);
+    if (pyList != NULL) {
+        for (const CaptureInterval& interval : epLatMeta.captureStats().getHistory()) {
+            PyObject* pyInterval = captureInterval2Dict(interval);
+            if (pyInterval == NULL || PyList_Append(pyList, pyInterval) != 0)
+                cout << "ERROR in _OFSniff_getCaptureStats: Unable to append interval to Python List" << endl;
+            Py_XDECREF(pyInterval);
+        }
+        PyDict_SetItemString(pyDict, "history", pyList);
+        Py_DECREF(pyList);
+    }
+
+    PyObject* pyDelivery = deliveryStats2Dict(epLatMeta.captureStats().getDelivery());
+    if (pyDelivery != NULL) {
+        PyDict_SetItemString(pyDict, "delivery", pyDelivery);
+        Py_DECREF(pyDelivery);
+    }
+
+    return pyDict;
+}
+
+/* Takes up to three parameters:
+ *  - min_severity: string (optional)
+ *              "debug", "info", "warning" or "error"; messages below it are only counted
+ *  - rate: double (optional)
+ *              Diagnostic messages per second written for each reason
+ *  - burst: double (optional)
+ *              Messages per reason that may be written back-to-back
+ */
+static PyObject* _OFSniff_setDiagnostics(PyObject *self, PyObject *args, PyObject *keywords) {
+    char* min_severity = NULL;
+    double rate = DIAG_DEFAULT_RATE;
+    double burst = DIAG_DEFAULT_BURST;
+
+    static char *kwlist[] = {(char*)"min_severity", (char*)"rate", (char*)"burst", NULL};
+
+    // "s" = char * (NULL-terminated C-string)
+    // "d" = double
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "|sdd", kwlist, &min_severity, &rate, &burst)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    DiagSeverity severity = epLatMeta.diagnostics().getMinSeverity();
+    if (min_severity && !Diagnostics::parseSeverity(min_severity, severity)) {
+        cout << "ERROR: Invalid diagnostics severity (" << min_severity << ")" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    epLatMeta.diagnostics().setMinSeverity(severity);
+    epLatMeta.diagnostics().setRateLimit(rate, burst);
+    Py_RETURN_TRUE;
+}
+
+/* Takes one parameter:
+ *  - max_level: unsigned char value
+ *              Highest level of the overload governor (0 - 5), 0 disables it
+ */
+static PyObject* _OFSniff_setOverloadLevel(PyObject *self, PyObject *args) {
+    unsigned char max_level = 0;
+
+    // "b" = unsigned char
+    if (!PyArg_ParseTuple(args, "b", &max_level) || max_level > OVERLOAD_MAX_LEVEL) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    epLatMeta.governor().setMaxLevel(max_level);
+    Py_RETURN_TRUE;
+}
+
+/* Returns a dict of the overload governor's state: level, max_level,
+ * sample_rate (share of probes processed), raised, lowered, shed_messages
+ * and skipped_probes
+ */
+static PyObject* _OFSniff_getOverloadState(PyObject *self, PyObject *args) {
+    OverloadState state = epLatMeta.governor().state();
+
+    return Py_BuildValue("{s:B,s:B,s:d,s:K,s:K,s:K,s:K}",
+                "level", state.level,
+                "max_level", state.maxLevel,
+                "sample_rate", state.sampleRate,
+                "raised", state.raised,
+                "lowered", state.lowered,
+                "shed_messages", state.shedMessages,
+                "skipped_probes", state.skippedProbes);
+}
+
+/* Takes up to four parameters (all optional, default True):
+ *  - samples: bool
+ *              Queue an event for every new latency sample
+ *  - thresholds: bool
+ *              Queue an event when samples cross their metric's threshold
+ *  - endpoints: bool
+ *              Queue an event when a switch connection comes up or goes down
+ *  - changes: bool
+ *              Queue an event when a metric's level changes (see
+ *              setChangeSensitivity())
+ *
+ * Returns a file descriptor (eventfd) that is readable while events are
+ * queued, e.g. for asyncio's loop.add_reader(), or -1 on error
+ */
+static PyObject* _OFSniff_enableObserverEvents(PyObject *self, PyObject *args, PyObject *keywords) {
+    PyObject* samples = NULL;
+    PyObject* thresholds = NULL;
+    PyObject* endpoints = NULL;
+    PyObject* changes = NULL;
+
+    static char *kwlist[] = {(char*)"samples", (char*)"thresholds", (char*)"endpoints",
+                                (char*)"changes", NULL};
+
+    // "O" = PyObject*
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "|OOOO", kwlist, &samples,
+                                        &thresholds, &endpoints, &changes)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        return Py_BuildValue("i", -1);
+    }
+
+    uint32_t typeMask = 0;
+    if (!samples || PyObject_IsTrue(samples))
+        typeMask |= OBS_EVENT_BIT(OBS_EVENT_SAMPLE);
+    if (!thresholds || PyObject_IsTrue(thresholds))
+        typeMask |= OBS_EVENT_BIT(OBS_EVENT_THRESHOLD);
+    if (!endpoints || PyObject_IsTrue(endpoints))
+        typeMask |= OBS_EVENT_BIT(OBS_EVENT_ENDPOINT_UP) | OBS_EVENT_BIT(OBS_EVENT_ENDPOINT_DOWN);
+    if (!changes || PyObject_IsTrue(changes))
+        typeMask |= OBS_EVENT_BIT(OBS_EVENT_CHANGE);
+
+    return Py_BuildValue("i", epLatMeta.observers().enablePolling(typeMask));
+}
+
+static PyObject* _OFSniff_disableObserverEvents(PyObject *self, PyObject *args) {
+    epLatMeta.observers().disablePolling();
+    Py_RETURN_NONE;
+}
+
+/* Takes one parameter:
+ *  - max_events: unsigned int (optional)
+ *              Maximum number of events returned
+ *
+ * Returns a list of (type, metric, endpoint, port_no, value, threshold,
+ * above, ts_us) tuples, oldest first, and resets the file descriptor (it
+ * stays readable if events remain). For "change" events, value is the new
+ * level, threshold the previous one and above is True if the level went up.
+ */
+static PyObject* _OFSniff_drainObserverEvents(PyObject *self, PyObject *args, PyObject *keywords) {
+    unsigned int max_events = OBS_DRAIN_DEFAULT_MAX;
+
+    static char *kwlist[] = {(char*)"max_events", NULL};
+
+    // "I" = unsigned int
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "|I", kwlist, &max_events)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_NONE;
+    }
+
+    vector<ObserverEvent> events(max_events);
+    uint32_t numEvents = epLatMeta.observers().drain(events.data(), max_events);
+
+    PyObject* pyList = PyList_New(numEvents);
+    if (pyList == NULL)
+        return NULL;
+
+    for (uint32_t i = 0; i < numEvents; i++) {
+        const ObserverEvent& event = events[i];
+        PyObject* pyTuple = Py_BuildValue("(ssKHddOK)",
+                                Observers::typeName((ObserverEventType)event.type),
+                                Observers::metricName((ObserverMetric)event.metric),
+                                event.endpoint, event.port_no, event.value, event.threshold,
+                                event.above ? Py_True : Py_False, event.tsUs);
+        if (pyTuple == NULL) {
+            Py_DECREF(pyList);
+            return NULL;
+        }
+        PyList_SET_ITEM(pyList, i, pyTuple); // Steals the reference
+    }
+
+    return pyList;
+}
+
+/* Takes two parameters:
+ *  - metric: string
+ *              "echo_rtt", "pktin_rtt", "link_latency", "tcp_rtt_to_switch"
+ *              or "tcp_rtt_from_switch"
+ *  - threshold: double
+ *              Threshold (ms) whose crossing queues an event, <= 0 disables it
+ */
+static PyObject* _OFSniff_setObserverThreshold(PyObject *self, PyObject *args, PyObject *keywords) {
+    char* metricName = NULL;
+    double threshold = 0;
+
+    static char *kwlist[] = {(char*)"metric", (char*)"threshold", NULL};
+
+    // "s" = char * (NULL-terminated C-string)
+    // "d" = double
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "sd", kwlist, &metricName, &threshold)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    ObserverMetric metric;
+    if (!Observers::parseMetric(metricName, metric)) {
+        cout << "ERROR: Invalid observer metric (" << metricName << ")" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    epLatMeta.observers().setThreshold(metric, threshold);
+    Py_RETURN_TRUE;
+}
+
+/* Takes three parameters:
+ *  - metric: string
+ *              "echo_rtt", "pktin_rtt" or "link_latency"
+ *  - cusum: double
+ *              CUSUM decision threshold, in sigmas of the metric's baseline
+ *  - ewma: double
+ *              EWMA control limit, in sigmas of the EWMA
+ *
+ * Lower is more sensitive, 0 disables a detector (both 0 disables change
+ * detection of the metric)
+ */
+static PyObject* _OFSniff_setChangeSensitivity(PyObject *self, PyObject *args, PyObject *keywords) {
+    char* metricName = NULL;
+    ChangeSensitivity sens = {CHANGE_DEFAULT_CUSUM, CHANGE_DEFAULT_EWMA};
+
+    static char *kwlist[] = {(char*)"metric", (char*)"cusum", (char*)"ewma", NULL};
+
+    // "s" = char * (NULL-terminated C-string)
+    // "d" = double
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "sdd", kwlist, &metricName,
+                                        &sens.cusum, &sens.ewma)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    ObserverMetric metric;
+    if (!Observers::parseMetric(metricName, metric) ||
+            !epLatMeta.observers().setChangeSensitivity(metric, sens)) {
+        cout << "ERROR: Changes of " << metricName << " aren't detected" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    Py_RETURN_TRUE;
 }
 
-/* Parses argument for "endpoint" keyword
- * Writes parsed value to the "endpoint" output argument
+/* Takes one parameter:
+ *  - metric: string
+ *              "echo_rtt", "pktin_rtt" or "link_latency"
  *
- * Returns true upon success, or false upon failure
+ * Returns a (cusum, ewma) tuple, or None if changes of the metric aren't detected
  */
-bool parseEndpointFromArgs(PyObject *args, PyObject *keywords, IPv4EndpointType& endpoint) {
-    static char *kwlist[] = {(char*)"endpoint", NULL};
+static PyObject* _OFSniff_getChangeSensitivity(PyObject *self, PyObject *args) {
+    char* metricName = NULL;
 
-    // "K" = unsigned long long (aka uint64_t)
-    if (!PyArg_ParseTupleAndKeywords(args, keywords, "K", kwlist, &endpoint))
-        return false;
+    // "s" = char * (NULL-terminated C-string)
+    if (!PyArg_ParseTuple(args, "s", &metricName)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_NONE;
+    }
 
-    return true;
+    ObserverMetric metric;
+    if (!Observers::parseMetric(metricName, metric) || !Observers::detectsChanges(metric))
+        Py_RETURN_NONE;
+
+    ChangeSensitivity sens = epLatMeta.observers().changeSensitivity(metric);
+    return Py_BuildValue("(dd)", sens.cusum, sens.ewma);
 }
 
+/* Takes up to two parameters (both optional):
+ *  - log_path: string
+ *              File a line is appended to for every closed interval of every
+ *              stream, at the log_level resolution (no log if empty)
+ *  - log_level: string
+ *              "1s", "1min" (default) or "1h"
+ *
+ * Keeps 1s, 1min and 1h rollups of the echo RTT, PacketIn RTT and link
+ * latency samples, see getRollups()
+ * Must be called before startSniffLoop()
+ */
+static PyObject* _OFSniff_enableRollups(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (threadWrap.sources) {
+        cout << "ERROR: Stop the current sniff loop before enabling rollups" << endl;
+        Py_RETURN_FALSE;
+    }
 
-/* ========== EXPOSED MODULE METHODS ========== */
+    char* log_path = NULL;
+    char* log_level = NULL;
 
-static PyObject* _OFSniff_isSniffing(PyObject *self, PyObject *args) {
-    if (threadWrap.sniffer)
+    static char *kwlist[] = {(char*)"log_path", (char*)"log_level", NULL};
+
+    // "s" = char * (NULL-terminated C-string)
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "|ss", kwlist, &log_path, &log_level)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_FALSE;
+    }
+
+    RollupLevel level = ROLLUP_MINUTE;
+    if (log_level && !ParseRollupLevel(log_level, level)) {
+        cout << "ERROR: Unknown rollup level " << log_level << endl;
+        Py_RETURN_FALSE;
+    }
+
+    if (epLatMeta.enableRollups(log_path ? log_path : "", level))
         Py_RETURN_TRUE;
     else
         Py_RETURN_FALSE;
 }
 
-/* Creates new Sniffer and starts sniffing
- * Only starts sniff loop if there's no current sniffer
+// Builds an array.array of 'typecode' from contiguous values
+static PyObject* buildArray(const char* typecode, const void* data, const size_t bytes) {
+    PyObject* arrayModule = PyImport_ImportModule("array");
+    if (arrayModule == NULL)
+        return NULL;
+
+    // "s#" = char * and its length (machine values, as array.fromstring())
+    PyObject* pyArray = PyObject_CallMethod(arrayModule, (char*)"array", (char*)"ss#", typecode,
+                                            (const char*)data, (int)bytes);
+    Py_DECREF(arrayModule);
+    return pyArray;
+}
+
+/* Takes up to six parameters:
+ *  - endpoint: unsigned long long value
+ *              Representing an endpoint, likely retrieved from getEndpoints()
+ *  - metric: string
+ *              "echo_rtt", "pktin_rtt" or "link_latency"
+ *  - level: string (optional)
+ *              "1s" (default), "1min" or "1h"
+ *  - from_s, to_s: unsigned long long values (optional)
+ *              Intervals starting in [from_s, to_s), packet time in seconds
+ *              since the epoch (default: all that are kept)
+ *  - port_no: unsigned short value (optional)
+ *              Port of the link, for "link_latency"
+ *
+ * Returns a dict with "start" (first interval, seconds since the epoch) and
+ * "resolution" (seconds), and "count" (array.array of 'I'), "min", "max",
+ * "mean", "p50", "p90" and "p99" (array.array of 'f', ms) with one entry per
+ * interval; intervals without samples have a count of 0 and NaN statistics.
+ * Returns None if rollups aren't enabled or the stream wasn't seen yet.
  */
-static PyObject* _OFSniff_startSniffLoop(PyObject *self, PyObject *args, PyObject *keywords) {
-    if ( !threadWrap.sniffer ) {
-        char* iface = NULL;
-        uint16_t ofp_port = 0;
+static PyObject* _OFSniff_getRollups(PyObject *self, PyObject *args, PyObject *keywords) {
+    IPv4EndpointType endpoint = 0;
+    char* metricName = NULL;
+    char* levelName = NULL;
+    unsigned long long from_s = 0;
+    unsigned long long to_s = 0;
+    uint16_t port_no = 0;
 
-        static char *kwlist[] = {(char*)"iface", (char*)"ofp_port", NULL};
+    static char *kwlist[] = {(char*)"endpoint", (char*)"metric", (char*)"level", (char*)"from_s",
+                                (char*)"to_s", (char*)"port_no", NULL};
 
-        // "s" = char * (NULL-terminated C-string)
-        // "H" = unsigned short (aka uint16_t)
-        if (!PyArg_ParseTupleAndKeywords(args, keywords, "sH", kwlist, &iface, &ofp_port))
+    // "K" = unsigned long long (aka uint64_t)
+    // "s" = char * (NULL-terminated C-string)
+    // "H" = unsigned short (aka uint16_t)
+    if (!PyArg_ParseTupleAndKeywords(args, keywords, "Ks|sKKH", kwlist, &endpoint, &metricName,
+                                        &levelName, &from_s, &to_s, &port_no)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_NONE;
+    }
+
+    ObserverMetric metric;
+    RollupLevel level = ROLLUP_SECOND;
+    if (!Observers::parseMetric(metricName, metric) || (levelName && !ParseRollupLevel(levelName, level))) {
+        cout << "ERROR: Unknown rollup metric or level" << endl;
+        Py_RETURN_NONE;
+    }
+
+    RollupSeries series;
+    if (!epLatMeta.getRollups(endpoint, metric, port_no, level, from_s, to_s ? to_s : UINT64_MAX, series))
+        Py_RETURN_NONE;
+
+    PyObject* pyDict = Py_BuildValue("{s:K,s:I}", "start", (unsigned long long)series.startS,
+                                        "resolution", series.resolutionS);
+    if (pyDict == NULL)
+        return NULL;
+
+    const char* statNames[] = {"min", "max", "mean", "p50", "p90", "p99"};
+    const vector<float>* stats[] = {&series.min, &series.max, &series.mean, &series.p50,
+                                    &series.p90, &series.p99};
+    for (uint16_t i = 0; i <= 6; i++) {
+        const char* name = i ? statNames[i - 1] : "count";
+        PyObject* pyArray = i ? buildArray("f", stats[i - 1]->data(), stats[i - 1]->size() * sizeof(float)) :
+                                buildArray("I", series.count.data(), series.count.size() * sizeof(uint32_t));
+        if (pyArray == NULL || PyDict_SetItemString(pyDict, name, pyArray) != 0)
+            cout << "ERROR in _OFSniff_getRollups: Unable to add " << name << " to Python Dict" << endl;
+        Py_XDECREF(pyArray);
+    }
+
+    return pyDict;
+}
+
+// Returns a (published, dropped) tuple of observer event counts
+static PyObject* _OFSniff_getObserverStats(PyObject *self, PyObject *args) {
+    Observers& observers = epLatMeta.observers();
+    return Py_BuildValue("(KK)", observers.getPublished(), observers.getDropped());
+}
+
+/* Returns a dict mapping each diagnostics reason to a
+ * (severity, count, suppressed) tuple, where suppressed counts the
+ * occurrences at or above the minimum severity that were rate-limited
+ */
+static PyObject* _OFSniff_getDiagnostics(PyObject *self, PyObject *args) {
+    PyObject* pyDict = PyDict_New();
+    if (pyDict == NULL)
+        return NULL;
+
+    Diagnostics& diag = epLatMeta.diagnostics();
+    for (uint16_t i = 0; i < NUM_DIAG_REASONS; i++) {
+        DiagReason reason = (DiagReason)i;
+        PyObject* pyTuple = Py_BuildValue("(sKK)",
+                                Diagnostics::severityName(Diagnostics::severityOf(reason)),
+                                diag.getCount(reason), diag.getSuppressed(reason));
+        if (pyTuple == NULL || PyDict_SetItemString(pyDict, Diagnostics::reasonName(reason), pyTuple) != 0)
+            cout << "ERROR in _OFSniff_getDiagnostics: Unable to add reason to Python Dict" << endl;
+        Py_XDECREF(pyTuple);
+    }
+
+    return pyDict;
+}
+
+// Converts one direction of OFTrafficStats to a new Python dict, skipping unseen types
+static PyObject* ofTraffic2Dict(const OFTrafficStats& stats, const uint16_t dir) {
+    PyObject* pyDict = PyDict_New();
+    if (pyDict == NULL)
+        return NULL;
+
+    for (uint16_t type = 0; type < OF_TRAFFIC_TYPES; type++) {
+        const OFTypeCounter& total = stats.total.type[dir][type];
+        if (total.msgs == 0)
+            continue;
+
+        const OFTypeRate& rate = stats.rate[dir][type];
+        PyObject* pyType = Py_BuildValue("H", type);
+        PyObject* pyTuple = Py_BuildValue("(KKdd)", total.msgs, total.bytes,
+                                            rate.msgsPerSec, rate.bytesPerSec);
+        if (pyType == NULL || pyTuple == NULL || PyDict_SetItem(pyDict, pyType, pyTuple) != 0)
+            cout << "ERROR in ofTraffic2Dict: Unable to add type to Python Dict" << endl;
+        Py_XDECREF(pyType);
+        Py_XDECREF(pyTuple);
+    }
+
+    return pyDict;
+}
+
+/* Returns a dict mapping each endpoint to a dict of:
+ *  - "window_sec": length of the sliding window the rates are averaged over
+ *  - "unparsed_bytes": (from switch, to switch) payload bytes not attributed to a type
+ *  - "from_switch" / "to_switch": dict mapping OpenFlow type to
+ *              (msgs, bytes, msgs_per_sec, bytes_per_sec), seen types only
+ * Values are as of the last closed interval (refreshed every OF_TRAFFIC_INTERVAL_MS)
+ */
+static PyObject* _OFSniff_getOFTraffic(PyObject *self, PyObject *args) {
+    PyObject* pyDict = PyDict_New();
+    if (pyDict == NULL)
+        return NULL;
+
+    for (const OFTrafficStats& stats : epLatMeta.getOFTraffic()) {
+        // "N" = PyObject*, reference is stolen
+        PyObject* pyStats = Py_BuildValue("{s:d,s:(KK),s:N,s:N}",
+                                "window_sec", stats.windowSec,
+                                "unparsed_bytes", stats.unparsedBytes[OF_FROM_SWITCH],
+                                                    stats.unparsedBytes[OF_TO_SWITCH],
+                                "from_switch", ofTraffic2Dict(stats, OF_FROM_SWITCH),
+                                "to_switch", ofTraffic2Dict(stats, OF_TO_SWITCH));
+        PyObject* pyEndpoint = Py_BuildValue("K", stats.endpoint);
+        if (pyStats == NULL || pyEndpoint == NULL || PyDict_SetItem(pyDict, pyEndpoint, pyStats) != 0)
+            cout << "ERROR in _OFSniff_getOFTraffic: Unable to add endpoint to Python Dict" << endl;
+        Py_XDECREF(pyEndpoint);
+        Py_XDECREF(pyStats);
+    }
+
+    return pyDict;
+}
+
+/* Takes one parameter:
+ *  - type: unsigned char value
+ *              OpenFlow message type
+ *
+ * Returns the OpenFlow 1.0 name of the type (e.g. "packet_in")
+ */
+static PyObject* _OFSniff_getOFTypeName(PyObject *self, PyObject *args) {
+    unsigned char type = 0;
+
+    // "b" = unsigned char
+    if (!PyArg_ParseTuple(args, "b", &type)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_NONE;
+    }
+
+    return Py_BuildValue("s", OFTypeName(type));
+}
+
+/* Takes one parameter:
+ *  - endpoint: unsigned long long value
+ *              Representing an endpoint, likely retrieved from getEndpoints()
+ *
+ * Returns a dict mapping each transaction kind (e.g. "echo", "barrier",
+ * "flow_install") to a (count, expired, mean, min, max, last) tuple, with
+ * latencies in ms
+ */
+static PyObject* _OFSniff_getTransactionStats(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (threadWrap.sources) {
+        IPv4EndpointType endpoint = 0;
+        OFTransactionStats stats[NUM_OF_TXN_KINDS];
+        if (!parseEndpointFromArgs(args, keywords, endpoint)) {
             cout << "ERROR: Unable to parse input parameters" << endl;
+        } else if (epLatMeta.getTransactionStats(endpoint, stats)) {
+            PyObject* pyDict = PyDict_New();
+            if (pyDict == NULL)
+                return NULL;
 
-        string filter = "tcp port " + std::to_string(ofp_port);
-
-        // Set sniffer configurations
-        SnifferConfiguration sniffConfig;
-        sniffConfig.set_filter(filter);
-        sniffConfig.set_promisc_mode(false);
-        sniffConfig.set_snap_len(MAX_CAP_LEN);
-        sniffConfig.set_immediate_mode(true);
-
-        threadWrap.sniffer = new Sniffer(iface, sniffConfig);
-
-        if (threadWrap.sniffer != NULL) {
-            try {
-                threadWrap.threadHandle = std::thread(OFSniffLoopWrapper,
-                                                std::ref(threadWrap.sniffer),
-                                                ofp_port,
-                                                std::ref(epLatMeta));
-            } catch (const std::exception &ex) {
-                cout << "ERROR in _OFSniff_startSniffLoop: Thread creation failed" << endl;
-                cout << ex.what() << endl;
-                Py_RETURN_FALSE;
+            for (uint16_t i = 0; i < NUM_OF_TXN_KINDS; i++) {
+                const OFTransactionStats& s = stats[i];
+                PyObject* pyTuple = Py_BuildValue("(KKdddd)", s.count, s.expired,
+                                        s.count ? s.hist.sum / s.count : 0.0, s.min, s.max, s.last);
+                if (pyTuple == NULL || PyDict_SetItemString(pyDict,
+                        OFTransactionTable::kindName((OFTransactionKind)i), pyTuple) != 0)
+                    cout << "ERROR in _OFSniff_getTransactionStats: Unable to add kind to Python Dict" << endl;
+                Py_XDECREF(pyTuple);
             }
+
+            return pyDict;
         }
-        else {
-            cout << "ERROR in _OFSniff_startSniffLoop: Sniffer allocation failed" << endl;
-            Py_RETURN_FALSE;
+    } else {
+        cout << "ERROR: No sniff loop started" << endl;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/* Takes one parameter:
+ *  - endpoint: unsigned long long value
+ *              Representing an endpoint, likely retrieved from getEndpoints()
+ *
+ * Returns a dict with "to_switch" and "from_switch" entries, each a
+ * (count, mean, min, max, srtt, last, in_flight, in_flight_peak) tuple of
+ * passive TCP RTTs (ms) of segments sent in that direction and the Bytes
+ * sent in that direction still unacknowledged
+ */
+static PyObject* _OFSniff_getTCPStats(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (threadWrap.sources) {
+        IPv4EndpointType endpoint = 0;
+        TCPFlowStats stats;
+        if (!parseEndpointFromArgs(args, keywords, endpoint)) {
+            cout << "ERROR: Unable to parse input parameters" << endl;
+        } else if (epLatMeta.getTCPStats(endpoint, stats)) {
+            const char* dirNames[NUM_OF_DIRECTIONS] = {"from_switch", "to_switch"};
+            PyObject* pyDict = PyDict_New();
+            if (pyDict == NULL)
+                return NULL;
+
+            for (uint16_t dir = 0; dir < NUM_OF_DIRECTIONS; dir++) {
+                const TCPRTTStats& rtt = stats.rtt[dir];
+                PyObject* pyTuple = Py_BuildValue("(KdddddII)", rtt.count,
+                                        rtt.count ? rtt.hist.sum / rtt.count : 0.0,
+                                        rtt.min, rtt.max, rtt.srtt, rtt.last,
+                                        stats.inFlight[dir], stats.inFlightPeak[dir]);
+                if (pyTuple == NULL || PyDict_SetItemString(pyDict, dirNames[dir], pyTuple) != 0)
+                    cout << "ERROR in _OFSniff_getTCPStats: Unable to add direction to Python Dict" << endl;
+                Py_XDECREF(pyTuple);
+            }
+
+            return pyDict;
         }
     } else {
-        cout << "ERROR: Sniffing already started. Stop the current sniff loop first if changing sniffing parameters." << endl;
+        cout << "ERROR: No sniff loop started" << endl;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/* Takes one parameter:
+ *  - endpoint: unsigned long long value
+ *              Representing an endpoint, likely retrieved from getEndpoints()
+ *
+ * Returns a (sent, matched, expired) tuple of LLDP probe counts
+ */
+static PyObject* _OFSniff_getProbeStats(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (threadWrap.sources) {
+        IPv4EndpointType endpoint = 0;
+        if (parseEndpointFromArgs(args, keywords, endpoint))
+            // "K" = unsigned long long (aka uint64_t)
+            return Py_BuildValue("(KKK)", epLatMeta.getProbesSent(endpoint),
+                                    epLatMeta.getProbesMatched(endpoint),
+                                    epLatMeta.getProbesExpired(endpoint));
+        else
+            cout << "ERROR: Unable to parse input parameters" << endl;
+    } else {
+        cout << "ERROR: No sniff loop started" << endl;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/* Takes one parameter:
+ *  - endpoint: unsigned long long value
+ *              Representing an endpoint, likely retrieved from getEndpoints()
+ *
+ * Returns a (sample_rate, skipped) tuple: the share of LLDP probes processed
+ * when the endpoint's last probe was seen (1.0 unless under overload), and
+ * the number of probe messages the overload governor skipped
+ */
+static PyObject* _OFSniff_getProbeSampling(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (threadWrap.sources) {
+        IPv4EndpointType endpoint = 0;
+        if (parseEndpointFromArgs(args, keywords, endpoint))
+            // "K" = unsigned long long (aka uint64_t)
+            return Py_BuildValue("(dK)", epLatMeta.getProbeSampleRate(endpoint),
+                                    epLatMeta.getProbesSkipped(endpoint));
+        else
+            cout << "ERROR: Unable to parse input parameters" << endl;
+    } else {
+        cout << "ERROR: No sniff loop started" << endl;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/* Takes one parameter:
+ *  - budget: unsigned long long value
+ *              Bytes of switch metadata allowed, 0 for no limit. Over it, the
+ *              probe tables of the least recently active switches are compacted
+ */
+static PyObject* _OFSniff_setMemoryBudget(PyObject *self, PyObject *args) {
+    unsigned long long budget = 0;
+
+    // "K" = unsigned long long
+    if (!PyArg_ParseTuple(args, "K", &budget)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
         Py_RETURN_FALSE;
     }
 
+    epLatMeta.memoryBudget().setBudget(budget);
     Py_RETURN_TRUE;
 }
 
-static PyObject* _OFSniff_stopSniffLoop(PyObject *self, PyObject *args) {
-    if (threadWrap.sniffer) {
-        threadWrap.sniffer->stop_sniff();
-        threadWrap.threadHandle.join(); // Or use detach? In case the thread doesn't end...
+/* Returns a dict of the memory used by all switches: used, peak, budget
+ * (0 = unlimited), compactions and shed_probes (outstanding probes given
+ * up on to stay within the budget)
+ */
+static PyObject* _OFSniff_getMemoryUsage(PyObject *self, PyObject *args) {
+    MemoryState state = epLatMeta.memoryBudget().state();
+
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:K}",
+                "used", state.used,
+                "peak", state.peak,
+                "budget", state.budget,
+                "compactions", state.compactions,
+                "shed_probes", state.shedProbes);
+}
+
+/* Takes one parameter:
+ *  - endpoint: unsigned long long value
+ *              Representing an endpoint, likely retrieved from getEndpoints()
+ *
+ * Returns the switch's datapath ID (from its FeaturesReply), 0 if not seen yet
+ */
+static PyObject* _OFSniff_getDatapathID(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (threadWrap.sources) {
+        IPv4EndpointType endpoint = 0;
+        if (parseEndpointFromArgs(args, keywords, endpoint))
+            // "K" = unsigned long long (aka uint64_t)
+            return Py_BuildValue("K", epLatMeta.getDatapathID(endpoint));
+        else
+            cout << "ERROR: Unable to parse input parameters" << endl;
+    } else {
+        cout << "ERROR: No sniff loop started" << endl;
+    }
 
-        threadWrap.sniffer = nullptr;
+    Py_RETURN_NONE;
+}
+
+/* Takes one parameter:
+ *  - endpoint: unsigned long long value
+ *              Representing an endpoint, likely retrieved from getEndpoints()
+ *
+ * Returns the Bytes of metadata kept for the endpoint
+ */
+static PyObject* _OFSniff_getEndpointMemory(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (threadWrap.sources) {
+        IPv4EndpointType endpoint = 0;
+        if (parseEndpointFromArgs(args, keywords, endpoint))
+            // "K" = unsigned long long (aka uint64_t)
+            return Py_BuildValue("K", epLatMeta.getMemoryBytes(endpoint));
+        else
+            cout << "ERROR: Unable to parse input parameters" << endl;
+    } else {
+        cout << "ERROR: No sniff loop started" << endl;
     }
 
     Py_RETURN_NONE;
 }
 
+/* Takes one parameter:
+ *  - endpoint: unsigned long long value
+ *              Representing an endpoint, likely retrieved from getEndpoints()
+ *
+ * Returns the endpoint's address as a string ("a.b.c.d" or an IPv6 address),
+ * or None if it is an unknown IPv6 endpoint
+ */
+static PyObject* _OFSniff_getEndpointAddress(PyObject *self, PyObject *args) {
+    IPv4EndpointType endpoint = 0;
+
+    // "K" = unsigned long long (aka uint64_t)
+    if (!PyArg_ParseTuple(args, "K", &endpoint)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_NONE;
+    }
+
+    string addr = EndpointAddress(endpoint);
+    if (addr.empty())
+        Py_RETURN_NONE;
+
+    return Py_BuildValue("s", addr.c_str());
+}
+
+/* Takes two parameters:
+ *  - ip: string
+ *              IPv6 address
+ *  - port: unsigned short value
+ *
+ * Returns the numerical endpoint, or 0 if no connection from that address
+ * has been seen (IPv6 endpoints are numbered as they are seen)
+ */
+static PyObject* _OFSniff_findIPv6Endpoint(PyObject *self, PyObject *args) {
+    char* ip = NULL;
+    uint16_t port = 0;
+
+    // "s" = string, "H" = unsigned short
+    if (!PyArg_ParseTuple(args, "sH", &ip, &port)) {
+        cout << "ERROR: Unable to parse input parameters" << endl;
+        Py_RETURN_NONE;
+    }
+
+    uint8_t addr[IPV6_ADDR_LEN];
+    if (inet_pton(AF_INET6, ip, addr) != 1) {
+        cout << "ERROR: Invalid IPv6 address (" << ip << ")" << endl;
+        Py_RETURN_NONE;
+    }
+
+    uint32_t id = IPv6AddressTable::global().find(addr);
+    IPv4EndpointType endpoint = (id == IPV6_NO_ID) ? 0 :
+            (ENDPOINT_IPV6_FLAG | ((uint64_t)id << 16) | port);
+
+    return Py_BuildValue("K", endpoint);
+}
+
 static PyObject* _OFSniff_getEndpoints(PyObject *self, PyObject *args) {
     PyObject* pyList = PyList_New(0); // Create empty list
 
-    if (threadWrap.sniffer) {
+    if (threadWrap.sources) {
         vector<IPv4EndpointType> endpoints = epLatMeta.getEndpoints();
         if (pyList != NULL) {
             for (IPv4EndpointType ep : endpoints) {
@@ -178,7 +1424,7 @@ static PyObject* _OFSniff_getEndpoints(PyObject *self, PyObject *args) {
  *              Representing an endpoint, likely retrieved from getEndpoints()
  */
 static PyObject* _OFSniff_getEchoRTTAvg(PyObject *self, PyObject *args, PyObject *keywords) {
-    if (threadWrap.sniffer) {
+    if (threadWrap.sources) {
         IPv4EndpointType endpoint = 0;
         if (parseEndpointFromArgs(args, keywords, endpoint))
             // "d" = double
@@ -197,7 +1443,7 @@ static PyObject* _OFSniff_getEchoRTTAvg(PyObject *self, PyObject *args, PyObject
  *              Representing an endpoint, likely retrieved from getEndpoints()
  */
 static PyObject* _OFSniff_getEchoRTTVar(PyObject *self, PyObject *args, PyObject *keywords) {
-    if (threadWrap.sniffer) {
+    if (threadWrap.sources) {
         IPv4EndpointType endpoint = 0;
         if (parseEndpointFromArgs(args, keywords, endpoint))
             // "d" = double
@@ -216,7 +1462,7 @@ static PyObject* _OFSniff_getEchoRTTVar(PyObject *self, PyObject *args, PyObject
  *              Representing an endpoint, likely retrieved from getEndpoints()
  */
 static PyObject* _OFSniff_getEchoRTTMed(PyObject *self, PyObject *args, PyObject *keywords) {
-    if (threadWrap.sniffer) {
+    if (threadWrap.sources) {
         IPv4EndpointType endpoint = 0;
         if (parseEndpointFromArgs(args, keywords, endpoint))
             // "d" = double
@@ -235,7 +1481,7 @@ static PyObject* _OFSniff_getEchoRTTMed(PyObject *self, PyObject *args, PyObject
  *              Representing an endpoint, likely retrieved from getEndpoints()
  */
 static PyObject* _OFSniff_getPktInRTTAvg(PyObject *self, PyObject *args, PyObject *keywords) {
-    if (threadWrap.sniffer) {
+    if (threadWrap.sources) {
         IPv4EndpointType endpoint = 0;
         if (parseEndpointFromArgs(args, keywords, endpoint))
             // "d" = double
@@ -254,7 +1500,7 @@ static PyObject* _OFSniff_getPktInRTTAvg(PyObject *self, PyObject *args, PyObjec
  *              Representing an endpoint, likely retrieved from getEndpoints()
  */
 static PyObject* _OFSniff_getPktInRTTVar(PyObject *self, PyObject *args, PyObject *keywords) {
-    if (threadWrap.sniffer) {
+    if (threadWrap.sources) {
         IPv4EndpointType endpoint = 0;
         if (parseEndpointFromArgs(args, keywords, endpoint))
             // "d" = double
@@ -273,7 +1519,7 @@ static PyObject* _OFSniff_getPktInRTTVar(PyObject *self, PyObject *args, PyObjec
  *              Representing an endpoint, likely retrieved from getEndpoints()
  */
 static PyObject* _OFSniff_getPktInRTTMed(PyObject *self, PyObject *args, PyObject *keywords) {
-    if (threadWrap.sniffer) {
+    if (threadWrap.sources) {
         IPv4EndpointType endpoint = 0;
         if (parseEndpointFromArgs(args, keywords, endpoint))
             // "d" = double
@@ -287,6 +1533,70 @@ static PyObject* _OFSniff_getPktInRTTMed(PyObject *self, PyObject *args, PyObjec
     Py_RETURN_NONE;
 }
 
+/* Takes one parameter:
+ *  - endpoint: unsigned long long value
+ *              Representing an endpoint, likely retrieved from getEndpoints()
+ */
+static PyObject* _OFSniff_getEchoRTTSmoothed(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (threadWrap.sources) {
+        IPv4EndpointType endpoint = 0;
+        if (parseEndpointFromArgs(args, keywords, endpoint))
+            // "d" = double
+            return Py_BuildValue("d", epLatMeta.getEchoRTTSmoothed(endpoint));
+        else
+            cout << "ERROR: Unable to parse input parameters" << endl;
+    } else {
+        cout << "ERROR: No sniff loop started" << endl;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/* Takes one parameter:
+ *  - endpoint: unsigned long long value
+ *              Representing an endpoint, likely retrieved from getEndpoints()
+ */
+static PyObject* _OFSniff_getPktInRTTSmoothed(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (threadWrap.sources) {
+        IPv4EndpointType endpoint = 0;
+        if (parseEndpointFromArgs(args, keywords, endpoint))
+            // "d" = double
+            return Py_BuildValue("d", epLatMeta.getPktInRTTSmoothed(endpoint));
+        else
+            cout << "ERROR: Unable to parse input parameters" << endl;
+    } else {
+        cout << "ERROR: No sniff loop started" << endl;
+    }
+
+    Py_RETURN_NONE;
+}
+
+/* Takes two parameters:
+ *  - endpoint: unsigned long long value
+ *              Representing an endpoint, likely retrieved from getEndpoints()
+ *  - port_no: unsigned short value
+ *              Represents the port number of the switch which the link is connected to
+ */
+static PyObject* _OFSniff_getLinkLatSmoothed(PyObject *self, PyObject *args, PyObject *keywords) {
+    if (threadWrap.sources) {
+        IPv4EndpointType endpoint = 0;
+        uint16_t port_no = 0;
+
+        static char *kwlist[] = {(char*)"endpoint", (char*)"port_no", NULL};
+
+        // "K" = unsigned long long (aka uint64_t)
+        // "H" = unsigned short (aka uint16_t)
+        if (PyArg_ParseTupleAndKeywords(args, keywords, "KH", kwlist, &endpoint, &port_no))
+            return Py_BuildValue("d", epLatMeta.getLinkLatSmoothed(endpoint, port_no));
+        else
+            cout << "ERROR: Unable to parse input parameters" << endl;
+    } else {
+        cout << "ERROR: No sniff loop started" << endl;
+    }
+
+    Py_RETURN_NONE;
+}
+
 /* Takes two parameters:
  *  - endpoint: unsigned long long value
  *              Representing an endpoint, likely retrieved from getEndpoints()
@@ -294,7 +1604,7 @@ static PyObject* _OFSniff_getPktInRTTMed(PyObject *self, PyObject *args, PyObjec
  *              Represents the port number of the switch which the link is connected to
  */
 static PyObject* _OFSniff_getLinkLatAvg(PyObject *self, PyObject *args, PyObject *keywords) {
-    if (threadWrap.sniffer) {
+    if (threadWrap.sources) {
         IPv4EndpointType endpoint = 0;
         uint16_t port_no = 0;
 
@@ -320,7 +1630,7 @@ static PyObject* _OFSniff_getLinkLatAvg(PyObject *self, PyObject *args, PyObject
  *              Represents the port number of the switch which the link is connected to
  */
 static PyObject* _OFSniff_getLinkLatVar(PyObject *self, PyObject *args, PyObject *keywords) {
-    if (threadWrap.sniffer) {
+    if (threadWrap.sources) {
         IPv4EndpointType endpoint = 0;
         uint16_t port_no = 0;
 
@@ -346,7 +1656,7 @@ static PyObject* _OFSniff_getLinkLatVar(PyObject *self, PyObject *args, PyObject
  *              Represents the port number of the switch which the link is connected to
  */
 static PyObject* _OFSniff_getLinkLatMed(PyObject *self, PyObject *args, PyObject *keywords) {
-    if (threadWrap.sniffer) {
+    if (threadWrap.sources) {
         IPv4EndpointType endpoint = 0;
         uint16_t port_no = 0;
 
@@ -370,7 +1680,7 @@ static PyObject* _OFSniff_getLinkLatMed(PyObject *self, PyObject *args, PyObject
  *              Representing an endpoint, likely retrieved from getEndpoints()
  */
 static PyObject* _OFSniff_getDp2CtrlRTT(PyObject *self, PyObject *args, PyObject *keywords) {
-    if (threadWrap.sniffer) {
+    if (threadWrap.sources) {
         IPv4EndpointType endpoint = 0;
         if (parseEndpointFromArgs(args, keywords, endpoint))
             // "d" = double
@@ -389,7 +1699,45 @@ static PyMethodDef OFSniffMethods[] = {
     {"startSniffLoop", (PyCFunction)_OFSniff_startSniffLoop, METH_KEYWORDS, "Start sniffing in secondary thread"},
     {"stopSniffLoop", _OFSniff_stopSniffLoop, METH_VARARGS, "Stop sniffing"},
     {"isSniffing", _OFSniff_isSniffing, METH_VARARGS, "Indicates whether the sniff loop has started"},
+    {"setCaptureSource", (PyCFunction)_OFSniff_setCaptureSource, METH_KEYWORDS, "Add or replace a capture source of the running sniff loop"},
+    {"removeCaptureSource", _OFSniff_removeCaptureSource, METH_VARARGS, "Remove a capture source from the running sniff loop"},
+    {"setDelivery", (PyCFunction)_OFSniff_setDelivery, METH_KEYWORDS, "Change the delivery of the running sniff loop"},
+    {"getCaptureSources", _OFSniff_getCaptureSources, METH_VARARGS, "Get the interfaces and ports captured by the sniff loop"},
+    {"openShmTable", (PyCFunction)_OFSniff_openShmTable, METH_KEYWORDS, "Publish statistics into a shared memory table"},
+    {"setThreadPlacement", (PyCFunction)_OFSniff_setThreadPlacement, METH_KEYWORDS, "Pin threads to CPUs, set their scheduling, lock memory"},
+    {"setLatencyConfig", (PyCFunction)_OFSniff_setLatencyConfig, METH_KEYWORDS, "Set window sizes, the outstanding probe limit and estimators"},
+    {"getLatencyConfig", _OFSniff_getLatencyConfig, METH_VARARGS, "Get window sizes, the outstanding probe limit and estimators"},
+    {"enableCheckpoints", (PyCFunction)_OFSniff_enableCheckpoints, METH_KEYWORDS, "Periodically checkpoint the latency state into a file"},
+    {"loadCheckpoint", _OFSniff_loadCheckpoint, METH_VARARGS, "Restore the latency state from a checkpoint file"},
+    {"getStageTimers", _OFSniff_getStageTimers, METH_VARARGS, "Get per-stage processing times of the sniff loop"},
+    {"getStageCyclesPerUs", _OFSniff_getStageCyclesPerUs, METH_VARARGS, "Get the clock rate used by the stage timers"},
+    {"getCaptureStats", _OFSniff_getCaptureStats, METH_VARARGS, "Get kernel capture counters and probe losses"},
+    {"setDiagnostics", (PyCFunction)_OFSniff_setDiagnostics, METH_KEYWORDS, "Set the minimum severity and rate limit of diagnostic messages"},
+    {"getDiagnostics", _OFSniff_getDiagnostics, METH_VARARGS, "Get per-reason diagnostics counts"},
+    {"setOverloadLevel", _OFSniff_setOverloadLevel, METH_VARARGS, "Set the highest level of the overload governor"},
+    {"getOverloadState", _OFSniff_getOverloadState, METH_VARARGS, "Get the overload governor's level, probe sampling rate and counters"},
+    {"enableObserverEvents", (PyCFunction)_OFSniff_enableObserverEvents, METH_KEYWORDS, "Queue sample, threshold, endpoint and change events, returns a pollable file descriptor"},
+    {"disableObserverEvents", _OFSniff_disableObserverEvents, METH_VARARGS, "Stop queueing observer events"},
+    {"drainObserverEvents", (PyCFunction)_OFSniff_drainObserverEvents, METH_KEYWORDS, "Take queued observer events out"},
+    {"setObserverThreshold", (PyCFunction)_OFSniff_setObserverThreshold, METH_KEYWORDS, "Set the threshold of a metric for threshold events"},
+    {"setChangeSensitivity", (PyCFunction)_OFSniff_setChangeSensitivity, METH_KEYWORDS, "Set the sensitivity of a metric's change detectors"},
+    {"getChangeSensitivity", _OFSniff_getChangeSensitivity, METH_VARARGS, "Get the (cusum, ewma) sensitivity of a metric's change detectors"},
+    {"enableRollups", (PyCFunction)_OFSniff_enableRollups, METH_KEYWORDS, "Keep 1s, 1min and 1h rollups of every metric, optionally logging them"},
+    {"getRollups", (PyCFunction)_OFSniff_getRollups, METH_KEYWORDS, "Get the rollups of a metric of an endpoint over a time range"},
+    {"getObserverStats", _OFSniff_getObserverStats, METH_VARARGS, "Get the numbers of published and dropped observer events"},
+    {"getOFTraffic", _OFSniff_getOFTraffic, METH_VARARGS, "Get per-endpoint OpenFlow message counts and rates by type"},
+    {"getOFTypeName", _OFSniff_getOFTypeName, METH_VARARGS, "Get the name of an OpenFlow message type"},
+    {"getTransactionStats", (PyCFunction)_OFSniff_getTransactionStats, METH_KEYWORDS, "Get request/reply latencies by transaction kind for a given endpoint"},
+    {"getTCPStats", (PyCFunction)_OFSniff_getTCPStats, METH_KEYWORDS, "Get passive TCP RTT and bytes in flight per direction for a given endpoint"},
+    {"getProbeStats", (PyCFunction)_OFSniff_getProbeStats, METH_KEYWORDS, "Get the (sent, matched, expired) LLDP probe counts for a given endpoint"},
+    {"getProbeSampling", (PyCFunction)_OFSniff_getProbeSampling, METH_KEYWORDS, "Get the probe sampling rate and skipped probes for a given endpoint"},
+    {"setMemoryBudget", _OFSniff_setMemoryBudget, METH_VARARGS, "Set the memory budget of the switch metadata"},
+    {"getMemoryUsage", _OFSniff_getMemoryUsage, METH_VARARGS, "Get the memory used by all switches"},
+    {"getEndpointMemory", (PyCFunction)_OFSniff_getEndpointMemory, METH_KEYWORDS, "Get the memory used by a switch"},
+    {"getDatapathID", (PyCFunction)_OFSniff_getDatapathID, METH_KEYWORDS, "Get the datapath ID of a switch"},
     {"getEndpoints", (PyCFunction)_OFSniff_getEndpoints, METH_VARARGS, "Get endpoints"},
+    {"getEndpointAddress", _OFSniff_getEndpointAddress, METH_VARARGS, "Get the IPv4 or IPv6 address of an endpoint"},
+    {"findIPv6Endpoint", _OFSniff_findIPv6Endpoint, METH_VARARGS, "Get the numerical endpoint of an IPv6 address and port"},
     {"getEchoRTTAvg", (PyCFunction)_OFSniff_getEchoRTTAvg, METH_KEYWORDS, "Get the average echo RTT for a given endpoint"},
     {"getEchoRTTVar", (PyCFunction)_OFSniff_getEchoRTTVar, METH_KEYWORDS, "Get the variance of echo RTT for a given endpoint"},
     {"getEchoRTTMed", (PyCFunction)_OFSniff_getEchoRTTMed, METH_KEYWORDS, "Get the median of echo RTT for a given endpoint"},
@@ -399,6 +1747,9 @@ static PyMethodDef OFSniffMethods[] = {
     {"getLinkLatAvg", (PyCFunction)_OFSniff_getLinkLatAvg, METH_KEYWORDS, "Get the average link latency for a given endpoint and port"},
     {"getLinkLatVar", (PyCFunction)_OFSniff_getLinkLatVar, METH_KEYWORDS, "Get the variance of link latnecy for a given endpoint and port"},
     {"getLinkLatMed", (PyCFunction)_OFSniff_getLinkLatMed, METH_KEYWORDS, "Get the median of link latnecy for a given endpoint and port"},
+    {"getEchoRTTSmoothed", (PyCFunction)_OFSniff_getEchoRTTSmoothed, METH_KEYWORDS, "Get the smoothed echo RTT for a given endpoint"},
+    {"getPktInRTTSmoothed", (PyCFunction)_OFSniff_getPktInRTTSmoothed, METH_KEYWORDS, "Get the smoothed PacketIn RTT for a given endpoint"},
+    {"getLinkLatSmoothed", (PyCFunction)_OFSniff_getLinkLatSmoothed, METH_KEYWORDS, "Get the smoothed link latency for a given endpoint and port"},
     {"getDp2CtrlRTT", (PyCFunction)_OFSniff_getDp2CtrlRTT, METH_KEYWORDS, "Get the datapath to controller RTT for a given endpoint"},
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };